@@ -0,0 +1,109 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.HashMap;
+import java.util.Map;
+
+
+// A set of named off-heap (direct) buffers owned by one worker of a stream.
+// The blocks processed by the worker run one at a time, so a named buffer is
+// reused from one block to the next instead of allocating a new big table per
+// block. The memory is outside of the Java heap: it is not scanned or moved
+// by the garbage collector and does not count against the heap size (see
+// -XX:MaxDirectMemorySize). It is released when the arena is closed and the
+// buffers handed out are not referenced anymore.
+public final class Arena
+{
+   private static final byte[] ZEROS = new byte[65536];
+
+   private final Map<String, ByteBuffer> buffers;
+   private boolean closed;
+
+
+   public Arena()
+   {
+      this.buffers = new HashMap<>();
+   }
+
+
+   // Return a zeroed buffer of 'size' bytes in native byte order. The previous
+   // buffer with the same name is reused if big enough: it must not be in use
+   // anymore.
+   public synchronized ByteBuffer allocate(String name, int size)
+   {
+      if (this.closed == true)
+         throw new IllegalStateException("Arena closed");
+
+      if (size < 0)
+         throw new IllegalArgumentException("Invalid negative buffer size: "+size);
+
+      ByteBuffer buf = this.buffers.get(name);
+
+      if ((buf == null) || (buf.capacity() < size))
+      {
+         // Drop the old buffer first to let the memory be reclaimed
+         this.buffers.remove(name);
+         buf = ByteBuffer.allocateDirect(size);
+         this.buffers.put(name, buf);
+      }
+      else
+      {
+         clear(buf, size);
+      }
+
+      ByteBuffer res = buf.duplicate();
+      res.limit(size);
+      return res.slice().order(ByteOrder.nativeOrder());
+   }
+
+
+   // Zero the first 'size' bytes (direct buffers are zeroed on allocation)
+   private static void clear(ByteBuffer buf, int size)
+   {
+      ByteBuffer dst = buf.duplicate();
+      dst.clear();
+
+      while (size > 0)
+      {
+         final int n = Math.min(size, ZEROS.length);
+         dst.put(ZEROS, 0, n);
+         size -= n;
+      }
+   }
+
+
+   // Return the number of off-heap bytes held by the arena
+   public synchronized long allocated()
+   {
+      long sum = 0;
+
+      for (ByteBuffer buf : this.buffers.values())
+         sum += buf.capacity();
+
+      return sum;
+   }
+
+
+   // Release the buffers. Subsequent allocations fail.
+   public synchronized void close()
+   {
+      this.buffers.clear();
+      this.closed = true;
+   }
+}
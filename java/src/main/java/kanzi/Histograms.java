@@ -0,0 +1,113 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi;
+
+
+// Order 0 histograms of consecutive slots of SLOT_SIZE bytes of a buffer.
+// A transform can record them while writing its output, so that the entropy
+// encoder gets the histogram of each chunk without another pass over the data.
+// Positions are relative to the start of the transform output.
+public final class Histograms
+{
+   public static final int LOG_SLOT_SIZE = 14;
+   public static final int SLOT_SIZE = 1 << LOG_SLOT_SIZE;
+
+   private int[][] slots;
+   private int count;  // number of slots in use
+   private int length; // number of bytes described (-1 if not valid)
+
+
+   public Histograms()
+   {
+      this.slots = new int[0][];
+      this.length = -1;
+   }
+
+
+   // Invalidate the histograms and drop all slots
+   public void reset()
+   {
+      this.count = 0;
+      this.length = -1;
+   }
+
+
+   // Return the zeroed histogram of the next slot
+   public int[] nextSlot()
+   {
+      if (this.count == this.slots.length)
+      {
+         int[][] newSlots = new int[this.count+16][];
+         System.arraycopy(this.slots, 0, newSlots, 0, this.count);
+
+         for (int i=this.count; i<newSlots.length; i++)
+            newSlots[i] = new int[256];
+
+         this.slots = newSlots;
+      }
+
+      final int[] h = this.slots[this.count++];
+
+      for (int i=0; i<256; i++)
+         h[i] = 0;
+
+      return h;
+   }
+
+
+   // Mark the slots as describing 'length' bytes. Return false (histograms
+   // not valid) if the number of slots does not match.
+   public boolean setLength(int length)
+   {
+      final int n = Math.max((length+SLOT_SIZE-1) >> LOG_SLOT_SIZE, 1);
+      this.length = ((length >= 0) && (n == this.count)) ? length : -1;
+      return this.length >= 0;
+   }
+
+
+   // Compute the histogram of the bytes in [start, end) into freqs. Return false
+   // if not available: start must be a slot boundary, end a slot boundary or
+   // the end of the data. If withTotal is true, freqs[256] is the total.
+   public boolean getHistogram(int start, int end, int[] freqs, boolean withTotal)
+   {
+      if ((this.length < 0) || (start < 0) || (start >= end) || (end > this.length))
+         return false;
+
+      if ((start & (SLOT_SIZE-1)) != 0)
+         return false;
+
+      if (((end & (SLOT_SIZE-1)) != 0) && (end != this.length))
+         return false;
+
+      for (int i=0; i<256; i++)
+         freqs[i] = 0;
+
+      final int endSlot = (end+SLOT_SIZE-1) >> LOG_SLOT_SIZE;
+
+      for (int s=start>>LOG_SLOT_SIZE; s<endSlot; s++)
+      {
+         final int[] h = this.slots[s];
+
+         for (int i=0; i<256; i++)
+            freqs[i] += h[i];
+      }
+
+      if (withTotal == true)
+         freqs[256] = end - start;
+
+      return true;
+   }
+}
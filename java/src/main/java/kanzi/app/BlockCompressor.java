@@ -21,12 +21,15 @@ import java.io.FileOutputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
+import java.nio.channels.FileChannel;
 import java.nio.file.FileSystems;
 import java.nio.file.Files;
 import java.nio.file.Path;
 import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
 import java.util.ArrayList;
 import java.util.HashMap;
+import java.util.Iterator;
 import java.util.List;
 import java.util.Map;
 import java.util.concurrent.ArrayBlockingQueue;
@@ -36,6 +39,9 @@ import java.util.concurrent.Executors;
 import java.util.concurrent.Future;
 import kanzi.Event;
 import kanzi.SliceByteArray;
+import kanzi.io.AsyncInputStream;
+import kanzi.io.AsyncOutputStream;
+import kanzi.io.Checkpoint;
 import kanzi.io.CompressedOutputStream;
 import kanzi.Error;
 import kanzi.Global;
@@ -47,9 +53,12 @@ import kanzi.transform.TransformFactory;
 public class BlockCompressor implements Runnable, Callable<Integer>
 {
    private static final int DEFAULT_BUFFER_SIZE = 65536;
+   private static final int IO_BUFFER_SIZE = 256*1024;
+   private static final int IO_NB_BUFFERS = 4;
    private static final int DEFAULT_BLOCK_SIZE  = 4*1024*1024;
    private static final int MIN_BLOCK_SIZE  = 1024;
    private static final int MAX_BLOCK_SIZE  = 1024*1024*1024;
+   private static final int MIN_AUTO_BLOCK_SIZE = 64*1024;
    private static final int DEFAULT_CONCURRENCY = 1;
    private static final int MAX_CONCURRENCY = 64;
    private static final String STDOUT = "STDOUT";
@@ -60,6 +69,14 @@ public class BlockCompressor implements Runnable, Callable<Integer>
    private final boolean overwrite;
    private final boolean checksum;
    private final boolean skipBlocks;
+   private final boolean splitBlocks;
+   private final boolean checkpoints;
+   private final boolean resume;
+   private final boolean offHeap;
+   private final boolean lazyMatch;
+   private final boolean chunkTable;
+   private final boolean staged;
+   private final boolean incremental;
    private final String inputName;
    private final String outputName;
    private final String codec;
@@ -78,6 +95,22 @@ public class BlockCompressor implements Runnable, Callable<Integer>
       this.overwrite = (bForce == null) ? false : bForce;
       Boolean bSkip = (Boolean) map.remove("skipBlocks");
       this.skipBlocks = (bSkip == null) ? false : bSkip;
+      Boolean bSplit = (Boolean) map.remove("splitBlocks");
+      this.splitBlocks = (bSplit == null) ? false : bSplit;
+      Boolean bResume = (Boolean) map.remove("resume");
+      this.resume = (bResume == null) ? false : bResume;
+      Boolean bCheckpoint = (Boolean) map.remove("checkpoint");
+      this.checkpoints = (this.resume == true) || ((bCheckpoint == null) ? false : bCheckpoint);
+      Boolean bOffHeap = (Boolean) map.remove("offHeap");
+      this.offHeap = (bOffHeap == null) ? false : bOffHeap;
+      Boolean bLazy = (Boolean) map.remove("lazyMatch");
+      this.lazyMatch = (bLazy == null) ? false : bLazy;
+      Boolean bChunkTable = (Boolean) map.remove("chunkTable");
+      this.chunkTable = (bChunkTable == null) ? false : bChunkTable;
+      Boolean bStaged = (Boolean) map.remove("staged");
+      this.staged = (bStaged == null) ? false : bStaged;
+      Boolean bIncremental = (Boolean) map.remove("incremental");
+      this.incremental = (bIncremental == null) ? false : bIncremental;
       this.inputName = (String) map.remove("inputName");
       this.outputName = (String) map.remove("outputName");
       String strTransf;
@@ -98,7 +131,9 @@ public class BlockCompressor implements Runnable, Callable<Integer>
 
       this.codec = (strCodec == null) ? "ANS0" : strCodec;
       Integer iBlockSize = (Integer) map.remove("block");
-      final int bs = (iBlockSize == null) ? DEFAULT_BLOCK_SIZE : iBlockSize;
+      Boolean bAutoBlock = (Boolean) map.remove("autoBlock");
+      Boolean bAutoJobs = (Boolean) map.remove("autoJobs");
+      int bs = (iBlockSize == null) ? DEFAULT_BLOCK_SIZE : iBlockSize;
 
       if (bs < MIN_BLOCK_SIZE)
          throw new IllegalArgumentException("Minimum block size is "+(MIN_BLOCK_SIZE/1024)+
@@ -108,7 +143,8 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          throw new IllegalArgumentException("Maximum block size is "+(MAX_BLOCK_SIZE/(1024*1024*1024))+
             " GB ("+MAX_BLOCK_SIZE+" bytes), got "+bs+" bytes");
 
-      this.blockSize = Math.min((bs + 15) & -16, MAX_BLOCK_SIZE);
+      // 0 means 'derive from the machine and the input' (see autoTune)
+      bs = ((bAutoBlock != null) && (bAutoBlock == true)) ? 0 : Math.min((bs + 15) & -16, MAX_BLOCK_SIZE);
 
       // Extract transform names. Curate input (EG. NONE+NONE+xxxx => xxxx)
       TransformFactory bff = new TransformFactory();
@@ -126,7 +162,20 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          concurrency = MAX_CONCURRENCY;
       }
 
-      this.jobs = (concurrency == 0) ? DEFAULT_CONCURRENCY : concurrency;
+      int nbJobs = (concurrency == 0) ? DEFAULT_CONCURRENCY : concurrency;
+
+      if ((bAutoJobs != null) && (bAutoJobs == true))
+         nbJobs = 0;
+
+      if ((bs == 0) || (nbJobs == 0))
+      {
+         final int[] res = autoTune(getInputSize(this.inputName), bs, nbJobs, this.transform, this.codec);
+         bs = res[0];
+         nbJobs = res[1];
+      }
+
+      this.blockSize = bs;
+      this.jobs = nbJobs;
       this.pool = Executors.newFixedThreadPool(this.jobs);
       this.listeners = new ArrayList<>(10);
 
@@ -172,6 +221,19 @@ public class BlockCompressor implements Runnable, Callable<Integer>
             return Error.ERR_OPEN_FILE;
          }
 
+         // Incremental mode: do not compress the outputs of previous runs
+         // written next to the input files
+         if ((this.incremental == true) && (Files.isDirectory(Paths.get(this.inputName)) == true))
+         {
+            Iterator<Path> it = files.iterator();
+
+            while (it.hasNext() == true)
+            {
+               if (it.next().toString().endsWith(".knz") == true)
+                  it.remove();
+            }
+         }
+
          if (files.isEmpty())
          {
             System.err.println("Cannot access input file '"+this.inputName+"'");
@@ -189,6 +251,12 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          printOut("Verbosity set to " + this.verbosity, true);
          printOut("Overwrite set to " + this.overwrite, true);
          printOut("Checksum set to " +  this.checksum, true);
+         printOut("Checkpoints set to " + this.checkpoints, true);
+         printOut("Off-heap memory set to " + this.offHeap, true);
+         printOut("Lazy matching set to " + this.lazyMatch, true);
+         printOut("Chunk table set to " + this.chunkTable, true);
+         printOut("Staged execution set to " + this.staged, true);
+         printOut("Incremental mode set to " + this.incremental, true);
          String etransform = (NONE.equals(this.transform)) ? "no" : this.transform;
          printOut("Using " + etransform + " transform (stage 1)", true);
          String ecodec = (NONE.equals(this.codec)) ? "no" : this.codec;
@@ -213,6 +281,7 @@ public class BlockCompressor implements Runnable, Callable<Integer>
       String formattedInName = this.inputName;
       boolean specialOutput = (NONE.equalsIgnoreCase(formattedOutName)) ||
          (STDOUT.equalsIgnoreCase(formattedOutName));
+      Manifest manifest = null;
 
       try
       {
@@ -253,10 +322,39 @@ public class BlockCompressor implements Runnable, Callable<Integer>
             }
          }
 
+         if (this.incremental == true)
+         {
+            if ((inputIsDir == false) || (specialOutput == true))
+            {
+               printOut("Warning: incremental mode requires an input directory and an output directory, ignoring it.", this.verbosity > 0);
+            }
+            else
+            {
+               // The manifest is kept with the output files
+               final String dir = (formattedOutName != null) ? formattedOutName : formattedInName;
+               final String options = Manifest.getOptions(this.transform, this.codec, this.blockSize,
+                  this.checksum, this.skipBlocks, this.splitBlocks, this.chunkTable, this.lazyMatch);
+               manifest = Manifest.load(dir + Manifest.FILE_NAME, options);
+               List<String> names = new ArrayList<>(files.size());
+
+               for (Path file : files)
+                  names.add(file.toString());
+
+               manifest.retain(names);
+            }
+         }
+
          Map<String, Object> ctx = new HashMap<>();
          ctx.put("verbosity", this.verbosity);
          ctx.put("overwrite", this.overwrite);
          ctx.put("skipBlocks", this.skipBlocks);
+         ctx.put("splitBlocks", this.splitBlocks);
+         ctx.put("checkpoints", this.checkpoints);
+         ctx.put("resume", this.resume);
+         ctx.put("offHeap", this.offHeap);
+         ctx.put("lazyMatch", this.lazyMatch);
+         ctx.put("chunkTable", this.chunkTable);
+         ctx.put("staged", this.staged);
          ctx.put("blockSize", this.blockSize);
          ctx.put("checksum", this.checksum);
          ctx.put("pool", this.pool);
@@ -264,6 +362,9 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          ctx.put("transform", this.transform);
          ctx.put("extra", "TPAQX".equals(this.codec));
 
+         if (manifest != null)
+            ctx.put("manifest", manifest);
+
          // Run the task(s)
          if (nbFiles == 1)
          {
@@ -351,12 +452,36 @@ public class BlockCompressor implements Runnable, Callable<Integer>
             }
          }
       }
+      catch (kanzi.io.IOException e)
+      {
+         System.err.println(e.getMessage());
+         res = e.getErrorCode();
+      }
       catch (Exception e)
       {
          System.err.println("An unexpected error occurred: " + e.getMessage());
          res = Error.ERR_UNKNOWN;
       }
 
+      if (manifest != null)
+      {
+         // Save the entries of the files compressed so far (even after a failure)
+         try
+         {
+            manifest.save();
+         }
+         catch (kanzi.io.IOException e)
+         {
+            System.err.println(e.getMessage());
+
+            if (res == 0)
+               res = e.getErrorCode();
+         }
+
+         final int n = manifest.getNbUnchanged();
+         printOut(n+" unchanged file"+((n > 1) ? "s" : "")+" skipped", this.verbosity > 0);
+      }
+
       long after = System.nanoTime();
 
       if (nbFiles > 1)
@@ -420,6 +545,157 @@ public class BlockCompressor implements Runnable, Callable<Integer>
    }
 
 
+   // Derive the block size and/or the number of jobs (when 0) from the number
+   // of cores, the max heap, the memory used by one job with this transform
+   // and entropy codec, and the input size (0 if unknown).
+   // Return { block size, number of jobs }.
+   static int[] autoTune(long inputSize, int blockSize, int jobs, String transform, String codec)
+   {
+      final int cores = Math.min(Runtime.getRuntime().availableProcessors(), MAX_CONCURRENCY);
+      final long budget = Runtime.getRuntime().maxMemory() / 10 * 6;
+      final boolean autoBlock = blockSize == 0;
+      final boolean autoJobs = jobs == 0;
+      int bs = blockSize;
+      int nbJobs = jobs;
+
+      if (autoBlock == true)
+      {
+         bs = getPreferredBlockSize(transform, codec);
+
+         // Cut the input in enough blocks to keep the jobs busy
+         if (inputSize > 0)
+         {
+            final int tasks = (autoJobs == true) ? cores : nbJobs;
+            bs = (int) Math.max(Math.min(bs, (inputSize+tasks-1) / tasks), MIN_AUTO_BLOCK_SIZE);
+         }
+
+         bs = (bs + 15) & -16;
+      }
+
+      if (autoJobs == true)
+      {
+         nbJobs = cores;
+
+         // No more jobs than blocks
+         if (inputSize > 0)
+            nbJobs = (int) Math.max(Math.min(nbJobs, (inputSize+bs-1) / bs), 1);
+      }
+
+      // Fit the jobs in the memory budget: fewer jobs first, then smaller blocks
+      while (nbJobs*getJobMemory(bs, transform, codec) > budget)
+      {
+         if ((autoJobs == true) && (nbJobs > 1))
+            nbJobs--;
+         else if ((autoBlock == true) && (bs > MIN_AUTO_BLOCK_SIZE))
+            bs = Math.max((bs >> 1) & -16, MIN_AUTO_BLOCK_SIZE);
+         else
+            break;
+      }
+
+      return new int[] { bs, nbJobs };
+   }
+
+
+   // Bigger blocks improve the compression of the BWT and of context mixing
+   private static int getPreferredBlockSize(String transform, String codec)
+   {
+      if ("TPAQX".equals(codec))
+         return 32*1024*1024;
+
+      if (("TPAQ".equals(codec)) || ("CM".equals(codec)))
+         return 16*1024*1024;
+
+      if (transform.contains("BWT") == true)
+         return 8*1024*1024;
+
+      return DEFAULT_BLOCK_SIZE;
+   }
+
+
+   // Estimate the heap used by one job to compress a block
+   static long getJobMemory(int blockSize, String transform, String codec)
+   {
+      final long bs = blockSize;
+
+      // Input, output and transform buffers
+      long mem = 4*bs;
+
+      for (String t : transform.split("\\+"))
+      {
+         switch (t)
+         {
+            case "BWT":
+            case "BWTS":
+               mem += 5*bs; // suffix array and buffer
+               break;
+
+            case "LZ":
+            case "LZX":
+            case "ROLZ":
+            case "ROLZX":
+            case "TEXT":
+               mem += bs + (8<<20); // hash tables, dictionaries
+               break;
+
+            default:
+               break;
+         }
+      }
+
+      if (("TPAQ".equals(codec)) || ("TPAQX".equals(codec)))
+      {
+         // Same table sizes as TPAQPredictor
+         long states;
+
+         if (bs >= 64*1024*1024)
+            states = 1 << 28;
+         else if (bs >= 16*1024*1024)
+            states = 1 << 27;
+         else if (bs >= 4*1024*1024)
+            states = 1 << 26;
+         else
+            states = (bs >= 1024*1024) ? 1 << 24 : 1 << 22;
+
+         long tables = states + 4*Math.min(16*1024*1024, 16*bs) + (4<<20);
+
+         if ("TPAQX".equals(codec))
+            tables <<= 2;
+
+         mem += tables + (1<<24) + Math.min(64*1024*1024, bs);
+      }
+      else
+      {
+         mem += 1 << 20;
+      }
+
+      return mem;
+   }
+
+
+   // Return the total size of the input files (0 if unknown)
+   private static long getInputSize(String inputName)
+   {
+      if ((inputName == null) || (STDIN.equalsIgnoreCase(inputName) == true))
+         return 0;
+
+      try
+      {
+         List<Path> files = new ArrayList<>();
+         Kanzi.createFileList(inputName, files);
+         long size = 0;
+
+         for (Path f : files)
+            size += Files.size(f);
+
+         return size;
+      }
+      catch (IOException e)
+      {
+         return 0;
+      }
+   }
+
+
    private static String getTransformAndCodec(int level)
    {
       switch (level)
@@ -506,7 +782,85 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          }
          
          boolean overwrite = (Boolean) this.ctx.get("overwrite");
+         Manifest manifest = (Manifest) this.ctx.get("manifest");
+         long fileTime = 0;
+
+         if (manifest != null)
+         {
+            try
+            {
+               if (manifest.isUnchanged(inputName, outputName) == true)
+               {
+                  printOut("Skipping unchanged file '"+inputName+"'", verbosity > 1);
+                  return new FileCompressResult(0, 0, 0);
+               }
+
+               // The existing output (if any) was created by a previous run
+               overwrite |= manifest.contains(inputName);
+               fileTime = Files.getLastModifiedTime(Paths.get(inputName)).toMillis();
+            }
+            catch (IOException e)
+            {
+               System.err.println("Cannot access input file '"+inputName+"': " + e.getMessage());
+               return new FileCompressResult(Error.ERR_OPEN_FILE, 0, 0);
+            }
+         }
+
+         Checkpoint cp = null;
+         boolean resumed = false;
+
+         if ((Boolean) this.ctx.getOrDefault("checkpoints", false) == true)
+         {
+            if ((STDIN.equalsIgnoreCase(inputName) == true) || (NONE.equalsIgnoreCase(outputName) == true) ||
+               (STDOUT.equalsIgnoreCase(outputName) == true))
+            {
+               System.err.println("Checkpoints require an input file and an output file");
+               return new FileCompressResult(Error.ERR_INVALID_PARAM, 0, 0);
+            }
+
+            final String cpName = Checkpoint.getFileName(outputName);
+
+            try
+            {
+               if ((Boolean) this.ctx.getOrDefault("resume", false) == true)
+                  cp = Checkpoint.load(cpName, Checkpoint.DEFAULT_INTERVAL);
+            }
+            catch (kanzi.io.IOException e)
+            {
+               System.err.println(e.getMessage());
+               return new FileCompressResult(e.getErrorCode(), 0, 0);
+            }
+
+            if (cp != null)
+            {
+               // The job must produce the same bitstream as the interrupted one
+               if (cp.matches((long) this.ctx.getOrDefault("fileSize", 0L), (Integer) this.ctx.get("blockSize"),
+                  (String) this.ctx.get("transform"), (String) this.ctx.get("codec"),
+                  (Boolean) this.ctx.get("checksum"), (Boolean) this.ctx.getOrDefault("splitBlocks", false),
+                  (Boolean) this.ctx.getOrDefault("chunkTable", false)) == false)
+               {
+                  System.err.println("Checkpoint '"+cpName+"' does not match the input file or the compression options");
+                  return new FileCompressResult(Error.ERR_INVALID_PARAM, 0, 0);
+               }
 
+               if (new File(outputName).length() < cp.getOutputOffset())
+               {
+                  System.err.println("File '"+outputName+"' is shorter than recorded in checkpoint '"+cpName+"'");
+                  return new FileCompressResult(Error.ERR_INVALID_FILE, 0, 0);
+               }
+
+               resumed = true;
+               printOut("Resuming from block "+(cp.getBlockId()+1)+" (input offset "+cp.getInputOffset()+")", verbosity > 1);
+            }
+            else
+            {
+               cp = new Checkpoint(cpName, Checkpoint.DEFAULT_INTERVAL);
+            }
+
+            this.ctx.put("checkpoint", cp);
+         }
+
+         this.ctx.put("resume", resumed);
          OutputStream os;
 
          try
@@ -531,7 +885,7 @@ public class BlockCompressor implements Runnable, Callable<Integer>
                      return new FileCompressResult(Error.ERR_OUTPUT_IS_DIR, 0, 0);
                   }
 
-                  if (overwrite == false)
+                  if ((overwrite == false) && (resumed == false))
                   {
                      System.err.println("File '" + outputName + "' exists and " +
                         "the 'force' command line option has not been provided");
@@ -550,7 +904,20 @@ public class BlockCompressor implements Runnable, Callable<Integer>
 
                try
                {
-                  os = new FileOutputStream(output);
+                  if (resumed == true)
+                  {
+                     // Drop the partial output written after the checkpoint
+                     try (FileChannel fc = FileChannel.open(output.toPath(), StandardOpenOption.WRITE))
+                     {
+                        fc.truncate(cp.getOutputOffset());
+                     }
+
+                     os = new FileOutputStream(output, true);
+                  }
+                  else
+                  {
+                     os = new FileOutputStream(output);
+                  }
                }
                catch (IOException e1)
                {
@@ -570,6 +937,14 @@ public class BlockCompressor implements Runnable, Callable<Integer>
                }
             }
 
+            // Each checkpoint forces the output to the storage first
+            if ((cp != null) && (os instanceof FileOutputStream))
+               cp.setOutput(((FileOutputStream) os).getChannel());
+
+            // Write the compressed data on a dedicated thread
+            if ((os instanceof NullOutputStream) == false)
+               os = new AsyncOutputStream(os, IO_BUFFER_SIZE, IO_NB_BUFFERS);
+
             try
             {
                this.cos = new CompressedOutputStream(os, this.ctx);
@@ -591,7 +966,25 @@ public class BlockCompressor implements Runnable, Callable<Integer>
 
          try
          {
-            this.is = (STDIN.equalsIgnoreCase(inputName)) ? System.in : new FileInputStream(inputName);
+            InputStream fis;
+
+            if (STDIN.equalsIgnoreCase(inputName))
+            {
+               fis = System.in;
+            }
+            else
+            {
+               FileInputStream fileIs = new FileInputStream(inputName);
+
+               // Skip the input compressed before the checkpoint
+               if (resumed == true)
+                  fileIs.getChannel().position(cp.getInputOffset());
+
+               fis = fileIs;
+            }
+
+            // Read ahead on a dedicated thread: reads overlap with block processing
+            this.is = new AsyncInputStream(fis, IO_BUFFER_SIZE, IO_NB_BUFFERS);
          }
          catch (Exception e)
          {
@@ -602,10 +995,14 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          // Encode
          printOut("\nEncoding "+inputName+" ...", verbosity>1);
          printOut("", verbosity>3);
-         long read = 0;
+         long read = (resumed == true) ? cp.getInputOffset() : 0;
          SliceByteArray sa = new SliceByteArray(new byte[DEFAULT_BUFFER_SIZE], 0);
          int len;
 
+         // Hash the input for the manifest while reading it (the input before
+         // a checkpoint is not read: hash the file at the end instead)
+         Manifest.Hasher hasher = ((manifest != null) && (resumed == false)) ? new Manifest.Hasher() : null;
+
          if (this.listeners.size() > 0)
          {
             Event evt = new Event(Event.Type.COMPRESSION_START, -1, 0);
@@ -633,10 +1030,27 @@ public class BlockCompressor implements Runnable, Callable<Integer>
                if (len <= 0)
                   break;
 
+               if (hasher != null)
+                  hasher.update(sa.array, 0, len);
+
                // Just write block to the compressed output stream !
                read += len;
                this.cos.write(sa.array, 0, len);
             }
+
+            // Encode the last blocks. The writer stage reports its errors on close
+            this.cos.close();
+
+            try
+            {
+               os.close();
+            }
+            catch (IOException e)
+            {
+               System.err.print("Failed to write compressed data to file '"+outputName+"': ");
+               System.err.println(e.getMessage());
+               return new FileCompressResult(Error.ERR_WRITE_FILE, read, this.cos.getWritten());
+            }
          }
          catch (kanzi.io.IOException e)
          {
@@ -652,8 +1066,15 @@ public class BlockCompressor implements Runnable, Callable<Integer>
          }
          finally
          {
-            // Close streams to ensure all data are flushed
-            this.dispose();
+            // Close streams to release resources after a failure
+            try
+            {
+               this.dispose();
+            }
+            catch (IOException e)
+            {
+               // Ignore: the failure has already been reported
+            }
 
             try
             {
@@ -665,6 +1086,25 @@ public class BlockCompressor implements Runnable, Callable<Integer>
             }
          }
 
+         // The job completed: the checkpoint is not needed anymore
+         if (cp != null)
+            cp.delete();
+
+         if (manifest != null)
+         {
+            try
+            {
+               final long hash = (hasher != null) ? hasher.getValue() : Manifest.hash(inputName);
+               manifest.update(inputName, (long) this.ctx.getOrDefault("fileSize", 0L), fileTime,
+                  new File(outputName).length(), hash);
+            }
+            catch (IOException e)
+            {
+               // Not recorded: the file is compressed again by the next run
+               printOut("Cannot record file '"+inputName+"' in manifest: "+e.getMessage(), verbosity > 0);
+            }
+         }
+
          if (read == 0)
          {
             printOut("Input file " + inputName + " is empty... nothing to do", verbosity > 0);
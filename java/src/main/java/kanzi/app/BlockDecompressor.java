@@ -38,8 +38,11 @@ import kanzi.Event;
 import kanzi.Error;
 import kanzi.Global;
 import kanzi.SliceByteArray;
+import kanzi.io.AsyncInputStream;
+import kanzi.io.AsyncOutputStream;
 import kanzi.io.CompressedInputStream;
 import kanzi.io.NullOutputStream;
+import kanzi.io.SparseOutputStream;
 import kanzi.Listener;
 
 
@@ -47,6 +50,8 @@ import kanzi.Listener;
 public class BlockDecompressor implements Runnable, Callable<Integer>
 {
    private static final int DEFAULT_BUFFER_SIZE = 65536;
+   private static final int IO_BUFFER_SIZE = 256*1024;
+   private static final int IO_NB_BUFFERS = 4;
    private static final int DEFAULT_CONCURRENCY = 1;
    private static final int MAX_CONCURRENCY = 64;
    private static final String STDOUT = "STDOUT";
@@ -55,6 +60,8 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
 
    private int verbosity;
    private final boolean overwrite;
+   private final boolean offHeap;
+   private final boolean sparse;
    private final String inputName;
    private final String outputName;
    private final int jobs;
@@ -68,6 +75,10 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
    {
       Boolean bForce = (Boolean) map.remove("overwrite");
       this.overwrite = (bForce == null) ? false : bForce;
+      Boolean bOffHeap = (Boolean) map.remove("offHeap");
+      this.offHeap = (bOffHeap == null) ? false : bOffHeap;
+      Boolean bSparse = (Boolean) map.remove("sparse");
+      this.sparse = (bSparse == null) ? false : bSparse;
       this.inputName = (String) map.remove("inputName");
       this.outputName = (String) map.remove("outputName");
       this.verbosity = (Integer) map.remove("verbose");
@@ -83,6 +94,12 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
          concurrency = MAX_CONCURRENCY;
       }
 
+      Boolean bAutoJobs = (Boolean) map.remove("autoJobs");
+
+      // One job per core when requested
+      if ((bAutoJobs != null) && (bAutoJobs == true))
+         concurrency = Math.min(Runtime.getRuntime().availableProcessors(), MAX_CONCURRENCY);
+
       this.jobs = (concurrency == 0) ? DEFAULT_CONCURRENCY : concurrency;
       this.pool = Executors.newFixedThreadPool(this.jobs);
       this.listeners = new ArrayList<>(10);
@@ -140,6 +157,8 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
       {
          printOut("Verbosity set to "+this.verbosity, true);
          printOut("Overwrite set to "+this.overwrite, true);
+         printOut("Off-heap memory set to "+this.offHeap, true);
+         printOut("Sparse output set to "+this.sparse, true);
          printOut("Using " + this.jobs + " job" + ((this.jobs > 1) ? "s" : ""), true);
       }
       
@@ -201,6 +220,8 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
          Map<String, Object> ctx = new HashMap<>();
          ctx.put("verbosity", this.verbosity);
          ctx.put("overwrite", this.overwrite);
+         ctx.put("offHeap", this.offHeap);
+         ctx.put("sparse", this.sparse);
          ctx.put("pool", this.pool);
 
          if (this.from >= 0)
@@ -397,6 +418,7 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
          }
          
          boolean overwrite = (Boolean) this.ctx.get("overwrite");
+         SparseOutputStream sos = null;
 
          long read = 0;
          printOut("\nDecoding "+inputName+" ...", verbosity>1);
@@ -468,6 +490,13 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
                      throw e1;
                   }
                }
+
+               // Leave holes in the output file instead of writing zero pages
+               if ((Boolean) this.ctx.getOrDefault("sparse", false) == true)
+               {
+                  sos = new SparseOutputStream((FileOutputStream) this.os);
+                  this.os = sos;
+               }
             }
             catch (Exception e)
             {
@@ -483,6 +512,9 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
             is = (STDIN.equalsIgnoreCase(inputName)) ? System.in :
                new FileInputStream(new File(inputName));
 
+            // Read ahead on a dedicated thread: reads overlap with block decoding
+            is = new AsyncInputStream(is, IO_BUFFER_SIZE, IO_NB_BUFFERS);
+
             try
             {
                this.cis = new CompressedInputStream(is, this.ctx);
@@ -493,6 +525,7 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
             catch (Exception e)
             {
                System.err.println("Cannot create compressed stream: "+e.getMessage());
+               is.close();
                return new FileDecompressResult(Error.ERR_CREATE_DECOMPRESSOR, 0);
             }
          }
@@ -502,6 +535,10 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
             return new FileDecompressResult(Error.ERR_OPEN_FILE, 0);
          }
 
+         // Write the decompressed data on a dedicated thread
+         if ((this.os instanceof NullOutputStream) == false)
+            this.os = new AsyncOutputStream(this.os, IO_BUFFER_SIZE, IO_NB_BUFFERS);
+
          long before = System.nanoTime();
 
          try
@@ -532,10 +569,22 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
                {
                   System.err.print("Failed to write decompressed block to file '"+outputName+"': ");
                   System.err.println(e.getMessage());
-                  return new FileDecompressResult(Error.ERR_READ_FILE, this.cis.getRead());
+                  return new FileDecompressResult(Error.ERR_WRITE_FILE, this.cis.getRead());
                }
             }
             while (decoded == sa.array.length);
+
+            // The writer stage reports its errors on flush or close
+            try
+            {
+               this.os.close();
+            }
+            catch (Exception e)
+            {
+               System.err.print("Failed to write decompressed block to file '"+outputName+"': ");
+               System.err.println(e.getMessage());
+               return new FileDecompressResult(Error.ERR_WRITE_FILE, this.cis.getRead());
+            }
          }
          catch (kanzi.io.IOException e)
          {
@@ -552,7 +601,14 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
          finally
          {
             // Close streams to ensure all data are flushed
-            this.dispose();
+            try
+            {
+               this.dispose();
+            }
+            catch (IOException e)
+            {
+               // Ignore: a write failure has already been reported
+            }
 
             try
             {
@@ -589,6 +645,9 @@ public class BlockDecompressor implements Runnable, Callable<Integer>
                printOut("Decoding:          "+str, true);
                printOut("Input size:        "+this.cis.getRead(), true);
                printOut("Output size:       "+read, true);
+
+               if (sos != null)
+                  printOut("Holes (sparse):    "+sos.getSkipped(), true);
             }
 
             if (verbosity == 1)
@@ -17,6 +17,7 @@ package kanzi.app;
 
 import java.io.File;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.nio.file.DirectoryIteratorException;
 import java.nio.file.DirectoryStream;
 import java.nio.file.Files;
@@ -25,6 +26,10 @@ import java.nio.file.Paths;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
+import kanzi.Global;
+import kanzi.Memory;
+import kanzi.entropy.EntropyUtils;
+import kanzi.transform.TextCodec;
 
 
 
@@ -48,6 +53,11 @@ public class Kanzi
    // private static final int ARG_IDX_FROM = 10;
    //private static final int ARG_IDX_TO = 11;
 
+   private static final int EST_CHUNK_SIZE = 4096;
+   private static final int EST_NB_CHUNKS = 16;
+   private static final int EST_MIN_LENGTH = 64;
+   private static final int EST_HASH_LOG = 12;
+   private static final int EST_HASH_SEED = 0x1E35A7BD;
    private static final String APP_HEADER = "Kanzi 1.9 (C) 2021,  Frederic Langlet";
 
 
@@ -133,6 +143,176 @@ public class Kanzi
    }
 
 
+   // Estimate the compressibility of the data at the given level from a sample
+   // (at most EST_NB_CHUNKS chunks of EST_CHUNK_SIZE bytes spread over the input).
+   // The cost is a small fraction of the actual compression.
+   public static Estimate estimate(byte[] data, int level)
+   {
+      if (data == null)
+         throw new NullPointerException("Invalid null data parameter");
+
+      return estimate(ByteBuffer.wrap(data), level);
+   }
+
+
+   // The position of the buffer is not modified
+   public static Estimate estimate(ByteBuffer data, int level)
+   {
+      if (data == null)
+         throw new NullPointerException("Invalid null data parameter");
+
+      if ((level < 0) || (level > 9))
+         throw new IllegalArgumentException("Invalid compression level (must be in [0..9]): " + level);
+
+      final byte[] sample = getSample(data);
+      final int n = sample.length;
+
+      if ((level == 0) || (n < EST_MIN_LENGTH))
+         return new Estimate(1.0, Estimate.THROUGHPUT_HIGH, false);
+
+      // Order 0 and order 1 entropies in [0..1024] (1024 = 8 bits per byte)
+      final int[] freqs0 = new int[256];
+      Global.computeHistogramOrder0(sample, 0, n, freqs0, false);
+      final int h0 = Global.computeFirstOrderEntropy1024(n, freqs0);
+      final int[][] freqs1 = new int[256][257];
+      Global.computeHistogramOrder1(sample, 0, n, freqs1, true);
+      long sum = 0;
+      int nbSymbols = 0;
+
+      for (int i=0; i<256; i++)
+      {
+         final int total = freqs1[i][256];
+
+         if (total == 0)
+            continue;
+
+         sum += ((long) total * Global.computeFirstOrderEntropy1024(total, freqs1[i]));
+
+         for (int j=0; j<256; j++)
+            nbSymbols += ((freqs1[i][j] != 0) ? 1 : 0);
+
+         nbSymbols--;
+      }
+
+      // Correct the underestimation of order 1 entropy on a small sample
+      // (Miller-Madow: (symbols-1)/(2*total*ln(2)) bits per context)
+      final int h1 = Math.min((int) (sum/n) + (92*nbSymbols)/n, h0);
+
+      // The TEXT transform applies to most levels
+      final int stats = TextCodec.computeStats(sample, 0, n, new int[256], false);
+      final boolean text = (stats & TextCodec.MASK_NOT_TEXT) == 0;
+      final double r0 = h0 / 1024.0;
+      final double r1 = h1 / 1024.0;
+      final double cover = getMatchRate1024(sample, n) / 1024.0;
+      double ratio;
+      int throughput;
+
+      switch (level)
+      {
+         case 1:
+         case 2:
+            // LZ + Huffman: literals coded at order 0, matches cost a fraction
+            // of their length
+            ratio = (1.0-cover)*r0 + 0.15*cover;
+            throughput = Estimate.THROUGHPUT_HIGH;
+            break;
+
+         case 3:
+         case 4:
+            // ROLZ: literals coded with an order 1 model
+            ratio = (1.0-cover)*(r0+r1)/2 + 0.1*cover;
+            throughput = Estimate.THROUGHPUT_MEDIUM;
+            break;
+
+         case 5:
+         case 6:
+            // BWT: close to order 1 entropy, better with repetitions
+            ratio = 0.9*r1*(1.0-0.5*cover);
+            throughput = Estimate.THROUGHPUT_MEDIUM;
+            break;
+
+         default:
+            // Context mixing
+            ratio = 0.8*r1*(1.0-0.6*cover);
+            throughput = Estimate.THROUGHPUT_LOW;
+      }
+
+      if (text == true)
+         ratio *= 0.9;
+
+      // High entropy data without repeats: the order 1 entropy of a small
+      // sample is underestimated and no model helps. Such blocks are stored.
+      if ((h0 >= EntropyUtils.INCOMPRESSIBLE_THRESHOLD) && (cover < 1.0/32))
+         ratio = 1.0;
+
+      // Blocks that do not compress are stored as is
+      ratio = Math.max(Math.min(ratio, 1.0), 0.01);
+      return new Estimate(ratio, throughput, text);
+   }
+
+
+   // Copy the whole input if small else chunks evenly spread over the input
+   private static byte[] getSample(ByteBuffer data)
+   {
+      final ByteBuffer buf = data.duplicate();
+      final int start = buf.position();
+      final int length = buf.remaining();
+
+      if (length <= EST_NB_CHUNKS*EST_CHUNK_SIZE)
+      {
+         final byte[] res = new byte[length];
+         buf.get(res);
+         return res;
+      }
+
+      final byte[] res = new byte[EST_NB_CHUNKS*EST_CHUNK_SIZE];
+      final long step = (length-EST_CHUNK_SIZE) / (EST_NB_CHUNKS-1);
+
+      for (int i=0; i<EST_NB_CHUNKS; i++)
+      {
+         buf.position(start+(int) (i*step));
+         buf.get(res, i*EST_CHUNK_SIZE, EST_CHUNK_SIZE);
+      }
+
+      return res;
+   }
+
+
+   // Return the part of the buffer (in [0..1024]) covered by matches of at
+   // least 4 bytes found with a single entry hash table (LZ probe)
+   private static int getMatchRate1024(byte[] buf, int length)
+   {
+      final int[] positions = new int[1<<EST_HASH_LOG];
+      final int end = length - 4;
+      int covered = 0;
+      int i = 0;
+
+      while (i < end)
+      {
+         final int val = Memory.LittleEndian.readInt32(buf, i);
+         final int h = (val*EST_HASH_SEED) >>> (32-EST_HASH_LOG);
+         final int ref = positions[h] - 1;
+         positions[h] = i + 1;
+
+         if ((ref < 0) || (Memory.LittleEndian.readInt32(buf, ref) != val))
+         {
+            i++;
+            continue;
+         }
+
+         int len = 4;
+
+         while ((i+len < length) && (buf[ref+len] == buf[i+len]))
+            len++;
+
+         covered += len;
+         i += len;
+      }
+
+      return (int) (((long) covered << 10) / length);
+   }
+
+
     private static int processCommandLine(String args[], Map<String, Object> map)
     {
         int blockSize = -1;
@@ -140,6 +320,17 @@ public class Kanzi
         boolean overwrite = false;
         boolean checksum = false;
         boolean skip = false;
+        boolean split = false;
+        boolean checkpoint = false;
+        boolean resume = false;
+        boolean offHeap = false;
+        boolean sparse = false;
+        boolean lazy = false;
+        boolean chunkTable = false;
+        boolean staged = false;
+        boolean incremental = false;
+        boolean autoBlock = false;
+        boolean autoJobs = false;
         String inputName = null;
         String outputName = null;
         String codec = null;
@@ -272,6 +463,96 @@ public class Kanzi
                continue;
            }
 
+           if (arg.equals("--split"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               split = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--checkpoint"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               checkpoint = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--off-heap"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               offHeap = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--sparse"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               sparse = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--lazy"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               lazy = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--chunk-table"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               chunkTable = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--staged"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               staged = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--incremental"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               incremental = true;
+               ctx = -1;
+               continue;
+           }
+
+           if (arg.equals("--resume"))
+           {
+               if (ctx != -1)
+                  printOut("Warning: ignoring option [" + CMD_LINE_ARGS[ctx] + "] with no value.", verbose>0);
+
+               resume = true;
+               ctx = -1;
+               continue;
+           }
+
            if (arg.equals("--checksum") || arg.equals("-x"))
            {
                if (ctx != -1)
@@ -399,13 +680,20 @@ public class Kanzi
                String name = arg.startsWith("--block=") ? arg.substring(8).toUpperCase().trim() :
                   arg.toUpperCase();
 
-               if (blockSize != -1)
+               if ((blockSize != -1) || (autoBlock == true))
                {
                   System.err.println("Warning: ignoring duplicate block size: "+name);
                   ctx = -1;
                   continue;
                }
 
+               if (name.equals("AUTO"))
+               {
+                  autoBlock = true;
+                  ctx = -1;
+                  continue;
+               }
+
                char lastChar = (name.length() == 0) ? ' ' : name.charAt(name.length()-1);
                int scale = 1;
 
@@ -445,13 +733,20 @@ public class Kanzi
            {
                String name = arg.startsWith("--jobs=") ? arg.substring(7).trim() : arg;
 
-               if (tasks != 0)
+               if ((tasks != 0) || (autoJobs == true))
                {
                   System.err.println("Warning: ignoring duplicate jobs: "+name);
                   ctx = -1;
                   continue;
                }
 
+               if (name.equalsIgnoreCase("auto"))
+               {
+                  autoJobs = true;
+                  ctx = -1;
+                  continue;
+               }
+
                try
                {
                   tasks = Integer.parseInt(name);
@@ -565,9 +860,21 @@ public class Kanzi
            }
          }
 
+        if ((sparse == true) && (mode != 'd'))
+        {
+           printOut("Warning: ignoring sparse output (only valid for decompression)", verbose>0);
+           sparse = false;
+        }
+
         if (blockSize != -1)
            map.put("block", blockSize);
 
+        if (autoBlock == true)
+           map.put("autoBlock", autoBlock);
+
+        if (autoJobs == true)
+           map.put("autoJobs", autoJobs);
+
         map.put("verbose", verbose);
         map.put("mode", mode);
 
@@ -592,6 +899,33 @@ public class Kanzi
         if (skip == true)
            map.put("skipBlocks", skip);
 
+        if (split == true)
+           map.put("splitBlocks", split);
+
+        if (checkpoint == true)
+           map.put("checkpoint", checkpoint);
+
+        if (resume == true)
+           map.put("resume", resume);
+
+        if (offHeap == true)
+           map.put("offHeap", offHeap);
+
+        if (sparse == true)
+           map.put("sparse", sparse);
+
+        if (lazy == true)
+           map.put("lazyMatch", lazy);
+
+        if (chunkTable == true)
+           map.put("chunkTable", chunkTable);
+
+        if (staged == true)
+           map.put("staged", staged);
+
+        if (incremental == true)
+           map.put("incremental", incremental);
+
         if (from >= 0)
            map.put("from", from);
 
@@ -647,7 +981,8 @@ public class Kanzi
       if (mode == 'c')
       {
          printOut("   -b, --block=<size>", true);
-         printOut("        size of blocks (default 4 MB, max 1 GB, min 1 KB).\n", true);
+         printOut("        size of blocks (default 4 MB, max 1 GB, min 1 KB).", true);
+         printOut("        'auto' derives it from the level, input size, jobs and max heap.\n", true);
          printOut("   -l, --level=<compression>", true);
          printOut("        set the compression level [0..9]", true);
          printOut("        Providing this option forces entropy and transform.", true);
@@ -656,7 +991,7 @@ public class Kanzi
          printOut("        6=TEXT+BWT+SRT+ZRLT&FPAQ, 7=LZP+TEXT+BWT+LZP&CM, 8=X86+RLT+TEXT&TPAQ", true);
          printOut("        9=X86+RLT+TEXT&TPAQX\n", true);
          printOut("   -e, --entropy=<codec>", true);
-         printOut("        entropy codec [None|Huffman|ANS0|ANS1|Range|FPAQ|TPAQ|TPAQX|CM]", true);
+         printOut("        entropy codec [None|Huffman|ANS0|ANS1|Range|FPAQ|TPAQ|TPAQX|CM|CMX]", true);
          printOut("        (default is ANS0)\n", true);
          printOut("   -t, --transform=<codec>", true);
          printOut("        transform [None|BWT|BWTS|LZ|LZX|LZP|ROLZ|ROLZX|RLT|ZRLT]", true);
@@ -666,11 +1001,31 @@ public class Kanzi
          printOut("        enable block checksum\n", true);
          printOut("   -s, --skip", true);
          printOut("        copy blocks with high entropy instead of compressing them.\n", true);
+         printOut("   --split", true);
+         printOut("        cut blocks where the data switches between text and binary.\n", true);
+         printOut("   --lazy", true);
+         printOut("        lazy match selection in ROLZ/ROLZX (slower compression, better", true);
+         printOut("        ratio, same decompression speed).\n", true);
+         printOut("   --chunk-table", true);
+         printOut("        add a table of chunk sizes to Huffman/ANS/Range coded blocks: the", true);
+         printOut("        chunks of a block can be decoded concurrently.\n", true);
+         printOut("   --staged", true);
+         printOut("        entropy code each batch of blocks while the next one is transformed", true);
+         printOut("        (uses twice the block buffer memory).\n", true);
+         printOut("   --incremental", true);
+         printOut("        only compress the files of the input directory that changed since the", true);
+         printOut("        previous run (see '.kanzi.manifest' in the output directory).\n", true);
+         printOut("   --checkpoint", true);
+         printOut("        periodically save the progress of the job to '<output>.ckpt'.\n", true);
+         printOut("   --resume", true);
+         printOut("        resume an interrupted job from '<output>.ckpt' (if present).", true);
+         printOut("        The options must be the same as for the interrupted job.\n", true);
       }
 
       printOut("   -j, --jobs=<jobs>", true);
       printOut("        maximum number of jobs the program may start concurrently", true);
-      printOut("        (default is 1, maximum is 64).\n", true);
+      printOut("        (default is 1, maximum is 64). 'auto' derives it from the number", true);
+      printOut("        of cores (and the input size and max heap when compressing).\n", true);
       printOut("   -v, --verbose=<level>", true);
       printOut("        0=silent, 1=default, 2=display details, 3=display configuration,", true);
       printOut("        4=display block size and timings, 5=display extra information", true);
@@ -678,6 +1033,9 @@ public class Kanzi
       printOut("        Verbosity is reduced to 0 when the output is 'stdout'", true);
       printOut("   -f, --force", true);
       printOut("        overwrite the output file if it already exists\n", true);
+      printOut("   --off-heap", true);
+      printOut("        keep the biggest model tables (TPAQ, TPAQX) outside of the Java heap.", true);
+      printOut("        The direct memory limit may need to be raised (-XX:MaxDirectMemorySize).\n", true);
 
       if (mode == 'd')
       {
@@ -686,6 +1044,9 @@ public class Kanzi
          printOut("        The first block ID is 1.\n", true);
          printOut("   --to=blockID", true);
          printOut("        Decompress ending at the provided block (excluded).\n", true);
+         printOut("   --sparse", true);
+         printOut("        leave holes in the output file instead of writing pages of zeros", true);
+         printOut("        (sparse files, EG. VM or database images).\n", true);
       }
 
       if (mode != 'd')
@@ -771,4 +1132,40 @@ public class Kanzi
          throw e.getCause();
        }
     }
+
+
+   // Result of a compressibility estimation
+   public static class Estimate
+   {
+      public static final int THROUGHPUT_HIGH   = 0; // levels 1-2 (LZ) or stored data
+      public static final int THROUGHPUT_MEDIUM = 1; // levels 3-6 (ROLZ, BWT)
+      public static final int THROUGHPUT_LOW    = 2; // levels 7-9 (context mixing)
+
+      public final double ratio; // predicted compressed size / original size
+      public final int throughput;
+      public final boolean text;
+
+
+      Estimate(double ratio, int throughput, boolean text)
+      {
+         this.ratio = ratio;
+         this.throughput = throughput;
+         this.text = text;
+      }
+
+
+      // Return true if compression is expected to save at least 5% of the size
+      public boolean isCompressible()
+      {
+         return this.ratio < 0.95;
+      }
+
+
+      @Override
+      public String toString()
+      {
+         return "ratio=" + String.format("%.3f", this.ratio) + ", throughput=" + this.throughput +
+            ", text=" + this.text;
+      }
+   }
 }
@@ -0,0 +1,367 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.app;
+
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardCopyOption;
+import java.util.Collection;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.Map;
+import java.util.Properties;
+import java.util.Set;
+import kanzi.Error;
+import kanzi.util.hash.XXHash64;
+
+
+// Files compressed by previous runs over a directory: size, modification time
+// and content hash of each input file and size of its output. A file is not
+// compressed again if it did not change since the previous run (the existing
+// output is kept). A file with a new modification time but the same content
+// hash is not compressed either. The entries are dropped when the compression
+// options change.
+public class Manifest
+{
+   private static final int VERSION = 1;
+   public static final String FILE_NAME = ".kanzi.manifest";
+   private static final String PREFIX = "file.";
+   private static final int HASH_BUFFER_SIZE = 1024*1024;
+
+   private final String fileName;
+   private final String options;
+   private final Map<String, Entry> entries;
+   private int unchanged;
+
+
+   public Manifest(String fileName, String options)
+   {
+      if (fileName == null)
+         throw new NullPointerException("Invalid null manifest file name");
+
+      if (options == null)
+         throw new NullPointerException("Invalid null compression options");
+
+      this.fileName = fileName;
+      this.options = options;
+      this.entries = new HashMap<>();
+   }
+
+
+   // Return the key of the compression options: all the options changing the
+   // compressed data (not the ones only changing the speed or the memory use)
+   public static String getOptions(String transform, String codec, int blockSize,
+      boolean checksum, boolean skipBlocks, boolean splitBlocks, boolean chunkTable,
+      boolean lazyMatch)
+   {
+      return transform + "&" + codec + "&" + blockSize + "&" + checksum + "&" +
+         skipBlocks + "&" + splitBlocks + "&" + chunkTable + "&" + lazyMatch;
+   }
+
+
+   // Load the manifest file. Return an empty manifest if there is none or if
+   // it was created with other compression options.
+   public static Manifest load(String fileName, String options) throws kanzi.io.IOException
+   {
+      Manifest res = new Manifest(fileName, options);
+
+      if (Files.exists(Paths.get(fileName)) == false)
+         return res;
+
+      Properties props = new Properties();
+
+      try (InputStream is = new FileInputStream(fileName))
+      {
+         props.load(is);
+      }
+      catch (IOException e)
+      {
+         throw new kanzi.io.IOException("Cannot read manifest '"+fileName+"': "+e.getMessage(),
+            Error.ERR_OPEN_FILE);
+      }
+
+      try
+      {
+         if (Integer.parseInt(props.getProperty("version")) != VERSION)
+            throw new kanzi.io.IOException("Invalid manifest version in '"+fileName+"'",
+               Error.ERR_INVALID_FILE);
+
+         if (options.equals(props.getProperty("options")) == false)
+            return res;
+
+         for (String key : props.stringPropertyNames())
+         {
+            if (key.startsWith(PREFIX) == false)
+               continue;
+
+            String[] tokens = props.getProperty(key).split(",");
+
+            if (tokens.length != 4)
+               throw new IllegalArgumentException();
+
+            res.entries.put(key.substring(PREFIX.length()), new Entry(Long.parseLong(tokens[0]),
+               Long.parseLong(tokens[1]), Long.parseUnsignedLong(tokens[2], 16),
+               Long.parseLong(tokens[3])));
+         }
+
+         return res;
+      }
+      catch (NullPointerException | IllegalArgumentException e)
+      {
+         // NumberFormatException is an IllegalArgumentException
+         throw new kanzi.io.IOException("Invalid manifest '"+fileName+"'",
+            Error.ERR_INVALID_FILE);
+      }
+   }
+
+
+   // Write the manifest to a temporary file and rename it
+   public synchronized void save() throws kanzi.io.IOException
+   {
+      Properties props = new Properties();
+      props.setProperty("version", String.valueOf(VERSION));
+      props.setProperty("options", this.options);
+
+      for (Map.Entry<String, Entry> e : this.entries.entrySet())
+      {
+         Entry entry = e.getValue();
+         props.setProperty(PREFIX+e.getKey(), entry.size + "," + entry.time + "," +
+            Long.toHexString(entry.hash) + "," + entry.outputSize);
+      }
+
+      Path path = Paths.get(this.fileName);
+      Path tmp = Paths.get(this.fileName + ".tmp");
+
+      try
+      {
+         try (OutputStream os = new FileOutputStream(tmp.toFile()))
+         {
+            props.store(os, "kanzi manifest");
+         }
+
+         Files.move(tmp, path, StandardCopyOption.REPLACE_EXISTING, StandardCopyOption.ATOMIC_MOVE);
+      }
+      catch (IOException e)
+      {
+         throw new kanzi.io.IOException("Cannot save manifest '"+this.fileName+"': "+e.getMessage(),
+            Error.ERR_WRITE_FILE);
+      }
+   }
+
+
+   // Drop the entries of the files not in the list (removed input files)
+   public synchronized void retain(Collection<String> inputNames)
+   {
+      Set<String> names = new HashSet<>(inputNames);
+      this.entries.keySet().retainAll(names);
+   }
+
+
+   // Return true if the output of a previous run is still valid for the input
+   public boolean isUnchanged(String inputName, String outputName) throws IOException
+   {
+      Entry entry;
+
+      synchronized (this)
+      {
+         entry = this.entries.get(inputName);
+      }
+
+      if (entry == null)
+         return false;
+
+      final Path input = Paths.get(inputName);
+      final Path output = Paths.get(outputName);
+
+      if ((Files.exists(output) == false) || (Files.size(output) != entry.outputSize))
+         return false;
+
+      final long size = Files.size(input);
+      final long time = Files.getLastModifiedTime(input).toMillis();
+
+      if (size != entry.size)
+         return false;
+
+      if (time != entry.time)
+      {
+         // Touched file: compare the contents
+         if (hash(inputName) != entry.hash)
+            return false;
+
+         // Same content: the next run does not need to hash it again
+         synchronized (this)
+         {
+            this.entries.put(inputName, new Entry(size, time, entry.hash, entry.outputSize));
+         }
+      }
+
+      synchronized (this)
+      {
+         this.unchanged++;
+      }
+
+      return true;
+   }
+
+
+   // Return true if the manifest has an entry for the input file (its output
+   // was created by a previous run)
+   public synchronized boolean contains(String inputName)
+   {
+      return this.entries.containsKey(inputName);
+   }
+
+
+   // Record a file after compression. The size and the modification time must
+   // be the ones before compression: if the file changed during compression,
+   // it is not recorded and the next run compresses it again.
+   // The content of the file is read again to compute its hash.
+   public void update(String inputName, long size, long time, long outputSize) throws IOException
+   {
+      this.update(inputName, size, time, outputSize, hash(inputName));
+   }
+
+
+   // Same as above with the hash of the content computed while compressing
+   // (see Hasher)
+   public void update(String inputName, long size, long time, long outputSize, long hash) throws IOException
+   {
+      final Path input = Paths.get(inputName);
+      final boolean same = (Files.size(input) == size) &&
+         (Files.getLastModifiedTime(input).toMillis() == time);
+
+      synchronized (this)
+      {
+         if (same == true)
+            this.entries.put(inputName, new Entry(size, time, hash, outputSize));
+         else
+            this.entries.remove(inputName);
+      }
+   }
+
+
+   // Return the number of files found unchanged
+   public synchronized int getNbUnchanged()
+   {
+      return this.unchanged;
+   }
+
+
+   public String getFileName()
+   {
+      return this.fileName;
+   }
+
+
+   // Hash of the file content (see Hasher)
+   static long hash(String fileName) throws IOException
+   {
+      Hasher hasher = new Hasher();
+      byte[] buf = new byte[HASH_BUFFER_SIZE];
+
+      try (InputStream is = new FileInputStream(fileName))
+      {
+         while (true)
+         {
+            final int r = is.read(buf, 0, buf.length);
+
+            if (r < 0)
+               break;
+
+            hasher.update(buf, 0, r);
+         }
+      }
+
+      return hasher.getValue();
+   }
+
+
+   // XXHash64 of a content given in pieces of any size. The content is hashed
+   // chunk by chunk (each chunk is hashed with the hash of the previous chunks
+   // as seed), so the value does not depend on the size of the pieces.
+   public static final class Hasher
+   {
+      private final XXHash64 hasher;
+      private final byte[] chunk;
+      private int length; // bytes in 'chunk'
+      private long value; // hash of the previous chunks
+
+
+      public Hasher()
+      {
+         this.hasher = new XXHash64(0);
+         this.chunk = new byte[HASH_BUFFER_SIZE];
+      }
+
+
+      public void update(byte[] buf, int off, int len)
+      {
+         while (len > 0)
+         {
+            final int n = Math.min(len, this.chunk.length-this.length);
+            System.arraycopy(buf, off, this.chunk, this.length, n);
+            this.length += n;
+            off += n;
+            len -= n;
+
+            if (this.length == this.chunk.length)
+               this.hashChunk();
+         }
+      }
+
+
+      private void hashChunk()
+      {
+         this.hasher.setSeed(this.value);
+         this.value = this.hasher.hash(this.chunk, 0, this.length);
+         this.length = 0;
+      }
+
+
+      // Return the hash of the content so far (then no more update)
+      public long getValue()
+      {
+         if (this.length > 0)
+            this.hashChunk();
+
+         return this.value;
+      }
+   }
+
+
+   static class Entry
+   {
+      final long size;
+      final long time; // last modification time in ms
+      final long hash;
+      final long outputSize;
+
+
+      Entry(long size, long time, long hash, long outputSize)
+      {
+         this.size = size;
+         this.time = time;
+         this.hash = hash;
+         this.outputSize = outputSize;
+      }
+   }
+}
@@ -210,6 +210,38 @@ public final class DefaultOutputBitStream implements OutputBitStream
    }
 
 
+   // Write the buffered bytes and flush the underlying stream. The bits cached
+   // in the current word (see pendingBits()) are not written: the number of
+   // bits in the underlying stream is written() - pendingCount() (multiple of 8).
+   public void sync() throws BitStreamException
+   {
+      this.flush();
+
+      try
+      {
+         this.os.flush();
+      }
+      catch (IOException e)
+      {
+         throw new BitStreamException(e, BitStreamException.INPUT_OUTPUT);
+      }
+   }
+
+
+   // Return the bits cached in the current word (not written to the buffer yet)
+   public long pendingBits()
+   {
+      return (this.availBits >= 64) ? 0 : this.current >>> this.availBits;
+   }
+
+
+   // Return the number of bits cached in the current word
+   public int pendingCount()
+   {
+      return 64 - this.availBits;
+   }
+
+
    @Override
    public void close()
    {
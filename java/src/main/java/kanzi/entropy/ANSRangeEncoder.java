@@ -15,8 +15,10 @@ limitations under the License.
 
 package kanzi.entropy;
 
+import java.util.Map;
 import kanzi.EntropyEncoder;
 import kanzi.Global;
+import kanzi.Histograms;
 import kanzi.OutputBitStream;
 
 // Implementation of an Asymmetric Numeral System encoder.
@@ -40,6 +42,7 @@ public class ANSRangeEncoder implements EntropyEncoder
    private final int chunkSize;
    private final int order;
    private int logRange;
+   private Histograms histograms; // recorded by the last transform (optional)
 
 
    public ANSRangeEncoder(OutputBitStream bs)
@@ -54,6 +57,17 @@ public class ANSRangeEncoder implements EntropyEncoder
    }
 
 
+   // Use the histograms of the context (if any) instead of scanning the
+   // chunks (order 0 only)
+   public ANSRangeEncoder(OutputBitStream bs, int order, Map<String, Object> ctx)
+   {
+      this(bs, order, DEFAULT_ANS0_CHUNK_SIZE, DEFAULT_LOG_RANGE);
+
+      if (order == 0)
+         this.histograms = (Histograms) ctx.get("histograms");
+   }
+
+
    // The chunk size indicates how many bytes are encoded (per block) before
    // resetting the frequency stats.
    public ANSRangeEncoder(OutputBitStream bs, int order, int chunkSize, int logRange)
@@ -342,7 +356,11 @@ public class ANSRangeEncoder implements EntropyEncoder
    private int rebuildStatistics(byte[] block, int start, int end, int lr)
    {
       if (this.order == 0)
-         Global.computeHistogramOrder0(block, start, end, this.freqs[0], true);
+      {
+         if ((this.histograms == null) ||
+            (this.histograms.getHistogram(start, end, this.freqs[0], true) == false))
+            Global.computeHistogramOrder0(block, start, end, this.freqs[0], true);
+      }
       else
          Global.computeHistogramOrder1(block, start, end, this.freqs, true);
 
@@ -0,0 +1,221 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.entropy;
+
+import java.util.Arrays;
+import java.util.Map;
+import kanzi.Global;
+import kanzi.Predictor;
+
+
+// Lightweight context mixing predictor sitting between CM and TPAQ.
+// Orders 0 to 3 are modeled with direct 16 bit probability counters (no bit
+// history), mixed by a small neural network with 4 inputs and refined by one
+// SSE stage. The tables fit in a few MB to remain mostly cache resident.
+public class CMXPredictor implements Predictor
+{
+   private static final int HASH = 0x7FEB352D;
+   private static final int RATE0 = 5;
+   private static final int RATE1 = 4;
+   private static final int RATE2 = 4;
+   private static final int RATE3 = 3;
+   private static final int PSCALE = 65536;
+
+   private int pr;           // next predicted value (0-4095)
+   private int c0;           // bitwise context: last 0-7 bits with a leading 1 (1-255)
+   private int c4;           // last 4 whole bytes, last is in low 8 bits
+   private int ctx1;         // contexts
+   private int ctx2;
+   private int ctx3;
+   private int cp0;          // context pointers
+   private int cp1;
+   private int cp2;
+   private int cp3;
+   private final int mask;
+   private final char[] counters0; // order 0 probabilities (direct)
+   private final char[] counters1; // order 1 probabilities (direct)
+   private final char[] counters2; // order 2 probabilities (hashed)
+   private final char[] counters3; // order 3 probabilities (hashed)
+   private final Mixer[] mixers;
+   private Mixer mixer;            // current mixer
+   private final LogisticAdaptiveProbMap sse;
+
+
+   public CMXPredictor()
+   {
+      this(null);
+   }
+
+
+   public CMXPredictor(Map<String, Object> ctx)
+   {
+      int logSize = 20; // 2 MB per hashed table
+
+      if (ctx != null)
+      {
+         // Actual size of the current block
+         // Smaller tables for small blocks reduce allocation and cache misses
+         final int absz = (Integer) ctx.getOrDefault("size", 1<<20);
+
+         if (absz < 64*1024)
+            logSize = 16;
+         else if (absz < 1024*1024)
+            logSize = 18;
+      }
+
+      this.pr = 2048;
+      this.c0 = 1;
+      this.counters0 = new char[256];
+      this.counters1 = new char[1<<16];
+      this.counters2 = new char[1<<logSize];
+      this.counters3 = new char[1<<logSize];
+      this.mask = (1<<logSize) - 1;
+      Arrays.fill(this.counters0, (char) (PSCALE>>1));
+      Arrays.fill(this.counters1, (char) (PSCALE>>1));
+      Arrays.fill(this.counters2, (char) (PSCALE>>1));
+      Arrays.fill(this.counters3, (char) (PSCALE>>1));
+      this.mixers = new Mixer[256];
+
+      for (int i=0; i<this.mixers.length; i++)
+         this.mixers[i] = new Mixer();
+
+      this.mixer = this.mixers[1];
+      this.sse = new LogisticAdaptiveProbMap(256, 7);
+      this.cp0 = 1;
+      this.cp1 = 1;
+      this.cp2 = 1;
+      this.cp3 = 1;
+   }
+
+
+   // Update the probability model
+   @Override
+   public void update(int bit)
+   {
+      this.mixer.update(bit);
+
+      // Update counters (target is 0 or 65535)
+      final int target = (-bit) & 0xFFFF;
+      this.counters0[this.cp0] += ((target-this.counters0[this.cp0]) >> RATE0);
+      this.counters1[this.cp1] += ((target-this.counters1[this.cp1]) >> RATE1);
+      this.counters2[this.cp2] += ((target-this.counters2[this.cp2]) >> RATE2);
+      this.counters3[this.cp3] += ((target-this.counters3[this.cp3]) >> RATE3);
+      this.c0 = (this.c0<<1) | bit;
+
+      if (this.c0 > 255)
+      {
+         this.c4 = (this.c4<<8) | (this.c0&0xFF);
+         this.c0 = 1;
+
+         // Hashed contexts are aligned on 256 slots (one per partial byte)
+         this.ctx1 = (this.c4&0xFF) << 8;
+         this.ctx2 = (hash(this.c4&0xFFFF, 2) << 8) & this.mask;
+         this.ctx3 = (hash(this.c4&0x00FFFFFF, 3) << 8) & this.mask;
+      }
+
+      final int c = this.c0;
+      this.cp0 = c;
+      this.cp1 = this.ctx1 | c;
+      this.cp2 = this.ctx2 | c;
+      this.cp3 = this.ctx3 | c;
+      final int p0 = Global.STRETCH[this.counters0[this.cp0]>>>4];
+      final int p1 = Global.STRETCH[this.counters1[this.cp1]>>>4];
+      final int p2 = Global.STRETCH[this.counters2[this.cp2]>>>4];
+      final int p3 = Global.STRETCH[this.counters3[this.cp3]>>>4];
+
+      // Mix predictions using NN (one set of weights per partial byte)
+      this.mixer = this.mixers[c];
+      int p = this.mixer.get(p0, p1, p2, p3);
+
+      // SSE (Secondary Symbol Estimation)
+      p = (3*this.sse.get(bit, p, c) + p) >> 2;
+      this.pr = p + ((p-2048) >>> 31);
+   }
+
+
+   private static int hash(int x, int ctxId)
+   {
+      x = x*HASH + ctxId;
+      x ^= (x>>>15);
+      x *= 0x2C1B3C6D;
+      return x ^ (x>>>12);
+   }
+
+
+   // Return the split value representing the probability of 1 in the [0..4095] range.
+   @Override
+   public int get()
+   {
+      return this.pr;
+   }
+
+
+   // Mixer combines models using a neural network with 4 inputs.
+   static class Mixer
+   {
+      private static final int BEGIN_LEARN_RATE = 60 << 7;
+      private static final int END_LEARN_RATE = 14 << 7;
+
+      private int pr;  // squashed prediction
+      private int skew;
+      private int w0, w1, w2, w3;
+      private int p0, p1, p2, p3;
+      private int learnRate;
+
+
+      Mixer()
+      {
+         this.pr = 2048;
+         this.w0 = this.w1 = this.w2 = this.w3 = 32768;
+         this.learnRate = BEGIN_LEARN_RATE;
+      }
+
+
+      // Adjust weights to minimize coding cost of last prediction
+      void update(int bit)
+      {
+         final int err = (((bit<<12) - this.pr) * this.learnRate) >> 10;
+
+         if (err == 0)
+            return;
+
+         // Quickly decaying learn rate
+         this.learnRate += ((END_LEARN_RATE-this.learnRate)>>31);
+         this.skew += err;
+
+         // Train Neural Network: update weights
+         this.w0 += ((this.p0*err) >> 12);
+         this.w1 += ((this.p1*err) >> 12);
+         this.w2 += ((this.p2*err) >> 12);
+         this.w3 += ((this.p3*err) >> 12);
+      }
+
+
+      int get(int p0, int p1, int p2, int p3)
+      {
+         this.p0 = p0;
+         this.p1 = p1;
+         this.p2 = p2;
+         this.p3 = p3;
+
+         // Neural Network dot product (sum weights*inputs)
+         this.pr = Global.squash((this.w0*p0 + this.w1*p1 + this.w2*p2 + this.w3*p3 +
+                                  this.skew + 65536) >> 17);
+
+         return this.pr;
+      }
+   }
+}
@@ -0,0 +1,164 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.entropy;
+
+import java.io.ByteArrayInputStream;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import kanzi.BitStreamException;
+import kanzi.EntropyDecoder;
+import kanzi.InputBitStream;
+import kanzi.bitstream.DefaultInputBitStream;
+
+
+// Decoder for blocks produced by ChunkedEntropyEncoder. The table of chunk
+// sizes is read first, then the chunks are decoded concurrently (if several
+// jobs are available) from their own bitstreams.
+public class ChunkedEntropyDecoder implements EntropyDecoder
+{
+   // No supported codec expands a chunk that much
+   private static final int MAX_ENCODED_CHUNK_SIZE = 4 * ChunkedEntropyEncoder.CHUNK_SIZE;
+
+   private final InputBitStream bitstream;
+   private final int entropyType;
+   private final int jobs;
+   private final ExecutorService pool;
+
+
+   public ChunkedEntropyDecoder(InputBitStream bitstream, Map<String, Object> ctx, int entropyType)
+   {
+      if (bitstream == null)
+         throw new NullPointerException("Chunked codec: Invalid null bitstream parameter");
+
+      if (ChunkedEntropyEncoder.isSupported(entropyType) == false)
+         throw new IllegalArgumentException("Chunked codec: Unsupported entropy codec type: " + entropyType);
+
+      final int tasks = (Integer) ctx.getOrDefault("jobs", 1);
+      this.bitstream = bitstream;
+      this.entropyType = entropyType;
+      this.pool = (ExecutorService) ctx.get("pool");
+      this.jobs = (this.pool == null) ? 1 : Math.max(tasks, 1);
+   }
+
+
+   private static EntropyDecoder newDecoder(InputBitStream ibs, int entropyType)
+   {
+      switch (entropyType)
+      {
+         case EntropyCodecFactory.HUFFMAN_TYPE:
+            return new HuffmanDecoder(ibs);
+
+         case EntropyCodecFactory.ANS0_TYPE:
+            return new ANSRangeDecoder(ibs, 0);
+
+         case EntropyCodecFactory.ANS1_TYPE:
+            return new ANSRangeDecoder(ibs, 1);
+
+         case EntropyCodecFactory.RANGE_TYPE:
+            return new RangeDecoder(ibs);
+
+         default:
+            throw new IllegalArgumentException("Chunked codec: Unsupported entropy codec type: " + entropyType);
+      }
+   }
+
+
+   @Override
+   public int decode(byte[] block, int blkptr, int count)
+   {
+      if ((block == null) || (blkptr+count > block.length) || (blkptr < 0) || (count < 0))
+         return -1;
+
+      if (count == 0)
+         return 0;
+
+      final int nbChunks = ChunkedEntropyEncoder.getNbChunks(count);
+
+      if (nbChunks == 1)
+      {
+         EntropyDecoder ed = newDecoder(this.bitstream, this.entropyType);
+         final int res = ed.decode(block, blkptr, count);
+         ed.dispose();
+         return res;
+      }
+
+      final int[] sizes = new int[nbChunks];
+
+      for (int i=0; i<nbChunks; i++)
+      {
+         sizes[i] = (int) this.bitstream.readBits(32);
+
+         if ((sizes[i] <= 0) || (sizes[i] > MAX_ENCODED_CHUNK_SIZE))
+         {
+            throw new BitStreamException("Invalid bitstream: incorrect chunk size " + sizes[i],
+               BitStreamException.INVALID_STREAM);
+         }
+      }
+
+      final byte[][] chunks = new byte[nbChunks][];
+
+      for (int i=0; i<nbChunks; i++)
+      {
+         chunks[i] = new byte[sizes[i]];
+         this.bitstream.readBits(chunks[i], 0, 8*sizes[i]);
+      }
+
+      final List<Callable<Integer>> tasks = new ArrayList<>(nbChunks);
+      final int chunkSize = ChunkedEntropyEncoder.CHUNK_SIZE;
+
+      for (int i=0; i<nbChunks; i++)
+      {
+         final int start = blkptr + i*chunkSize;
+         final int length = Math.min(count-i*chunkSize, chunkSize);
+         final byte[] chunk = chunks[i];
+
+         tasks.add(new Callable<Integer>()
+         {
+            @Override
+            public Integer call() throws Exception
+            {
+               DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(chunk), 16384);
+               EntropyDecoder ed = newDecoder(ibs, ChunkedEntropyDecoder.this.entropyType);
+               final int res = ed.decode(block, start, length);
+               ed.dispose();
+               ibs.close();
+               return (res == length) ? res : -1;
+            }
+         });
+      }
+
+      if (ChunkedEntropyEncoder.runTasks(tasks, this.jobs, this.pool) == false)
+         return -1;
+
+      return count;
+   }
+
+
+   @Override
+   public InputBitStream getBitStream()
+   {
+      return this.bitstream;
+   }
+
+
+   @Override
+   public void dispose()
+   {
+   }
+}
@@ -0,0 +1,217 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.entropy;
+
+import java.io.ByteArrayOutputStream;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Future;
+import kanzi.EntropyEncoder;
+import kanzi.OutputBitStream;
+import kanzi.bitstream.DefaultOutputBitStream;
+
+
+// Split the block in chunks of CHUNK_SIZE bytes encoded independently (in
+// parallel if several jobs are available). The encoded block starts with a
+// table of the chunk sizes in bytes, so that a decoder can locate every chunk
+// upfront: decode them concurrently or skip some of them.
+// Only for the codecs resetting their statistics at chunk boundaries (Huffman,
+// ANS, Range). CHUNK_SIZE is a multiple of their chunk sizes, so the cost is
+// limited to the table and the byte alignment of each chunk.
+public class ChunkedEntropyEncoder implements EntropyEncoder
+{
+   public static final int CHUNK_SIZE = 1 << 18;
+
+   private final OutputBitStream bitstream;
+   private final int entropyType;
+   private final Map<String, Object> ctx;
+   private final int jobs;
+   private final ExecutorService pool;
+
+
+   public ChunkedEntropyEncoder(OutputBitStream bitstream, Map<String, Object> ctx, int entropyType)
+   {
+      if (bitstream == null)
+         throw new NullPointerException("Chunked codec: Invalid null bitstream parameter");
+
+      if (isSupported(entropyType) == false)
+         throw new IllegalArgumentException("Chunked codec: Unsupported entropy codec type: " + entropyType);
+
+      final int tasks = (Integer) ctx.getOrDefault("jobs", 1);
+      this.bitstream = bitstream;
+      this.entropyType = entropyType;
+      this.ctx = ctx;
+      this.pool = (ExecutorService) ctx.get("pool");
+      this.jobs = (this.pool == null) ? 1 : Math.max(tasks, 1);
+   }
+
+
+   public static boolean isSupported(int entropyType)
+   {
+      switch (entropyType)
+      {
+         case EntropyCodecFactory.HUFFMAN_TYPE:
+         case EntropyCodecFactory.ANS0_TYPE:
+         case EntropyCodecFactory.ANS1_TYPE:
+         case EntropyCodecFactory.RANGE_TYPE:
+            return true;
+
+         default:
+            return false;
+      }
+   }
+
+
+   // No chunk table if the block fits in one chunk
+   static int getNbChunks(int count)
+   {
+      return (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+   }
+
+
+   // The chunks are encoded in place: the histograms of the context (if any)
+   // remain valid
+   private static EntropyEncoder newEncoder(OutputBitStream obs, Map<String, Object> ctx, int entropyType)
+   {
+      switch (entropyType)
+      {
+         case EntropyCodecFactory.HUFFMAN_TYPE:
+            return new HuffmanEncoder(obs, ctx);
+
+         case EntropyCodecFactory.ANS0_TYPE:
+            return new ANSRangeEncoder(obs, 0, ctx);
+
+         case EntropyCodecFactory.ANS1_TYPE:
+            return new ANSRangeEncoder(obs, 1);
+
+         case EntropyCodecFactory.RANGE_TYPE:
+            return new RangeEncoder(obs, ctx);
+
+         default:
+            throw new IllegalArgumentException("Chunked codec: Unsupported entropy codec type: " + entropyType);
+      }
+   }
+
+
+   // Run the tasks concurrently if several jobs are available
+   static boolean runTasks(List<Callable<Integer>> tasks, int jobs, ExecutorService pool)
+   {
+      try
+      {
+         if ((jobs == 1) || (pool == null))
+         {
+            for (Callable<Integer> task : tasks)
+            {
+               if (task.call() < 0)
+                  return false;
+            }
+         }
+         else
+         {
+            // Wait for completion of all concurrent tasks
+            for (Future<Integer> result : pool.invokeAll(tasks))
+            {
+               if (result.get() < 0)
+                  return false;
+            }
+         }
+      }
+      catch (Exception e)
+      {
+         return false;
+      }
+
+      return true;
+   }
+
+
+   @Override
+   public int encode(byte[] block, int blkptr, int count)
+   {
+      if ((block == null) || (blkptr+count > block.length) || (blkptr < 0) || (count < 0))
+         return -1;
+
+      if (count == 0)
+         return 0;
+
+      final int nbChunks = getNbChunks(count);
+
+      if (nbChunks == 1)
+      {
+         EntropyEncoder ee = newEncoder(this.bitstream, this.ctx, this.entropyType);
+         final int res = ee.encode(block, blkptr, count);
+         ee.dispose();
+         return res;
+      }
+
+      final byte[][] chunks = new byte[nbChunks][];
+      final List<Callable<Integer>> tasks = new ArrayList<>(nbChunks);
+
+      for (int i=0; i<nbChunks; i++)
+      {
+         final int start = blkptr + i*CHUNK_SIZE;
+         final int length = Math.min(count-i*CHUNK_SIZE, CHUNK_SIZE);
+         final int idx = i;
+
+         tasks.add(new Callable<Integer>()
+         {
+            @Override
+            public Integer call() throws Exception
+            {
+               ByteArrayOutputStream baos = new ByteArrayOutputStream(length+(length>>3));
+               DefaultOutputBitStream obs = new DefaultOutputBitStream(baos, 16384);
+               EntropyEncoder ee = newEncoder(obs, ChunkedEntropyEncoder.this.ctx, ChunkedEntropyEncoder.this.entropyType);
+
+               if (ee.encode(block, start, length) != length)
+                  return -1;
+
+               ee.dispose();
+               obs.close();
+               chunks[idx] = baos.toByteArray();
+               return chunks[idx].length;
+            }
+         });
+      }
+
+      if (runTasks(tasks, this.jobs, this.pool) == false)
+         return -1;
+
+      // Table of chunk sizes, then chunk data (byte aligned)
+      for (int i=0; i<nbChunks; i++)
+         this.bitstream.writeBits(chunks[i].length, 32);
+
+      for (int i=0; i<nbChunks; i++)
+         this.bitstream.writeBits(chunks[i], 0, 8*chunks[i].length);
+
+      return count;
+   }
+
+
+   @Override
+   public OutputBitStream getBitStream()
+   {
+      return this.bitstream;
+   }
+
+
+   @Override
+   public void dispose()
+   {
+   }
+}
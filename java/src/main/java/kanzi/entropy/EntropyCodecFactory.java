@@ -34,6 +34,7 @@ public class EntropyCodecFactory
    public static final byte TPAQ_TYPE    = 7; // Tangelo PAQ
    public static final byte ANS1_TYPE    = 8; // Asymmetric Numerical System order 1
    public static final byte TPAQX_TYPE   = 9; // Tangelo PAQ Extra
+   public static final byte CMX_TYPE     = 10; // Context Model Extra (orders 0 to 3)
 
 
    public EntropyDecoder newDecoder(InputBitStream ibs, Map<String, Object> ctx, int entropyType)
@@ -41,6 +42,13 @@ public class EntropyCodecFactory
       if (ibs == null)
          throw new NullPointerException("Invalid null input bitstream parameter");
 
+      // Blocks starting with a table of chunk sizes
+      if ((Boolean) ctx.getOrDefault("chunkTable", false) == true)
+      {
+         if (ChunkedEntropyEncoder.isSupported(entropyType) == true)
+            return new ChunkedEntropyDecoder(ibs, ctx, entropyType);
+      }
+
       switch (entropyType)
       {
          // Each block is decoded separately
@@ -63,6 +71,9 @@ public class EntropyCodecFactory
          case CM_TYPE:
             return new BinaryEntropyDecoder(ibs, new CMPredictor());
 
+         case CMX_TYPE:
+            return new BinaryEntropyDecoder(ibs, new CMXPredictor(ctx));
+
          case TPAQ_TYPE:
             return new BinaryEntropyDecoder(ibs, new TPAQPredictor(ctx));
 
@@ -83,19 +94,26 @@ public class EntropyCodecFactory
       if (obs == null)
          throw new NullPointerException("Invalid null output bitstream parameter");
 
+      // Blocks starting with a table of chunk sizes
+      if ((Boolean) ctx.getOrDefault("chunkTable", false) == true)
+      {
+         if (ChunkedEntropyEncoder.isSupported(entropyType) == true)
+            return new ChunkedEntropyEncoder(obs, ctx, entropyType);
+      }
+
       switch (entropyType)
       {
          case HUFFMAN_TYPE:
-            return new HuffmanEncoder(obs);
+            return new HuffmanEncoder(obs, ctx);
 
          case ANS0_TYPE:
-            return new ANSRangeEncoder(obs, 0);
+            return new ANSRangeEncoder(obs, 0, ctx);
 
          case ANS1_TYPE:
             return new ANSRangeEncoder(obs, 1);
 
          case RANGE_TYPE:
-            return new RangeEncoder(obs);
+            return new RangeEncoder(obs, ctx);
 
          case FPAQ_TYPE:
             return new FPAQEncoder(obs);
@@ -103,6 +121,9 @@ public class EntropyCodecFactory
          case CM_TYPE:
             return new BinaryEntropyEncoder(obs, new CMPredictor());
 
+         case CMX_TYPE:
+            return new BinaryEntropyEncoder(obs, new CMXPredictor(ctx));
+
          case TPAQ_TYPE:
             return new BinaryEntropyEncoder(obs, new TPAQPredictor(ctx));
 
@@ -140,6 +161,9 @@ public class EntropyCodecFactory
          case CM_TYPE:
             return "CM";
 
+         case CMX_TYPE:
+            return "CMX";
+
          case TPAQ_TYPE:
             return "TPAQ";
 
@@ -180,6 +204,9 @@ public class EntropyCodecFactory
          case "CM":
              return CM_TYPE;
 
+         case "CMX":
+             return CMX_TYPE;
+
          case "NONE":
              return NONE_TYPE;
 
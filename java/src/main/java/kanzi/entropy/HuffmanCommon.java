@@ -20,6 +20,9 @@ public final class HuffmanCommon
    public static final int LOG_MAX_CHUNK_SIZE = 14;
    public static final int MAX_CHUNK_SIZE = 1<<LOG_MAX_CHUNK_SIZE;
    public static final int MAX_SYMBOL_SIZE = LOG_MAX_CHUNK_SIZE;
+   // Default max code length of the encoder: the decoder can use a smaller table
+   // (L1 resident) and decode 5 symbols per 64 bit read
+   public static final int LIMITED_SYMBOL_SIZE = 12;
    private static final int BUFFER_SIZE = (MAX_SYMBOL_SIZE<<8) + 256;
 
 
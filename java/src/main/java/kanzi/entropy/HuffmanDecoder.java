@@ -25,6 +25,7 @@ public class HuffmanDecoder implements EntropyDecoder
 {
    private static final int DECODING_BATCH_SIZE = 14; // ensures decoding table fits in L1 cache
    private static final int TABLE_MASK = (1<<DECODING_BATCH_SIZE) - 1;
+   private static final int FAST_BATCH_SIZE = HuffmanCommon.LIMITED_SYMBOL_SIZE;
 
    private final InputBitStream bs;
    private final int[] codes;
@@ -32,6 +33,8 @@ public class HuffmanDecoder implements EntropyDecoder
    private final short[] sizes;
    private final short[] table; // decoding table: code -> size, symbol
    private final int chunkSize;
+   private int tableBits; // number of bits indexing the decoding table
+   private int tableMask;
    private long state; // holds bits read from bitstream
    private int bits; // holds number of unused bits in 'state'
 
@@ -61,6 +64,8 @@ public class HuffmanDecoder implements EntropyDecoder
       this.codes = new int[256];
       this.table = new short[TABLE_MASK+1];
       this.chunkSize = chunkSize;
+      this.tableBits = DECODING_BATCH_SIZE;
+      this.tableMask = TABLE_MASK;
 
       // Default lengths & canonical codes
       for (int i=0; i<256; i++)
@@ -119,9 +124,22 @@ public class HuffmanDecoder implements EntropyDecoder
 
 
    // max(CodeLen) must be <= MAX_SYMBOL_SIZE
+   // If max(CodeLen) <= LIMITED_SYMBOL_SIZE (default for the encoder), use a
+   // smaller table and decode 5 symbols per 64 bit read.
    private void buildDecodingTables(int count)
    {
-      for (int i=0; i<this.table.length; i++)
+      int maxLen = 0;
+
+      for (int i=0; i<count; i++)
+      {
+         if (this.sizes[this.alphabet[i]] > maxLen)
+            maxLen = this.sizes[this.alphabet[i]];
+      }
+
+      this.tableBits = (maxLen <= FAST_BATCH_SIZE) ? FAST_BATCH_SIZE : DECODING_BATCH_SIZE;
+      this.tableMask = (1<<this.tableBits) - 1;
+
+      for (int i=0; i<=this.tableMask; i++)
          this.table[i] = 0;
 
       int length = 0;
@@ -137,10 +155,10 @@ public class HuffmanDecoder implements EntropyDecoder
          final short val = (short) ((this.sizes[s]<<8) | s);
          final int code = this.codes[s];
 
-         // All DECODING_BATCH_SIZE bit values read from the bit stream and
+         // All 'tableBits' bit values read from the bit stream and
          // starting with the same prefix point to symbol s
-         int idx = code << (DECODING_BATCH_SIZE-length);
-         final int end = (code+1) << (DECODING_BATCH_SIZE-length);
+         int idx = code << (this.tableBits-length);
+         final int end = (code+1) << (this.tableBits-length);
 
          while (idx < end)
             this.table[idx++] = val;
@@ -187,19 +205,39 @@ public class HuffmanDecoder implements EntropyDecoder
          if (minCodeLen * padding != 64)
             padding++;
 
-         final int endChunk4 = startChunk + Math.max(((endChunk-startChunk-padding)&-4), 0);
+         int endFast;
 
-         for (int i=startChunk; i<endChunk4; i+=4)
+         if (this.tableBits == FAST_BATCH_SIZE)
+         {
+            // Length limited codes: 5*12 bits fit in one 64 bit read
+            endFast = startChunk + Math.max(((endChunk-startChunk-padding)/5)*5, 0);
+
+            for (int i=startChunk; i<endFast; i+=5)
+            {
+               this.fetchBits();
+               block[i]   = this.decodeByte();
+               block[i+1] = this.decodeByte();
+               block[i+2] = this.decodeByte();
+               block[i+3] = this.decodeByte();
+               block[i+4] = this.decodeByte();
+            }
+         }
+         else
          {
-            this.fetchBits();
-            block[i]   = this.decodeByte();
-            block[i+1] = this.decodeByte();
-            block[i+2] = this.decodeByte();
-            block[i+3] = this.decodeByte();
+            endFast = startChunk + Math.max(((endChunk-startChunk-padding)&-4), 0);
+
+            for (int i=startChunk; i<endFast; i+=4)
+            {
+               this.fetchBits();
+               block[i]   = this.decodeByte();
+               block[i+1] = this.decodeByte();
+               block[i+2] = this.decodeByte();
+               block[i+3] = this.decodeByte();
+            }
          }
 
          // Fallback to regular decoding
-         for (int i=endChunk4; i<endChunk; i++)
+         for (int i=endFast; i<endChunk; i++)
             block[i] = this.slowDecodeByte();
 
          startChunk = endChunk;
@@ -214,7 +252,7 @@ public class HuffmanDecoder implements EntropyDecoder
       int code = 0;
       int codeLen = 0;
 
-      while (codeLen < HuffmanCommon.MAX_SYMBOL_SIZE)
+      while (codeLen < this.tableBits)
       {
          codeLen++;
          code <<= 1;
@@ -229,7 +267,7 @@ public class HuffmanDecoder implements EntropyDecoder
             code |= ((this.state >>> this.bits) & 1);
          }
 
-         final int idx = code << (DECODING_BATCH_SIZE-codeLen);
+         final int idx = code << (this.tableBits-codeLen);
 
          if ((this.table[idx] >>> 8) == codeLen)
             return (byte) this.table[idx];
@@ -250,8 +288,8 @@ public class HuffmanDecoder implements EntropyDecoder
 
    private byte decodeByte()
    {
-      final int idx = (int) (this.state >>> (this.bits-DECODING_BATCH_SIZE));
-      final int val = this.table[idx&TABLE_MASK];
+      final int idx = (int) (this.state >>> (this.bits-this.tableBits));
+      final int val = this.table[idx&this.tableMask];
       this.bits -= (val >>> 8);
       return (byte) val;
    }
@@ -16,10 +16,12 @@ limitations under the License.
 package kanzi.entropy;
 
 import java.util.Arrays;
+import java.util.Map;
 import kanzi.OutputBitStream;
 import kanzi.BitStreamException;
 import kanzi.EntropyEncoder;
 import kanzi.Global;
+import kanzi.Histograms;
 
 
 // Implementation of a static Huffman encoder.
@@ -34,7 +36,9 @@ public class HuffmanEncoder implements EntropyEncoder
    private final int[] buffer;  // temporary data
    private final short[] sizes;
    private final int chunkSize;
+   private final int maxSymbolSize; // max code length
    private int maxCodeLen;
+   private Histograms histograms; // recorded by the last transform (optional)
 
 
    public HuffmanEncoder(OutputBitStream bitstream) throws BitStreamException
@@ -43,9 +47,25 @@ public class HuffmanEncoder implements EntropyEncoder
    }
 
 
+   // Use the histograms of the context (if any) instead of scanning the chunks
+   public HuffmanEncoder(OutputBitStream bitstream, Map<String, Object> ctx) throws BitStreamException
+   {
+      this(bitstream, HuffmanCommon.MAX_CHUNK_SIZE);
+      this.histograms = (Histograms) ctx.get("histograms");
+   }
+
+
     // The chunk size indicates how many bytes are encoded (per block) before
     // resetting the frequency stats.
    public HuffmanEncoder(OutputBitStream bitstream, int chunkSize) throws BitStreamException
+   {
+      this(bitstream, chunkSize, HuffmanCommon.LIMITED_SYMBOL_SIZE);
+   }
+
+
+   // The code lengths are limited to maxSymbolSize bits. Shorter limits make
+   // decoding faster at a small cost in compression.
+   public HuffmanEncoder(OutputBitStream bitstream, int chunkSize, int maxSymbolSize) throws BitStreamException
    {
       if (bitstream == null)
          throw new NullPointerException("Huffman codec: Invalid null bitstream parameter");
@@ -56,7 +76,12 @@ public class HuffmanEncoder implements EntropyEncoder
       if (chunkSize > HuffmanCommon.MAX_CHUNK_SIZE)
          throw new IllegalArgumentException("Huffman codec: The chunk size must be at most "+HuffmanCommon.MAX_CHUNK_SIZE);
 
+      if ((maxSymbolSize < 8) || (maxSymbolSize > HuffmanCommon.MAX_SYMBOL_SIZE))
+         throw new IllegalArgumentException("Huffman codec: The max code length must be in [8.."+
+            HuffmanCommon.MAX_SYMBOL_SIZE+"]");
+
       this.bs = bitstream;
+      this.maxSymbolSize = maxSymbolSize;
       this.freqs = new int[256];
       this.sizes = new short[256];
       this.alphabet = new int[256];
@@ -93,46 +118,13 @@ public class HuffmanEncoder implements EntropyEncoder
       }
 
       EntropyUtils.encodeAlphabet(this.bs, this.alphabet, count);
-      int retries = 0;
-
-      while (true)
-      {
-         this.computeCodeLengths(frequencies, count);
-
-         if (this.maxCodeLen <= HuffmanCommon.MAX_SYMBOL_SIZE)
-         {
-            // Usual case
-            HuffmanCommon.generateCanonicalCodes(this.sizes, this.codes, this.sranks, count);
-            break;
-         }
-
-         // Rare: some codes exceed the budget for the max code length => normalize
-         // frequencies (it boosts the smallest frequencies) and try once more.
-         if (retries > 2)
-            throw new IllegalArgumentException("Could not generate Huffman codes: max code length (" +
-               HuffmanCommon.MAX_SYMBOL_SIZE + " bits) exceeded");
+      this.computeCodeLengths(frequencies, count);
 
-         int[] f = new int[count];
-         int totalFreq = 0;
+      // The decoder infers the max code length from the transmitted lengths
+      if (this.maxCodeLen > this.maxSymbolSize)
+         this.limitCodeLengths(count);
 
-         for (int i=0; i<count; i++)
-         {
-            f[i] = frequencies[this.alphabet[i]];
-            totalFreq += f[i];
-         }
-
-         // Copy alphabet (modified by normalizeFrequencies)
-         int[] symbols = new int[count];
-         System.arraycopy(this.alphabet, 0, symbols, 0, count);
-         retries++;
-
-         // Normalize to a smaller scale
-         EntropyUtils.normalizeFrequencies(f, symbols, totalFreq,
-              HuffmanCommon.MAX_CHUNK_SIZE>>(2*retries));
-
-         for (int i=0; i<count; i++)
-            frequencies[this.alphabet[i]] = f[i];
-      }
+      HuffmanCommon.generateCanonicalCodes(this.sizes, this.codes, this.sranks, count);
 
       // Transmit code lengths only, frequencies and codes do not matter
       ExpGolombEncoder egenc = new ExpGolombEncoder(this.bs, true);
@@ -196,6 +188,57 @@ public class HuffmanEncoder implements EntropyEncoder
    }
 
 
+   // Limit the code lengths to maxSymbolSize bits. The lengths above the limit
+   // are clamped, then the Kraft inequality is restored by moving codes just
+   // below the limit one level down (as in zlib/miniz). The lengths are then
+   // reassigned by decreasing frequency. Expects the sorted ranks and code
+   // lengths computed by computeCodeLengths.
+   private void limitCodeLengths(int count)
+   {
+      final int limit = this.maxSymbolSize;
+      final int[] nbCodes = new int[limit+2];
+      int total = 0;
+
+      for (int i=0; i<count; i++)
+         nbCodes[Math.min(this.buffer[i], limit)]++;
+
+      for (int len=1; len<=limit; len++)
+         total += (nbCodes[len] << (limit-len));
+
+      while (total > (1<<limit))
+      {
+         // Remove one code of max length and split a shorter code in two
+         nbCodes[limit]--;
+
+         for (int len=limit-1; len>0; len--)
+         {
+            if (nbCodes[len] != 0)
+            {
+               nbCodes[len]--;
+               nbCodes[len+1] += 2;
+               break;
+            }
+         }
+
+         total--;
+      }
+
+      // The most frequent symbols (end of sranks) get the shortest codes
+      int len = 1;
+
+      for (int i=count-1; i>=0; i--)
+      {
+         while (nbCodes[len] == 0)
+            len++;
+
+         nbCodes[len]--;
+         this.sizes[this.sranks[i]] = (short) len;
+      }
+
+      this.maxCodeLen = len;
+   }
+
+
    static void computeInPlaceSizesPhase1(int[] data, int n)
    {
       for (int s=0, r=0, t=0; t<n-1; t++)
@@ -269,7 +312,9 @@ public class HuffmanEncoder implements EntropyEncoder
       {
          // Update frequencies and rebuild Huffman codes
          final int endChunk = (startChunk+this.chunkSize < end) ? startChunk+this.chunkSize : end;
-         Global.computeHistogramOrder0(block, startChunk, endChunk, this.freqs, false);
+         if ((this.histograms == null) ||
+            (this.histograms.getHistogram(startChunk, endChunk, this.freqs, false) == false))
+            Global.computeHistogramOrder0(block, startChunk, endChunk, this.freqs, false);
 
          if (this.updateFrequencies(this.freqs) <= 1)
          {
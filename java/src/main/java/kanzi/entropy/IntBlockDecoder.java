@@ -0,0 +1,204 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.entropy;
+
+import kanzi.BitStreamException;
+import kanzi.InputBitStream;
+import kanzi.Memory;
+
+
+// Decoder for the blocks of ints produced by IntBlockEncoder
+public final class IntBlockDecoder
+{
+   private final InputBitStream bitstream;
+   private byte[] buffer;
+
+
+   public IntBlockDecoder(InputBitStream bitstream)
+   {
+      if (bitstream == null)
+         throw new NullPointerException("Int block codec: Invalid null bitstream parameter");
+
+      this.bitstream = bitstream;
+      this.buffer = new byte[0];
+   }
+
+
+   // Decode 'count' ints. Return the number of ints decoded or -1 if the
+   // parameters are invalid.
+   public int decode(int[] block, int blkptr, int count)
+   {
+      if ((block == null) || (blkptr < 0) || (count < 0) || (blkptr+count > block.length))
+         return -1;
+
+      if (count == 0)
+         return 0;
+
+      final int mode = (int) this.bitstream.readBits(2);
+      final int bits = (int) this.bitstream.readBits(6);
+
+      if (bits > 32)
+         throw new BitStreamException("Invalid bit width in int block: "+bits,
+            BitStreamException.INVALID_STREAM);
+
+      final int end = blkptr + count;
+
+      switch (mode)
+      {
+         case IntBlockEncoder.MODE_RICE:
+            final int k = (int) this.bitstream.readBits(6);
+
+            if ((k > bits) || (k > 31))
+               throw new BitStreamException("Invalid Rice parameter in int block: "+k,
+                  BitStreamException.INVALID_STREAM);
+
+            this.decodeRice(block, blkptr, end, k, bits);
+            break;
+
+         case IntBlockEncoder.MODE_EXPGOLOMB:
+            this.decodeExpGolomb(block, blkptr, end);
+            break;
+
+         case IntBlockEncoder.MODE_ANS:
+            this.decodeANS(block, blkptr, count, bits);
+            break;
+
+         default:
+            this.decodePacked(block, blkptr, count, bits);
+      }
+
+      return count;
+   }
+
+
+   private void decodeRice(int[] block, int start, int end, int k, int bits)
+   {
+      final InputBitStream bs = this.bitstream;
+
+      for (int i=start; i<end; i++)
+      {
+         int q = 0;
+
+         while ((q < IntBlockEncoder.RICE_LIMIT) && (bs.readBit() == 1))
+            q++;
+
+         if (q == IntBlockEncoder.RICE_LIMIT)
+            block[i] = (bits == 0) ? 0 : (int) bs.readBits(bits);
+         else
+            block[i] = (k == 0) ? q : (int) ((((long) q) << k) | bs.readBits(k));
+      }
+   }
+
+
+   private void decodeExpGolomb(int[] block, int start, int end)
+   {
+      final InputBitStream bs = this.bitstream;
+
+      for (int i=start; i<end; i++)
+      {
+         int zeros = 0;
+
+         while (bs.readBit() == 0)
+         {
+            if (++zeros > 32)
+               throw new BitStreamException("Invalid Exp-Golomb code in int block",
+                  BitStreamException.INVALID_STREAM);
+         }
+
+         final long u = (zeros == 0) ? 1 : (1L<<zeros) | bs.readBits(zeros);
+         block[i] = (int) (u-1);
+      }
+   }
+
+
+   private void decodeANS(int[] block, int blkptr, int count, int bits)
+   {
+      final byte[] buf = this.getBuffer(count);
+      final int end = blkptr + count;
+
+      for (int i=blkptr; i<end; i++)
+         block[i] = 0;
+
+      for (int shift=0; shift<bits; shift+=8)
+      {
+         ANSRangeDecoder ed = new ANSRangeDecoder(this.bitstream, 0);
+
+         if (ed.decode(buf, 0, count) != count)
+            throw new BitStreamException("Invalid ANS plane in int block",
+               BitStreamException.INVALID_STREAM);
+
+         ed.dispose();
+
+         for (int i=0; i<count; i++)
+            block[blkptr+i] |= ((buf[i]&0xFF) << shift);
+      }
+   }
+
+
+   // Unpack values of 'bits' bits each from 64 bit words
+   private void decodePacked(int[] block, int blkptr, int count, int bits)
+   {
+      final int end = blkptr + count;
+
+      if (bits == 0)
+      {
+         for (int i=blkptr; i<end; i++)
+            block[i] = 0;
+
+         return;
+      }
+
+      final long totalBits = (long) count * bits;
+      final byte[] buf = this.getBuffer((int) (((totalBits+63)>>>6)<<3));
+      this.bitstream.readBits(buf, 0, (int) totalBits);
+      final long mask = (1L<<bits) - 1;
+      long acc = Memory.BigEndian.readLong64(buf, 0);
+      int avail = 64;
+      int n = 8;
+
+      for (int i=blkptr; i<end; i++)
+      {
+         if (bits <= avail)
+         {
+            avail -= bits;
+            block[i] = (int) ((acc >>> avail) & mask);
+            continue;
+         }
+
+         final int r = bits - avail;
+         final long hi = acc & ((1L<<avail)-1);
+         acc = Memory.BigEndian.readLong64(buf, n);
+         n += 8;
+         avail = 64 - r;
+         block[i] = (int) ((hi << r) | (acc >>> avail));
+      }
+   }
+
+
+   private byte[] getBuffer(int size)
+   {
+      if (this.buffer.length < size)
+         this.buffer = new byte[size];
+
+      return this.buffer;
+   }
+
+
+   public InputBitStream getBitStream()
+   {
+      return this.bitstream;
+   }
+}
@@ -0,0 +1,296 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.entropy;
+
+import kanzi.Global;
+import kanzi.Memory;
+import kanzi.OutputBitStream;
+
+
+// Entropy coder for blocks of unsigned ints (typically the output of the int
+// transforms). The coding mode is selected per block from the estimated cost:
+// - PACK: all values bit packed with the bit width of the largest value
+// - RICE: Rice-Golomb codes with the best parameter (escape for outliers)
+// - EXPGOLOMB: order 0 Exp-Golomb codes (for skewed distributions)
+// - ANS: each byte plane of the values coded with an order 0 ANS codec
+// Block header: mode (2 bits) + bit width of the largest value (6 bits).
+public final class IntBlockEncoder
+{
+   public static final int MODE_PACK      = 0;
+   public static final int MODE_RICE      = 1;
+   public static final int MODE_EXPGOLOMB = 2;
+   public static final int MODE_ANS       = 3;
+   static final int RICE_LIMIT = 24; // max quotient coded in unary
+   private static final int MIN_ANS_BLOCK_SIZE = 1024;
+   private static final int ANS_PLANE_OVERHEAD = 2048; // estimated header bits per plane
+
+   private final OutputBitStream bitstream;
+   private byte[] buffer;
+
+
+   public IntBlockEncoder(OutputBitStream bitstream)
+   {
+      if (bitstream == null)
+         throw new NullPointerException("Int block codec: Invalid null bitstream parameter");
+
+      this.bitstream = bitstream;
+      this.buffer = new byte[0];
+   }
+
+
+   // Encode 'count' ints (processed as unsigned values). Return the number of
+   // ints encoded or -1 if the parameters are invalid.
+   public int encode(int[] block, int blkptr, int count)
+   {
+      if ((block == null) || (blkptr < 0) || (count < 0) || (blkptr+count > block.length))
+         return -1;
+
+      if (count == 0)
+         return 0;
+
+      final int end = blkptr + count;
+      int or = 0;
+      long sum = 0;
+
+      for (int i=blkptr; i<end; i++)
+      {
+         or |= block[i];
+         sum += (block[i] & 0xFFFFFFFFL);
+      }
+
+      final int bits = 32 - Integer.numberOfLeadingZeros(or);
+      int mode = MODE_PACK;
+      int param = 0;
+
+      if (bits > 0)
+      {
+         long bestCost = (long) count * bits;
+
+         // Rice: try the parameters around log2(mean)
+         final long mean = sum / count;
+         final int k0 = (mean == 0) ? 0 : 63 - Long.numberOfLeadingZeros(mean);
+
+         for (int k=Math.max(k0-1, 0); k<=Math.min(k0+1, Math.min(bits, 31)); k++)
+         {
+            final long cost = riceCost(block, blkptr, end, k, bits);
+
+            if (cost < bestCost)
+            {
+               bestCost = cost;
+               mode = MODE_RICE;
+               param = k;
+            }
+         }
+
+         final long egCost = expGolombCost(block, blkptr, end);
+
+         if (egCost < bestCost)
+         {
+            bestCost = egCost;
+            mode = MODE_EXPGOLOMB;
+         }
+
+         if ((count >= MIN_ANS_BLOCK_SIZE) && (this.ansCost(block, blkptr, count, bits) < bestCost))
+            mode = MODE_ANS;
+      }
+
+      this.bitstream.writeBits(mode, 2);
+      this.bitstream.writeBits(bits, 6);
+
+      switch (mode)
+      {
+         case MODE_RICE:
+            this.bitstream.writeBits(param, 6);
+            this.encodeRice(block, blkptr, end, param, bits);
+            break;
+
+         case MODE_EXPGOLOMB:
+            this.encodeExpGolomb(block, blkptr, end);
+            break;
+
+         case MODE_ANS:
+            this.encodeANS(block, blkptr, count, bits);
+            break;
+
+         default:
+            this.encodePacked(block, blkptr, count, bits);
+      }
+
+      return count;
+   }
+
+
+   private static long riceCost(int[] block, int start, int end, int k, int bits)
+   {
+      long cost = 0;
+
+      for (int i=start; i<end; i++)
+      {
+         final int q = block[i] >>> k;
+         cost += (q < RICE_LIMIT) ? q+1+k : RICE_LIMIT+bits;
+      }
+
+      return cost;
+   }
+
+
+   private static long expGolombCost(int[] block, int start, int end)
+   {
+      long cost = 0;
+
+      for (int i=start; i<end; i++)
+      {
+         final long u = (block[i] & 0xFFFFFFFFL) + 1;
+         cost += 2*(64-Long.numberOfLeadingZeros(u)) - 1;
+      }
+
+      return cost;
+   }
+
+
+   // Estimate the size of the byte planes after order 0 entropy coding
+   private long ansCost(int[] block, int blkptr, int count, int bits)
+   {
+      final byte[] buf = this.getBuffer(count);
+      final int[] histo = new int[256];
+      long cost = 0;
+
+      for (int shift=0; shift<bits; shift+=8)
+      {
+         for (int i=0; i<count; i++)
+            buf[i] = (byte) (block[blkptr+i] >>> shift);
+
+         Global.computeHistogramOrder0(buf, 0, count, histo, false);
+         cost += (((long) count * Global.computeFirstOrderEntropy1024(count, histo)) >> 7);
+         cost += ANS_PLANE_OVERHEAD;
+      }
+
+      return cost;
+   }
+
+
+   private void encodeRice(int[] block, int start, int end, int k, int bits)
+   {
+      final OutputBitStream bs = this.bitstream;
+
+      for (int i=start; i<end; i++)
+      {
+         final int val = block[i];
+         final int q = val >>> k;
+
+         if (q < RICE_LIMIT)
+         {
+            // q ones followed by a zero, then the k low bits
+            bs.writeBits((1L<<(q+1))-2, q+1);
+            bs.writeBits(val, k);
+         }
+         else
+         {
+            // Escape: RICE_LIMIT ones followed by the raw value
+            bs.writeBits((1L<<RICE_LIMIT)-1, RICE_LIMIT);
+            bs.writeBits(val & 0xFFFFFFFFL, bits);
+         }
+      }
+   }
+
+
+   private void encodeExpGolomb(int[] block, int start, int end)
+   {
+      final OutputBitStream bs = this.bitstream;
+
+      for (int i=start; i<end; i++)
+      {
+         final long u = (block[i] & 0xFFFFFFFFL) + 1;
+         final int n = 64 - Long.numberOfLeadingZeros(u);
+
+         if (n > 1)
+            bs.writeBits(0, n-1);
+
+         bs.writeBits(u, n);
+      }
+   }
+
+
+   private void encodeANS(int[] block, int blkptr, int count, int bits)
+   {
+      final byte[] buf = this.getBuffer(count);
+
+      for (int shift=0; shift<bits; shift+=8)
+      {
+         for (int i=0; i<count; i++)
+            buf[i] = (byte) (block[blkptr+i] >>> shift);
+
+         ANSRangeEncoder ec = new ANSRangeEncoder(this.bitstream, 0);
+         ec.encode(buf, 0, count);
+         ec.dispose();
+      }
+   }
+
+
+   // Pack the values with 'bits' bits each into 64 bit words
+   private void encodePacked(int[] block, int blkptr, int count, int bits)
+   {
+      if (bits == 0)
+         return;
+
+      final long totalBits = (long) count * bits;
+      final byte[] buf = this.getBuffer((int) (((totalBits+63)>>>6)<<3));
+      final long mask = (1L<<bits) - 1;
+      final int end = blkptr + count;
+      long acc = 0;
+      int avail = 64;
+      int n = 0;
+
+      for (int i=blkptr; i<end; i++)
+      {
+         final long val = block[i] & mask;
+
+         if (bits < avail)
+         {
+            avail -= bits;
+            acc |= (val << avail);
+            continue;
+         }
+
+         final int r = bits - avail;
+         acc |= (val >>> r);
+         Memory.BigEndian.writeLong64(buf, n, acc);
+         n += 8;
+         avail = 64 - r;
+         acc = (r == 0) ? 0 : val << avail;
+      }
+
+      if (avail < 64)
+         Memory.BigEndian.writeLong64(buf, n, acc);
+
+      this.bitstream.writeBits(buf, 0, (int) totalBits);
+   }
+
+
+   private byte[] getBuffer(int size)
+   {
+      if (this.buffer.length < size)
+         this.buffer = new byte[size];
+
+      return this.buffer;
+   }
+
+
+   public OutputBitStream getBitStream()
+   {
+      return this.bitstream;
+   }
+}
@@ -15,8 +15,10 @@ limitations under the License.
 
 package kanzi.entropy;
 
+import java.util.Map;
 import kanzi.EntropyEncoder;
 import kanzi.Global;
+import kanzi.Histograms;
 import kanzi.OutputBitStream;
 
 
@@ -44,6 +46,7 @@ public final class RangeEncoder implements EntropyEncoder
     private final int chunkSize;
     private final int logRange;
     private int shift;
+    private Histograms histograms; // recorded by the last transform (optional)
 
 
     public RangeEncoder(OutputBitStream bitstream)
@@ -52,6 +55,14 @@ public final class RangeEncoder implements EntropyEncoder
     }
 
 
+    // Use the histograms of the context (if any) instead of scanning the chunks
+    public RangeEncoder(OutputBitStream bitstream, Map<String, Object> ctx)
+    {
+       this(bitstream, DEFAULT_CHUNK_SIZE, DEFAULT_LOG_RANGE);
+       this.histograms = (Histograms) ctx.get("histograms");
+    }
+
+
     // The chunk size indicates how many bytes are encoded (per block) before
     // resetting the frequency stats.
     public RangeEncoder(OutputBitStream bs, int chunkSize, int logRange)
@@ -225,7 +236,10 @@ public final class RangeEncoder implements EntropyEncoder
    // Compute chunk frequencies, cumulated frequencies and encode chunk header
    private int rebuildStatistics(byte[] block, int start, int end, int lr)
    {
-      Global.computeHistogramOrder0(block, start, end, this.freqs, false);
+      if ((this.histograms == null) ||
+         (this.histograms.getHistogram(start, end, this.freqs, false) == false))
+         Global.computeHistogramOrder0(block, start, end, this.freqs, false);
+
       return this.updateFrequencies(this.freqs, end-start, lr);
    }
 
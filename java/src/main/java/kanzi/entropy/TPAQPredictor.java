@@ -15,7 +15,10 @@ limitations under the License.
 package kanzi.entropy;
 
 import kanzi.Predictor;
+import java.nio.ByteBuffer;
+import java.nio.IntBuffer;
 import java.util.Map;
+import kanzi.Arena;
 import kanzi.Global;
 
 
@@ -35,6 +38,13 @@ public class TPAQPredictor implements Predictor
    private static final int MASK_FFFF0000 = 0xFFFF0000;
    private static final int HASH = 0x7FEB352D;
 
+   // Context sets selected from the type of data of the block
+   private static final int SET_MIXED = 0; // text or binary, decided on the fly
+   private static final int SET_TEXT = 1;
+   private static final int SET_BIN = 2;
+   private static final int SET_X86 = 3;
+   private static final int SET_MULTIMEDIA = 4;
+
    ///////////////////////// state table ////////////////////////
    // States represent a bit history within some context.
    // State 0 is the starting state (no bits seen).
@@ -192,6 +202,8 @@ public class TPAQPredictor implements Predictor
    private final byte[] buffer;
    private final int[] hashes;           // hash table(context, buffer position)
    private final byte[] bigStatesMap;    // hash table(context, prediction)
+   private final IntBuffer hashBuffer;   // off-heap hashes (arena only)
+   private final ByteBuffer bigStatesBuffer; // off-heap bigStatesMap (arena only)
    private final byte[] smallStatesMap0; // hash table(context, prediction)
    private final byte[] smallStatesMap1; // hash table(context, prediction)
    private int cp0;                      // context pointers
@@ -209,6 +221,8 @@ public class TPAQPredictor implements Predictor
    private int ctx5;
    private int ctx6;
    private boolean extra;
+   private int contextSet;
+   private boolean wordContext; // one more context (ctx6) for text data
 
 
    public TPAQPredictor()
@@ -224,6 +238,7 @@ public class TPAQPredictor implements Predictor
       int hashSize = HASH_SIZE;
       int extraMem = 0;
       int bufferSize = BUFFER_SIZE;
+      Arena arena = null;
 
       if (ctx != null)
       {
@@ -263,8 +278,40 @@ public class TPAQPredictor implements Predictor
 
          bufferSize = Math.min(BUFFER_SIZE, rbsz);
          hashSize = Math.min(hashSize, 16*absz);
+
+         // Off-heap memory owned by the stream worker (if any)
+         arena = (Arena) ctx.get("arena");
+
+         // Type of data deduced from the transforms (same for encoder and decoder)
+         Global.DataType dt = (Global.DataType) ctx.getOrDefault("blockType", Global.DataType.UNDEFINED);
+
+         switch (dt)
+         {
+            case TEXT:
+               this.contextSet = SET_TEXT;
+               break;
+
+            case BIN:
+               this.contextSet = SET_BIN;
+               break;
+
+            case X86:
+               this.contextSet = SET_X86;
+               break;
+
+            case MULTIMEDIA:
+               this.contextSet = SET_MULTIMEDIA;
+               break;
+
+            default:
+               this.contextSet = SET_MIXED;
+         }
       }
 
+      // The extra context only helps with text
+      this.wordContext = (this.extra == true) &&
+         ((this.contextSet == SET_MIXED) || (this.contextSet == SET_TEXT));
+
       mixersSize <<= (2*extraMem);
       statesSize <<= (2*extraMem);
       hashSize <<= (2*extraMem);
@@ -278,14 +325,30 @@ public class TPAQPredictor implements Predictor
          this.mixers[i] = new Mixer();
 
       this.mixer = this.mixers[0];
-      this.bigStatesMap = new byte[statesSize];
+      // The biggest tables (up to 1 GB with TPAQX) are reused off-heap when
+      // the stream provides an arena. Otherwise, they are plain arrays (faster
+      // access). Exactly one of the array and the buffer is not null.
+      if (arena != null)
+      {
+         this.bigStatesMap = null;
+         this.hashes = null;
+         this.bigStatesBuffer = arena.allocate("tpaq.states", statesSize);
+         this.hashBuffer = arena.allocate("tpaq.hashes", 4*hashSize).asIntBuffer();
+      }
+      else
+      {
+         this.bigStatesMap = new byte[statesSize];
+         this.hashes = new int[hashSize];
+         this.bigStatesBuffer = null;
+         this.hashBuffer = null;
+      }
+
       this.smallStatesMap0 = new byte[1<<16];
       this.smallStatesMap1 = new byte[1<<24];
-      this.hashes = new int[hashSize];
       this.buffer = new byte[bufferSize];
-      this.statesMask = this.bigStatesMap.length - 1;
+      this.statesMask = statesSize - 1;
       this.mixersMask = (this.mixers.length - 1) & ~1;
-      this.hashMask = this.hashes.length - 1;
+      this.hashMask = hashSize - 1;
       this.bufferMask = this.buffer.length - 1;
       this.sse0 = (this.extra == true) ? new LogisticAdaptiveProbMap(256, 6) :
          new LogisticAdaptiveProbMap(256, 7);
@@ -321,33 +384,42 @@ public class TPAQPredictor implements Predictor
         this.ctx2 = createContext(2, this.c4&0x00FFFFFF);
         this.ctx3 = createContext(3, this.c4);
 
-        if (this.binCount < (this.pos>>2))
-        {
-           // Mostly text or mixed
-           this.ctx4 = createContext(this.ctx1, this.c4^(this.c8&0xFFFF));
-           this.ctx5 = (this.c8&MASK_F0F0F000) | ((this.c4&MASK_F0F0F000)>>4);
-
-           if (this.extra == true)
-           {
-               final int h1 = ((this.c4&MASK_80808080) == 0) ? this.c4&MASK_4F4FFFFF : this.c4&MASK_80808080;
-               final int h2 = ((this.c8&MASK_80808080) == 0) ? this.c8&MASK_4F4FFFFF : this.c8&MASK_80808080;
-               this.ctx6 = hash(h1<<2, h2>>2);
-           }
-        }
-        else
+        switch (this.contextSet)
         {
-           // Mostly binary
-           this.ctx4 = createContext(HASH+this.matchLen, this.c4^(this.c4&0x000FFFFF));
-           this.ctx5 = this.ctx0 | (this.c8<<16);
-
-           if (this.extra == true)
-               this.ctx6 = hash(this.c4&MASK_FFFF0000, this.c8>>16);
+           case SET_TEXT:
+              this.addTextContexts();
+              break;
+
+           case SET_BIN:
+              this.addBinaryContexts();
+              break;
+
+           case SET_X86:
+              // Opcode and ModRM/displacement bytes
+              this.ctx4 = createContext(HASH+this.matchLen, this.c4&0xFFF00000);
+              this.ctx5 = createContext(5, this.c4&0x00FF00FF) << 8;
+              break;
+
+           case SET_MULTIMEDIA:
+              // Bytes at the same position in the previous records (2, 3 and 4 bytes)
+              this.ctx4 = createContext(4, this.c4&0xFF00FF00);
+              this.ctx5 = createContext(5, (this.c4&0x00FF0000)|((this.c8>>>8)&0xFF)) << 8;
+              break;
+
+           default:
+              if (this.binCount < (this.pos>>2))
+                 this.addTextContexts(); // mostly text or mixed
+              else
+                 this.addBinaryContexts(); // mostly binary
         }
 
         this.findMatch();
 
         // Keep track of current position
-        this.hashes[this.hash] = this.pos;
+        if (this.hashes != null)
+           this.hashes[this.hash] = this.pos;
+        else
+           this.hashBuffer.put(this.hash, this.pos);
       }
 
       // Get initial predictions
@@ -357,52 +429,84 @@ public class TPAQPredictor implements Predictor
       // the condition.
       final int c = this.c0;
       final int mask = this.statesMask;
-      final byte[] bst = this.bigStatesMap;
       final byte[] sst0 = this.smallStatesMap0;
       final byte[] sst1 = this.smallStatesMap1;
       final byte[] table = STATE_TRANSITIONS[bit];
       sst0[this.cp0] = table[sst0[this.cp0]&0xFF];
       sst1[this.cp1] = table[sst1[this.cp1]&0xFF];
-      bst[this.cp2] = table[bst[this.cp2]&0xFF];
-      bst[this.cp3] = table[bst[this.cp3]&0xFF];
-      bst[this.cp4] = table[bst[this.cp4]&0xFF];
-      bst[this.cp5] = table[bst[this.cp5]&0xFF];
       this.cp0 = this.ctx0 + c;
       final int p0 = STATE_MAP[sst0[this.cp0]&0xFF];
       this.cp1 = this.ctx1 + c;
       final int p1 = STATE_MAP[sst1[this.cp1]&0xFF];
-      this.cp2 = (this.ctx2 + c) & mask;
-      final int p2 = STATE_MAP[bst[this.cp2]&0xFF];
-      this.cp3 = (this.ctx3 + c) & mask;
-      final int p3 = STATE_MAP[bst[this.cp3]&0xFF];
-      this.cp4 = (this.ctx4 + c) & mask;
-      final int p4 = STATE_MAP[bst[this.cp4]&0xFF];
-      this.cp5 = (this.ctx5 ^ c) & mask;
-      final int p5 = STATE_MAP[bst[this.cp5]&0xFF];
+      final int p2, p3, p4, p5;
+      int p6 = 0;
+
+      if (this.bigStatesMap != null)
+      {
+         final byte[] bst = this.bigStatesMap;
+         bst[this.cp2] = table[bst[this.cp2]&0xFF];
+         bst[this.cp3] = table[bst[this.cp3]&0xFF];
+         bst[this.cp4] = table[bst[this.cp4]&0xFF];
+         bst[this.cp5] = table[bst[this.cp5]&0xFF];
+         this.cp2 = (this.ctx2 + c) & mask;
+         p2 = STATE_MAP[bst[this.cp2]&0xFF];
+         this.cp3 = (this.ctx3 + c) & mask;
+         p3 = STATE_MAP[bst[this.cp3]&0xFF];
+         this.cp4 = (this.ctx4 + c) & mask;
+         p4 = STATE_MAP[bst[this.cp4]&0xFF];
+         this.cp5 = (this.ctx5 ^ c) & mask;
+         p5 = STATE_MAP[bst[this.cp5]&0xFF];
+
+         if (this.wordContext == true)
+         {
+            // One more prediction
+            bst[this.cp6] = table[bst[this.cp6]&0xFF];
+            this.cp6 = (this.ctx6 + c) & mask;
+            p6 = STATE_MAP[bst[this.cp6]&0xFF];
+         }
+      }
+      else
+      {
+         // Same as above with the off-heap table
+         final ByteBuffer bst = this.bigStatesBuffer;
+         bst.put(this.cp2, table[bst.get(this.cp2)&0xFF]);
+         bst.put(this.cp3, table[bst.get(this.cp3)&0xFF]);
+         bst.put(this.cp4, table[bst.get(this.cp4)&0xFF]);
+         bst.put(this.cp5, table[bst.get(this.cp5)&0xFF]);
+         this.cp2 = (this.ctx2 + c) & mask;
+         p2 = STATE_MAP[bst.get(this.cp2)&0xFF];
+         this.cp3 = (this.ctx3 + c) & mask;
+         p3 = STATE_MAP[bst.get(this.cp3)&0xFF];
+         this.cp4 = (this.ctx4 + c) & mask;
+         p4 = STATE_MAP[bst.get(this.cp4)&0xFF];
+         this.cp5 = (this.ctx5 ^ c) & mask;
+         p5 = STATE_MAP[bst.get(this.cp5)&0xFF];
+
+         if (this.wordContext == true)
+         {
+            // One more prediction
+            bst.put(this.cp6, table[bst.get(this.cp6)&0xFF]);
+            this.cp6 = (this.ctx6 + c) & mask;
+            p6 = STATE_MAP[bst.get(this.cp6)&0xFF];
+         }
+      }
 
       final int p7 = (this.matchLen == 0) ? 0 : this.getMatchContextPred();
-      int p;
 
+      if (this.wordContext == false)
+         p6 = p7;
+
+      // Mix predictions using NN
+      int p = this.mixer.get(p0, p1, p2, p3, p4, p5, p6, p7);
+
+      // SSE (Secondary Symbol Estimation)
       if (this.extra == false)
       {
-         // Mix predictions using NN
-         p = this.mixer.get(p0, p1, p2, p3, p4, p5, p7, p7);
-
-         // SSE (Secondary Symbol Estimation)
          if (this.binCount < (this.pos>>3))
             p = (3*this.sse0.get(bit, p, this.c0) + p) >> 2;
       }
       else
       {
-         // One more prediction
-         bst[this.cp6] = table[bst[this.cp6]&0xFF];
-         this.cp6 = (this.ctx6 + c) & mask;
-         final int p6 = STATE_MAP[bst[this.cp6]&0xFF];
-
-         // Mix predictions using NN
-         p = this.mixer.get(p0, p1, p2, p3, p4, p5, p6, p7);
-
-         // SSE (Secondary Symbol Estimation)
          if (this.binCount < (this.pos>>3))
          {
             p = this.sse1.get(bit, p, this.ctx0+c);
@@ -420,6 +524,30 @@ public class TPAQPredictor implements Predictor
    }
 
 
+   private void addTextContexts()
+   {
+      this.ctx4 = createContext(this.ctx1, this.c4^(this.c8&0xFFFF));
+      this.ctx5 = (this.c8&MASK_F0F0F000) | ((this.c4&MASK_F0F0F000)>>4);
+
+      if (this.wordContext == true)
+      {
+         final int h1 = ((this.c4&MASK_80808080) == 0) ? this.c4&MASK_4F4FFFFF : this.c4&MASK_80808080;
+         final int h2 = ((this.c8&MASK_80808080) == 0) ? this.c8&MASK_4F4FFFFF : this.c8&MASK_80808080;
+         this.ctx6 = hash(h1<<2, h2>>2);
+      }
+   }
+
+
+   private void addBinaryContexts()
+   {
+      this.ctx4 = createContext(HASH+this.matchLen, this.c4^(this.c4&0x000FFFFF));
+      this.ctx5 = this.ctx0 | (this.c8<<16);
+
+      if (this.wordContext == true)
+         this.ctx6 = hash(this.c4&MASK_FFFF0000, this.c8>>16);
+   }
+
+
    private void findMatch()
    {
       // Update ongoing sequence match or detect match in the buffer (LZ like)
@@ -431,7 +559,8 @@ public class TPAQPredictor implements Predictor
       else
       {
          // Retrieve match position
-         this.matchPos = this.hashes[this.hash];
+         this.matchPos = (this.hashes != null) ? this.hashes[this.hash] :
+            this.hashBuffer.get(this.hash);
 
          // Detect match
          if ((this.matchPos != 0) && (this.pos - this.matchPos <= this.bufferMask))
@@ -0,0 +1,176 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.atomic.AtomicBoolean;
+import kanzi.Error;
+import kanzi.SliceByteArray;
+
+
+// Implementation of a java.io.InputStream that reads ahead from the underlying
+// stream on a dedicated thread, using a bounded set of buffers. Reads from
+// disk or pipe overlap with the processing of the data already read.
+public class AsyncInputStream extends InputStream
+{
+   private static final SliceByteArray EOS = new SliceByteArray(new byte[0], 0);
+
+   private final InputStream is;
+   private final ArrayBlockingQueue<SliceByteArray> filled;
+   private final ArrayBlockingQueue<SliceByteArray> free;
+   private final Thread reader;
+   private final AtomicBoolean closed;
+   private SliceByteArray current;
+   private volatile IOException error;
+
+
+   public AsyncInputStream(InputStream is, int bufferSize, int nbBuffers)
+   {
+      if (is == null)
+         throw new NullPointerException("Invalid null input stream parameter");
+
+      if (bufferSize < 1024)
+         throw new IllegalArgumentException("Invalid buffer size (must be at least 1024)");
+
+      if (nbBuffers < 2)
+         throw new IllegalArgumentException("Invalid number of buffers (must be at least 2)");
+
+      this.is = is;
+      this.filled = new ArrayBlockingQueue<>(nbBuffers+1);
+      this.free = new ArrayBlockingQueue<>(nbBuffers);
+      this.closed = new AtomicBoolean(false);
+
+      for (int i=0; i<nbBuffers; i++)
+         this.free.add(new SliceByteArray(new byte[bufferSize], 0));
+
+      this.reader = new Thread(new Runnable()
+      {
+         @Override
+         public void run()
+         {
+            AsyncInputStream.this.readAhead();
+         }
+      }, "kanzi-reader");
+
+      this.reader.setDaemon(true);
+      this.reader.start();
+   }
+
+
+   // Reader stage: fill free buffers and queue them until end of stream
+   private void readAhead()
+   {
+      try
+      {
+         while (this.closed.get() == false)
+         {
+            final SliceByteArray sba = this.free.take();
+            final int n = this.is.read(sba.array, 0, sba.array.length);
+
+            if (n <= 0)
+               break;
+
+            sba.index = 0;
+            sba.length = n;
+            this.filled.put(sba);
+         }
+      }
+      catch (InterruptedException e)
+      {
+         // Stream closed
+      }
+      catch (IOException e)
+      {
+         this.error = e;
+      }
+
+      // Capacity is nbBuffers+1: the end of stream marker always fits
+      this.filled.offer(EOS);
+   }
+
+
+   @Override
+   public int read() throws IOException
+   {
+      final byte[] buf = new byte[1];
+      return (this.read(buf, 0, 1) == 1) ? buf[0] & 0xFF : -1;
+   }
+
+
+   // Return at most the number of bytes remaining in the current buffer
+   @Override
+   public int read(byte[] data, int off, int len) throws IOException
+   {
+      if ((off < 0) || (len < 0) || (len + off > data.length))
+         throw new IndexOutOfBoundsException();
+
+      if (this.closed.get() == true)
+         throw new kanzi.io.IOException("Stream closed", Error.ERR_READ_FILE);
+
+      if (len == 0)
+         return 0;
+
+      if (this.current == null)
+      {
+         try
+         {
+            this.current = this.filled.take();
+         }
+         catch (InterruptedException e)
+         {
+            throw new kanzi.io.IOException("Read interrupted", Error.ERR_READ_FILE);
+         }
+      }
+
+      if (this.current == EOS)
+      {
+         // Keep the marker to return EOS on subsequent calls
+         this.filled.offer(EOS);
+         this.current = null;
+
+         if (this.error != null)
+            throw this.error;
+
+         return -1;
+      }
+
+      final int n = Math.min(len, this.current.length-this.current.index);
+      System.arraycopy(this.current.array, this.current.index, data, off, n);
+      this.current.index += n;
+
+      if (this.current.index >= this.current.length)
+      {
+         // Give the buffer back to the reader stage
+         this.free.offer(this.current);
+         this.current = null;
+      }
+
+      return n;
+   }
+
+
+   @Override
+   public void close() throws IOException
+   {
+      if (this.closed.getAndSet(true) == true)
+         return;
+
+      this.reader.interrupt();
+      this.is.close();
+   }
+}
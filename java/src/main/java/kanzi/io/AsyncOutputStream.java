@@ -0,0 +1,224 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.IOException;
+import java.io.OutputStream;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.atomic.AtomicBoolean;
+import kanzi.Error;
+import kanzi.SliceByteArray;
+
+
+// Implementation of a java.io.OutputStream that writes to the underlying
+// stream on a dedicated thread, using a bounded set of buffers. Writes to
+// disk or pipe overlap with the production of the next data.
+// Errors raised by the writer stage are reported by the next call to write,
+// flush or close.
+public class AsyncOutputStream extends OutputStream
+{
+   private static final SliceByteArray EOS = new SliceByteArray(new byte[0], 0);
+
+   private final OutputStream os;
+   private final ArrayBlockingQueue<SliceByteArray> filled;
+   private final ArrayBlockingQueue<SliceByteArray> free;
+   private final Thread writer;
+   private final AtomicBoolean closed;
+   private final Object lock;
+   private int pending; // number of queued buffers not yet written (guarded by lock)
+   private SliceByteArray current;
+   private volatile IOException error;
+
+
+   public AsyncOutputStream(OutputStream os, int bufferSize, int nbBuffers)
+   {
+      if (os == null)
+         throw new NullPointerException("Invalid null output stream parameter");
+
+      if (bufferSize < 1024)
+         throw new IllegalArgumentException("Invalid buffer size (must be at least 1024)");
+
+      if (nbBuffers < 2)
+         throw new IllegalArgumentException("Invalid number of buffers (must be at least 2)");
+
+      this.os = os;
+      this.filled = new ArrayBlockingQueue<>(nbBuffers+1);
+      this.free = new ArrayBlockingQueue<>(nbBuffers);
+      this.closed = new AtomicBoolean(false);
+      this.lock = new Object();
+
+      for (int i=1; i<nbBuffers; i++)
+         this.free.add(new SliceByteArray(new byte[bufferSize], 0));
+
+      this.current = new SliceByteArray(new byte[bufferSize], 0);
+
+      this.writer = new Thread(new Runnable()
+      {
+         @Override
+         public void run()
+         {
+            AsyncOutputStream.this.writeBehind();
+         }
+      }, "kanzi-writer");
+
+      this.writer.setDaemon(true);
+      this.writer.start();
+   }
+
+
+   // Writer stage: write queued buffers in order and recycle them
+   private void writeBehind()
+   {
+      try
+      {
+         while (true)
+         {
+            final SliceByteArray sba = this.filled.take();
+
+            if (sba == EOS)
+               break;
+
+            // After a failure, keep draining buffers to unblock the producer
+            if (this.error == null)
+            {
+               try
+               {
+                  this.os.write(sba.array, 0, sba.index);
+               }
+               catch (IOException e)
+               {
+                  this.error = e;
+               }
+            }
+
+            sba.index = 0;
+            this.free.put(sba);
+
+            synchronized (this.lock)
+            {
+               this.pending--;
+               this.lock.notifyAll();
+            }
+         }
+      }
+      catch (InterruptedException e)
+      {
+         // Stream closed
+      }
+   }
+
+
+   @Override
+   public void write(int b) throws IOException
+   {
+      if (this.current.index >= this.current.array.length)
+         this.submit();
+
+      this.current.array[this.current.index++] = (byte) b;
+   }
+
+
+   @Override
+   public void write(byte[] data, int off, int len) throws IOException
+   {
+      if ((off < 0) || (len < 0) || (len + off > data.length))
+         throw new IndexOutOfBoundsException();
+
+      while (len > 0)
+      {
+         if (this.current.index >= this.current.array.length)
+            this.submit();
+
+         final int n = Math.min(len, this.current.array.length-this.current.index);
+         System.arraycopy(data, off, this.current.array, this.current.index, n);
+         this.current.index += n;
+         off += n;
+         len -= n;
+      }
+   }
+
+
+   // Queue the current buffer for the writer stage and get a free one
+   private void submit() throws IOException
+   {
+      if (this.closed.get() == true)
+         throw new kanzi.io.IOException("Stream closed", Error.ERR_WRITE_FILE);
+
+      if (this.error != null)
+         throw this.error;
+
+      try
+      {
+         synchronized (this.lock)
+         {
+            this.pending++;
+         }
+
+         this.filled.put(this.current);
+         this.current = this.free.take();
+      }
+      catch (InterruptedException e)
+      {
+         throw new kanzi.io.IOException("Write interrupted", Error.ERR_WRITE_FILE);
+      }
+   }
+
+
+   // Wait until all queued data has been written to the underlying stream
+   @Override
+   public void flush() throws IOException
+   {
+      if (this.current.index > 0)
+         this.submit();
+
+      try
+      {
+         synchronized (this.lock)
+         {
+            while (this.pending > 0)
+               this.lock.wait();
+         }
+      }
+      catch (InterruptedException e)
+      {
+         throw new kanzi.io.IOException("Flush interrupted", Error.ERR_WRITE_FILE);
+      }
+
+      if (this.error != null)
+         throw this.error;
+
+      this.os.flush();
+   }
+
+
+   @Override
+   public void close() throws IOException
+   {
+      if (this.closed.get() == true)
+         return;
+
+      try
+      {
+         this.flush();
+      }
+      finally
+      {
+         this.closed.set(true);
+         this.filled.offer(EOS);
+         this.os.close();
+      }
+   }
+}
@@ -0,0 +1,362 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.IOException;
+import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Executor;
+import java.util.concurrent.FutureTask;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.LongAdder;
+import kanzi.Error;
+
+
+// A cache of decoded blocks shared by the readers of compressed files. The
+// blocks are keyed by (file, block id) and evicted in (approximate) least
+// recently used order once the total size of the cached blocks exceeds the
+// capacity. Lookups are lock free: a hit only records the current value of a
+// clock advanced by the insertions, so the blocks used since the last insertion
+// are all considered as recent. A missing block is decoded only once: the
+// threads asking for a block being decoded wait for the result (single flight).
+public final class BlockCache
+{
+   public static final long DEFAULT_CAPACITY = 256L*1024*1024;
+
+   private static BlockCache shared;
+
+   private final long capacity; // maximum number of bytes of cached blocks
+   private final ConcurrentHashMap<Key, Entry> blocks;
+   private final ConcurrentHashMap<Key, FutureTask<byte[]>> loading;
+   private final AtomicLong clock; // incremented by each insertion
+   private final LongAdder hits; // striped counters: no contention on hits
+   private final LongAdder misses;
+   private final AtomicLong size;
+
+
+   public BlockCache(long capacity)
+   {
+      if (capacity < 0)
+         throw new IllegalArgumentException("Invalid negative cache capacity: "+capacity);
+
+      this.capacity = capacity;
+      this.blocks = new ConcurrentHashMap<>();
+      this.loading = new ConcurrentHashMap<>();
+      this.clock = new AtomicLong();
+      this.hits = new LongAdder();
+      this.misses = new LongAdder();
+      this.size = new AtomicLong();
+   }
+
+
+   // Return the process wide cache
+   public static synchronized BlockCache getShared()
+   {
+      if (shared == null)
+         shared = new BlockCache(DEFAULT_CAPACITY);
+
+      return shared;
+   }
+
+
+   // Return the decoded block, calling the loader if it is not cached
+   // and not being decoded by another thread.
+   public byte[] get(Key key, Callable<byte[]> loader) throws IOException
+   {
+      byte[] block = this.lookup(key);
+
+      if (block != null)
+      {
+         this.hits.increment();
+         return block;
+      }
+
+      this.misses.increment();
+      FutureTask<byte[]> task = this.newTask(key, loader);
+      FutureTask<byte[]> prev = this.loading.putIfAbsent(key, task);
+
+      // Another thread is decoding the block: wait for it
+      if (prev != null)
+         return waitFor(key, prev);
+
+      try
+      {
+         // The block may have been added between the lookup and the registration
+         block = this.lookup(key);
+
+         if (block != null)
+            return block;
+
+         task.run();
+      }
+      finally
+      {
+         this.loading.remove(key, task);
+      }
+
+      return waitFor(key, task);
+   }
+
+
+   // Decode the block with the executor if it is neither cached nor being
+   // decoded. Errors are reported to the next reader of the block.
+   public void prefetch(final Key key, Callable<byte[]> loader, Executor executor)
+   {
+      if ((this.contains(key) == true) || (this.loading.containsKey(key) == true))
+         return;
+
+      final FutureTask<byte[]> task = this.newTask(key, loader);
+
+      if (this.loading.putIfAbsent(key, task) != null)
+         return;
+
+      executor.execute(new Runnable()
+      {
+         @Override
+         public void run()
+         {
+            try
+            {
+               task.run();
+            }
+            finally
+            {
+               BlockCache.this.loading.remove(key, task);
+            }
+         }
+      });
+   }
+
+
+   private static byte[] waitFor(Key key, FutureTask<byte[]> task) throws IOException
+   {
+      try
+      {
+         return task.get();
+      }
+      catch (InterruptedException e)
+      {
+         Thread.currentThread().interrupt();
+         throw new kanzi.io.IOException("Interrupted while decoding block "+key,
+            Error.ERR_PROCESS_BLOCK);
+      }
+      catch (ExecutionException e)
+      {
+         Throwable cause = e.getCause();
+
+         if (cause instanceof IOException)
+            throw (IOException) cause;
+
+         throw new kanzi.io.IOException("Failed to decode block "+key+": "+cause,
+            Error.ERR_PROCESS_BLOCK);
+      }
+   }
+
+
+   private FutureTask<byte[]> newTask(final Key key, final Callable<byte[]> loader)
+   {
+      return new FutureTask<>(new Callable<byte[]>()
+      {
+         @Override
+         public byte[] call() throws Exception
+         {
+            byte[] block = loader.call();
+            BlockCache.this.put(key, block);
+            return block;
+         }
+      });
+   }
+
+
+   private byte[] lookup(Key key)
+   {
+      final Entry e = this.blocks.get(key);
+
+      if (e == null)
+         return null;
+
+      // No lock on a hit: only the stamp of the entry is updated
+      e.stamp = this.clock.get();
+      return e.block;
+   }
+
+
+   public boolean contains(Key key)
+   {
+      return this.blocks.containsKey(key);
+   }
+
+
+   // Insertions and evictions are serialized, lookups are not
+   private synchronized void put(Key key, byte[] block)
+   {
+      // A block bigger than the whole cache is not cached
+      if (block.length > this.capacity)
+         return;
+
+      final Entry old = this.blocks.get(key);
+
+      if (old != null)
+         this.remove(key, old);
+
+      // Make room first: the size never exceeds the capacity
+      this.evict(this.capacity-block.length);
+      this.blocks.put(key, new Entry(block, this.clock.incrementAndGet()));
+      this.size.addAndGet(block.length);
+   }
+
+
+   // Evict the least recently used blocks until the size is at most 'target'
+   private void evict(long target)
+   {
+      while (this.size.get() > target)
+      {
+         Map.Entry<Key, Entry> lru = null;
+         long oldest = Long.MAX_VALUE;
+
+         for (Map.Entry<Key, Entry> e : this.blocks.entrySet())
+         {
+            final long stamp = e.getValue().stamp;
+
+            if (stamp < oldest)
+            {
+               oldest = stamp;
+               lru = e;
+            }
+         }
+
+         // Empty: the size is being updated by a concurrent removal
+         if (lru == null)
+            return;
+
+         this.remove(lru.getKey(), lru.getValue());
+      }
+   }
+
+
+   private void remove(Key key, Entry e)
+   {
+      // Only the thread removing the entry updates the size
+      if (this.blocks.remove(key, e) == true)
+         this.size.addAndGet(-e.block.length);
+   }
+
+
+   // Remove all the blocks of a file. The file key is the one the blocks were
+   // cached with (see CompressedFileReader.getFileKey()). The readers of a
+   // file modified since use a new key, so this only releases memory.
+   public void invalidate(String fileKey)
+   {
+      for (Map.Entry<Key, Entry> e : this.blocks.entrySet())
+      {
+         if (e.getKey().file.equals(fileKey) == true)
+            this.remove(e.getKey(), e.getValue());
+      }
+   }
+
+
+   public void clear()
+   {
+      for (Map.Entry<Key, Entry> e : this.blocks.entrySet())
+         this.remove(e.getKey(), e.getValue());
+   }
+
+
+   public long capacity()
+   {
+      return this.capacity;
+   }
+
+
+   // Return the number of bytes of cached blocks
+   public long size()
+   {
+      return this.size.get();
+   }
+
+
+   public long hits()
+   {
+      return this.hits.sum();
+   }
+
+
+   public long misses()
+   {
+      return this.misses.sum();
+   }
+
+
+   private static final class Entry
+   {
+      final byte[] block;
+      volatile long stamp; // value of the clock at the last use
+
+
+      Entry(byte[] block, long stamp)
+      {
+         this.block = block;
+         this.stamp = stamp;
+      }
+   }
+
+
+   public static final class Key
+   {
+      final String file;
+      final int blockId;
+
+
+      public Key(String file, int blockId)
+      {
+         if (file == null)
+            throw new NullPointerException("Invalid null file key");
+
+         this.file = file;
+         this.blockId = blockId;
+      }
+
+
+      @Override
+      public boolean equals(Object o)
+      {
+         if (o == this)
+            return true;
+
+         if ((o instanceof Key) == false)
+            return false;
+
+         Key k = (Key) o;
+         return (this.blockId == k.blockId) && (this.file.equals(k.file) == true);
+      }
+
+
+      @Override
+      public int hashCode()
+      {
+         return 31*this.file.hashCode() + this.blockId;
+      }
+
+
+      @Override
+      public String toString()
+      {
+         return this.file + "#" + this.blockId;
+      }
+   }
+}
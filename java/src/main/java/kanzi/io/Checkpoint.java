@@ -0,0 +1,288 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.channels.FileChannel;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardCopyOption;
+import java.util.Properties;
+import kanzi.Error;
+
+
+// State of a compression job after the last completed batch of blocks, saved
+// to a sidecar file. All the bytes of the output before 'outputOffset' have
+// been written to the output file. The last bits of the bitstream (at most 63,
+// not byte aligned) are kept in the checkpoint to be written again on resume.
+// The header parameters (and the options changing the block layout) let the
+// resumed job check that it produces the same bitstream.
+public class Checkpoint
+{
+   private static final int VERSION = 2;
+   public static final long DEFAULT_INTERVAL = 64L*1024*1024;
+
+   private final String fileName;
+   private final long interval; // minimum number of input bytes between saves
+   private long inputSize;
+   private long inputOffset;
+   private int blockId;
+   private long outputOffset;
+   private long pendingBits;
+   private int pendingCount;
+   private int blockSize;
+   private String transform;
+   private String codec;
+   private boolean checksum;
+   private boolean splitBlocks;
+   private boolean chunkTable;
+   private int formatVersion; // version of the bitstream format
+   private FileChannel output; // output file (null if not set)
+
+
+   public Checkpoint(String fileName, long interval)
+   {
+      if (fileName == null)
+         throw new NullPointerException("Invalid null checkpoint file name");
+
+      if (interval < 0)
+         throw new IllegalArgumentException("Invalid negative checkpoint interval");
+
+      this.fileName = fileName;
+      this.interval = interval;
+   }
+
+
+   // Return the sidecar file name for the provided output file
+   public static String getFileName(String outputName)
+   {
+      return outputName + ".ckpt";
+   }
+
+
+   // Set the header parameters and input size of the job
+   public void setParameters(long inputSize, int blockSize, String transform,
+      String codec, boolean checksum, boolean splitBlocks, boolean chunkTable,
+      int formatVersion)
+   {
+      this.inputSize = inputSize;
+      this.blockSize = blockSize;
+      this.transform = transform;
+      this.codec = codec;
+      this.checksum = checksum;
+      this.splitBlocks = splitBlocks;
+      this.chunkTable = chunkTable;
+      this.formatVersion = formatVersion;
+   }
+
+
+   // Return true if the saved parameters match the ones of the job
+   public boolean matches(long inputSize, int blockSize, String transform,
+      String codec, boolean checksum, boolean splitBlocks, boolean chunkTable)
+   {
+      return (this.inputSize == inputSize) && (this.blockSize == blockSize) &&
+         (transform.equals(this.transform) == true) &&
+         (codec.equals(this.codec) == true) && (this.checksum == checksum) &&
+         (this.splitBlocks == splitBlocks) && (this.chunkTable == chunkTable);
+   }
+
+
+   // Set the output file, forced to the storage before each save
+   public void setOutput(FileChannel output)
+   {
+      this.output = output;
+   }
+
+
+   // Record the position after the last completed block
+   public void update(long inputOffset, int blockId, long outputOffset,
+      long pendingBits, int pendingCount)
+   {
+      if ((pendingCount < 0) || (pendingCount > 63))
+         throw new IllegalArgumentException("Invalid number of pending bits: "+pendingCount);
+
+      this.inputOffset = inputOffset;
+      this.blockId = blockId;
+      this.outputOffset = outputOffset;
+      this.pendingBits = (pendingCount == 0) ? 0 : pendingBits & ((1L<<pendingCount)-1);
+      this.pendingCount = pendingCount;
+   }
+
+
+   // Write the checkpoint to a temporary file and rename it, so that the
+   // sidecar file always contains a complete checkpoint
+   public void save() throws kanzi.io.IOException
+   {
+      Properties props = new Properties();
+      props.setProperty("version", String.valueOf(VERSION));
+      props.setProperty("inputSize", String.valueOf(this.inputSize));
+      props.setProperty("inputOffset", String.valueOf(this.inputOffset));
+      props.setProperty("blockId", String.valueOf(this.blockId));
+      props.setProperty("outputOffset", String.valueOf(this.outputOffset));
+      props.setProperty("pendingBits", Long.toHexString(this.pendingBits));
+      props.setProperty("pendingCount", String.valueOf(this.pendingCount));
+      props.setProperty("blockSize", String.valueOf(this.blockSize));
+      props.setProperty("transform", this.transform);
+      props.setProperty("codec", this.codec);
+      props.setProperty("checksum", String.valueOf(this.checksum));
+      props.setProperty("splitBlocks", String.valueOf(this.splitBlocks));
+      props.setProperty("chunkTable", String.valueOf(this.chunkTable));
+      props.setProperty("formatVersion", String.valueOf(this.formatVersion));
+      Path path = Paths.get(this.fileName);
+      Path tmp = Paths.get(this.fileName + ".tmp");
+
+      try
+      {
+         // The output up to the checkpoint must be on the storage before the
+         // checkpoint refers to it
+         if (this.output != null)
+            this.output.force(false);
+
+         try (FileOutputStream os = new FileOutputStream(tmp.toFile()))
+         {
+            props.store(os, "kanzi checkpoint");
+            os.getChannel().force(true);
+         }
+
+         Files.move(tmp, path, StandardCopyOption.REPLACE_EXISTING, StandardCopyOption.ATOMIC_MOVE);
+      }
+      catch (IOException e)
+      {
+         throw new kanzi.io.IOException("Cannot save checkpoint '"+this.fileName+"': "+e.getMessage(),
+            Error.ERR_WRITE_FILE);
+      }
+   }
+
+
+   // Load a checkpoint from the sidecar file. Return null if there is none.
+   public static Checkpoint load(String fileName, long interval) throws kanzi.io.IOException
+   {
+      if (Files.exists(Paths.get(fileName)) == false)
+         return null;
+
+      Properties props = new Properties();
+
+      try (InputStream is = new FileInputStream(fileName))
+      {
+         props.load(is);
+      }
+      catch (IOException e)
+      {
+         throw new kanzi.io.IOException("Cannot read checkpoint '"+fileName+"': "+e.getMessage(),
+            Error.ERR_OPEN_FILE);
+      }
+
+      try
+      {
+         if (Integer.parseInt(props.getProperty("version")) != VERSION)
+            throw new kanzi.io.IOException("Invalid checkpoint version in '"+fileName+"'",
+               Error.ERR_INVALID_FILE);
+
+         Checkpoint cp = new Checkpoint(fileName, interval);
+         cp.setParameters(Long.parseLong(props.getProperty("inputSize")),
+            Integer.parseInt(props.getProperty("blockSize")),
+            props.getProperty("transform"), props.getProperty("codec"),
+            Boolean.parseBoolean(props.getProperty("checksum")),
+            Boolean.parseBoolean(props.getProperty("splitBlocks")),
+            Boolean.parseBoolean(props.getProperty("chunkTable")),
+            Integer.parseInt(props.getProperty("formatVersion")));
+         cp.update(Long.parseLong(props.getProperty("inputOffset")),
+            Integer.parseInt(props.getProperty("blockId")),
+            Long.parseLong(props.getProperty("outputOffset")),
+            Long.parseUnsignedLong(props.getProperty("pendingBits"), 16),
+            Integer.parseInt(props.getProperty("pendingCount")));
+
+         if ((cp.inputOffset < 0) || (cp.outputOffset < 0) || (cp.blockId < 0) ||
+            (cp.transform == null) || (cp.codec == null))
+            throw new kanzi.io.IOException("Invalid checkpoint '"+fileName+"'",
+               Error.ERR_INVALID_FILE);
+
+         return cp;
+      }
+      catch (NullPointerException | IllegalArgumentException e)
+      {
+         // NumberFormatException is an IllegalArgumentException
+         throw new kanzi.io.IOException("Invalid checkpoint '"+fileName+"'",
+            Error.ERR_INVALID_FILE);
+      }
+   }
+
+
+   // Remove the sidecar file (after the job completed)
+   public void delete()
+   {
+      try
+      {
+         Files.deleteIfExists(Paths.get(this.fileName));
+      }
+      catch (IOException e)
+      {
+         // Ignore
+      }
+   }
+
+
+   public String getFileName()
+   {
+      return this.fileName;
+   }
+
+
+   public long getInterval()
+   {
+      return this.interval;
+   }
+
+
+   public long getInputOffset()
+   {
+      return this.inputOffset;
+   }
+
+
+   public int getBlockId()
+   {
+      return this.blockId;
+   }
+
+
+   public long getOutputOffset()
+   {
+      return this.outputOffset;
+   }
+
+
+   public long getPendingBits()
+   {
+      return this.pendingBits;
+   }
+
+
+   public int getPendingCount()
+   {
+      return this.pendingCount;
+   }
+
+
+   public int getFormatVersion()
+   {
+      return this.formatVersion;
+   }
+}
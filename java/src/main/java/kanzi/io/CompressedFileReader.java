@@ -0,0 +1,415 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.Closeable;
+import java.io.File;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.file.StandardOpenOption;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.Executor;
+import kanzi.Error;
+import kanzi.Memory;
+import kanzi.bitstream.DefaultInputBitStream;
+import kanzi.bitstream.DefaultOutputBitStream;
+
+
+// Random access to the decompressed bytes of a compressed file. The reader
+// indexes the blocks of the bitstream on open (without decoding them) and
+// decodes a block when a read needs it. The decoded blocks go to a cache
+// (shared by default) so that concurrent readers of the same file decode
+// each block once. With an executor, sequential reads also prefetch the
+// next block. The read methods can be called from several threads.
+public class CompressedFileReader implements Closeable
+{
+   private static final int BITSTREAM_TYPE           = 0x4B414E5A; // "KANZ"
+   private static final int BITSTREAM_FORMAT_VERSION = 2;
+   private static final int HEADER_SIZE              = 16; // bytes
+
+   private final FileChannel channel;
+   private final String fileKey;
+   private final BlockCache cache;
+   private final Executor prefetcher;
+   private final byte[] header;
+   private final int blockSize;
+   private volatile boolean fixedSize; // all blocks but the last have 'blockSize' bytes
+   private final long[] offsets; // bit offset of each block in the file
+   private final long[] starts; // offset of each block in the decompressed data
+   private int indexed; // number of valid entries in 'starts' minus one
+   private volatile int lastBlock;
+
+
+   public CompressedFileReader(String fileName) throws IOException
+   {
+      this(fileName, BlockCache.getShared(), null);
+   }
+
+
+   // The executor (if any) runs the prefetching of blocks
+   public CompressedFileReader(String fileName, BlockCache cache, Executor prefetcher) throws IOException
+   {
+      if (fileName == null)
+         throw new NullPointerException("Invalid null file name");
+
+      if (cache == null)
+         throw new NullPointerException("Invalid null block cache");
+
+      File file = new File(fileName);
+      this.channel = FileChannel.open(file.toPath(), StandardOpenOption.READ);
+
+      try
+      {
+         // The key changes when the file is modified: stale blocks are never returned
+         this.fileKey = file.getCanonicalPath() + ":" + file.length() + ":" + file.lastModified();
+         this.cache = cache;
+         this.prefetcher = prefetcher;
+         this.header = new byte[HEADER_SIZE];
+         this.lastBlock = -1;
+
+         if (this.readFully(this.header, 0) != HEADER_SIZE)
+            throw new kanzi.io.IOException("Invalid stream, the file is too short", Error.ERR_INVALID_FILE);
+
+         DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(this.header), 1024);
+
+         if ((int) ibs.readBits(32) != BITSTREAM_TYPE)
+            throw new kanzi.io.IOException("Invalid stream type", Error.ERR_INVALID_FILE);
+
+         final int bsVersion = (int) ibs.readBits(4);
+
+         if ((bsVersion < 1) || (bsVersion > BITSTREAM_FORMAT_VERSION))
+            throw new kanzi.io.IOException("Invalid bitstream, cannot read this version of the stream: " + bsVersion,
+                    Error.ERR_STREAM_VERSION);
+
+         ibs.readBits(1+5+48); // checksum flag, entropy, transform
+         this.blockSize = (int) ibs.readBits(28) << 4;
+
+         // The number of blocks is 0 when unknown or when the blocks are split
+         // on content or submitted (see read() for older streams)
+         this.fixedSize = ibs.readBits(6) != 0;
+         this.offsets = this.indexBlocks();
+         this.starts = new long[this.offsets.length+1];
+      }
+      catch (IOException | RuntimeException e)
+      {
+         this.channel.close();
+         throw e;
+      }
+   }
+
+
+   // Scan the block headers: 5 bits (log of the size in bits minus 3), the
+   // size of the block in bits and the block bits. A size of 0 ends the stream.
+   private long[] indexBlocks() throws IOException
+   {
+      final long end = this.channel.size() << 3;
+      long[] res = new long[64];
+      int n = 0;
+      long offset = HEADER_SIZE << 3;
+      final byte[] buf = new byte[8];
+
+      while (true)
+      {
+         if (offset + 8 > end)
+            throw new kanzi.io.IOException("Invalid stream, missing end of stream marker", Error.ERR_INVALID_FILE);
+
+         // 5 + 34 bits at most after up to 7 bits of misalignment
+         Arrays.fill(buf, (byte) 0);
+         this.readFully(buf, offset>>3);
+         final long bits = Memory.BigEndian.readLong64(buf, 0) << (offset&7);
+         final int lw = (int) (bits>>>59) + 3;
+         final long written = (bits<<5) >>> (64-lw);
+
+         if (written == 0)
+            break;
+
+         if (written > 1L<<34)
+            throw new kanzi.io.IOException("Invalid block size", Error.ERR_BLOCK_SIZE);
+
+         if (n == res.length)
+            res = Arrays.copyOf(res, 2*n);
+
+         res[n++] = offset;
+         offset += 5 + lw + written;
+
+         if (offset > end)
+            throw new kanzi.io.IOException("Invalid stream, truncated block "+n, Error.ERR_INVALID_FILE);
+      }
+
+      return Arrays.copyOf(res, n);
+   }
+
+
+   // Read up to buf.length bytes at the given file offset
+   private int readFully(byte[] buf, long position) throws IOException
+   {
+      ByteBuffer bb = ByteBuffer.wrap(buf);
+
+      while (bb.hasRemaining() == true)
+      {
+         if (this.channel.read(bb, position+bb.position()) < 0)
+            break;
+      }
+
+      return bb.position();
+   }
+
+
+   public int getBlockSize()
+   {
+      return this.blockSize;
+   }
+
+
+   public int getNbBlocks()
+   {
+      return this.offsets.length;
+   }
+
+
+   // Return the key of the file in the block cache (see BlockCache.invalidate)
+   public String getFileKey()
+   {
+      return this.fileKey;
+   }
+
+
+   // Return the decoded block (1 based id like in the stream). The returned
+   // array is shared and must not be modified.
+   public byte[] getBlock(final int blockId) throws IOException
+   {
+      if ((blockId < 1) || (blockId > this.offsets.length))
+         throw new IllegalArgumentException("Invalid block id: "+blockId+" (must be in [1.."+this.offsets.length+"])");
+
+      return this.cache.get(new BlockCache.Key(this.fileKey, blockId), this.loader(blockId));
+   }
+
+
+   private Callable<byte[]> loader(final int blockId)
+   {
+      return new Callable<byte[]>()
+      {
+         @Override
+         public byte[] call() throws IOException
+         {
+            return CompressedFileReader.this.decodeBlock(blockId);
+         }
+      };
+   }
+
+
+   // Decode one block: build a bitstream made of the file header, the block
+   // and the end of stream marker, then decompress it.
+   private byte[] decodeBlock(int blockId) throws IOException
+   {
+      final long offset = this.offsets[blockId-1];
+      final long end = (blockId < this.offsets.length) ? this.offsets[blockId] : this.findEnd(offset);
+      final int skip = (int) (offset & 7);
+      final byte[] raw = new byte[(int) (((end+7)>>3) - (offset>>3))];
+
+      if (this.readFully(raw, offset>>3) != raw.length)
+         throw new kanzi.io.IOException("Failed to read block "+blockId, Error.ERR_READ_FILE);
+
+      ByteArrayOutputStream baos = new ByteArrayOutputStream(raw.length+HEADER_SIZE+8);
+      DefaultOutputBitStream obs = new DefaultOutputBitStream(baos, 65536);
+      obs.writeBits(this.header, 0, HEADER_SIZE<<3);
+      DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(raw), 65536);
+
+      if (skip != 0)
+         ibs.readBits(skip);
+
+      long remaining = end - offset;
+      final byte[] buf = new byte[(int) Math.min((remaining+7)>>3, 1<<24)];
+
+      while (remaining > 0)
+      {
+         final int chkSize = (int) Math.min(remaining, buf.length<<3);
+         ibs.readBits(buf, 0, chkSize);
+         obs.writeBits(buf, 0, chkSize);
+         remaining -= chkSize;
+      }
+
+      // End of stream marker
+      obs.writeBits(0, 5);
+      obs.writeBits(0, 3);
+      obs.close();
+
+      Map<String, Object> ctx = new HashMap<>();
+      ctx.put("jobs", 1);
+      byte[] res = new byte[this.blockSize];
+      int decoded = 0;
+
+      try (CompressedInputStream cis = new CompressedInputStream(new ByteArrayInputStream(baos.toByteArray()), ctx))
+      {
+         while (decoded < res.length)
+         {
+            final int r = cis.read(res, decoded, res.length-decoded);
+
+            if (r < 0)
+               break;
+
+            decoded += r;
+         }
+      }
+
+      return (decoded == res.length) ? res : Arrays.copyOf(res, decoded);
+   }
+
+
+   // Return the bit offset of the end of the block starting at 'offset'
+   private long findEnd(long offset) throws IOException
+   {
+      final byte[] buf = new byte[8];
+      this.readFully(buf, offset>>3);
+      final long bits = Memory.BigEndian.readLong64(buf, 0) << (offset&7);
+      final int lw = (int) (bits>>>59) + 3;
+      return offset + 5 + lw + ((bits<<5) >>> (64-lw));
+   }
+
+
+   // Read up to 'len' decompressed bytes starting at 'position'. Return the
+   // number of bytes read or -1 if the position is at or past the end of the data.
+   public int read(long position, byte[] buf, int off, int len) throws IOException
+   {
+      if (position < 0)
+         throw new IllegalArgumentException("Invalid negative position: "+position);
+
+      if ((off < 0) || (len < 0) || (len > buf.length-off))
+         throw new IndexOutOfBoundsException();
+
+      if (len == 0)
+         return 0;
+
+      final long position0 = position;
+      int read = 0;
+
+      while (read < len)
+      {
+         final int idx = this.findBlock(position);
+
+         if (idx < 0)
+            break;
+
+         final byte[] block = this.getBlock(idx+1);
+         final long start = this.startOf(idx);
+         final int blkOff = (int) (position - start);
+
+         if ((this.fixedSize == true) && (idx+1 < this.offsets.length) && (block.length != this.blockSize))
+         {
+            // Older streams of submitted blocks (any size up to blockSize)
+            // have a number of blocks in the header: index the block starts
+            // and read again
+            this.fixedSize = false;
+            position = position0;
+            read = 0;
+            continue;
+         }
+
+         if (blkOff >= block.length)
+            break;
+
+         final int n = Math.min(len-read, block.length-blkOff);
+         System.arraycopy(block, blkOff, buf, off+read, n);
+         read += n;
+         position += n;
+         this.prefetch(idx);
+      }
+
+      return (read == 0) ? -1 : read;
+   }
+
+
+   // Prefetch the next block when the blocks are read in sequence
+   private void prefetch(int idx)
+   {
+      final int prev = this.lastBlock;
+      this.lastBlock = idx;
+
+      if ((this.prefetcher == null) || (prev != idx-1) || (idx+1 >= this.offsets.length))
+         return;
+
+      this.cache.prefetch(new BlockCache.Key(this.fileKey, idx+2), this.loader(idx+2), this.prefetcher);
+   }
+
+
+   // Return the index of the block containing the decompressed byte at
+   // 'position' or -1 if past the last block
+   private int findBlock(long position) throws IOException
+   {
+      if (this.fixedSize == true)
+      {
+         final long idx = position / this.blockSize;
+         return (idx < this.offsets.length) ? (int) idx : -1;
+      }
+
+      // Variable block sizes: extend the index of block starts (decoding the
+      // blocks up to the position the first time)
+      synchronized (this.starts)
+      {
+         int lo = 0;
+         int hi = this.indexed;
+
+         while ((this.starts[this.indexed] <= position) && (this.indexed < this.offsets.length))
+         {
+            final int n = this.getBlock(this.indexed+1).length;
+            this.starts[this.indexed+1] = this.starts[this.indexed] + n;
+            this.indexed++;
+            hi = this.indexed;
+         }
+
+         if (position >= this.starts[this.indexed])
+            return -1;
+
+         // Binary search of the last start <= position
+         while (lo < hi-1)
+         {
+            final int mid = (lo+hi) >>> 1;
+
+            if (this.starts[mid] <= position)
+               lo = mid;
+            else
+               hi = mid;
+         }
+
+         return lo;
+      }
+   }
+
+
+   private long startOf(int idx)
+   {
+      if (this.fixedSize == true)
+         return (long) idx * this.blockSize;
+
+      synchronized (this.starts)
+      {
+         return this.starts[idx];
+      }
+   }
+
+
+   @Override
+   public void close() throws IOException
+   {
+      this.channel.close();
+   }
+}
@@ -30,6 +30,7 @@ import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Future;
 import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicInteger;
+import kanzi.Arena;
 import kanzi.BitStreamException;
 import kanzi.EntropyDecoder;
 import kanzi.Global;
@@ -44,11 +45,14 @@ import kanzi.Listener;
 
 // Implementation of a java.io.InputStream that can decode a stream
 // compressed with CompressedOutputStream
+// With the 'streaming' option (and a thread pool), the blocks are decoded
+// one at a time and the output of LZ-only blocks is returned while decoding.
 public class CompressedInputStream extends InputStream
 {
    private static final int BITSTREAM_TYPE           = 0x4B414E5A; // "KANZ"
-   private static final int BITSTREAM_FORMAT_VERSION = 1;
+   private static final int BITSTREAM_FORMAT_VERSION = 2;
    private static final int DEFAULT_BUFFER_SIZE      = 256*1024;
+   private static final int MIN_LZ_SECTIONS_SIZE     = 1024;
    private static final int EXTRA_BUFFER_SIZE        = 256;
    private static final int COPY_BLOCK_MASK          = 0x80;
    private static final int TRANSFORMS_MASK          = 0x10;
@@ -74,6 +78,11 @@ public class CompressedInputStream extends InputStream
    private int jobs;
    private final ExecutorService pool;
    private final List<Listener> listeners;
+   private final Arena[] arenas; // off-heap memory per job (null if disabled)
+   private final boolean streaming; // return the bytes of a block while it is decoded
+   private Future<Status> pending; // block being decoded (streaming)
+   private AtomicInteger progress; // bytes of the pending block decoded so far (streaming)
+   private boolean pendingDone; // end of the pending block task (guarded by progress)
    private final Map<String, Object> ctx;
 
 
@@ -115,6 +124,8 @@ public class CompressedInputStream extends InputStream
 
       this.blockId = new AtomicInteger(0);
       this.listeners = new ArrayList<>(10);
+      this.arenas = CompressedOutputStream.createArenas(ctx, this.jobs);
+      this.streaming = ((Boolean) ctx.getOrDefault("streaming", false) == true) && (threadPool != null);
       this.ctx = ctx;
       this.blockSize = 0;
       this.entropyType = EntropyCodecFactory.NONE_TYPE;
@@ -135,7 +146,7 @@ public class CompressedInputStream extends InputStream
       final int bsVersion = (int) this.ibs.readBits(4);
 
       // Sanity check
-      if (bsVersion != BITSTREAM_FORMAT_VERSION)
+      if ((bsVersion < 1) || (bsVersion > BITSTREAM_FORMAT_VERSION))
          throw new kanzi.io.IOException("Invalid bitstream, cannot read this version of the stream: " + bsVersion,
                  Error.ERR_STREAM_VERSION);
 
@@ -169,8 +180,11 @@ public class CompressedInputStream extends InputStream
       // Read number of blocks in input. 0 means 'unknown' and 63 means 63 or more.
       this.nbInputBlocks = (int) this.ibs.readBits(6);
 
+      // Read chunk table flag (entropy coded blocks start with a table of chunk sizes)
+      this.ctx.put("chunkTable", this.ibs.readBits(1) == 1);
+
       // Read reserved bits
-      this.ibs.readBits(4);
+      this.ibs.readBits(3);
 
       if (this.listeners.size() > 0)
       {
@@ -359,6 +373,9 @@ public class CompressedInputStream extends InputStream
 
       try
       {
+         if (this.streaming == true)
+            return this.processWindow();
+
          // Add a padding area to manage any block with header or temporarily expanded
          final int blkSize = Math.max(this.blockSize+EXTRA_BUFFER_SIZE, this.blockSize+(this.blockSize>>4));
 
@@ -410,6 +427,10 @@ public class CompressedInputStream extends InputStream
 
                Map<String, Object> map = new HashMap<>(this.ctx);
                map.put("jobs", jobsPerTask[jobId]);
+
+               if (this.arenas != null)
+                  map.put("arena", this.arenas[jobId]);
+
                Callable<Status> task = new DecodingTask(this.buffers[2*jobId],
                        this.buffers[2*jobId+1], blkSize, this.transformType,
                        this.entropyType, firstBlockId+jobId+1,
@@ -499,6 +520,124 @@ public class CompressedInputStream extends InputStream
    }
 
 
+   // Streaming mode: the blocks are decoded one at a time by a pool thread.
+   // The LZ inverse transforms publish the number of bytes decoded so far when
+   // they are the only transform of the block (and signal the progress monitor
+   // the reader waits on), so these bytes can be returned before the end of
+   // the block. Other blocks are returned once decoded.
+   // The checksum of a block (if any) is verified at the end of the block.
+   // Return the end index of the available bytes or 0 at the end of stream.
+   private int processWindow() throws Exception
+   {
+      while (true)
+      {
+         if (this.pending == null)
+         {
+            final int blkSize = Math.max(this.blockSize+EXTRA_BUFFER_SIZE, this.blockSize+(this.blockSize>>4));
+            Listener[] blockListeners = this.listeners.toArray(new Listener[this.listeners.size()]);
+            this.buffers[0].index = 0;
+            this.buffers[1].index = 0;
+
+            if (this.buffers[0].array.length < blkSize+1024)
+            {
+               this.buffers[0].array = new byte[blkSize+1024];
+               this.buffers[0].length = blkSize+1024;
+            }
+
+            Map<String, Object> map = new HashMap<>(this.ctx);
+            map.put("jobs", this.jobs);
+            this.progress = new AtomicInteger(0);
+            map.put("progress", this.progress);
+
+            if (this.arenas != null)
+               map.put("arena", this.arenas[0]);
+
+            final DecodingTask task = new DecodingTask(this.buffers[0], this.buffers[1],
+                    blkSize, this.transformType, this.entropyType, this.blockId.get()+1,
+                    this.ibs, this.hasher, this.blockId, blockListeners, map);
+            final AtomicInteger prog = this.progress;
+            this.pendingDone = false;
+
+            // The codecs signal the progress monitor when they publish bytes.
+            // Signal it at the end of the task as well.
+            this.pending = this.pool.submit(new Callable<Status>()
+            {
+               @Override
+               public Status call() throws Exception
+               {
+                  try
+                  {
+                     return task.call();
+                  }
+                  finally
+                  {
+                     synchronized (prog)
+                     {
+                        CompressedInputStream.this.pendingDone = true;
+                        prog.notifyAll();
+                     }
+                  }
+               }
+            });
+
+            this.sa.index = 0;
+         }
+
+         int available = 0;
+
+         synchronized (this.progress)
+         {
+            // Wait for more decoded bytes or for the end of the task
+            while ((this.pendingDone == false) && (this.progress.get() <= this.sa.index))
+               this.progress.wait();
+
+            if (this.pendingDone == false)
+               available = this.progress.get();
+         }
+
+         if (available > 0)
+         {
+            // The decoding task writes the block to this.buffers[0]
+            this.sa.array = this.buffers[0].array;
+            return available;
+         }
+
+         final Status status = this.pending.get();
+         this.pending = null;
+
+         if (status.error != 0)
+            throw new kanzi.io.IOException(status.msg, status.error);
+
+         if (status.decoded > this.blockSize)
+            throw new kanzi.io.IOException("Invalid data", Error.ERR_PROCESS_BLOCK);
+
+         if (this.listeners.size() > 0)
+         {
+            Listener[] blockListeners = this.listeners.toArray(new Listener[this.listeners.size()]);
+            Event evt = new Event(Event.Type.AFTER_TRANSFORM, status.blockId,
+                    status.decoded, status.checksum, this.hasher != null, status.completionTime);
+
+            notifyListeners(blockListeners, evt);
+         }
+
+         if (status.skipped == true)
+            continue;
+
+         // End of stream
+         if (status.decoded == 0)
+            return 0;
+
+         if (status.decoded > this.sa.index)
+         {
+            this.sa.array = status.data;
+            return status.decoded;
+         }
+
+         // All the bytes of the block have been returned while decoding
+      }
+   }
+
+
    /**
     * Closes this input stream and releases any system resources associated
     * with the stream.
@@ -511,6 +650,21 @@ public class CompressedInputStream extends InputStream
       if (this.closed.getAndSet(true)== true)
          return;
 
+      if (this.pending != null)
+      {
+         // Let the block being decoded (streaming) complete before releasing the bitstream
+         try
+         {
+            this.pending.get();
+         }
+         catch (Exception e)
+         {
+            // Ignore
+         }
+
+         this.pending = null;
+      }
+
       try
       {
          this.ibs.close();
@@ -529,6 +683,12 @@ public class CompressedInputStream extends InputStream
 
       for (int i=0; i<this.buffers.length; i++)
          this.buffers[i] = new SliceByteArray(EMPTY_BYTE_ARRAY, 0);
+
+      if (this.arenas != null)
+      {
+         for (Arena arena : this.arenas)
+            arena.close();
+      }
    }
 
 
@@ -539,6 +699,23 @@ public class CompressedInputStream extends InputStream
    }
 
 
+   // Blocks ending with a LZ/LZX transform and coded with Huffman or ANS:
+   // the literal, token and match sections are coded with separate models
+   // (the section sizes are read before the entropy coded data).
+   private static boolean hasLZSections(long transformType, byte skipFlags, int entropyType, int length)
+   {
+      if (length < MIN_LZ_SECTIONS_SIZE)
+         return false;
+
+      if ((entropyType != EntropyCodecFactory.HUFFMAN_TYPE) &&
+         (entropyType != EntropyCodecFactory.ANS0_TYPE) && (entropyType != EntropyCodecFactory.ANS1_TYPE))
+         return false;
+
+      final int t = new TransformFactory().getLastApplied(transformType, skipFlags);
+      return (t == TransformFactory.LZ_TYPE) || (t == TransformFactory.LZX_TYPE);
+   }
+
+
    static void notifyListeners(Listener[] listeners, Event evt)
    {
       for (Listener bl : listeners)
@@ -741,22 +918,57 @@ public class CompressedInputStream extends InputStream
             final int savedIdx = data.index;
             this.ctx.put("size", preTransformLength);
 
-            // Each block is decoded separately
-            // Rebuild the entropy decoder to reset block statistics
-            ed = new EntropyCodecFactory().newDecoder(is, this.ctx, blockEntropyType);
+            // One section or literal, token and match sections of a LZ block
+            // (version 2 and above)
+            final int bsVersion = (Integer) this.ctx.getOrDefault("bsVersion", BITSTREAM_FORMAT_VERSION);
+            final int[] sections = new int[] { preTransformLength, 0, 0 };
 
-            // Block entropy decode
-            if (ed.decode(buffer.array, 0, preTransformLength) != preTransformLength)
+            if ((bsVersion >= 2) &&
+               (hasLZSections(blockTransformType, skipFlags, blockEntropyType, preTransformLength) == true))
             {
-               // Error => cancel concurrent decoding tasks
-               this.processedBlockId.set(CANCEL_TASKS_ID);
-               return new Status(data, currentBlockId, 0, checksum1, Error.ERR_PROCESS_BLOCK,
-                  "Entropy decoding failed");
+               sections[0] = (int) (is.readBits(length) & mask);
+               sections[1] = (int) (is.readBits(length) & mask);
+               sections[2] = preTransformLength - sections[0] - sections[1];
+
+               if ((sections[0] < 0) || (sections[1] < 0) || (sections[2] < 0))
+               {
+                  // Error => cancel concurrent decoding tasks
+                  this.processedBlockId.set(CANCEL_TASKS_ID);
+                  return new Status(data, currentBlockId, 0, checksum1, Error.ERR_READ_FILE,
+                     "Invalid LZ section lengths");
+               }
+            }
+
+            // Same contexts as the entropy encoder (type of data deduced from the
+            // transforms). Version 1 streams do not use the type of data.
+            this.ctx.put("blockType", (bsVersion < 2) ? Global.DataType.UNDEFINED :
+               new TransformFactory().getDataType(blockTransformType, skipFlags));
+            int start = 0;
+
+            for (int i=0; i<sections.length; i++)
+            {
+               if (sections[i] == 0)
+                  continue;
+
+               // Each block (section) is decoded separately
+               // Rebuild the entropy decoder to reset block statistics
+               ed = new EntropyCodecFactory().newDecoder(is, this.ctx, blockEntropyType);
+
+               // Block entropy decode
+               if (ed.decode(buffer.array, start, sections[i]) != sections[i])
+               {
+                  // Error => cancel concurrent decoding tasks
+                  this.processedBlockId.set(CANCEL_TASKS_ID);
+                  return new Status(data, currentBlockId, 0, checksum1, Error.ERR_PROCESS_BLOCK,
+                     "Entropy decoding failed");
+               }
+
+               ed.dispose();
+               ed = null;
+               start += sections[i];
             }
 
             is.close();
-            ed.dispose();
-            ed = null;
 
             if (this.listeners.length > 0)
             {
@@ -776,6 +988,11 @@ public class CompressedInputStream extends InputStream
                notifyListeners(this.listeners, evt);
             }
 
+            // Streaming: only the last inverse transform produces final bytes
+            if ((this.ctx.containsKey("progress") == true) &&
+               (new TransformFactory().getNbApplied(blockTransformType, skipFlags) != 1))
+               this.ctx.remove("progress");
+
             Sequence transform = new TransformFactory().newFunction(this.ctx,
                      blockTransformType);
             transform.setSkipFlags(skipFlags);
@@ -0,0 +1,233 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.io.InputStream;
+import java.util.Map;
+import kanzi.BitStreamException;
+import kanzi.Error;
+import kanzi.InputBitStream;
+import kanzi.IntTransform;
+import kanzi.SliceIntArray;
+import kanzi.bitstream.DefaultInputBitStream;
+import kanzi.entropy.IntBlockDecoder;
+import kanzi.transform.IntTransformFactory;
+
+
+// Decompressor for the streams of ints produced by CompressedIntOutputStream.
+// The parameters (transforms, block size) are read from the stream header.
+public class CompressedIntInputStream implements Closeable
+{
+   private static final int DEFAULT_BUFFER_SIZE = 256*1024;
+
+   private final InputBitStream ibs;
+   private IntTransform transform; // null if no transform
+   private IntBlockDecoder decoder;
+   private int blockSize;
+   private int[] block;
+   private int[] buffer;
+   private int index; // position of the next int in block
+   private int size;  // number of ints in block
+   private boolean initialized;
+   private boolean closed;
+   private boolean eos;
+
+
+   public CompressedIntInputStream(InputStream is, Map<String, Object> ctx)
+   {
+      this(new DefaultInputBitStream(is, DEFAULT_BUFFER_SIZE), ctx);
+   }
+
+
+   // Allow caller to provide custom input bitstream
+   public CompressedIntInputStream(InputBitStream ibs, Map<String, Object> ctx)
+   {
+      if (ibs == null)
+         throw new NullPointerException("Invalid null input bitstream parameter");
+
+      if (ctx == null)
+         throw new NullPointerException("Invalid null context parameter");
+
+      this.ibs = ibs;
+   }
+
+
+   protected void readHeader() throws IOException
+   {
+      try
+      {
+         final int type = (int) this.ibs.readBits(32);
+
+         if (type != CompressedIntOutputStream.BITSTREAM_TYPE)
+            throw new kanzi.io.IOException("Invalid stream type", Error.ERR_INVALID_FILE);
+
+         final int version = (int) this.ibs.readBits(4);
+
+         if (version != CompressedIntOutputStream.BITSTREAM_FORMAT_VERSION)
+            throw new kanzi.io.IOException("Invalid bitstream, cannot read this version of the stream: "+version,
+               Error.ERR_STREAM_VERSION);
+
+         final int transformType = (int) this.ibs.readBits(16);
+         final int bSize = (int) this.ibs.readBits(32);
+
+         if ((bSize < CompressedIntOutputStream.MIN_BLOCK_SIZE) ||
+            (bSize > CompressedIntOutputStream.MAX_BLOCK_SIZE))
+            throw new kanzi.io.IOException("Invalid bitstream, incorrect block size: "+bSize,
+               Error.ERR_BLOCK_SIZE);
+
+         try
+         {
+            this.transform = new IntTransformFactory().newFunction(transformType);
+         }
+         catch (IllegalArgumentException e)
+         {
+            throw new kanzi.io.IOException("Invalid bitstream, unknown transform type: "+
+               Integer.toHexString(transformType), Error.ERR_INVALID_CODEC);
+         }
+
+         this.blockSize = bSize;
+         this.decoder = new IntBlockDecoder(this.ibs);
+         final int maxLength = (this.transform == null) ? bSize :
+            this.transform.getMaxEncodedLength(bSize);
+
+         // The inverse transforms may use the output block for intermediate
+         // results, which can be longer than the block size
+         this.block = new int[maxLength];
+         this.buffer = (this.transform == null) ? this.block : new int[maxLength];
+      }
+      catch (BitStreamException e)
+      {
+         throw new kanzi.io.IOException("Cannot read bitstream header: "+e.getMessage(),
+            Error.ERR_READ_FILE);
+      }
+   }
+
+
+   // Read at most 'len' ints into 'data'. Return the number of ints read or -1
+   // if the end of stream has been reached.
+   public int read(int[] data, int off, int len) throws IOException
+   {
+      if ((off < 0) || (len < 0) || (len + off > data.length))
+         throw new IndexOutOfBoundsException();
+
+      if (this.closed == true)
+         throw new kanzi.io.IOException("Stream closed", Error.ERR_READ_FILE);
+
+      int remaining = len;
+
+      while (remaining > 0)
+      {
+         if (this.index == this.size)
+         {
+            if (this.processBlock() == false)
+               break;
+         }
+
+         final int chunk = Math.min(remaining, this.size-this.index);
+         System.arraycopy(this.block, this.index, data, off, chunk);
+         this.index += chunk;
+         off += chunk;
+         remaining -= chunk;
+      }
+
+      return ((remaining == len) && (len != 0)) ? -1 : len - remaining;
+   }
+
+
+   // Decode the next block. Return false at the end of stream.
+   private boolean processBlock() throws IOException
+   {
+      if (this.initialized == false)
+      {
+         this.readHeader();
+         this.initialized = true;
+      }
+
+      if (this.eos == true)
+         return false;
+
+      try
+      {
+         final int length = (int) this.ibs.readBits(32);
+
+         if (length == 0)
+         {
+            this.eos = true;
+            return false;
+         }
+
+         if ((length < 0) || (length > this.buffer.length))
+            throw new kanzi.io.IOException("Invalid bitstream, incorrect block length: "+length,
+               Error.ERR_PROCESS_BLOCK);
+
+         if (this.decoder.decode(this.buffer, 0, length) != length)
+            throw new kanzi.io.IOException("Int entropy decoding failed", Error.ERR_PROCESS_BLOCK);
+
+         int count = length;
+
+         if (this.transform != null)
+         {
+            SliceIntArray src = new SliceIntArray(this.buffer, length, 0);
+            SliceIntArray dst = new SliceIntArray(this.block, this.block.length, 0);
+
+            if (this.transform.inverse(src, dst) == false)
+               throw new kanzi.io.IOException("Int inverse transform failed", Error.ERR_PROCESS_BLOCK);
+
+            count = dst.index;
+         }
+
+         if (count > this.blockSize)
+            throw new kanzi.io.IOException("Invalid bitstream, incorrect block length: "+count,
+               Error.ERR_PROCESS_BLOCK);
+
+         this.index = 0;
+         this.size = count;
+         return true;
+      }
+      catch (BitStreamException e)
+      {
+         throw new kanzi.io.IOException(e.getMessage(), Error.ERR_READ_FILE);
+      }
+   }
+
+
+   // Return the number of bytes read so far
+   public long getRead()
+   {
+      return (this.ibs.read() + 7) >> 3;
+   }
+
+
+   @Override
+   public void close() throws IOException
+   {
+      if (this.closed == true)
+         return;
+
+      this.closed = true;
+
+      try
+      {
+         this.ibs.close();
+      }
+      catch (BitStreamException e)
+      {
+         throw new kanzi.io.IOException(e.getMessage(), Error.ERR_READ_FILE);
+      }
+   }
+}
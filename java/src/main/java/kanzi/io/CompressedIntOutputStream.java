@@ -0,0 +1,210 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.util.Map;
+import kanzi.BitStreamException;
+import kanzi.Error;
+import kanzi.IntTransform;
+import kanzi.OutputBitStream;
+import kanzi.SliceIntArray;
+import kanzi.bitstream.DefaultOutputBitStream;
+import kanzi.entropy.IntBlockEncoder;
+import kanzi.transform.IntTransformFactory;
+
+
+// Compressed stream of ints (time series, posting lists, ...). The ints are
+// processed by blocks: each block goes through a sequence of int transforms
+// (DELTA, ZIGZAG, FOR) and is then entropy coded by an IntBlockEncoder which
+// selects the coding mode (bit packing, Rice, Exp-Golomb, ANS) per block.
+// Context parameters: "transform" (default DELTA+ZIGZAG) and "blockSize"
+// (number of ints per block).
+public class CompressedIntOutputStream implements Closeable
+{
+   static final int BITSTREAM_TYPE           = 0x4B494E54; // "KINT"
+   static final int BITSTREAM_FORMAT_VERSION = 1;
+   static final int MIN_BLOCK_SIZE           = 256;
+   static final int MAX_BLOCK_SIZE           = 16*1024*1024;
+   public static final int DEFAULT_BLOCK_SIZE = 64*1024;
+   public static final String DEFAULT_TRANSFORM = "DELTA+ZIGZAG";
+   private static final int DEFAULT_BUFFER_SIZE = 256*1024;
+
+   private final OutputBitStream obs;
+   private final int transformType;
+   private final IntTransform transform; // null if no transform
+   private final IntBlockEncoder encoder;
+   private final int blockSize;
+   private final int[] block;
+   private final int[] buffer;
+   private int count; // number of ints in the current block
+   private boolean initialized;
+   private boolean closed;
+
+
+   public CompressedIntOutputStream(OutputStream os, Map<String, Object> ctx)
+   {
+      this(new DefaultOutputBitStream(os, DEFAULT_BUFFER_SIZE), ctx);
+   }
+
+
+   // Allow caller to provide custom output bitstream
+   public CompressedIntOutputStream(OutputBitStream obs, Map<String, Object> ctx)
+   {
+      if (obs == null)
+         throw new NullPointerException("Invalid null output bitstream parameter");
+
+      if (ctx == null)
+         throw new NullPointerException("Invalid null context parameter");
+
+      final String transform = (String) ctx.getOrDefault("transform", DEFAULT_TRANSFORM);
+      final int bSize = (Integer) ctx.getOrDefault("blockSize", DEFAULT_BLOCK_SIZE);
+
+      if (bSize > MAX_BLOCK_SIZE)
+         throw new IllegalArgumentException("The block size must be at most "+MAX_BLOCK_SIZE+" ints");
+
+      if (bSize < MIN_BLOCK_SIZE)
+         throw new IllegalArgumentException("The block size must be at least "+MIN_BLOCK_SIZE+" ints");
+
+      IntTransformFactory factory = new IntTransformFactory();
+      this.obs = obs;
+      this.transformType = factory.getType(transform);
+      this.transform = factory.newFunction(this.transformType);
+      this.encoder = new IntBlockEncoder(obs);
+      this.blockSize = bSize;
+      this.block = new int[bSize];
+      this.buffer = (this.transform == null) ? this.block :
+         new int[this.transform.getMaxEncodedLength(bSize)];
+   }
+
+
+   protected void writeHeader() throws IOException
+   {
+      if (this.obs.writeBits(BITSTREAM_TYPE, 32) != 32)
+         throw new kanzi.io.IOException("Cannot write bitstream type to header", Error.ERR_WRITE_FILE);
+
+      if (this.obs.writeBits(BITSTREAM_FORMAT_VERSION, 4) != 4)
+         throw new kanzi.io.IOException("Cannot write bitstream version to header", Error.ERR_WRITE_FILE);
+
+      if (this.obs.writeBits(this.transformType, 16) != 16)
+         throw new kanzi.io.IOException("Cannot write transform types to header", Error.ERR_WRITE_FILE);
+
+      if (this.obs.writeBits(this.blockSize, 32) != 32)
+         throw new kanzi.io.IOException("Cannot write block size to header", Error.ERR_WRITE_FILE);
+   }
+
+
+   public void write(int value) throws IOException
+   {
+      if (this.count == this.blockSize)
+         this.processBlock();
+
+      this.block[this.count++] = value;
+   }
+
+
+   public void write(int[] data, int off, int len) throws IOException
+   {
+      if ((off < 0) || (len < 0) || (len + off > data.length))
+         throw new IndexOutOfBoundsException();
+
+      while (len > 0)
+      {
+         if (this.count == this.blockSize)
+            this.processBlock();
+
+         final int chunk = Math.min(len, this.blockSize-this.count);
+         System.arraycopy(data, off, this.block, this.count, chunk);
+         this.count += chunk;
+         off += chunk;
+         len -= chunk;
+      }
+   }
+
+
+   private void processBlock() throws IOException
+   {
+      if (this.closed == true)
+         throw new kanzi.io.IOException("Stream closed", Error.ERR_WRITE_FILE);
+
+      try
+      {
+         if (this.initialized == false)
+         {
+            this.writeHeader();
+            this.initialized = true;
+         }
+
+         if (this.count == 0)
+            return;
+
+         int length = this.count;
+
+         if (this.transform != null)
+         {
+            SliceIntArray src = new SliceIntArray(this.block, this.count, 0);
+            SliceIntArray dst = new SliceIntArray(this.buffer, this.buffer.length, 0);
+
+            if (this.transform.forward(src, dst) == false)
+               throw new kanzi.io.IOException("Int transform failed", Error.ERR_PROCESS_BLOCK);
+
+            length = dst.index;
+         }
+
+         // Block length after transform (0 marks the end of stream)
+         this.obs.writeBits(length, 32);
+
+         if (this.encoder.encode(this.buffer, 0, length) != length)
+            throw new kanzi.io.IOException("Int entropy coding failed", Error.ERR_PROCESS_BLOCK);
+
+         this.count = 0;
+      }
+      catch (BitStreamException e)
+      {
+         throw new kanzi.io.IOException(e.getMessage(), Error.ERR_WRITE_FILE);
+      }
+   }
+
+
+   // Return the number of bytes written so far
+   public long getWritten()
+   {
+      return (this.obs.written() + 7) >> 3;
+   }
+
+
+   @Override
+   public void close() throws IOException
+   {
+      if (this.closed == true)
+         return;
+
+      this.processBlock();
+      this.closed = true;
+
+      try
+      {
+         this.obs.writeBits(0, 32);
+         this.obs.close();
+      }
+      catch (BitStreamException e)
+      {
+         throw new kanzi.io.IOException(e.getMessage(), Error.ERR_WRITE_FILE);
+      }
+   }
+}
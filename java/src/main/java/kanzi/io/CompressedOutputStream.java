@@ -21,18 +21,24 @@ import kanzi.Error;
 import kanzi.Event;
 import java.io.IOException;
 import java.io.OutputStream;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
+import java.util.BitSet;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.concurrent.Callable;
+import java.util.concurrent.ConcurrentSkipListMap;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Future;
 import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicInteger;
+import kanzi.Arena;
 import kanzi.BitStreamException;
 import kanzi.EntropyEncoder;
 import kanzi.Global;
+import kanzi.Histograms;
+import kanzi.Memory;
 import kanzi.SliceByteArray;
 import kanzi.OutputBitStream;
 import kanzi.bitstream.DefaultOutputBitStream;
@@ -48,19 +54,24 @@ import kanzi.entropy.EntropyUtils;
 // using a 2 step process:
 // - step 1: a ByteFunction is used to reduce the size of the input data (bytes input & output)
 // - step 2: an EntropyEncoder is used to entropy code the results of step 1 (bytes input, bits output)
+// Whole blocks can also be submitted concurrently by several producers (see
+// newTicket and submitBlock). They are emitted in ticket order.
 public class CompressedOutputStream extends OutputStream
 {
    private static final int BITSTREAM_TYPE           = 0x4B414E5A; // "KANZ"
-   private static final int BITSTREAM_FORMAT_VERSION = 1;
+   private static final int BITSTREAM_FORMAT_VERSION = 2;
    private static final int COPY_BLOCK_MASK          = 0x80;
    private static final int TRANSFORMS_MASK          = 0x10;
    private static final int MIN_BITSTREAM_BLOCK_SIZE = 1024;
    private static final int MAX_BITSTREAM_BLOCK_SIZE = 1024*1024*1024;
    private static final int DEFAULT_BUFFER_SIZE      = 256*1024;
    private static final int SMALL_BLOCK_SIZE         = 15;
+   private static final int MIN_LZ_SECTIONS_SIZE     = 1024;
    private static final byte[] EMPTY_BYTE_ARRAY      = new byte[0];
    private static final int MAX_CONCURRENCY          = 64;
    private static final int CANCEL_TASKS_ID          = -1;
+   private static final int SPLIT_CHUNK_SIZE         = 4096;
+   private static final int MIN_SPLIT_SIZE           = 16*SPLIT_CHUNK_SIZE;
 
    private final int blockSize;
    private final int nbInputBlocks;
@@ -74,9 +85,23 @@ public class CompressedOutputStream extends OutputStream
    private final AtomicBoolean closed;
    private final AtomicInteger blockId;
    private final int jobs;
+   private final boolean splitBlocks;
+   private final boolean chunkTable;
+   private final boolean staged; // entropy coding overlaps the next transforms
+   private final List<Future<Status>> stages; // pending entropy stages
+   private int bufferBase; // first buffer of the current batch (staged: 2 sets)
    private final ExecutorService pool;
    private final List<Listener> listeners;
+   private final Arena[] arenas; // off-heap memory per job (null if disabled)
    private final Map<String, Object> ctx;
+   private final AtomicInteger tickets; // last block id reserved for submission
+   private final ConcurrentSkipListMap<Integer, EncodingTask> deferred; // submitted blocks waiting for their turn
+   private int pendingBlocks; // submitted blocks not encoded yet (guarded by deferred)
+   private final BitSet usedTickets; // tickets already submitted (guarded by deferred)
+   private final Checkpoint checkpoint; // null unless checkpoints are enabled
+   private final long outputBase; // bits written by previous runs (resumed job)
+   private long consumed; // input bytes in the blocks processed so far
+   private long lastCheckpoint; // value of consumed at the last checkpoint
 
 
    public CompressedOutputStream(OutputStream os, Map<String, Object> ctx)
@@ -147,9 +172,16 @@ public class CompressedOutputStream extends OutputStream
       this.hasher = (checksum == true) ? new XXHash32(BITSTREAM_TYPE) : null;
       this.jobs = tasks;
       this.pool = threadPool;
+      this.splitBlocks = (Boolean) ctx.getOrDefault("splitBlocks", false);
+      this.chunkTable = (Boolean) ctx.getOrDefault("chunkTable", false);
+      this.staged = (threadPool != null) && ((Boolean) ctx.getOrDefault("staged", false) == true);
+      this.stages = new ArrayList<>();
       ctx.put("bsVersion", BITSTREAM_FORMAT_VERSION);
       this.sa = new SliceByteArray(new byte[0], 0);
-      this.buffers = new SliceByteArray[2*this.jobs];
+
+      // Staged execution: the buffers of a batch are in use until its entropy
+      // stages complete, the next batch uses a second set
+      this.buffers = new SliceByteArray[((this.staged == true) ? 4 : 2)*this.jobs];
       this.closed = new AtomicBoolean(false);
       this.initialized = new AtomicBoolean(false);
 
@@ -158,7 +190,56 @@ public class CompressedOutputStream extends OutputStream
 
       this.blockId = new AtomicInteger(0);
       this.listeners = new ArrayList<>(10);
+      this.arenas = createArenas(ctx, this.jobs);
       this.ctx = ctx;
+      this.tickets = new AtomicInteger(0);
+      this.deferred = new ConcurrentSkipListMap<>();
+      this.usedTickets = new BitSet();
+      this.checkpoint = (Checkpoint) ctx.get("checkpoint");
+      long base = 0;
+
+      if (this.checkpoint != null)
+      {
+         if ((obs instanceof DefaultOutputBitStream) == false)
+            throw new IllegalArgumentException("Checkpoints require a default output bitstream");
+
+         if ((Boolean) ctx.getOrDefault("resume", false) == true)
+         {
+            if (this.checkpoint.getFormatVersion() != BITSTREAM_FORMAT_VERSION)
+               throw new IllegalArgumentException("The checkpoint was saved with bitstream version " +
+                  this.checkpoint.getFormatVersion() + ", cannot resume with version " + BITSTREAM_FORMAT_VERSION);
+
+            // The header and the blocks up to the checkpoint are already in
+            // the output. Write the trailing bits of the last saved byte again.
+            this.initialized.set(true);
+            this.blockId.set(this.checkpoint.getBlockId());
+            this.consumed = this.checkpoint.getInputOffset();
+            this.lastCheckpoint = this.consumed;
+            base = this.checkpoint.getOutputOffset() << 3;
+
+            if (this.checkpoint.getPendingCount() > 0)
+               obs.writeBits(this.checkpoint.getPendingBits(), this.checkpoint.getPendingCount());
+         }
+
+         this.checkpoint.setParameters(fileSize, bSize, transform, entropyCodec, checksum,
+            this.splitBlocks, this.chunkTable, BITSTREAM_FORMAT_VERSION);
+      }
+
+      this.outputBase = base;
+   }
+
+
+   // Write the header once, before the first block (producers may race)
+   private void initialize() throws IOException
+   {
+      synchronized (this.initialized)
+      {
+         if (this.initialized.get() == false)
+         {
+            this.writeHeader();
+            this.initialized.set(true);
+         }
+      }
    }
 
    protected void writeHeader() throws IOException
@@ -181,10 +262,18 @@ public class CompressedOutputStream extends OutputStream
       if (this.obs.writeBits(this.blockSize >>> 4, 28) != 28)
          throw new kanzi.io.IOException("Cannot write block size to header", Error.ERR_WRITE_FILE);
 
-      if (this.obs.writeBits(this.nbInputBlocks, 6) != 6)
+      // The number of blocks is unknown when blocks are split on content or
+      // submitted (the submitted blocks may be smaller than blockSize)
+      final int nbBlocks = ((this.splitBlocks == true) || (this.tickets.get() != 0)) ? 0 : this.nbInputBlocks;
+
+      if (this.obs.writeBits(nbBlocks, 6) != 6)
          throw new kanzi.io.IOException("Cannot write number of blocks to header", Error.ERR_WRITE_FILE);
 
-      if (this.obs.writeBits(0L, 4) != 4)
+      // Entropy coded blocks start with a table of chunk sizes
+      if (this.obs.writeBits((this.chunkTable == true) ? 1 : 0, 1) != 1)
+         throw new kanzi.io.IOException("Cannot write chunk table flag to header", Error.ERR_WRITE_FILE);
+
+      if (this.obs.writeBits(0L, 3) != 3)
          throw new kanzi.io.IOException("Cannot write reserved bits to header", Error.ERR_WRITE_FILE);
    }
 
@@ -350,9 +439,13 @@ public class CompressedOutputStream extends OutputStream
       if (this.closed.getAndSet(true) == true)
          return;
 
-      if (this.sa.index > 0)
+      // Split blocks may leave data to process after each batch
+      while (this.sa.index > 0)
          this.processBlock(true);
 
+      this.waitForStages();
+      this.waitForSubmissions();
+
       try
       {
          // Write end block of size 0
@@ -375,6 +468,27 @@ public class CompressedOutputStream extends OutputStream
 
       for (int i=0; i<this.buffers.length; i++)
          this.buffers[i] = new SliceByteArray(EMPTY_BYTE_ARRAY, 0);
+
+      if (this.arenas != null)
+      {
+         for (Arena arena : this.arenas)
+            arena.close();
+      }
+   }
+
+
+   // Create one arena per job if off-heap memory is enabled (ctx 'offHeap')
+   static Arena[] createArenas(Map<String, Object> ctx, int jobs)
+   {
+      if ((Boolean) ctx.getOrDefault("offHeap", false) == false)
+         return null;
+
+      Arena[] arenas = new Arena[jobs];
+
+      for (int i=0; i<jobs; i++)
+         arenas[i] = new Arena();
+
+      return arenas;
    }
 
 
@@ -398,8 +512,10 @@ public class CompressedOutputStream extends OutputStream
       if (this.sa.index == 0)
          return;
 
-      if (this.initialized.getAndSet(true) == false)
-         this.writeHeader();
+      if (this.tickets.get() != 0)
+         throw new kanzi.io.IOException("Cannot mix stream writes and block submissions", Error.ERR_WRITE_FILE);
+
+      this.initialize();
 
       try
       {
@@ -407,42 +523,66 @@ public class CompressedOutputStream extends OutputStream
          Listener[] blockListeners = this.listeners.toArray(new Listener[this.listeners.size()]);
          final int dataLength = this.sa.index;
          this.sa.index = 0;
-         List<Callable<Status>> tasks = new ArrayList<>(this.jobs);
+         List<EncodingTask> tasks = new ArrayList<>(this.jobs);
+         List<Map<String, Object>> contexts = new ArrayList<>(this.jobs);
          int firstBlockId = this.blockId.get();
+         final SliceByteArray[] bufs = this.buffers;
+         final int base = this.bufferBase;
 
          // Create as many tasks as required
          for (int jobId=0; jobId<this.jobs; jobId++)
          {
-            final int sz = (this.sa.index + this.blockSize > dataLength) ?
+            int sz = (this.sa.index + this.blockSize > dataLength) ?
                     dataLength - this.sa.index : this.blockSize;
 
             if (sz == 0)
                break;
 
-            this.buffers[2*jobId].index = 0;
-            this.buffers[2*jobId+1].index = 0;
+            // Cut the block at the first text/binary transition (if any)
+            if (this.splitBlocks == true)
+               sz = findSplit(this.sa.array, this.sa.index, sz, this.blockSize);
+
+            bufs[base+2*jobId].index = 0;
+            bufs[base+2*jobId+1].index = 0;
 
             // Add padding for incompressible data
             final int length = Math.max(sz+(sz>>6), 65536);
 
             // Grow encoding buffer if required
-            if (this.buffers[2*jobId].array.length < length)
+            if (bufs[base+2*jobId].array.length < length)
             {
-               this.buffers[2*jobId].array = new byte[length];
-               this.buffers[2*jobId].length = length;
+               bufs[base+2*jobId].array = new byte[length];
+               bufs[base+2*jobId].length = length;
             }
 
-            System.arraycopy(this.sa.array, this.sa.index, this.buffers[2*jobId].array, 0, sz);
+            System.arraycopy(this.sa.array, this.sa.index, bufs[base+2*jobId].array, 0, sz);
+            Map<String, Object> map = new HashMap<>(this.ctx);
+
+            if (this.arenas != null)
+               map.put("arena", this.arenas[jobId]);
 
-            Callable<Status> task = new EncodingTask(this.buffers[2*jobId],
-                    this.buffers[2*jobId+1], sz, this.transformType,
+            EncodingTask task = new EncodingTask(bufs[base+2*jobId],
+                    bufs[base+2*jobId+1], sz, this.transformType,
                     this.entropyType, firstBlockId+jobId+1,
                     this.obs, this.hasher, this.blockId,
-                    blockListeners, new HashMap<>(this.ctx));
+                    blockListeners, map, null);
+            task.staged = this.staged;
             tasks.add(task);
+            contexts.add(map);
             this.sa.index += sz;
          }
 
+         // Give the jobs not used by block tasks to the transforms (EG. TextCodec).
+         // Staged: the entropy stages of the previous batch run on the pool with
+         // the transforms of this batch and both may submit nested tasks (text
+         // and LZX segments, chunks). Each batch gets half of the jobs, so that
+         // pool threads remain available for the nested tasks.
+         final int batchJobs = (this.staged == true) ? Math.max(this.jobs/2, 1) : this.jobs;
+         final int[] jobsPerTask = Global.computeJobsPerTask(new int[tasks.size()], batchJobs, tasks.size());
+
+         for (int i=0; i<contexts.size(); i++)
+            contexts.get(i).put("jobs", jobsPerTask[i]);
+
          if (tasks.size() == 1)
          {
             // Synchronous call
@@ -464,7 +604,32 @@ public class CompressedOutputStream extends OutputStream
             }
          }
 
-         this.sa.index = 0;
+         if (this.staged == true)
+         {
+            // Bounded pipeline: wait for the entropy stages of the previous
+            // batch, then start the ones of this batch and switch buffer sets
+            this.waitForStages();
+
+            for (EncodingTask task : tasks)
+            {
+               if (task.entropyStage != null)
+                  this.stages.add(this.pool.submit(task.entropyStage));
+            }
+
+            this.bufferBase = (this.bufferBase == 0) ? 2*this.jobs : 0;
+         }
+
+         // Move unprocessed data (split blocks only) to the beginning of the buffer
+         final int remaining = dataLength - this.sa.index;
+         this.consumed += this.sa.index;
+
+         if (remaining > 0)
+            System.arraycopy(this.sa.array, this.sa.index, this.sa.array, 0, remaining);
+
+         this.sa.index = remaining;
+
+         if ((this.checkpoint != null) && (this.consumed-this.lastCheckpoint >= this.checkpoint.getInterval()))
+            this.saveCheckpoint();
       }
       catch (kanzi.io.IOException e)
       {
@@ -479,10 +644,248 @@ public class CompressedOutputStream extends OutputStream
    }
 
 
+   // Flush the output up to the last completed block and record the position
+   // of the job in the checkpoint file
+   private void saveCheckpoint() throws IOException
+   {
+      // All the blocks consumed so far must be in the output
+      this.waitForStages();
+      final DefaultOutputBitStream dobs = (DefaultOutputBitStream) this.obs;
+      dobs.sync();
+      final int count = dobs.pendingCount();
+      final long offset = (this.outputBase + dobs.written() - count) >> 3;
+      this.checkpoint.update(this.consumed, this.blockId.get(), offset, dobs.pendingBits(), count);
+      this.checkpoint.save();
+      this.lastCheckpoint = this.consumed;
+   }
+
+
+   // Return the size of the next block. The block is cut at the first confirmed
+   // transition between text and binary data located after the minimum block
+   // size, so that each block gets a uniform transform decision.
+   private static int findSplit(byte[] buf, int start, int length, int blockSize)
+   {
+      final int minSize = Math.max(blockSize>>3, MIN_SPLIT_SIZE);
+
+      if (length < minSize+2*SPLIT_CHUNK_SIZE)
+         return length;
+
+      // Type of the data before the cut point candidates
+      final boolean isText = isTextChunk(buf, start+minSize-SPLIT_CHUNK_SIZE);
+      final int end = start + length - 2*SPLIT_CHUNK_SIZE;
+
+      for (int i=start+minSize; i<=end; i+=SPLIT_CHUNK_SIZE)
+      {
+         // Require 2 consecutive chunks of the other type to ignore outliers
+         if ((isTextChunk(buf, i) != isText) && (isTextChunk(buf, i+SPLIT_CHUNK_SIZE) != isText))
+            return i - start;
+      }
+
+      return length;
+   }
+
+
+   // Sliding classifier: a chunk is text if it has (almost) no control characters
+   private static boolean isTextChunk(byte[] buf, int start)
+   {
+      final int end = start + SPLIT_CHUNK_SIZE;
+      int controls = 0;
+
+      for (int i=start; i<end; i++)
+      {
+         final int c = buf[i] & 0xFF;
+
+         // Ignore TAB, LF and CR
+         if (((c < 32) && (c != 9) && (c != 10) && (c != 13)) || (c == 127))
+            controls++;
+      }
+
+      return controls < (SPLIT_CHUNK_SIZE>>6);
+   }
+
+
+   // Blocks ending with a LZ/LZX transform and coded with Huffman or ANS:
+   // the literal, token and match sections are coded with separate models
+   // (the section sizes are written before the entropy coded data, version 2 and above).
+   private static boolean hasLZSections(long transformType, byte skipFlags, int entropyType, int length)
+   {
+      if (length < MIN_LZ_SECTIONS_SIZE)
+         return false;
+
+      if ((entropyType != EntropyCodecFactory.HUFFMAN_TYPE) &&
+         (entropyType != EntropyCodecFactory.ANS0_TYPE) && (entropyType != EntropyCodecFactory.ANS1_TYPE))
+         return false;
+
+      final int t = new TransformFactory().getLastApplied(transformType, skipFlags);
+      return (t == TransformFactory.LZ_TYPE) || (t == TransformFactory.LZX_TYPE);
+   }
+
+
+   // Reserve the position of the next submitted block in the stream.
+   // Tickets are consecutive, each one must be used by exactly one submission
+   // (a reused ticket is rejected).
+   public int newTicket()
+   {
+      if (this.sa.length != 0)
+         throw new IllegalStateException("Cannot mix stream writes and block submissions");
+
+      if (this.checkpoint != null)
+         throw new IllegalStateException("Checkpoints are not supported with block submissions");
+
+      return this.tickets.incrementAndGet();
+   }
+
+
+   public Future<Integer> submitBlock(int ticket, ByteBuffer buffer) throws IOException
+   {
+      if (buffer.hasArray() == false)
+      {
+         final byte[] data = new byte[buffer.remaining()];
+         buffer.get(data);
+         return this.submitBlock(ticket, data, 0, data.length);
+      }
+
+      final int len = buffer.remaining();
+      Future<Integer> res = this.submitBlock(ticket, buffer.array(), buffer.arrayOffset()+buffer.position(), len);
+      buffer.position(buffer.position()+len);
+      return res;
+   }
+
+
+   // Encode a block (at most blockSize bytes) on the thread pool. May be called
+   // concurrently by several producers. The block is emitted after the blocks
+   // with lower tickets. The future returns the size of the block once encoded.
+   public Future<Integer> submitBlock(int ticket, byte[] data, int off, final int len) throws IOException
+   {
+      if ((off < 0) || (len < 0) || (len + off > data.length))
+         throw new IndexOutOfBoundsException();
+
+      if ((len == 0) || (len > this.blockSize))
+         throw new IllegalArgumentException("Invalid block size (must be in [1.." + this.blockSize + "]): " + len);
+
+      if ((ticket <= 0) || (ticket > this.tickets.get()))
+         throw new IllegalArgumentException("Invalid ticket: " + ticket);
+
+      if (this.pool == null)
+         throw new IllegalStateException("Block submission requires a thread pool");
+
+      if (this.closed.get() == true)
+         throw new kanzi.io.IOException("Stream closed", Error.ERR_WRITE_FILE);
+
+      this.initialize();
+
+      // Add padding for incompressible data
+      final SliceByteArray input = new SliceByteArray(new byte[Math.max(len+(len>>6), 65536)], 0);
+      System.arraycopy(data, off, input.array, 0, len);
+      Listener[] blockListeners = this.listeners.toArray(new Listener[this.listeners.size()]);
+      Map<String, Object> map = new HashMap<>(this.ctx);
+
+      // Pool threads are shared by all submissions: no nested concurrent tasks
+      map.put("jobs", 1);
+
+      final EncodingTask task = new EncodingTask(input,
+              new SliceByteArray(EMPTY_BYTE_ARRAY, 0), len, this.transformType,
+              this.entropyType, ticket, this.obs, this.hasher, this.blockId,
+              blockListeners, map, this.deferred);
+
+      synchronized (this.deferred)
+      {
+         // A reused ticket would overwrite another block or never be emitted
+         if (this.usedTickets.get(ticket) == true)
+            throw new IllegalArgumentException("Ticket already used: " + ticket);
+
+         this.usedTickets.set(ticket);
+         this.pendingBlocks++;
+      }
+
+      return this.pool.submit(new Callable<Integer>()
+      {
+         @Override
+         public Integer call() throws Exception
+         {
+            try
+            {
+               Status status = task.call();
+
+               if (status.error != 0)
+                  throw new kanzi.io.IOException(status.msg, status.error);
+
+               return len;
+            }
+            finally
+            {
+               synchronized (CompressedOutputStream.this.deferred)
+               {
+                  CompressedOutputStream.this.pendingBlocks--;
+                  CompressedOutputStream.this.deferred.notifyAll();
+               }
+            }
+         }
+      });
+   }
+
+
+   // Wait for the pending entropy stages (staged execution) and check the results
+   private void waitForStages() throws IOException
+   {
+      try
+      {
+         for (Future<Status> result : this.stages)
+         {
+            Status status = result.get();
+
+            if (status.error != 0)
+               throw new kanzi.io.IOException(status.msg, status.error);
+         }
+      }
+      catch (kanzi.io.IOException e)
+      {
+         throw e;
+      }
+      catch (Exception e)
+      {
+         throw new kanzi.io.IOException(e.getMessage(), Error.ERR_PROCESS_BLOCK);
+      }
+      finally
+      {
+         this.stages.clear();
+      }
+   }
+
+
+   // Wait until all submitted blocks are encoded and check that they were emitted
+   private void waitForSubmissions() throws IOException
+   {
+      if (this.tickets.get() == 0)
+         return;
+
+      try
+      {
+         synchronized (this.deferred)
+         {
+            while (this.pendingBlocks > 0)
+               this.deferred.wait();
+         }
+      }
+      catch (InterruptedException e)
+      {
+         throw new kanzi.io.IOException("Interrupted while waiting for submitted blocks", Error.ERR_WRITE_FILE);
+      }
+
+      final int lastId = this.blockId.get();
+
+      if (lastId == CANCEL_TASKS_ID)
+         throw new kanzi.io.IOException("Failed to encode submitted blocks", Error.ERR_PROCESS_BLOCK);
+
+      if (lastId != this.tickets.get())
+         throw new kanzi.io.IOException("Missing submitted block for ticket " + (lastId+1), Error.ERR_WRITE_FILE);
+   }
+
+
    // Return the number of bytes written so far
    public long getWritten()
    {
-      return (this.obs.written() + 7) >> 3;
+      return (this.outputBase + this.obs.written() + 7) >> 3;
    }
 
 
@@ -517,13 +920,19 @@ public class CompressedOutputStream extends OutputStream
       private final AtomicInteger processedBlockId;
       private final Listener[] listeners;
       private final Map<String, Object> ctx;
+      private final ConcurrentSkipListMap<Integer, EncodingTask> deferred; // null unless submitted block
+      private long written;
+      private int checksum;
+      private boolean staged; // return after the transforms (see entropyStage)
+      private Callable<Status> entropyStage; // set by the transform stage if staged
 
 
       EncodingTask(SliceByteArray iBuffer, SliceByteArray oBuffer, int length,
               long transformType, int entropyType, int blockId,
               OutputBitStream obs, XXHash32 hasher,
               AtomicInteger processedBlockId, Listener[] listeners,
-              Map<String, Object> ctx)
+              Map<String, Object> ctx,
+              ConcurrentSkipListMap<Integer, EncodingTask> deferred)
       {
          this.data = iBuffer;
          this.buffer = oBuffer;
@@ -536,6 +945,7 @@ public class CompressedOutputStream extends OutputStream
          this.processedBlockId = processedBlockId;
          this.listeners = listeners;
          this.ctx = ctx;
+         this.deferred = deferred;
       }
 
 
@@ -560,7 +970,7 @@ public class CompressedOutputStream extends OutputStream
            int blockLength, long blockTransformType,
            int blockEntropyType, int currentBlockId)
       {
-         EntropyEncoder ee = null;
+         boolean handedOff = false; // the entropy stage takes over
 
          try
          {
@@ -613,6 +1023,15 @@ public class CompressedOutputStream extends OutputStream
                }
             }
 
+            // Order 0 entropy coders can use the histograms recorded by the
+            // last transform instead of scanning the data again
+            if ((blockEntropyType == EntropyCodecFactory.HUFFMAN_TYPE) ||
+               (blockEntropyType == EntropyCodecFactory.ANS0_TYPE) ||
+               (blockEntropyType == EntropyCodecFactory.RANGE_TYPE))
+               this.ctx.put("histograms", new Histograms());
+            else
+               this.ctx.remove("histograms");
+
             this.ctx.put("size", blockLength);
             Sequence transform = new TransformFactory().newFunction(this.ctx, blockTransformType);
             int requiredSize = transform.getMaxEncodedLength(blockLength);
@@ -658,6 +1077,59 @@ public class CompressedOutputStream extends OutputStream
                notifyListeners(this.listeners, evt);
             }
 
+            if (this.staged == true)
+            {
+               // Staged execution: the entropy stage runs later on the pool,
+               // possibly while the next blocks are transformed
+               final byte fMode = mode;
+               final int fLength = postTransformLength;
+               final int fChecksum = checksum;
+               final long fTransformType = blockTransformType;
+               final int fEntropyType = blockEntropyType;
+               handedOff = true;
+
+               this.entropyStage = new Callable<Status>()
+               {
+                  @Override
+                  public Status call() throws Exception
+                  {
+                     return EncodingTask.this.encodeEntropy(buffer, fMode, transform, fLength,
+                        dataSize, fChecksum, fTransformType, fEntropyType, currentBlockId);
+                  }
+               };
+
+               return new Status(currentBlockId, 0, "Success");
+            }
+
+            handedOff = true;
+            return this.encodeEntropy(buffer, mode, transform, postTransformLength,
+               dataSize, checksum, blockTransformType, blockEntropyType, currentBlockId);
+         }
+         catch (Exception e)
+         {
+            this.processedBlockId.set(CANCEL_TASKS_ID);
+            return new Status(currentBlockId, Error.ERR_PROCESS_BLOCK,
+               "Error in block "+currentBlockId+": "+e.getMessage());
+         }
+         finally
+         {
+            // Make sure to unfreeze next block (submitted blocks are emitted by others)
+            if ((handedOff == false) && (this.deferred == null) &&
+               (this.processedBlockId.get() == this.blockId-1))
+               this.processedBlockId.incrementAndGet();
+         }
+      }
+
+
+      // Entropy code the transform output, then emit the block in order
+      private Status encodeEntropy(SliceByteArray buffer, byte mode, Sequence transform,
+           int postTransformLength, int dataSize, int checksum,
+           long blockTransformType, int blockEntropyType, int currentBlockId)
+      {
+         EntropyEncoder ee = null;
+
+         try
+         {
             this.data.index = 0;
             CustomByteArrayOutputStream baos = new CustomByteArrayOutputStream(this.data.array, this.data.array.length);
             DefaultOutputBitStream os = new DefaultOutputBitStream(baos, 16384);
@@ -689,26 +1161,58 @@ public class CompressedOutputStream extends OutputStream
                notifyListeners(this.listeners, evt);
             }
 
-            // Each block is encoded separately
-            // Rebuild the entropy encoder to reset block statistics
-            ee = new EntropyCodecFactory().newEncoder(os, this.ctx, blockEntropyType);
+            // One section or literal, token and match sections of a LZ block
+            final int[] sections = new int[] { postTransformLength, 0, 0 };
 
-            // Entropy encode block
-            if (ee.encode(buffer.array, 0, postTransformLength) != postTransformLength)
+            if (hasLZSections(blockTransformType, transform.getSkipFlags(), blockEntropyType, postTransformLength) == true)
             {
-               this.processedBlockId.set(CANCEL_TASKS_ID);
-               return new Status(currentBlockId, Error.ERR_PROCESS_BLOCK, "Entropy coding failed");
+               getLZSections(buffer.array, postTransformLength, sections);
+               os.writeBits(sections[0], 8*dataSize);
+               os.writeBits(sections[1], 8*dataSize);
             }
 
-            // Dispose before displaying statistics. Dispose may write to the bitstream
-            ee.dispose();
+            // Let the entropy coder select its contexts from the type of data
+            this.ctx.put("blockType", new TransformFactory().getDataType(blockTransformType, transform.getSkipFlags()));
+            int start = 0;
+
+            for (int i=0; i<sections.length; i++)
+            {
+               if (sections[i] == 0)
+                  continue;
+
+               // Each block (section) is encoded separately
+               // Rebuild the entropy encoder to reset block statistics
+               ee = new EntropyCodecFactory().newEncoder(os, this.ctx, blockEntropyType);
 
-            // Force ee to null to avoid double dispose (in the finally section)
-            ee = null;
+               // Entropy encode block
+               if (ee.encode(buffer.array, start, sections[i]) != sections[i])
+               {
+                  this.processedBlockId.set(CANCEL_TASKS_ID);
+                  return new Status(currentBlockId, Error.ERR_PROCESS_BLOCK, "Entropy coding failed");
+               }
+
+               // Dispose before displaying statistics. Dispose may write to the bitstream
+               ee.dispose();
+
+               // Force ee to null to avoid double dispose (in the finally section)
+               ee = null;
+               start += sections[i];
+            }
 
             os.close();
             long written = os.written();
 
+            if (this.deferred != null)
+            {
+               // Submitted block: never wait in a pool thread. The block is
+               // emitted by the task completing the previous block if needed.
+               this.written = written;
+               this.checksum = checksum;
+               this.deferred.put(currentBlockId, this);
+               emitDeferred(this.deferred, this.processedBlockId);
+               return new Status(currentBlockId, 0, "Success");
+            }
+
             // Lock free synchronization
             while (true)
             {
@@ -727,34 +1231,7 @@ public class CompressedOutputStream extends OutputStream
                Thread.yield(); // Should be Thread.onSpinWait() on JDK 9 and above
             }
 
-            if (this.listeners.length > 0)
-            {
-               // Notify after entropy
-               Event evt = new Event(Event.Type.AFTER_ENTROPY,
-                       currentBlockId, (written+7) >> 3, checksum, this.hasher != null);
-
-               notifyListeners(this.listeners, evt);
-            }
-
-            // Emit block size in bits (max size pre-entropy is 1 GB = 1 << 30 bytes)
-            final int lw = (written < 8) ? 3 : Global.log2((int) (written >> 3)) + 4;
-            this.obs.writeBits(lw-3, 5); // write length-3 (5 bits max)
-            this.obs.writeBits(written, lw);
-            int chkSize = (int) Math.min(written, 1<<30);
-
-            // Emit data to shared bitstream
-            for (int n=0; written>0; )
-            {
-               this.obs.writeBits(this.data.array, n, chkSize);
-               n += ((chkSize+7) >> 3);
-               written -= chkSize;
-               chkSize = (int) Math.min(written, 1<<30);
-            }
-
-            // After completion of the entropy coding, increment the block id.
-            // It unblocks the task processing the next block (if any).
-            this.processedBlockId.incrementAndGet();
-
+            this.emit(written, checksum);
             return new Status(currentBlockId, 0, "Success");
          }
          catch (Exception e)
@@ -765,14 +1242,88 @@ public class CompressedOutputStream extends OutputStream
          }
          finally
          {
-            // Make sure to unfreeze next block
-            if (this.processedBlockId.get() == this.blockId-1)
+            // Make sure to unfreeze next block (submitted blocks are emitted by others)
+            if ((this.deferred == null) && (this.processedBlockId.get() == this.blockId-1))
                this.processedBlockId.incrementAndGet();
 
             if (ee != null)
               ee.dispose();
          }
       }
+
+
+      // Find the literal, token and match sections from the header of a LZX
+      // stream: literal end (4 bytes), token count (4 bytes), mode (1 byte).
+      // Segmented or unexpected streams are kept in one section.
+      private static void getLZSections(byte[] buf, int length, int[] sections)
+      {
+         final int litEnd = Memory.LittleEndian.readInt32(buf, 0);
+         final int tkLen = Memory.LittleEndian.readInt32(buf, 4);
+
+         if (((buf[8] & 0xFE) != 0) || (litEnd < 9) || (tkLen < 0) || (litEnd > length-tkLen))
+            return;
+
+         sections[0] = litEnd;
+         sections[1] = tkLen;
+         sections[2] = length - litEnd - tkLen;
+      }
+
+
+      // Write the encoded block to the shared bitstream and unblock the next block
+      private void emit(long written, int checksum)
+      {
+         if (this.listeners.length > 0)
+         {
+            // Notify after entropy
+            Event evt = new Event(Event.Type.AFTER_ENTROPY,
+                    this.blockId, (written+7) >> 3, checksum, this.hasher != null);
+
+            notifyListeners(this.listeners, evt);
+         }
+
+         // Emit block size in bits (max size pre-entropy is 1 GB = 1 << 30 bytes)
+         final int lw = (written < 8) ? 3 : Global.log2((int) (written >> 3)) + 4;
+         this.obs.writeBits(lw-3, 5); // write length-3 (5 bits max)
+         this.obs.writeBits(written, lw);
+         int chkSize = (int) Math.min(written, 1<<30);
+
+         // Emit data to shared bitstream
+         for (int n=0; written>0; )
+         {
+            this.obs.writeBits(this.data.array, n, chkSize);
+            n += ((chkSize+7) >> 3);
+            written -= chkSize;
+            chkSize = (int) Math.min(written, 1<<30);
+         }
+
+         // After completion of the entropy coding, increment the block id.
+         // It unblocks the task processing the next block (if any).
+         this.processedBlockId.incrementAndGet();
+      }
+
+
+      // Emit the submitted blocks whose turn has come, in block order
+      static void emitDeferred(ConcurrentSkipListMap<Integer, EncodingTask> deferred,
+         AtomicInteger processedBlockId)
+      {
+         synchronized (deferred)
+         {
+            while (true)
+            {
+               final int taskId = processedBlockId.get();
+
+               if (taskId == CANCEL_TASKS_ID)
+                  return;
+
+               final EncodingTask task = deferred.remove(taskId+1);
+
+               if (task == null)
+                  return;
+
+               task.emit(task.written, task.checksum);
+            }
+         }
+      }
    }
 
 
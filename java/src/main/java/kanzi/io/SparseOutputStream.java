@@ -0,0 +1,202 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.io;
+
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import kanzi.Memory;
+
+
+// Implementation of a java.io.OutputStream that writes to a file and leaves
+// holes instead of zero pages. The pages full of zeros (aligned on the file
+// offset) are not written: the file position skips them. Most file systems do
+// not allocate disk space for such holes (sparse files), and they read as
+// zeros. Restoring VM or database images with long zero regions writes less.
+public class SparseOutputStream extends OutputStream
+{
+   public static final int DEFAULT_PAGE_SIZE = 4096;
+
+   private final FileOutputStream fos;
+   private final FileChannel channel;
+   private final byte[] page; // pending bytes of a partial page
+   private int count; // number of bytes in 'page'
+   private long position; // logical position in the file (holes included)
+   private long skipped; // number of bytes left as holes
+   private boolean closed;
+
+
+   public SparseOutputStream(FileOutputStream fos)
+   {
+      this(fos, DEFAULT_PAGE_SIZE);
+   }
+
+
+   public SparseOutputStream(FileOutputStream fos, int pageSize)
+   {
+      if (fos == null)
+         throw new NullPointerException("Invalid null output stream parameter");
+
+      if ((pageSize < 512) || ((pageSize & (pageSize-1)) != 0))
+         throw new IllegalArgumentException("Invalid page size (must be a power of 2, at least 512)");
+
+      this.fos = fos;
+      this.channel = fos.getChannel();
+      this.page = new byte[pageSize];
+   }
+
+
+   @Override
+   public void write(int b) throws IOException
+   {
+      if (this.closed == true)
+         throw new IOException("Stream closed");
+
+      this.page[this.count++] = (byte) b;
+
+      if (this.count == this.page.length)
+      {
+         this.writePages(this.page, 0, this.count);
+         this.count = 0;
+      }
+   }
+
+
+   @Override
+   public void write(byte[] data, int off, int len) throws IOException
+   {
+      if (this.closed == true)
+         throw new IOException("Stream closed");
+
+      if ((off < 0) || (len < 0) || (len > data.length-off))
+         throw new IndexOutOfBoundsException();
+
+      final int pageSize = this.page.length;
+
+      while (len > 0)
+      {
+         if ((this.count > 0) || (len < pageSize))
+         {
+            // Complete the pending page
+            final int n = Math.min(len, pageSize-this.count);
+
+            System.arraycopy(data, off, this.page, this.count, n);
+            this.count += n;
+            off += n;
+            len -= n;
+
+            if (this.count == pageSize)
+            {
+               this.writePages(this.page, 0, pageSize);
+               this.count = 0;
+            }
+
+            continue;
+         }
+
+         // Whole pages directly from the input
+         final int n = len & -pageSize;
+         this.writePages(data, off, n);
+         off += n;
+         len -= n;
+      }
+   }
+
+
+   // Write a whole number of pages: consecutive non zero pages are written
+   // at once, zero pages are skipped
+   private void writePages(byte[] data, int off, int len) throws IOException
+   {
+      final int pageSize = this.page.length;
+      final int end = off + len;
+      int start = off; // start of the run of non zero pages
+
+      for (int i=off; i<end; i+=pageSize)
+      {
+         if (isZero(data, i, pageSize) == false)
+            continue;
+
+         this.writeFully(data, start, i-start);
+         this.position += pageSize;
+         this.skipped += pageSize;
+         start = i + pageSize;
+      }
+
+      this.writeFully(data, start, end-start);
+   }
+
+
+   private void writeFully(byte[] data, int off, int len) throws IOException
+   {
+      if (len == 0)
+         return;
+
+      ByteBuffer buf = ByteBuffer.wrap(data, off, len);
+
+      while (buf.hasRemaining() == true)
+         this.position += this.channel.write(buf, this.position);
+   }
+
+
+   private static boolean isZero(byte[] data, int off, int len)
+   {
+      final int end = off + len;
+
+      for (int i=off; i<end; i+=8)
+      {
+         if (Memory.LittleEndian.readLong64(data, i) != 0)
+            return false;
+      }
+
+      return true;
+   }
+
+
+   // Return the number of bytes left as holes
+   public long getSkipped()
+   {
+      return this.skipped;
+   }
+
+
+   @Override
+   public void close() throws IOException
+   {
+      if (this.closed == true)
+         return;
+
+      try
+      {
+         // The last partial page is always written
+         this.writeFully(this.page, 0, this.count);
+         this.count = 0;
+
+         // Trailing holes: write the last byte to set the file size
+         if (this.channel.size() < this.position)
+         {
+            ByteBuffer last = ByteBuffer.wrap(new byte[1]);
+            this.channel.write(last, this.position-1);
+         }
+      }
+      finally
+      {
+         this.closed = true;
+         this.fos.close();
+      }
+   }
+}
@@ -24,23 +24,22 @@ import kanzi.SliceByteArray;
 // Bijective version of the Burrows-Wheeler Transform
 // The main advantage over the regular BWT is that there is no need for a primary
 // index (hence the bijectivity). BWTS is about 10% slower than BWT.
-// Forward transform based on the code at https://code.google.com/p/mk-bwts/
-// by Neal Burns and DivSufSort (port of libDivSufSort by Yuta Mori)
+// The forward transform sorts the rotations of the Lyndon factors of the block
+// directly in linear time (see LyndonSA_IS), so that the encoding time does not
+// depend on the repetitiveness of the data.
 
 public class BWTS implements ByteTransform
 {
    private static final int MAX_BLOCK_SIZE = 1024*1024*1024; // 1 GB
 
    private int[] buffer1;
-   private int[] buffer2;
    private final int[] buckets;
-   private DivSufSort saAlgo;
+   private LyndonSA_IS saAlgo;
 
 
    public BWTS()
    {
       this.buffer1 = new int[0];
-      this.buffer2 = new int[0];
       this.buckets = new int[256];
    }
 
@@ -48,7 +47,6 @@ public class BWTS implements ByteTransform
    public BWTS(Map<String, Object> ctx)
    {
       this.buffer1 = new int[0];
-      this.buffer2 = new int[0];
       this.buckets = new int[256];
    }
 
@@ -73,141 +71,24 @@ public class BWTS implements ByteTransform
       if (dst.index + count > dst.array.length)
          return false;
 
-      final byte[] input = src.array;
-      final byte[] output = dst.array;
-      final int srcIdx = src.index;
-      final int dstIdx = dst.index;
-
       if (count < 2)
       {
          if (count == 1)
-            output[dst.index++] = input[src.index++];
+            dst.array[dst.index++] = src.array[src.index++];
 
          return true;
       }
 
       if (this.saAlgo == null)
-         this.saAlgo = new DivSufSort();
-
-      // Lazy dynamic memory allocations
-      if (this.buffer1.length < count)
-         this.buffer1 = new int[count];
-
-      if (this.buffer2.length < count)
-         this.buffer2 = new int[count];
-
-      // Aliasing
-      final int[] sa = this.buffer1;
-      final int[] isa = this.buffer2;
-
-      this.saAlgo.computeSuffixArray(input, sa, srcIdx, count);
-
-      for (int i=0; i<count; i++)
-         isa[sa[i]] = i;
-
-      int min = isa[0];
-      int idxMin = 0;
-
-      for (int i=1; ((i<count) && (min>0)); i++)
-      {
-         if (isa[i] >= min)
-            continue;
-
-         int refRank = moveLyndonWordHead(sa, isa, input, count, srcIdx, idxMin, i-idxMin, min);
-
-         for (int j=i-1; j>idxMin; j--)
-         {
-            // iterate through the new lyndon word from end to start
-            int testRank = isa[j];
-            int startRank = testRank;
-
-            while (testRank < count-1)
-            {
-               int nextRankStart = sa[testRank+1];
-
-               if ((j > nextRankStart) || (input[srcIdx+j] != input[srcIdx+nextRankStart])
-                        || (refRank < isa[nextRankStart+1]))
-                  break;
-
-               sa[testRank] = nextRankStart;
-               isa[nextRankStart] = testRank;
-               testRank++;
-            }
-
-            sa[testRank] = j;
-            isa[j] = testRank;
-            refRank = testRank;
-
-            if (startRank == testRank)
-               break;
-         }
+         this.saAlgo = new LyndonSA_IS();
 
-         min = isa[i];
-         idxMin = i;
-      }
-
-      min = count;
-      final int srcIdx2 = srcIdx - 1;
-
-      for (int i=0; i<count; i++)
-      {
-         if (isa[i] >= min)
-         {
-            output[dstIdx+isa[i]] = input[srcIdx2+i];
-            continue;
-         }
-
-         if (min < count)
-            output[dstIdx+min] = input[srcIdx2+i];
-
-         min = isa[i];
-      }
-
-      output[dstIdx] = input[srcIdx2+count];
+      this.saAlgo.computeBWTS(src.array, src.index, dst.array, dst.index, count);
       src.index += count;
       dst.index += count;
       return true;
    }
 
 
-   private static int moveLyndonWordHead(int[] sa, int[] isa, byte[] data, int count, int srcIdx, int start, int size, int rank)
-   {
-      final int end = start + size;
-      final int startIdx = srcIdx + start;
-
-      while (rank+1 < count)
-      {
-         final int nextStart0 = sa[rank+1];
-
-         if (nextStart0 <= end)
-            break;
-
-         int nextStart = nextStart0;
-         int k = 0;
-
-         while ((k < size) && (nextStart < count) && (data[startIdx+k] == data[srcIdx+nextStart]))
-         {
-             k++;
-             nextStart++;
-         }
-
-         if ((k == size) && (rank < isa[nextStart]))
-            break;
-
-         if ((k < size) && (nextStart < count) && ((data[startIdx+k] & 0xFF) < (data[srcIdx+nextStart] & 0xFF)))
-            break;
-
-         sa[rank] = nextStart0;
-         isa[nextStart0] = rank;
-         rank++;
-      }
-
-      sa[rank] = start;
-      isa[start] = rank;
-      return rank;
-   }
-
-
    // Not thread safe
    @Override
    public boolean inverse(SliceByteArray src, SliceByteArray dst)
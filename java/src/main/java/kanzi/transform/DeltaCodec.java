@@ -0,0 +1,103 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.transform;
+
+import kanzi.IntTransform;
+import kanzi.SliceIntArray;
+
+
+// Delta coding of a sequence of ints: each value is replaced by its difference
+// with the previous one (the first value is kept). Sorted sequences such as
+// timestamps or posting lists become sequences of small values.
+// The arithmetic wraps around, so any sequence of ints can be processed.
+public class DeltaCodec implements IntTransform
+{
+   public DeltaCodec()
+   {
+   }
+
+
+   @Override
+   public boolean forward(SliceIntArray input, SliceIntArray output)
+   {
+      if (input.length == 0)
+         return true;
+
+      if (input.array == output.array)
+         return false;
+
+      final int count = input.length;
+
+      if (output.length - output.index < count)
+         return false;
+
+      final int[] src = input.array;
+      final int[] dst = output.array;
+      final int srcIdx = input.index;
+      final int dstIdx = output.index;
+      int prev = 0;
+
+      for (int i=0; i<count; i++)
+      {
+         final int val = src[srcIdx+i];
+         dst[dstIdx+i] = val - prev;
+         prev = val;
+      }
+
+      input.index += count;
+      output.index += count;
+      return true;
+   }
+
+
+   @Override
+   public boolean inverse(SliceIntArray input, SliceIntArray output)
+   {
+      if (input.length == 0)
+         return true;
+
+      if (input.array == output.array)
+         return false;
+
+      final int count = input.length;
+
+      if (output.length - output.index < count)
+         return false;
+
+      final int[] src = input.array;
+      final int[] dst = output.array;
+      final int srcIdx = input.index;
+      final int dstIdx = output.index;
+      int prev = 0;
+
+      for (int i=0; i<count; i++)
+      {
+         prev += src[srcIdx+i];
+         dst[dstIdx+i] = prev;
+      }
+
+      input.index += count;
+      output.index += count;
+      return true;
+   }
+
+
+   @Override
+   public int getMaxEncodedLength(int srcLength)
+   {
+      return srcLength;
+   }
+}
@@ -0,0 +1,104 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.transform;
+
+import kanzi.IntTransform;
+import kanzi.SliceIntArray;
+
+
+// Frame Of Reference coding: the minimum of the block is emitted first,
+// followed by the offsets of all the values from this minimum. The offsets
+// are unsigned and need fewer bits than the values when the block has a
+// small range. The output is one int longer than the input.
+public class FORCodec implements IntTransform
+{
+   public FORCodec()
+   {
+   }
+
+
+   @Override
+   public boolean forward(SliceIntArray input, SliceIntArray output)
+   {
+      if (input.length == 0)
+         return true;
+
+      if (input.array == output.array)
+         return false;
+
+      final int count = input.length;
+
+      if (output.length - output.index < count+1)
+         return false;
+
+      final int[] src = input.array;
+      final int[] dst = output.array;
+      final int srcIdx = input.index;
+      final int dstIdx = output.index + 1;
+      int min = src[srcIdx];
+
+      for (int i=1; i<count; i++)
+      {
+         if (src[srcIdx+i] < min)
+            min = src[srcIdx+i];
+      }
+
+      output.array[output.index] = min;
+
+      for (int i=0; i<count; i++)
+         dst[dstIdx+i] = src[srcIdx+i] - min;
+
+      input.index += count;
+      output.index += (count+1);
+      return true;
+   }
+
+
+   @Override
+   public boolean inverse(SliceIntArray input, SliceIntArray output)
+   {
+      if (input.length == 0)
+         return true;
+
+      if (input.array == output.array)
+         return false;
+
+      final int count = input.length - 1;
+
+      if ((count < 0) || (output.length - output.index < count))
+         return false;
+
+      final int[] src = input.array;
+      final int[] dst = output.array;
+      final int srcIdx = input.index + 1;
+      final int dstIdx = output.index;
+      final int min = src[input.index];
+
+      for (int i=0; i<count; i++)
+         dst[dstIdx+i] = src[srcIdx+i] + min;
+
+      input.index += (count+1);
+      output.index += count;
+      return true;
+   }
+
+
+   @Override
+   public int getMaxEncodedLength(int srcLength)
+   {
+      return srcLength + 1;
+   }
+}
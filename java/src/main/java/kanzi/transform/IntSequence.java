@@ -0,0 +1,144 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.transform;
+
+import kanzi.IntTransform;
+import kanzi.SliceIntArray;
+
+
+// Encapsulates a sequence of int transforms in a transform. Unlike the byte
+// transforms, the int transforms always apply: the sequence fails if any
+// of them fails.
+public class IntSequence implements IntTransform
+{
+   private final IntTransform[] transforms;
+   private int[] buffer; // intermediate results
+
+
+   public IntSequence(IntTransform[] transforms)
+   {
+      if (transforms == null)
+         throw new NullPointerException("Invalid null transforms parameter");
+
+      if ((transforms.length == 0) || (transforms.length > 4))
+         throw new IllegalArgumentException("Only 1 to 4 transforms allowed");
+
+      this.transforms = transforms;
+      this.buffer = new int[0];
+   }
+
+
+   @Override
+   public boolean forward(SliceIntArray src, SliceIntArray dst)
+   {
+      int count = src.length;
+
+      if ((count < 0) || (count+src.index > src.array.length))
+         return false;
+
+      if (count == 0)
+         return true;
+
+      final int requiredSize = this.getMaxEncodedLength(count);
+
+      if (dst.length - dst.index < requiredSize)
+         return false;
+
+      // Intermediate results alternate between dst and a temporary buffer
+      // so that the last transform writes to dst.
+      final int[] buf = this.getBuffer(requiredSize);
+      SliceIntArray sa1 = src;
+      final int n = this.transforms.length;
+
+      for (int i=0; i<n; i++)
+      {
+         final SliceIntArray sa2 = (((n-1-i) & 1) == 0) ?
+            new SliceIntArray(dst.array, dst.length, dst.index) :
+            new SliceIntArray(buf, buf.length, 0);
+         final SliceIntArray in = new SliceIntArray(sa1.array, count, sa1.index);
+         final int savedOIdx = sa2.index;
+
+         if (this.transforms[i].forward(in, sa2) == false)
+            return false;
+
+         count = sa2.index - savedOIdx;
+         sa1 = new SliceIntArray(sa2.array, savedOIdx+count, savedOIdx);
+      }
+
+      src.index += src.length;
+      dst.index += count;
+      return true;
+   }
+
+
+   @Override
+   public boolean inverse(SliceIntArray src, SliceIntArray dst)
+   {
+      int count = src.length;
+
+      if ((count < 0) || (count+src.index > src.array.length))
+         return false;
+
+      if (count == 0)
+         return true;
+
+      final int[] buf = this.getBuffer(count);
+      SliceIntArray sa1 = src;
+      final int n = this.transforms.length;
+
+      // Process transforms in reverse order (the transforms never expand
+      // the data when inverted)
+      for (int i=n-1; i>=0; i--)
+      {
+         final SliceIntArray sa2 = ((i & 1) == 0) ?
+            new SliceIntArray(dst.array, dst.length, dst.index) :
+            new SliceIntArray(buf, buf.length, 0);
+         final SliceIntArray in = new SliceIntArray(sa1.array, count, sa1.index);
+         final int savedOIdx = sa2.index;
+
+         if (this.transforms[i].inverse(in, sa2) == false)
+            return false;
+
+         count = sa2.index - savedOIdx;
+         sa1 = new SliceIntArray(sa2.array, savedOIdx+count, savedOIdx);
+      }
+
+      src.index += src.length;
+      dst.index += count;
+      return true;
+   }
+
+
+   private int[] getBuffer(int size)
+   {
+      if (this.buffer.length < size)
+         this.buffer = new int[size];
+
+      return this.buffer;
+   }
+
+
+   @Override
+   public int getMaxEncodedLength(int srcLength)
+   {
+      int requiredSize = srcLength;
+
+      for (IntTransform transform : this.transforms)
+         requiredSize = transform.getMaxEncodedLength(requiredSize);
+
+      return requiredSize;
+   }
+}
@@ -0,0 +1,175 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.transform;
+
+import kanzi.IntTransform;
+
+
+// Factory of the transforms used by the int streams
+public class IntTransformFactory
+{
+   private static final int ONE_SHIFT = 4; // bits per transform
+   private static final int MAX_SHIFT = (4-1) * ONE_SHIFT; // 4 transforms
+   private static final int MASK = (1<<ONE_SHIFT) - 1;
+
+   // Up to 16 transforms can be declared (4 bit index)
+   public static final int NONE_TYPE   = 0; // copy
+   public static final int DELTA_TYPE  = 1; // Delta
+   public static final int ZIGZAG_TYPE = 2; // ZigZag
+   public static final int FOR_TYPE    = 3; // Frame Of Reference
+
+
+   // The returned type contains 4 transform values
+   public int getType(String name)
+   {
+      String[] tokens = name.split("\\+");
+
+      if (tokens.length == 0)
+         throw new IllegalArgumentException("Unknown int transform type: " + name);
+
+      if (tokens.length > 4)
+         throw new IllegalArgumentException("Only 4 int transforms allowed: " + name);
+
+      int res = 0;
+      int shift = MAX_SHIFT;
+
+      for (String token: tokens)
+      {
+         final int typeTk = this.getTypeToken(token);
+
+         // Skip null transform
+         if (typeTk != NONE_TYPE)
+         {
+            res |= (typeTk << shift);
+            shift -= ONE_SHIFT;
+         }
+      }
+
+      return res;
+   }
+
+
+   private int getTypeToken(String name)
+   {
+      name = String.valueOf(name).toUpperCase();
+
+      switch (name)
+      {
+         case "DELTA":
+            return DELTA_TYPE;
+
+         case "ZIGZAG":
+            return ZIGZAG_TYPE;
+
+         case "FOR":
+            return FOR_TYPE;
+
+         case "NONE":
+            return NONE_TYPE;
+
+         default:
+            throw new IllegalArgumentException("Unknown int transform type: '" + name + "'");
+      }
+   }
+
+
+   // Return null if the type contains only null transforms
+   public IntTransform newFunction(int functionType)
+   {
+      int nbtr = 0;
+
+      for (int i=0; i<4; i++)
+      {
+         if (((functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK) != NONE_TYPE)
+            nbtr++;
+      }
+
+      if (nbtr == 0)
+         return null;
+
+      IntTransform[] transforms = new IntTransform[nbtr];
+      nbtr = 0;
+
+      for (int i=0; i<4; i++)
+      {
+         final int t = (functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK;
+
+         if (t != NONE_TYPE)
+            transforms[nbtr++] = newFunctionToken(t);
+      }
+
+      return new IntSequence(transforms);
+   }
+
+
+   private static IntTransform newFunctionToken(int functionType)
+   {
+      switch (functionType)
+      {
+         case DELTA_TYPE:
+            return new DeltaCodec();
+
+         case ZIGZAG_TYPE:
+            return new ZigZagCodec();
+
+         case FOR_TYPE:
+            return new FORCodec();
+
+         default:
+            throw new IllegalArgumentException("Unknown int transform type: '" + functionType + "'");
+      }
+   }
+
+
+   public String getName(int functionType)
+   {
+      StringBuilder sb = new StringBuilder();
+
+      for (int i=0; i<4; i++)
+      {
+         final int t = (functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK;
+
+         if (t == NONE_TYPE)
+            continue;
+
+         if (sb.length() != 0)
+            sb.append('+');
+
+         sb.append(getNameToken(t));
+      }
+
+      return (sb.length() == 0) ? "NONE" : sb.toString();
+   }
+
+
+   private static String getNameToken(int functionType)
+   {
+      switch (functionType)
+      {
+         case DELTA_TYPE:
+            return "DELTA";
+
+         case ZIGZAG_TYPE:
+            return "ZIGZAG";
+
+         case FOR_TYPE:
+            return "FOR";
+
+         default:
+            throw new IllegalArgumentException("Unknown int transform type: '" + functionType + "'");
+      }
+   }
+}
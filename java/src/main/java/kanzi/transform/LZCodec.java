@@ -15,10 +15,18 @@ limitations under the License.
 
 package kanzi.transform;
 
+import java.util.ArrayList;
+import java.util.List;
 import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Future;
+import java.util.concurrent.atomic.AtomicInteger;
 import kanzi.ByteTransform;
+import kanzi.Global;
 import kanzi.Memory;
 import kanzi.SliceByteArray;
+import kanzi.SliceIntArray;
 
 
 // Simple byte oriented LZ77 implementation.
@@ -77,6 +85,38 @@ public final class LZCodec implements ByteTransform
    }
 
 
+   // Run the tasks concurrently if several jobs are available
+   private static boolean runTasks(List<Callable<Integer>> tasks, int jobs, ExecutorService pool)
+   {
+      try
+      {
+         if ((jobs == 1) || (pool == null))
+         {
+            for (Callable<Integer> task : tasks)
+            {
+               if (task.call() < 0)
+                  return false;
+            }
+         }
+         else
+         {
+            // Wait for completion of all concurrent tasks
+            for (Future<Integer> result : pool.invokeAll(tasks))
+            {
+               if (result.get() < 0)
+                  return false;
+            }
+         }
+      }
+      catch (Exception e)
+      {
+         return false;
+      }
+
+      return true;
+   }
+
+
    private static boolean differentInts(byte[] array, int srcIdx, int dstIdx)
    {
       return ((array[srcIdx] != array[dstIdx])     ||
@@ -91,30 +131,35 @@ public final class LZCodec implements ByteTransform
    {
       private static final int HASH_SEED          = 0x1E35A7BD;
       private static final int HASH_LOG1          = 16;
-      private static final int HASH_SHIFT1        = 40 - HASH_LOG1;
-      private static final int HASH_MASK1         = (1<<HASH_LOG1) - 1;
       private static final int HASH_LOG2          = 21;
-      private static final int HASH_SHIFT2        = 48 - HASH_LOG2;
-      private static final int HASH_MASK2         = (1<<HASH_LOG2) - 1;
+      private static final int MIN_HASH_LOG       = 12;
       private static final int MAX_DISTANCE1      = (1<<17) - 2;
       private static final int MAX_DISTANCE2      = (1<<24) - 2;
       private static final int MIN_MATCH          = 5;
       private static final int MAX_MATCH          = 65535 + 254 + 15 + MIN_MATCH;
       private static final int MIN_BLOCK_LENGTH   = 24;
       private static final int MIN_MATCH_MIN_DIST = 1 << 16;
+      private static final int SEGMENTED_FLAG     = 0x80;
+      private static final int MIN_SEGMENT_SIZE   = 1 << 22;
+      private static final int MAX_SEGMENTS       = 32;
+      private static final int PROGRESS_STEP      = 1 << 16;
 
       private int[] hashes;
+      private int hashBase;
+      private int hashShift;
+      private int hashMask;
       private byte[] mBuf;
       private byte[] tkBuf;
+      private final SliceIntArray taints; // ranges of bytes copied from the window
       private final boolean extra;
+      private final int jobs;
+      private final ExecutorService pool;
+      private final AtomicInteger progress; // decoded bytes (may be null)
 
 
       public LZXCodec()
       {
-         this.hashes = new int[0];
-         this.mBuf = new byte[0];
-         this.tkBuf = new byte[0];
-         this.extra = false;
+         this(false);
       }
 
 
@@ -123,8 +168,30 @@ public final class LZCodec implements ByteTransform
          this.hashes = new int[0];
          this.mBuf = new byte[0];
          this.tkBuf = new byte[0];
+         this.taints = new SliceIntArray(new int[0], 0);
          short lzType = (short) ctx.getOrDefault("lz", TransformFactory.LZ_TYPE);
          this.extra = lzType == TransformFactory.LZX_TYPE;
+
+         // Jobs available to process the segments of a block concurrently
+         final int tasks = (Integer) ctx.getOrDefault("jobs", 1);
+         this.pool = (ExecutorService) ctx.get("pool");
+         this.jobs = (this.pool == null) ? 1 : Math.max(tasks, 1);
+
+         // Number of decoded bytes, published while decoding (streaming decoder)
+         this.progress = (AtomicInteger) ctx.get("progress");
+      }
+
+
+      private LZXCodec(boolean extra)
+      {
+         this.hashes = new int[0];
+         this.mBuf = new byte[0];
+         this.tkBuf = new byte[0];
+         this.taints = new SliceIntArray(new int[0], 0);
+         this.extra = extra;
+         this.jobs = 1;
+         this.pool = null;
+         this.progress = null;
       }
 
 
@@ -209,28 +276,53 @@ public final class LZCodec implements ByteTransform
          if (count < MIN_BLOCK_LENGTH)
              return false;
 
-         if (this.hashes.length == 0)
-         {
-            this.hashes = (this.extra == true) ? new int[1<<HASH_LOG2] : new int[1<<HASH_LOG1];
-         }
-         else
+         final int nbSegments = getNbSegments(count);
+
+         if (nbSegments > 1)
+            return this.forwardSegments(input, output, nbSegments);
+
+         return this.forward(input, output, input.index);
+      }
+
+
+      // Encode the input. Positions in [winIdx, input.index) (tail of the previous
+      // segment) can also be referenced. In this case, the source of a match
+      // never overlaps the bytes produced by a window reference so that the
+      // decoder can copy all other matches before the window is available.
+      private boolean forward(SliceByteArray input, SliceByteArray output, int winIdx)
+      {
+         final int count = input.length;
+         final int srcIdx0 = input.index;
+         final int length = srcIdx0 + count - winIdx;
+
+         // Size the hash table from the block length
+         final int maxLog = (this.extra == true) ? HASH_LOG2 : HASH_LOG1;
+         final int hashLog = Math.min(Math.max(Global.log2(length), MIN_HASH_LOG), maxLog);
+
+         if (this.hashes.length < (1<<hashLog))
          {
-            for (int i=0; i<this.hashes.length; i++)
-               this.hashes[i] = 0;
+            this.hashes = new int[1<<hashLog];
+            this.hashBase = 0;
          }
 
+         this.hashShift = ((this.extra == true) ? 48 : 40) - hashLog;
+         this.hashMask = (1<<hashLog) - 1;
+
          if (this.mBuf.length < Math.max(count/5, 256))
             this.mBuf = new byte[Math.max(count/5, 256)];
 
          if (this.tkBuf.length < Math.max(count/5, 256))
             this.tkBuf = new byte[Math.max(count/5, 256)];
 
-         final int srcIdx0 = input.index;
          final int dstIdx0 = output.index;
          final byte[] src = input.array;
          final byte[] dst = output.array;
          final int srcEnd = srcIdx0 + count - 16 - 1;
-         final int maxDist = (srcEnd < 4*MAX_DISTANCE1) ? MAX_DISTANCE1 : MAX_DISTANCE2;
+
+         // Stored positions are offset by the table generation, entries from
+         // previous blocks map below winIdx and fail the minRef check.
+         final int bias = this.newGeneration(length) - winIdx;
+         final int maxDist = (srcEnd-winIdx < 4*MAX_DISTANCE1) ? MAX_DISTANCE1 : MAX_DISTANCE2;
          dst[dstIdx0+8] = (maxDist == MAX_DISTANCE1) ? (byte) 0 : (byte) 1;
          int srcIdx = srcIdx0;
          int anchor = srcIdx0;
@@ -238,13 +330,18 @@ public final class LZCodec implements ByteTransform
          int mIdx = 0;
          int tkIdx = 0;
          int repd = 0;
+         this.taints.index = 0;
+
+         // Register the window positions
+         for (int i=winIdx; i<srcIdx0; i++)
+            this.hashes[hash(src, i)] = i + bias;
 
          while (srcIdx < srcEnd)
          {
-            final int minRef = Math.max(srcIdx-maxDist, srcIdx0);
+            final int minRef = Math.max(srcIdx-maxDist, winIdx);
             int h = hash(src, srcIdx);
-            int ref = this.hashes[h];
-            this.hashes[h] = srcIdx;
+            int ref = this.hashes[h] - bias;
+            this.hashes[h] = srcIdx + bias;
             int bestLen = 0;
 
             // Find a match
@@ -252,6 +349,9 @@ public final class LZCodec implements ByteTransform
             {
                final int maxMatch = Math.min(srcEnd-srcIdx, MAX_MATCH);
                bestLen = findMatch(src, srcIdx, ref, maxMatch);
+
+               if (winIdx != srcIdx0)
+                  bestLen = this.clampMatch(ref, bestLen, srcIdx0);
             }
 
             // No good match ?
@@ -263,14 +363,17 @@ public final class LZCodec implements ByteTransform
 
             // Check if better match at next position
             final int h2 = hash(src, srcIdx+1);
-            final int ref2 = this.hashes[h2];
-            this.hashes[h2] = srcIdx + 1;
+            final int ref2 = this.hashes[h2] - bias;
+            this.hashes[h2] = srcIdx + 1 + bias;
             int bestLen2 = 0;
 
             if (ref2 > minRef + 1)
             {
                final int maxMatch = Math.min(srcEnd-srcIdx-1, MAX_MATCH);
                bestLen2 = findMatch(src, srcIdx+1, ref2, maxMatch);
+
+               if (winIdx != srcIdx0)
+                  bestLen2 = this.clampMatch(ref2, bestLen2, srcIdx0);
             }
 
             // Select best match
@@ -281,6 +384,10 @@ public final class LZCodec implements ByteTransform
                srcIdx++;
             }
 
+            // Bytes copied from the window cannot be referenced by other matches
+            if (ref < srcIdx0)
+               this.addTaint(srcIdx, srcIdx+bestLen);
+
             // Emit token
             // Token: 3 bits litLen + 1 bit flag + 4 bits mLen (LLLFMMMM)
             // flag = if maxDist = MAX_DISTANCE1, then highest bit of distance
@@ -344,13 +451,13 @@ public final class LZCodec implements ByteTransform
 
             while (srcIdx < anchor)
             {
-               this.hashes[hash(src, srcIdx)] = srcIdx;
+               this.hashes[hash(src, srcIdx)] = srcIdx + bias;
                srcIdx++;
             }
          }
 
          // Emit last literals
-         final int litLen = count - anchor;
+         final int litLen = srcIdx0 + count - anchor;
 
          if (dstIdx+litLen+tkIdx+mIdx >= output.index+count)
             return false;
@@ -369,40 +476,170 @@ public final class LZCodec implements ByteTransform
          dstIdx += litLen;
 
          // Emit buffers: literals + tokens + matches
-         Memory.LittleEndian.writeInt32(dst, dstIdx0, dstIdx);
+         Memory.LittleEndian.writeInt32(dst, dstIdx0, dstIdx-dstIdx0);
          Memory.LittleEndian.writeInt32(dst, dstIdx0+4, tkIdx);
          System.arraycopy(this.tkBuf, 0, dst, dstIdx, tkIdx);
          dstIdx += tkIdx;
          System.arraycopy(this.mBuf, 0, dst, dstIdx, mIdx);
          dstIdx += mIdx;
-         input.index = count;
+         input.index = srcIdx0 + count;
+         output.index = dstIdx;
+         return true;
+      }
+
+
+      // Encode a big block as segments processed concurrently.
+      // Each segment can reference its own data and the tail of the previous
+      // segment. Layout: number of segments (4 bytes), segment size (4 bytes),
+      // mode byte, encoded size of each segment (4 bytes), encoded segments.
+      private boolean forwardSegments(SliceByteArray input, SliceByteArray output, int nbSegments)
+      {
+         final int count = input.length;
+         final int segSize = count / nbSegments;
+         final int window = Math.min(segSize>>2, MAX_DISTANCE2);
+         final SliceByteArray[] outputs = new SliceByteArray[nbSegments];
+         final List<Callable<Integer>> tasks = new ArrayList<>(nbSegments);
+
+         for (int i=0; i<nbSegments; i++)
+         {
+            final int start = input.index + i*segSize;
+            final int length = (i == nbSegments-1) ? count - i*segSize : segSize;
+            final int winIdx = (i == 0) ? start : start - window;
+            final SliceByteArray sba1 = new SliceByteArray(input.array, length, start);
+            final SliceByteArray sba2 = new SliceByteArray(new byte[this.getMaxEncodedLength(length)], 0);
+            outputs[i] = sba2;
+
+            tasks.add(new Callable<Integer>()
+            {
+               @Override
+               public Integer call() throws Exception
+               {
+                  final LZXCodec codec = new LZXCodec(LZXCodec.this.extra);
+                  return (codec.forward(sba1, sba2, winIdx) == true) ? sba2.index : -1;
+               }
+            });
+         }
+
+         if (runTasks(tasks, this.jobs, this.pool) == false)
+            return false;
+
+         final byte[] dst = output.array;
+         final int dstIdx0 = output.index;
+         int dstIdx = dstIdx0 + 9 + 4*nbSegments;
+         Memory.LittleEndian.writeInt32(dst, dstIdx0, nbSegments);
+         Memory.LittleEndian.writeInt32(dst, dstIdx0+4, segSize);
+         dst[dstIdx0+8] = (byte) SEGMENTED_FLAG;
+
+         for (int i=0; i<nbSegments; i++)
+         {
+            final int size = outputs[i].index;
+
+            if (dstIdx+size >= dstIdx0+count)
+               return false;
+
+            Memory.LittleEndian.writeInt32(dst, dstIdx0+9+4*i, size);
+            System.arraycopy(outputs[i].array, 0, dst, dstIdx, size);
+            dstIdx += size;
+         }
+
+         input.index += count;
          output.index = dstIdx;
          return true;
       }
 
 
+      // Limit the length of a match so that its source does not extend past
+      // the window nor overlap bytes copied from the window.
+      private int clampMatch(int ref, int len, int srcIdx0)
+      {
+         if (ref < srcIdx0)
+            return Math.min(len, srcIdx0-ref);
+
+         // Find the first tainted range ending after ref
+         final int[] ranges = this.taints.array;
+         final int n = this.taints.index >> 1;
+         int lo = 0;
+         int hi = n;
+
+         while (lo < hi)
+         {
+            final int mid = (lo+hi) >>> 1;
+
+            if (ranges[2*mid+1] <= ref)
+               lo = mid + 1;
+            else
+               hi = mid;
+         }
+
+         if (lo == n)
+            return len;
+
+         return (ranges[2*lo] <= ref) ? 0 : Math.min(len, ranges[2*lo]-ref);
+      }
+
+
+      private void addTaint(int start, int end)
+      {
+         int[] ranges = this.taints.array;
+         int idx = this.taints.index;
+
+         // Merge with the previous range if contiguous
+         if ((idx > 0) && (ranges[idx-1] == start))
+         {
+            ranges[idx-1] = end;
+            return;
+         }
+
+         if (idx+2 > ranges.length)
+         {
+            ranges = new int[Math.max(2*ranges.length, 64)];
+            System.arraycopy(this.taints.array, 0, ranges, 0, idx);
+            this.taints.array = ranges;
+         }
+
+         ranges[idx] = start;
+         ranges[idx+1] = end;
+         this.taints.index += 2;
+      }
+
+
       @Override
       public boolean inverse(SliceByteArray input, SliceByteArray output)
       {
          if (input.length == 0)
             return true;
 
+         if ((input.length > 8) && ((input.array[input.index+8] & SEGMENTED_FLAG) != 0))
+            return this.inverseSegments(input, output);
+
+         return inverse(input, output, output.array.length-16, null, this.progress);
+      }
+
+
+      // Decode the input up to dstEnd (+16 for the last match).
+      // If fixups is not null, matches referencing the data before output.index
+      // are not copied but recorded in fixups (destination, reference, length).
+      // If progress is not null, the number of bytes decoded so far is published
+      // regularly (the output before that point is final).
+      private static boolean inverse(SliceByteArray input, SliceByteArray output,
+         int dstEnd, SliceIntArray fixups, AtomicInteger progress)
+      {
          final int count = input.length;
          final int srcIdx0 = input.index;
          final int dstIdx0 = output.index;
          final byte[] src = input.array;
          final byte[] dst = output.array;
-         final int dstEnd = dst.length - 16;
-         int tkIdx = Memory.LittleEndian.readInt32(src, srcIdx0);
+         int tkIdx = srcIdx0 + Memory.LittleEndian.readInt32(src, srcIdx0);
          int mIdx = tkIdx + Memory.LittleEndian.readInt32(src, srcIdx0+4);
 
          if ((tkIdx < srcIdx0) || (mIdx < srcIdx0) || (tkIdx > srcIdx0+count) || (mIdx > srcIdx0+count))
             return false;
 
-         final int srcEnd = srcIdx0 + tkIdx - 9;
+         final int srcEnd = tkIdx - 9;
          final int maxDist = (src[srcIdx0+8] == 1) ? MAX_DISTANCE2 : MAX_DISTANCE1;
          int srcIdx = srcIdx0 + 9;
          int dstIdx = dstIdx0;
+         int nextProgress = (progress == null) ? Integer.MAX_VALUE : dstIdx0 + PROGRESS_STEP;
          int repd = 0;
          SliceByteArray sba1 = new SliceByteArray(src, srcIdx);
          SliceByteArray sba2 = new SliceByteArray(src, mIdx);
@@ -423,6 +660,15 @@ public final class LZCodec implements ByteTransform
                   srcIdx = sba1.index;
                }
 
+               // Sanity check: the literals must not go past the end of
+               // the output (of the segment if decoding by segments)
+               if (dstIdx+litLen > dstEnd+16)
+               {
+                  input.index = srcIdx;
+                  output.index = dstIdx;
+                  return false;
+               }
+
                // Emit literals
                if (dstIdx+litLen >= dstEnd)
                {
@@ -464,38 +710,55 @@ public final class LZCodec implements ByteTransform
 
             final int dist = (d == 0) ? repd : d - 1;
             repd = dist;
+            final int ref = dstIdx - dist;
 
             // Sanity check
-            if ((dstIdx-dist < dstIdx0) || (dist > maxDist) || (mEnd > dstEnd+16))
+            if ((dist > maxDist) || (mEnd > dstEnd+16) ||
+               ((ref < dstIdx0) && ((fixups == null) || (ref < 0) || (ref+mLen > dstIdx0))))
             {
                input.index = srcIdx;
                output.index = dstIdx;
                return false;
             }
 
-            // Copy match
-            if (dist >= 16)
+            if (ref < dstIdx0)
             {
-               int ref = dstIdx - dist;
+               // Reference to the previous segment, copied later
+               addFixup(fixups, dstIdx, ref, mLen);
+            }
+            else if ((dist >= 16) && (mEnd <= dstEnd))
+            {
+               // Copy match
+               int r = ref;
 
                do
                {
                   // No overlap
-                  System.arraycopy(dst, ref, dst, dstIdx, 16);
-                  ref += 16;
+                  System.arraycopy(dst, r, dst, dstIdx, 16);
+                  r += 16;
                   dstIdx += 16;
                }
                while (dstIdx < mEnd);
             }
             else
             {
-               final int ref = dstIdx - dist;
-
                for (int i=0; i<mLen; i++)
                   dst[dstIdx+i] = dst[ref+i];
             }
 
             dstIdx = mEnd;
+
+            if (dstIdx >= nextProgress)
+            {
+               // Publish the bytes decoded so far and wake up the reader
+               synchronized (progress)
+               {
+                  progress.set(dstIdx-dstIdx0);
+                  progress.notifyAll();
+               }
+
+               nextProgress = dstIdx + PROGRESS_STEP;
+            }
          }
 
          output.index = dstIdx;
@@ -504,12 +767,133 @@ public final class LZCodec implements ByteTransform
       }
 
 
-      private int hash(byte[] block, int idx)
+      // Decode the segments concurrently then copy the matches referencing
+      // the previous segments in segment order.
+      private boolean inverseSegments(SliceByteArray input, SliceByteArray output)
+      {
+         final int count = input.length;
+         final byte[] src = input.array;
+         final byte[] dst = output.array;
+         final int srcIdx0 = input.index;
+         final int dstIdx0 = output.index;
+         final int nbSegments = Memory.LittleEndian.readInt32(src, srcIdx0);
+         final int segSize = Memory.LittleEndian.readInt32(src, srcIdx0+4);
+
+         if ((nbSegments < 2) || (nbSegments > MAX_SEGMENTS) || (segSize <= 0) ||
+            (9+4*nbSegments > count) || ((long) segSize*nbSegments > dst.length-dstIdx0))
+            return false;
+
+         final SliceByteArray[] outputs = new SliceByteArray[nbSegments];
+         final SliceIntArray[] fixups = new SliceIntArray[nbSegments];
+         final List<Callable<Integer>> tasks = new ArrayList<>(nbSegments);
+         final int srcEnd = srcIdx0 + count;
+         int srcIdx = srcIdx0 + 9 + 4*nbSegments;
+
+         for (int i=0; i<nbSegments; i++)
+         {
+            final int size = Memory.LittleEndian.readInt32(src, srcIdx0+9+4*i);
+
+            if ((size <= 9) || (size > srcEnd-srcIdx))
+               return false;
+
+            final int start = dstIdx0 + i*segSize;
+            final boolean last = i == nbSegments-1;
+
+            // Intermediate segments must not write past their end
+            final int dstEnd = (last == true) ? dst.length-16 : start+segSize-16;
+            final SliceByteArray sba1 = new SliceByteArray(src, size, srcIdx);
+            final SliceByteArray sba2 = new SliceByteArray(dst, start);
+            final SliceIntArray sia = new SliceIntArray(new int[64], 0);
+            outputs[i] = sba2;
+            fixups[i] = sia;
+            srcIdx += size;
+
+            tasks.add(new Callable<Integer>()
+            {
+               @Override
+               public Integer call() throws Exception
+               {
+                  if (inverse(sba1, sba2, dstEnd, sia, null) == false)
+                     return -1;
+
+                  return ((last == true) || (sba2.index == start+segSize)) ? sba2.index : -1;
+               }
+            });
+         }
+
+         if (srcIdx != srcEnd)
+            return false;
+
+         if (runTasks(tasks, this.jobs, this.pool) == false)
+            return false;
+
+         for (int i=0; i<nbSegments; i++)
+         {
+            final int[] array = fixups[i].array;
+
+            for (int n=0; n<fixups[i].index; n+=3)
+            {
+               final int idx = array[n];
+               final int ref = array[n+1];
+               final int len = array[n+2];
+
+               for (int j=0; j<len; j++)
+                  dst[idx+j] = dst[ref+j];
+            }
+         }
+
+         input.index = srcEnd;
+         output.index = outputs[nbSegments-1].index;
+         return true;
+      }
+
+
+      private static void addFixup(SliceIntArray fixups, int idx, int ref, int len)
       {
-         if (this.extra == true)
-            return (int) ((Memory.LittleEndian.readLong64(block, idx)*HASH_SEED) >> HASH_SHIFT2) & HASH_MASK2;
+         if (fixups.index+3 > fixups.array.length)
+         {
+            int[] buf = new int[2*fixups.array.length+3];
+            System.arraycopy(fixups.array, 0, buf, 0, fixups.index);
+            fixups.array = buf;
+         }
+
+         fixups.array[fixups.index]   = idx;
+         fixups.array[fixups.index+1] = ref;
+         fixups.array[fixups.index+2] = len;
+         fixups.index += 3;
+      }
+
+
+      // Number of segments of a block (1 means no segmentation). It depends on
+      // the block length only: the output is the same whatever the number of jobs.
+      private static int getNbSegments(int count)
+      {
+         return Math.max(Math.min(MAX_SEGMENTS, count/MIN_SEGMENT_SIZE), 1);
+      }
+
+
+      // Start a new generation of hash entries and return its base.
+      // Entries of previous generations are never above the new base, so the
+      // table is only cleared when the base would overflow.
+      private int newGeneration(int length)
+      {
+         if (this.hashBase > Integer.MAX_VALUE - length - 1)
+         {
+            for (int i=0; i<this.hashes.length; i++)
+               this.hashes[i] = 0;
+
+            this.hashBase = 0;
+         }
 
-         return (int) ((Memory.LittleEndian.readLong64(block, idx)*HASH_SEED) >> HASH_SHIFT1) & HASH_MASK1;
+         final int base = this.hashBase;
+         this.hashBase += length;
+         return base;
+      }
+
+
+      private int hash(byte[] block, int idx)
+      {
+         return (int) ((Memory.LittleEndian.readLong64(block, idx)*HASH_SEED) >> this.hashShift) & this.hashMask;
       }
 
 
@@ -546,23 +930,59 @@ public final class LZCodec implements ByteTransform
    {
       private static final int HASH_SEED        = 0x7FEB352D;
       private static final int HASH_LOG         = 16;
-      private static final int HASH_SHIFT       = 32 - HASH_LOG;
+      private static final int MIN_HASH_LOG     = 12;
       private static final int MIN_MATCH        = 96;
       private static final int MIN_BLOCK_LENGTH = 128;
       private static final int MATCH_FLAG       = 0xFC;
 
       private int[] hashes;
+      private int hashBase;
+      private final int hashShift;
 
 
       public LZPCodec()
       {
          this.hashes = new int[0];
+         this.hashShift = 32 - HASH_LOG;
       }
 
 
       public LZPCodec(Map<String, Object> ctx)
       {
          this.hashes = new int[0];
+
+         // The decoder must use the same table size: derive it from the
+         // block size of the stream rather than from the block length.
+         // Streams before version 2 always use the biggest table.
+         final int bsVersion = (Integer) ctx.getOrDefault("bsVersion", 2);
+         final int bSize = (Integer) ctx.getOrDefault("blockSize", 1<<HASH_LOG);
+         final int logSize = (bsVersion < 2) ? HASH_LOG :
+            Math.min(Math.max(Global.log2(bSize), MIN_HASH_LOG), HASH_LOG);
+         this.hashShift = 32 - logSize;
+      }
+
+
+      // Start a new generation of hash entries and return its base.
+      // Valid entries are strictly above the base of the generation, so that
+      // entries of previous blocks read as empty without clearing the table.
+      private int newGeneration(int length)
+      {
+         if (this.hashes.length == 0)
+         {
+            this.hashes = new int[1<<(32-this.hashShift)];
+            this.hashBase = 0;
+         }
+         else if (this.hashBase > Integer.MAX_VALUE - length - 1)
+         {
+            for (int i=0; i<this.hashes.length; i++)
+               this.hashes[i] = 0;
+
+            this.hashBase = 0;
+         }
+
+         final int base = this.hashBase;
+         this.hashBase += length;
+         return base;
       }
 
 
@@ -581,20 +1001,12 @@ public final class LZCodec implements ByteTransform
          if (count < MIN_BLOCK_LENGTH)
              return false;
 
-         if (this.hashes.length == 0)
-         {
-            this.hashes = new int[1<<HASH_LOG];
-         }
-         else
-         {
-            for (int i=0; i<(1<<HASH_LOG); i++)
-               this.hashes[i] = 0;
-         }
-
          final int srcIdx0 = input.index;
          final int dstIdx0 = output.index;
          final byte[] src = input.array;
          final byte[] dst = output.array;
+         final int base = this.newGeneration(count);
+         final int bias = base + 1 - srcIdx0;
          final int srcEnd = srcIdx0 + count - 8;
          final int dstEnd = dstIdx0 + count - 4;
          int srcIdx = srcIdx0;
@@ -610,9 +1022,9 @@ public final class LZCodec implements ByteTransform
          int minRef = 4;
 
          while ((srcIdx < srcEnd) && (dstIdx < dstEnd)) {
-            final int h = (HASH_SEED*ctx) >>> HASH_SHIFT;
-            final int ref = this.hashes[h];
-            this.hashes[h] = srcIdx;
+            final int h = (HASH_SEED*ctx) >>> this.hashShift;
+            final int ref = (this.hashes[h] > base) ? this.hashes[h] - bias : 0;
+            this.hashes[h] = srcIdx + bias;
             int bestLen = 0;
 
             // Find a match
@@ -667,9 +1079,9 @@ public final class LZCodec implements ByteTransform
 
          while ((srcIdx < srcEnd+8) && (dstIdx < dstEnd))
          {
-            final int h = (HASH_SEED*ctx) >>> HASH_SHIFT;
-            final int ref = this.hashes[h];
-            this.hashes[h] = srcIdx;
+            final int h = (HASH_SEED*ctx) >>> this.hashShift;
+            final int ref = (this.hashes[h] > base) ? this.hashes[h] - bias : 0;
+            this.hashes[h] = srcIdx + bias;
             final int val = src[srcIdx] & 0xFF;
             ctx = (ctx<<8) | val;
             dst[dstIdx++] = src[srcIdx++];
@@ -696,16 +1108,8 @@ public final class LZCodec implements ByteTransform
          final int srcEnd = input.index + count;
          int srcIdx = input.index;
          int dstIdx = output.index;
-
-         if (this.hashes.length == 0)
-         {
-            this.hashes = new int[1<<HASH_LOG];
-         }
-         else
-         {
-            for (int i=0; i<(1<<HASH_LOG); i++)
-               this.hashes[i] = 0;
-         }
+         final int base = this.newGeneration(dst.length-dstIdx);
+         final int bias = base + 1 - dstIdx;
 
          dst[dstIdx]   = src[srcIdx];
          dst[dstIdx+1] = src[srcIdx+1];
@@ -717,9 +1121,9 @@ public final class LZCodec implements ByteTransform
 
          while (srcIdx < srcEnd)
          {
-            final int h = (HASH_SEED*ctx) >>> HASH_SHIFT;
-            final int ref = this.hashes[h];
-            this.hashes[h] = dstIdx;
+            final int h = (HASH_SEED*ctx) >>> this.hashShift;
+            final int ref = (this.hashes[h] > base) ? this.hashes[h] - bias : 0;
+            this.hashes[h] = dstIdx + bias;
 
             if ((ref == 0) || (src[srcIdx] != (byte) MATCH_FLAG))
             {
@@ -0,0 +1,388 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.transform;
+
+
+// Linear time construction of the bijective BWT (BWTS).
+// The BWTS sorts the rotations (conjugates) of all the Lyndon factors of the
+// input in infinite periodic order (u < v if u^inf < v^inf) and emits the last
+// symbol of each rotation. This is an induced sorting (SA-IS) of the positions
+// of the input where the successor of the last position of each factor is the
+// first position of the factor (cyclic strings):
+// - L/S types and LMS positions are defined on each cycle
+// - the LMS substrings are sorted by induction and named
+// - if the names are not unique, the reduced string (one cycle per factor)
+//   is sorted recursively
+// - the order of all positions is induced from the sorted LMS positions
+// The rotations of a factor of length 1 (c^inf) cannot be induced. They sit
+// between the L and the S positions of the bucket of symbol c.
+// See [Bannai, Karkkainen, Koppl, Piatkowski - Constructing the Bijective
+// and the Extended Burrows-Wheeler Transform in Linear Time, CPM 2021]
+public final class LyndonSA_IS
+{
+   private static final byte START  = 1;  // first position of a cycle
+   private static final byte END    = 2;  // last position of a cycle
+   private static final byte STYPE  = 4;  // S type position
+   private static final byte LMS    = 8;  // leftmost S type position
+   private static final byte SINGLE = 16; // cycle of length 1
+
+   private int[] sa;
+   private int[] text;
+   private int[] wrap; // other end of the cycle for first and last positions
+   private byte[] flags;
+
+
+   public LyndonSA_IS()
+   {
+      this.sa = new int[0];
+      this.text = new int[0];
+      this.wrap = new int[0];
+      this.flags = new byte[0];
+   }
+
+
+   // Write the BWTS of input[srcIdx..srcIdx+count) to output[dstIdx..dstIdx+count)
+   public void computeBWTS(byte[] input, int srcIdx, byte[] output, int dstIdx, int count)
+   {
+      if (this.sa.length < count)
+      {
+         this.sa = new int[count];
+         this.text = new int[count];
+         this.wrap = new int[count];
+         this.flags = new byte[count];
+      }
+
+      final int[] sa_ = this.sa;
+      final int[] t = this.text;
+      final int[] w = this.wrap;
+      final byte[] f = this.flags;
+
+      for (int i=0; i<count; i++)
+      {
+         t[i] = input[srcIdx+i] & 0xFF;
+         f[i] = 0;
+      }
+
+      factorize(t, count, w, f);
+      sort(t, count, 256, w, f, sa_);
+
+      // Emit the symbol preceding each rotation in its cycle
+      for (int i=0; i<count; i++)
+      {
+         final int j = sa_[i];
+         output[dstIdx+i] = input[srcIdx+prev(w, f, j)];
+      }
+   }
+
+
+   private static int next(int[] wrap, byte[] flags, int i)
+   {
+      return ((flags[i] & END) != 0) ? wrap[i] : i+1;
+   }
+
+
+   private static int prev(int[] wrap, byte[] flags, int i)
+   {
+      return ((flags[i] & START) != 0) ? wrap[i] : i-1;
+   }
+
+
+   private static void setCycle(int[] wrap, byte[] flags, int start, int end)
+   {
+      if (start == end)
+      {
+         wrap[start] = start;
+         flags[start] = START | END | SINGLE;
+         return;
+      }
+
+      wrap[start] = end;
+      wrap[end] = start;
+      flags[start] |= START;
+      flags[end] |= END;
+   }
+
+
+   // Lyndon factorization (Duval's algorithm). Each factor becomes a cycle.
+   private static void factorize(int[] t, int n, int[] wrap, byte[] flags)
+   {
+      int i = 0;
+
+      while (i < n)
+      {
+         int j = i + 1;
+         int k = i;
+
+         while ((j < n) && (t[k] <= t[j]))
+         {
+            k = (t[k] < t[j]) ? i : k+1;
+            j++;
+         }
+
+         final int length = j - k;
+
+         while (i <= k)
+         {
+            setCycle(wrap, flags, i, i+length-1);
+            i += length;
+         }
+      }
+   }
+
+
+   // Compute the type of each position in its cycle. The cycles are Lyndon
+   // words, hence primitive: a cycle longer than 1 contains two different
+   // symbols and its first position is LMS.
+   private static void computeTypes(int[] t, int n, int[] wrap, byte[] flags)
+   {
+      int i = 0;
+
+      while (i < n)
+      {
+         if ((flags[i] & SINGLE) != 0)
+         {
+            i++;
+            continue;
+         }
+
+         final int end = wrap[i];
+         int p = end;
+
+         // Start from a position followed by a different symbol
+         while (t[p] == t[next(wrap, flags, p)])
+            p--;
+
+         if (t[p] < t[next(wrap, flags, p)])
+            flags[p] |= STYPE;
+
+         for (int q=prev(wrap, flags, p); q!=p; q=prev(wrap, flags, q))
+         {
+            final int nq = next(wrap, flags, q);
+
+            if ((t[q] < t[nq]) || ((t[q] == t[nq]) && ((flags[nq] & STYPE) != 0)))
+               flags[q] |= STYPE;
+         }
+
+         i = end + 1;
+      }
+
+      for (i=0; i<n; i++)
+      {
+         if (((flags[i] & STYPE) != 0) && ((flags[prev(wrap, flags, i)] & STYPE) == 0))
+            flags[i] |= LMS;
+      }
+   }
+
+
+   // Sort all the positions of t (cycles defined by wrap and flags) in
+   // infinite periodic order. The symbols are in [0..k).
+   private static void sort(int[] t, int n, int k, int[] wrap, byte[] flags, int[] sa)
+   {
+      computeTypes(t, n, wrap, flags);
+      final int[] buckets = new int[k+1]; // bucket starts
+      final int[] nbL = new int[k]; // number of L type positions per bucket
+      final int[] ptr = new int[k];
+      int m = 0;
+
+      for (int i=0; i<n; i++)
+      {
+         final int c = t[i];
+         buckets[c+1]++;
+
+         if ((flags[i] & (STYPE|SINGLE)) == 0)
+            nbL[c]++;
+         else if ((flags[i] & LMS) != 0)
+            m++;
+      }
+
+      for (int c=0; c<k; c++)
+         buckets[c+1] += buckets[c];
+
+      // Step 1: sort the LMS substrings
+      for (int i=0; i<n; i++)
+         sa[i] = -1;
+
+      for (int c=0; c<k; c++)
+         ptr[c] = buckets[c+1] - 1;
+
+      for (int i=0; i<n; i++)
+      {
+         if ((flags[i] & LMS) != 0)
+            sa[ptr[t[i]]--] = i;
+      }
+
+      placeSingles(t, n, k, flags, sa, buckets, nbL, ptr);
+      induce(t, n, k, wrap, flags, sa, buckets, ptr);
+
+      // Move the sorted LMS positions to the front
+      for (int i=0, j=0; i<n; i++)
+      {
+         final int p = sa[i];
+
+         if ((flags[p] & LMS) != 0)
+            sa[j++] = p;
+      }
+
+      // Step 2: name the LMS substrings. The LMS positions are at least 2
+      // apart, so the names fit in sa[m..n).
+      for (int i=m; i<n; i++)
+         sa[i] = -1;
+
+      int name = 0;
+
+      for (int i=0, prevPos=-1; i<m; i++)
+      {
+         final int p = sa[i];
+
+         if ((prevPos < 0) || (equalLMS(t, wrap, flags, prevPos, p) == false))
+            name++;
+
+         prevPos = p;
+         sa[m+(p>>1)] = name - 1;
+      }
+
+      if (name < m)
+      {
+         // Some LMS substrings are equal: sort the reduced problem
+         final int[] pos = new int[m];
+         final int[] r = new int[m];
+
+         for (int i=0, j=0; i<n; i++)
+         {
+            if ((flags[i] & LMS) != 0)
+            {
+               pos[j] = i;
+               r[j] = sa[m+(i>>1)];
+               j++;
+            }
+         }
+
+         // One reduced cycle per cycle: the names of its LMS positions
+         final int[] rWrap = new int[m];
+         final byte[] rFlags = new byte[m];
+
+         for (int i=0, j=0; i<n; )
+         {
+            if ((flags[i] & SINGLE) != 0)
+            {
+               i++;
+               continue;
+            }
+
+            final int end = wrap[i];
+            final int first = j;
+
+            while ((j < m) && (pos[j] <= end))
+               j++;
+
+            setCycle(rWrap, rFlags, first, j-1);
+            i = end + 1;
+         }
+
+         sort(r, m, name, rWrap, rFlags, sa);
+
+         for (int i=0; i<m; i++)
+            sa[i] = pos[sa[i]];
+      }
+
+      // Step 3: induce the order of all positions from the sorted LMS positions
+      for (int i=m; i<n; i++)
+         sa[i] = -1;
+
+      for (int c=0; c<k; c++)
+         ptr[c] = buckets[c+1] - 1;
+
+      for (int i=m-1; i>=0; i--)
+      {
+         final int p = sa[i];
+         sa[i] = -1;
+         sa[ptr[t[p]]--] = p;
+      }
+
+      placeSingles(t, n, k, flags, sa, buckets, nbL, ptr);
+      induce(t, n, k, wrap, flags, sa, buckets, ptr);
+   }
+
+
+   // Place the cycles of length 1 between the L and S positions of their bucket
+   private static void placeSingles(int[] t, int n, int k, byte[] flags, int[] sa,
+      int[] buckets, int[] nbL, int[] ptr)
+   {
+      for (int c=0; c<k; c++)
+         ptr[c] = buckets[c] + nbL[c];
+
+      for (int i=0; i<n; i++)
+      {
+         if ((flags[i] & SINGLE) != 0)
+            sa[ptr[t[i]]++] = i;
+      }
+   }
+
+
+   private static void induce(int[] t, int n, int k, int[] wrap, byte[] flags, int[] sa,
+      int[] buckets, int[] ptr)
+   {
+      // L type positions, left to right from the bucket heads
+      System.arraycopy(buckets, 0, ptr, 0, k);
+
+      for (int i=0; i<n; i++)
+      {
+         final int j = sa[i];
+
+         if (j < 0)
+            continue;
+
+         final int p = prev(wrap, flags, j);
+
+         if ((flags[p] & (STYPE|SINGLE)) == 0)
+            sa[ptr[t[p]]++] = p;
+      }
+
+      // S type positions, right to left from the bucket tails
+      for (int c=0; c<k; c++)
+         ptr[c] = buckets[c+1] - 1;
+
+      for (int i=n-1; i>=0; i--)
+      {
+         final int j = sa[i];
+
+         if (j < 0)
+            continue;
+
+         final int p = prev(wrap, flags, j);
+
+         if ((flags[p] & STYPE) != 0)
+            sa[ptr[t[p]]--] = p;
+      }
+   }
+
+
+   // Compare the (cyclic) LMS substrings starting at a and b
+   private static boolean equalLMS(int[] t, int[] wrap, byte[] flags, int a, int b)
+   {
+      for (int d=0; ; d++)
+      {
+         if ((t[a] != t[b]) || ((flags[a] & STYPE) != (flags[b] & STYPE)))
+            return false;
+
+         if ((d > 0) && (((flags[a] | flags[b]) & LMS) != 0))
+            return (flags[a] & flags[b] & LMS) != 0;
+
+         a = next(wrap, flags, a);
+         b = next(wrap, flags, b);
+      }
+   }
+}
@@ -18,6 +18,7 @@ package kanzi.transform;
 import java.io.ByteArrayInputStream;
 import java.io.ByteArrayOutputStream;
 import java.util.Map;
+import java.util.concurrent.atomic.AtomicInteger;
 import kanzi.ByteTransform;
 import kanzi.InputBitStream;
 import kanzi.Memory;
@@ -44,6 +45,7 @@ public class ROLZCodec implements ByteTransform
    private static final int HASH_MASK = ~(CHUNK_SIZE - 1);
    private static final int MAX_BLOCK_SIZE = 1 << 30; // 1 GB
    private static final int MIN_BLOCK_SIZE = 64;
+   private static final int PROGRESS_STEP = 1 << 16;
 
 
    private final ByteTransform delegate;
@@ -64,7 +66,13 @@ public class ROLZCodec implements ByteTransform
    public ROLZCodec(Map<String, Object> ctx)
    {
       String transform = (String) ctx.getOrDefault("transform", "NONE");
-      this.delegate = (transform.contains("ROLZX")) ? new ROLZCodec2() : new ROLZCodec1();
+
+      // Number of decoded bytes, published while decoding (streaming decoder)
+      AtomicInteger progress = (AtomicInteger) ctx.get("progress");
+      // Lazy match evaluation: better compression, slower encoding
+      boolean lazy = (Boolean) ctx.getOrDefault("lazyMatch", false);
+      this.delegate = (transform.contains("ROLZX")) ? new ROLZCodec2(LOG_POS_CHECKS2, progress, lazy) :
+         new ROLZCodec1(LOG_POS_CHECKS1, progress, lazy);
    }
 
 
@@ -160,8 +168,13 @@ public class ROLZCodec implements ByteTransform
       private final int logPosChecks;
       private final int maskChecks;
       private final int posChecks;
-      private final int[] matches;
-      private final int[] counters;
+      private final int[] keys;
+      private int[] matches;
+      private int[] counters;
+      private int keyBase;
+      private int nbBuckets;
+      private final AtomicInteger progress; // decoded bytes (may be null)
+      private final boolean lazy; // lazy match evaluation (encoder only)
 
 
       public ROLZCodec1()
@@ -171,27 +184,114 @@ public class ROLZCodec implements ByteTransform
 
 
       public ROLZCodec1(int logPosChecks)
+      {
+         this(logPosChecks, null);
+      }
+
+
+      public ROLZCodec1(int logPosChecks, AtomicInteger progress)
+      {
+         this(logPosChecks, progress, false);
+      }
+
+
+      public ROLZCodec1(int logPosChecks, AtomicInteger progress, boolean lazy)
       {
          if ((logPosChecks < 2) || (logPosChecks > 8))
             throw new IllegalArgumentException("ROLZ codec: Invalid logPosChecks parameter " +
                "(must be in [2..8])");
 
+         this.progress = progress;
+         this.lazy = lazy;
          this.logPosChecks = logPosChecks;
          this.posChecks = 1 << logPosChecks;
          this.maskChecks = this.posChecks - 1;
-         this.counters = new int[1<<16];
-         this.matches = new int[HASH_SIZE<<this.logPosChecks];
+         this.keys = new int[HASH_SIZE];
+         this.counters = new int[0];
+         this.matches = new int[0];
+      }
+
+
+      // Prepare the match tables for a new chunk.
+      // Keys are tagged with a chunk generation (keyBase) so that the key table
+      // does not need to be cleared. The buckets of positions are allocated on
+      // first use of a key in the chunk, hence the work and memory are
+      // proportional to the chunk size rather than to the number of keys.
+      private void resetBuckets(int chunkSize)
+      {
+         final int n = Math.min(chunkSize, HASH_SIZE);
+
+         if (this.counters.length < n)
+         {
+            this.counters = new int[n];
+            this.matches = new int[n<<this.logPosChecks];
+         }
+
+         if (this.keyBase >= Integer.MAX_VALUE - 2*HASH_SIZE)
+         {
+            for (int i=0; i<this.keys.length; i++)
+               this.keys[i] = 0;
+
+            this.keyBase = 0;
+         }
+
+         // Invalidate all buckets of the previous generation
+         this.keyBase += (this.nbBuckets + 1);
+         this.nbBuckets = 0;
+      }
+
+
+      private int getBucket(int key)
+      {
+         final int bucket = this.keys[key] - this.keyBase;
+         return (bucket > 0) ? bucket - 1 : this.newBucket(key);
+      }
+
+
+      private int newBucket(int key)
+      {
+         final int bucket = this.nbBuckets++;
+
+         if (bucket >= this.counters.length)
+         {
+            final int n = Math.min(Math.max(2*this.counters.length, 256), HASH_SIZE);
+            int[] buf = new int[n];
+            System.arraycopy(this.counters, 0, buf, 0, this.counters.length);
+            this.counters = buf;
+            buf = new int[n<<this.logPosChecks];
+            System.arraycopy(this.matches, 0, buf, 0, this.matches.length);
+            this.matches = buf;
+         }
+
+         this.keys[key] = this.keyBase + bucket + 1;
+         this.counters[bucket] = 0;
+         final int base = bucket << this.logPosChecks;
+
+         for (int i=0; i<this.posChecks; i++)
+            this.matches[base+i] = 0;
+
+         return bucket;
       }
 
 
-      // return position index (LOG_POS_CHECKS bits) + length (16 bits) or -1
-      private int findMatch(final SliceByteArray sba, final int pos)
+      // Return position index (LOG_POS_CHECKS bits) + length (16 bits) or -1.
+      // If register is false, the current position is not recorded (and no
+      // bucket is created) so that the state shared with the decoder is not
+      // affected.
+      private int findMatch(final SliceByteArray sba, final int pos, final boolean register)
       {
          final byte[] buf = sba.array;
          final int key = getKey(buf, pos-2) & 0xFFFF;
-         final int base = key << this.logPosChecks;
+         final int bucket = (register == true) ? this.getBucket(key) :
+            this.keys[key] - this.keyBase - 1;
+
+         // No position recorded for this key in the chunk
+         if (bucket < 0)
+            return -1;
+
+         final int base = bucket << this.logPosChecks;
          final int hash32 = hash(buf, pos);
-         final int counter = this.counters[key];
+         final int counter = this.counters[bucket];
          int bestLen = MIN_MATCH - 1;
          int bestIdx = -1;
          byte first = buf[pos];
@@ -226,13 +326,30 @@ public class ROLZCodec implements ByteTransform
             }
          }
 
-         // Register current position
-         this.counters[key]++;
-         this.matches[base+(this.counters[key]&this.maskChecks)] = hash32 | (pos-sba.index);
+         if (register == true)
+         {
+            // Register current position
+            this.counters[bucket]++;
+            this.matches[base+(this.counters[bucket]&this.maskChecks)] = hash32 | (pos-sba.index);
+         }
+
          return (bestLen < MIN_MATCH) ? -1 : (bestIdx<<16) | (bestLen-MIN_MATCH);
       }
 
 
+      // Lazy evaluation: return true if the match found at 'pos' should be
+      // dropped (position emitted as a literal) because a longer match starts
+      // at pos+1. Only the encoder changes, the decoder is the same.
+      private boolean deferMatch(final SliceByteArray sba, final int pos, final int matchLen)
+      {
+         if ((this.lazy == false) || (pos+1 >= sba.length))
+            return false;
+
+         final int match = this.findMatch(sba, pos+1, false);
+         return (match >= 0) && ((match&0xFFFF)+MIN_MATCH > matchLen+1);
+      }
+
+
       @Override
       public boolean forward(SliceByteArray input, SliceByteArray output)
       {
@@ -256,9 +373,6 @@ public class ROLZCodec implements ByteTransform
          final SliceByteArray tkBuf = new SliceByteArray(new byte[sizeChunk/5], 0);
          ByteArrayOutputStream baos = new ByteArrayOutputStream(this.getMaxEncodedLength(sizeChunk));
 
-         for (int i=0; i<this.counters.length; i++)
-            this.counters[i] = 0;
-
          final int litOrder = (count < 1<<17) ? 0 : 1;
          dst[dstIdx++] = (byte) litOrder;
 
@@ -270,8 +384,7 @@ public class ROLZCodec implements ByteTransform
             mIdxBuf.index = 0;
             tkBuf.index = 0;
 
-            for (int i=0; i<this.matches.length; i++)
-               this.matches[i] = 0;
+            this.resetBuckets(sizeChunk);
 
             final int endChunk = (startChunk+sizeChunk < srcEnd) ? startChunk+sizeChunk : srcEnd;
             sizeChunk = endChunk - startChunk;
@@ -287,9 +400,9 @@ public class ROLZCodec implements ByteTransform
             // Next chunk
             while (srcIdx < endChunk)
             {
-               final int match = findMatch(sba, srcIdx);
+               final int match = findMatch(sba, srcIdx, true);
 
-               if (match == -1)
+               if ((match == -1) || (this.deferMatch(sba, srcIdx, (match&0xFFFF)+MIN_MATCH) == true))
                {
                   srcIdx++;
                   continue;
@@ -431,14 +544,13 @@ public class ROLZCodec implements ByteTransform
          srcIdx += 4;
          int sizeChunk = (dstEnd <= CHUNK_SIZE) ? dstEnd : CHUNK_SIZE;
          int startChunk = output.index;
+         final int dstIdx0 = output.index;
+         int nextProgress = dstIdx0 + PROGRESS_STEP;
          final SliceByteArray litBuf  = new SliceByteArray(new byte[this.getMaxEncodedLength(sizeChunk)], 0);
          final SliceByteArray lenBuf = new SliceByteArray(new byte[sizeChunk/5], 0);
          final SliceByteArray mIdxBuf = new SliceByteArray(new byte[sizeChunk/4], 0);
          final SliceByteArray tkBuf = new SliceByteArray(new byte[sizeChunk/5], 0);
 
-         for (int i=0; i<this.counters.length; i++)
-            this.counters[i] = 0;
-
          final int litOrder = src[srcIdx++];
 
          // Main loop
@@ -449,8 +561,7 @@ public class ROLZCodec implements ByteTransform
             mIdxBuf.index = 0;
             tkBuf.index = 0;
 
-            for (int i=0; i<this.matches.length; i++)
-               this.matches[i] = 0;
+            this.resetBuckets(sizeChunk);
 
             final int endChunk = (startChunk+sizeChunk < dstEnd) ? startChunk+sizeChunk : dstEnd;
             sizeChunk = endChunk - startChunk;
@@ -526,13 +637,26 @@ public class ROLZCodec implements ByteTransform
                }
 
                final int key = getKey(dst, dstIdx-2) & 0xFFFF;
-               final int base = key << this.logPosChecks;
+               final int bucket = this.getBucket(key);
+               final int base = bucket << this.logPosChecks;
                final int matchIdx = mIdxBuf.array[mIdxBuf.index++] & 0xFF;
-               final int ref = output.index + this.matches[base+((this.counters[key]-matchIdx)&this.maskChecks)];
+               final int ref = output.index + this.matches[base+((this.counters[bucket]-matchIdx)&this.maskChecks)];
                final int savedIdx = dstIdx;
                dstIdx = emitCopy(dst, dstIdx, ref, matchLen);
-               this.counters[key]++;
-               this.matches[base+(this.counters[key]&this.maskChecks)] = savedIdx - output.index;
+               this.counters[bucket]++;
+               this.matches[base+(this.counters[bucket]&this.maskChecks)] = savedIdx - output.index;
+
+               // Publish the bytes decoded so far and wake up the reader
+               if ((dstIdx >= nextProgress) && (this.progress != null))
+               {
+                  synchronized (this.progress)
+                  {
+                     this.progress.set(dstIdx-dstIdx0);
+                     this.progress.notifyAll();
+                  }
+
+                  nextProgress = dstIdx + PROGRESS_STEP;
+               }
             }
 
             startChunk = endChunk;
@@ -584,10 +708,11 @@ public class ROLZCodec implements ByteTransform
          for (int n=0; n<length; n++)
          {
             final int key = getKey(dst, dstIdx+n-2) & 0xFFFF;
-            final int base = key << this.logPosChecks;
+            final int bucket = this.getBucket(key);
+            final int base = bucket << this.logPosChecks;
             dst[dstIdx+n] = litBuf.array[litBuf.index+n];
-            this.counters[key]++;
-            this.matches[base+(this.counters[key]&this.maskChecks)] = n0 + n;
+            this.counters[bucket]++;
+            this.matches[base+(this.counters[bucket]&this.maskChecks)] = n0 + n;
          }
 
          return length;
@@ -612,8 +737,13 @@ public class ROLZCodec implements ByteTransform
       private final int logPosChecks;
       private final int maskChecks;
       private final int posChecks;
-      private final int[] matches;
-      private final int[] counters;
+      private final int[] keys;
+      private int[] matches;
+      private int[] counters;
+      private int keyBase;
+      private int nbBuckets;
+      private final AtomicInteger progress; // decoded bytes (may be null)
+      private final boolean lazy; // lazy match evaluation (encoder only)
 
 
       public ROLZCodec2()
@@ -623,27 +753,114 @@ public class ROLZCodec implements ByteTransform
 
 
       public ROLZCodec2(int logPosChecks)
+      {
+         this(logPosChecks, null);
+      }
+
+
+      public ROLZCodec2(int logPosChecks, AtomicInteger progress)
+      {
+         this(logPosChecks, progress, false);
+      }
+
+
+      public ROLZCodec2(int logPosChecks, AtomicInteger progress, boolean lazy)
       {
          if ((logPosChecks < 2) || (logPosChecks > 8))
             throw new IllegalArgumentException("ROLZX codec: Invalid logPosChecks parameter " +
                "(must be in [2..8])");
 
+         this.progress = progress;
+         this.lazy = lazy;
          this.logPosChecks = logPosChecks;
          this.posChecks = 1 << logPosChecks;
          this.maskChecks = this.posChecks - 1;
-         this.counters = new int[1<<16];
-         this.matches = new int[HASH_SIZE<<this.logPosChecks];
+         this.keys = new int[HASH_SIZE];
+         this.counters = new int[0];
+         this.matches = new int[0];
       }
 
 
-      // return position index (LOG_POS_CHECKS bits) + length (16 bits) or -1
-      private int findMatch(final SliceByteArray sba, final int pos)
+      // Prepare the match tables for a new chunk.
+      // Keys are tagged with a chunk generation (keyBase) so that the key table
+      // does not need to be cleared. The buckets of positions are allocated on
+      // first use of a key in the chunk, hence the work and memory are
+      // proportional to the chunk size rather than to the number of keys.
+      private void resetBuckets(int chunkSize)
+      {
+         final int n = Math.min(chunkSize, HASH_SIZE);
+
+         if (this.counters.length < n)
+         {
+            this.counters = new int[n];
+            this.matches = new int[n<<this.logPosChecks];
+         }
+
+         if (this.keyBase >= Integer.MAX_VALUE - 2*HASH_SIZE)
+         {
+            for (int i=0; i<this.keys.length; i++)
+               this.keys[i] = 0;
+
+            this.keyBase = 0;
+         }
+
+         // Invalidate all buckets of the previous generation
+         this.keyBase += (this.nbBuckets + 1);
+         this.nbBuckets = 0;
+      }
+
+
+      private int getBucket(int key)
+      {
+         final int bucket = this.keys[key] - this.keyBase;
+         return (bucket > 0) ? bucket - 1 : this.newBucket(key);
+      }
+
+
+      private int newBucket(int key)
+      {
+         final int bucket = this.nbBuckets++;
+
+         if (bucket >= this.counters.length)
+         {
+            final int n = Math.min(Math.max(2*this.counters.length, 256), HASH_SIZE);
+            int[] buf = new int[n];
+            System.arraycopy(this.counters, 0, buf, 0, this.counters.length);
+            this.counters = buf;
+            buf = new int[n<<this.logPosChecks];
+            System.arraycopy(this.matches, 0, buf, 0, this.matches.length);
+            this.matches = buf;
+         }
+
+         this.keys[key] = this.keyBase + bucket + 1;
+         this.counters[bucket] = 0;
+         final int base = bucket << this.logPosChecks;
+
+         for (int i=0; i<this.posChecks; i++)
+            this.matches[base+i] = 0;
+
+         return bucket;
+      }
+
+
+      // Return position index (LOG_POS_CHECKS bits) + length (16 bits) or -1.
+      // If register is false, the current position is not recorded (and no
+      // bucket is created) so that the state shared with the decoder is not
+      // affected.
+      private int findMatch(final SliceByteArray sba, final int pos, final boolean register)
       {
          final byte[] buf = sba.array;
          final int key = getKey(buf, pos-2) & 0xFFFF;
-         final int base = key << this.logPosChecks;
+         final int bucket = (register == true) ? this.getBucket(key) :
+            this.keys[key] - this.keyBase - 1;
+
+         // No position recorded for this key in the chunk
+         if (bucket < 0)
+            return -1;
+
+         final int base = bucket << this.logPosChecks;
          final int hash32 = hash(buf, pos);
-         final int counter = this.counters[key];
+         final int counter = this.counters[bucket];
          int bestLen = MIN_MATCH - 1;
          int bestIdx = -1;
          byte first = buf[pos];
@@ -678,13 +895,30 @@ public class ROLZCodec implements ByteTransform
             }
          }
 
-         // Register current position
-         this.counters[key]++;
-         this.matches[base+(this.counters[key]&this.maskChecks)] = hash32 | (pos-sba.index);
+         if (register == true)
+         {
+            // Register current position
+            this.counters[bucket]++;
+            this.matches[base+(this.counters[bucket]&this.maskChecks)] = hash32 | (pos-sba.index);
+         }
+
          return (bestLen < MIN_MATCH) ? -1 : (bestIdx<<16) | (bestLen-MIN_MATCH);
       }
 
 
+      // Lazy evaluation: return true if the match found at 'pos' should be
+      // dropped (position emitted as a literal) because a longer match starts
+      // at pos+1. Only the encoder changes, the decoder is the same.
+      private boolean deferMatch(final SliceByteArray sba, final int pos, final int matchLen)
+      {
+         if ((this.lazy == false) || (pos+1 >= sba.length))
+            return false;
+
+         final int match = this.findMatch(sba, pos+1, false);
+         return (match >= 0) && ((match&0xFFFF)+MIN_MATCH > matchLen+1);
+      }
+
+
       @Override
       public boolean forward(SliceByteArray input, SliceByteArray output)
       {
@@ -705,14 +939,10 @@ public class ROLZCodec implements ByteTransform
          SliceByteArray sba1 = new SliceByteArray(dst, dstIdx);
          ROLZEncoder re = new ROLZEncoder(9, this.logPosChecks, sba1);
 
-         for (int i=0; i<this.counters.length; i++)
-            this.counters[i] = 0;
-
          // Main loop
          while (startChunk < srcEnd)
          {
-            for (int i=0; i<this.matches.length; i++)
-               this.matches[i] = 0;
+            this.resetBuckets(sizeChunk);
 
             final int endChunk = (startChunk+sizeChunk < srcEnd) ? startChunk+sizeChunk : srcEnd;
             final SliceByteArray sba2 = new SliceByteArray(src, endChunk, startChunk);
@@ -734,9 +964,9 @@ public class ROLZCodec implements ByteTransform
             while (srcIdx < endChunk)
             {
                re.setContext(src[srcIdx-1]);
-               final int match = findMatch(sba2, srcIdx);
+               final int match = findMatch(sba2, srcIdx, true);
 
-               if (match < 0)
+               if ((match < 0) || (this.deferMatch(sba2, srcIdx, (match&0xFFFF)+MIN_MATCH) == true))
                {
                   // Emit one literal
                   re.encodeBits((LITERAL_FLAG<<8)|(src[srcIdx]&0xFF), 9);
@@ -786,17 +1016,15 @@ public class ROLZCodec implements ByteTransform
          srcIdx += 4;
          int sizeChunk = (dstEnd < CHUNK_SIZE) ? dstEnd : CHUNK_SIZE;
          int startChunk = output.index;
+         final int dstIdx0 = output.index;
+         int nextProgress = dstIdx0 + PROGRESS_STEP;
          SliceByteArray sba = new SliceByteArray(src, srcIdx);
          ROLZDecoder rd = new ROLZDecoder(9, this.logPosChecks, sba);
 
-         for (int i=0; i<this.counters.length; i++)
-            this.counters[i] = 0;
-
          // Main loop
          while (startChunk < dstEnd)
          {
-            for (int i=0; i<this.matches.length; i++)
-               this.matches[i] = 0;
+            this.resetBuckets(sizeChunk);
 
             final int endChunk = (startChunk+sizeChunk < dstEnd) ? startChunk+sizeChunk : dstEnd;
             int dstIdx = output.index;
@@ -834,7 +1062,8 @@ public class ROLZCodec implements ByteTransform
             {
                final int savedIdx = dstIdx;
                final int key = getKey(dst, dstIdx-2) & 0xFFFF;
-               final int base = key << this.logPosChecks;
+               final int bucket = this.getBucket(key);
+               final int base = bucket << this.logPosChecks;
                rd.setMode(LITERAL_FLAG);
                rd.setContext(dst[dstIdx-1]);
                final int val = rd.decodeBits(9);
@@ -859,13 +1088,25 @@ public class ROLZCodec implements ByteTransform
                   rd.setMode(MATCH_FLAG);
                   rd.setContext(dst[dstIdx-1]);
                   final int matchIdx = rd.decodeBits(this.logPosChecks);
-                  final int ref = output.index + this.matches[base+((this.counters[key]-matchIdx)&this.maskChecks)];
+                  final int ref = output.index + this.matches[base+((this.counters[bucket]-matchIdx)&this.maskChecks)];
                   dstIdx = emitCopy(dst, dstIdx, ref, matchLen);
                }
 
                // Update map
-               this.counters[key]++;
-               this.matches[base+(this.counters[key]&this.maskChecks)] = savedIdx - output.index;
+               this.counters[bucket]++;
+               this.matches[base+(this.counters[bucket]&this.maskChecks)] = savedIdx - output.index;
+
+               // Publish the bytes decoded so far and wake up the reader
+               if ((dstIdx >= nextProgress) && (this.progress != null))
+               {
+                  synchronized (this.progress)
+                  {
+                     this.progress.set(dstIdx-dstIdx0);
+                     this.progress.notifyAll();
+                  }
+
+                  nextProgress = dstIdx + PROGRESS_STEP;
+               }
             }
 
             startChunk = endChunk;
@@ -15,14 +15,23 @@ limitations under the License.
 
 package kanzi.transform;
 
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
 import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Future;
 import kanzi.ByteTransform;
 import kanzi.Global;
+import kanzi.Memory;
 import kanzi.SliceByteArray;
 
 
 // Simple one-pass text codec. Uses a default (small) static dictionary
 // or potentially larger custom one. Generates a dynamic dictionary.
+// A big block is split in segments encoded against a block dictionary
+// instead (concurrently if several jobs are available).
 public final class TextCodec implements ByteTransform
 {
    private static final int THRESHOLD1 = 128;
@@ -39,7 +48,7 @@ public final class TextCodec implements ByteTransform
    public static final byte ESCAPE_TOKEN2 = 0x0E; // toggle upper/lower case of first word char
    private static final int HASH1 = 0x7FEB352D;
    private static final int HASH2 = 0x846CA68B;
-   private static final int MASK_NOT_TEXT = 0x80;
+   public static final int MASK_NOT_TEXT = 0x80;
    private static final int MASK_DNA = MASK_NOT_TEXT | 0x40;
    private static final int MASK_BIN = MASK_NOT_TEXT | 0x20;
    private static final int MASK_BASE64 = MASK_NOT_TEXT | 0x10;
@@ -47,7 +56,12 @@ public final class TextCodec implements ByteTransform
    private static final int MASK_FULL_ASCII = 0x04;
    private static final int MASK_XML_HTML = 0x02;
    private static final int MASK_CRLF = 0x01;
+   private static final int MASK_SEGMENTS = 0x20; // only in emitted mode (text)
    private static final int MASK_LENGTH = 0x0007FFFF; // 19 bits
+   private static final int MIN_SEGMENT_SIZE = 1 << 20;
+   private static final int MAX_SEGMENTS = 32;
+   private static final int MAX_EOL_SEARCH = 4096;
+   private static final int MIN_BLOCK_WORD_LENGTH = 4;
 
    private static final boolean[] DELIMITER_CHARS = initDelimiterChars();
 
@@ -478,8 +492,268 @@ public final class TextCodec implements ByteTransform
 
 
 
+   // Number of segments of a block (1 means no segmentation). It depends on
+   // the block length only: the output is the same whatever the number of jobs.
+   private static int getNbSegments(int count)
+   {
+      return Math.max(Math.min(MAX_SEGMENTS, count/MIN_SEGMENT_SIZE), 1);
+   }
+
+
+   // Two-phase encoding of a block split in segments.
+   // Phase 1: the words of the segments are counted concurrently and the most
+   // frequent ones make up a block dictionary emitted once.
+   // Phase 2: the segments are encoded concurrently against this fixed dictionary.
+   // Layout after the mode byte: number of segments (1 byte), size and encoded
+   // size of each segment (2x4 bytes), number of words (4 bytes), words (length
+   // byte + chars), encoded segments.
+   // Return the new destination index or -1 on failure.
+   private static int forwardSegments(SegmentCodec codec, byte[] src, int srcIdx, int srcEnd,
+      byte[] dst, int dstIdx, int dstEnd, int nbSegments, int jobs, ExecutorService pool)
+   {
+      final int count = srcEnd - srcIdx;
+      final int[] starts = new int[nbSegments+1];
+      starts[0] = srcIdx;
+      starts[nbSegments] = srcEnd;
+
+      // Cut segments after an end of line when possible
+      for (int i=1; i<nbSegments; i++)
+      {
+         final int pos = srcIdx + (int) (((long) count*i) / nbSegments);
+         final int end = Math.min(pos+MAX_EOL_SEARCH, srcEnd);
+         int n = pos;
+
+         while ((n < end) && (src[n] != LF))
+            n++;
+
+         if (n < end)
+         {
+            starts[i] = n + 1;
+            continue;
+         }
+
+         // No end of line nearby: cut after a delimiter to avoid splitting a word.
+         // There is no LF in [pos, end), so a cut in this range never separates
+         // CR and LF (see CRLF mode).
+         n = pos;
+
+         while ((n < end-1) && ((isDelimiter(src[n]) == false) || (src[n] == CR)))
+            n++;
+
+         starts[i] = (n < end-1) ? n+1 : pos;
+      }
+
+      // Phase 1: count words in each segment
+      List<Callable<Integer>> tasks = new ArrayList<>(nbSegments);
+      final WordCounter[] counters = new WordCounter[nbSegments];
+
+      for (int i=0; i<nbSegments; i++)
+      {
+         final int logSize = Math.max(Math.min(Global.log2(Math.max((starts[i+1]-starts[i])>>3, 1))+1, 22), 12);
+         counters[i] = new WordCounter(src, starts[i], starts[i+1], logSize);
+         tasks.add(counters[i]);
+      }
+
+      if (runTasks(tasks, jobs, pool) == false)
+         return -1;
+
+      // Merge the counts and keep the words seen at least twice, most frequent first
+      int total = 0;
+
+      for (WordCounter wc : counters)
+         total += wc.size;
+
+      final WordCounter merged = new WordCounter(src, srcIdx, srcIdx,
+         Math.max(Math.min(Global.log2(Math.max(total, 1))+2, 24), 12));
+
+      for (WordCounter wc : counters)
+         wc.mergeInto(merged);
+
+      final long[] candidates = new long[merged.size];
+      int nbCandidates = 0;
+
+      for (int i=0; i<merged.counts.length; i++)
+      {
+         if (merged.counts[i] >= 2)
+            candidates[nbCandidates++] = ((long) merged.counts[i] << 32) | i;
+      }
+
+      Arrays.sort(candidates, 0, nbCandidates);
+      final int hdrIdx = dstIdx;
+      dstIdx += 1 + 8*nbSegments;
+      final int wordsIdx = dstIdx;
+      dstIdx += 4;
+
+      if (dstIdx >= dstEnd)
+         return -1;
+
+      final int firstWord = codec.firstWordIndex();
+      int nbWords = 0;
+
+      for (int i=nbCandidates-1; (i>=0) && (firstWord+nbWords<MAX_DICT_SIZE); i--)
+      {
+         final int slot = (int) candidates[i];
+         final int pos = merged.positions[slot];
+         final int length = merged.lengths[slot];
+
+         if (dstIdx+length+1 >= dstEnd)
+            break;
+
+         if (codec.addWord(src, pos, length, merged.hashes[slot], firstWord+nbWords) == false)
+            continue;
+
+         dst[dstIdx++] = (byte) length;
+         System.arraycopy(src, pos, dst, dstIdx, length);
+         dstIdx += length;
+         nbWords++;
+      }
+
+      Memory.BigEndian.writeInt32(dst, wordsIdx, nbWords);
+
+      // Phase 2: encode the segments (the dictionary is now read only)
+      tasks.clear();
+      final SegmentTask[] segments = new SegmentTask[nbSegments];
+
+      for (int i=0; i<nbSegments; i++)
+      {
+         // A segment may expand as long as the whole block fits (checked below)
+         final int length = starts[i+1] - starts[i];
+         final int maxLength = Math.min(codec.getMaxEncodedLength(length) + (length>>2), dstEnd-dstIdx);
+         segments[i] = new SegmentTask(codec, src, starts[i], starts[i+1],
+            new byte[maxLength], 0, maxLength, true);
+         tasks.add(segments[i]);
+      }
+
+      if (runTasks(tasks, jobs, pool) == false)
+         return -1;
+
+      dst[hdrIdx] = (byte) nbSegments;
+
+      for (int i=0; i<nbSegments; i++)
+      {
+         final int length = segments[i].result;
+
+         if (dstIdx+length >= dstEnd)
+            return -1;
+
+         Memory.BigEndian.writeInt32(dst, hdrIdx+1+8*i, starts[i+1]-starts[i]);
+         Memory.BigEndian.writeInt32(dst, hdrIdx+5+8*i, length);
+         System.arraycopy(segments[i].output, 0, dst, dstIdx, length);
+         dstIdx += length;
+      }
+
+      return dstIdx;
+   }
+
+
+   // Decode a block split in segments (see forwardSegments).
+   // Return the new destination index or -1 on failure.
+   private static int inverseSegments(SegmentCodec codec, byte[] src, int srcIdx, int srcEnd,
+      byte[] dst, int dstIdx, int jobs, ExecutorService pool)
+   {
+      if (srcIdx >= srcEnd)
+         return -1;
+
+      final int nbSegments = src[srcIdx++] & 0xFF;
+
+      if ((nbSegments == 0) || (8*nbSegments+4 > srcEnd-srcIdx))
+         return -1;
+
+      final int hdrIdx = srcIdx;
+      srcIdx += 8*nbSegments;
+      final int nbWords = Memory.BigEndian.readInt32(src, srcIdx);
+      srcIdx += 4;
+      final int firstWord = codec.firstWordIndex();
+
+      if ((nbWords < 0) || (nbWords > MAX_DICT_SIZE-firstWord))
+         return -1;
+
+      // Load the block dictionary (words point to the input buffer)
+      for (int i=0; i<nbWords; i++)
+      {
+         if (srcIdx >= srcEnd)
+            return -1;
+
+         final int length = src[srcIdx++] & 0xFF;
+
+         if ((length == 0) || (length > MAX_WORD_LENGTH) || (length > srcEnd-srcIdx))
+            return -1;
+
+         if (codec.setWord(src, srcIdx, length, firstWord+i) == false)
+            return -1;
+
+         srcIdx += length;
+      }
+
+      List<Callable<Integer>> tasks = new ArrayList<>(nbSegments);
+      final SegmentTask[] segments = new SegmentTask[nbSegments];
+      final int[] ends = new int[nbSegments];
+
+      for (int i=0; i<nbSegments; i++)
+      {
+         final int dstLength = Memory.BigEndian.readInt32(src, hdrIdx+8*i);
+         final int srcLength = Memory.BigEndian.readInt32(src, hdrIdx+8*i+4);
+
+         if ((dstLength < 0) || (srcLength < 0) || (srcLength > srcEnd-srcIdx) || (dstLength > dst.length-dstIdx))
+            return -1;
+
+         // One byte of slack for the decoder bound checks
+         ends[i] = dstIdx + dstLength;
+         segments[i] = new SegmentTask(codec, src, srcIdx, srcIdx+srcLength,
+            dst, dstIdx, ends[i]+1, false);
+         tasks.add(segments[i]);
+         srcIdx += srcLength;
+         dstIdx += dstLength;
+      }
+
+      if ((srcIdx != srcEnd) || (runTasks(tasks, jobs, pool) == false))
+         return -1;
+
+      for (int i=0; i<nbSegments; i++)
+      {
+         if (segments[i].result != ends[i])
+            return -1;
+      }
+
+      return dstIdx;
+   }
+
+
+   // Run the tasks concurrently if several jobs are available
+   private static boolean runTasks(List<Callable<Integer>> tasks, int jobs, ExecutorService pool)
+   {
+      try
+      {
+         if ((jobs == 1) || (pool == null))
+         {
+            for (Callable<Integer> task : tasks)
+            {
+               if (task.call() < 0)
+                  return false;
+            }
+         }
+         else
+         {
+            // Wait for completion of all concurrent tasks
+            for (Future<Integer> result : pool.invokeAll(tasks))
+            {
+               if (result.get() < 0)
+                  return false;
+            }
+         }
+      }
+      catch (Exception e)
+      {
+         return false;
+      }
+
+      return true;
+   }
+
+
+
    // Encode word indexes using a token
-   static class TextCodec1 implements ByteTransform
+   static class TextCodec1 implements ByteTransform, SegmentCodec
    {
       private DictEntry[] dictMap;
       private DictEntry[] dictList;
@@ -489,6 +763,8 @@ public final class TextCodec implements ByteTransform
       private boolean isCRLF; // EOL = CR+LF ?
       private int dictSize;
       private Map<String, Object> ctx;
+      private final int jobs;
+      private final ExecutorService pool;
 
 
       public TextCodec1()
@@ -499,6 +775,8 @@ public final class TextCodec implements ByteTransform
          this.dictList = new DictEntry[0];
          this.hashMask = (1<<this.logHashSize) - 1;
          this.staticDictSize = STATIC_DICT_WORDS + 2;
+         this.jobs = 1;
+         this.pool = null;
       }
 
 
@@ -524,6 +802,11 @@ public final class TextCodec implements ByteTransform
          this.hashMask = (1<<this.logHashSize) - 1;
          this.staticDictSize = STATIC_DICT_WORDS + 2;
          this.ctx = ctx;
+
+         // Jobs available to process the segments of a block concurrently
+         final int tasks = (Integer) ctx.getOrDefault("jobs", 1);
+         this.pool = (ExecutorService) ctx.get("pool");
+         this.jobs = (this.pool == null) ? 1 : Math.max(tasks, 1);
       }
 
 
@@ -624,14 +907,43 @@ public final class TextCodec implements ByteTransform
 
          this.reset(count);
          final int dstEnd = output.index + this.getMaxEncodedLength(count);
-         final int dstEnd4 = dstEnd - 4;
-         int emitAnchor = input.index; // never less than input.index
-         int words = this.staticDictSize;
 
          // DOS encoded end of line (CR+LF) ?
          this.isCRLF = (mode & MASK_CRLF) != 0;
-         dst[dstIdx++] = (byte) mode;
-         boolean res = true;
+         final int nbSegments = getNbSegments(count);
+
+         if (nbSegments > 1)
+         {
+            // Encode segments against a block dictionary (concurrently if jobs allow)
+            dst[dstIdx++] = (byte) (mode|MASK_SEGMENTS);
+            dstIdx = forwardSegments(this, src, srcIdx, srcEnd, dst, dstIdx, dstEnd,
+               nbSegments, this.jobs, this.pool);
+         }
+         else
+         {
+            dst[dstIdx++] = (byte) mode;
+            dstIdx = this.encode(src, srcIdx, srcEnd, dst, dstIdx, dstEnd, true);
+         }
+
+         if (dstIdx < 0)
+            return false;
+
+         output.index = dstIdx;
+         input.index = srcEnd;
+         return true;
+      }
+
+
+      // Encode src[srcIdx..srcEnd[ and return the new destination index (or -1
+      // if the output is too small). The dictionary is read only when learn is
+      // false, so that segments can be encoded concurrently.
+      @Override
+      public int encode(byte[] src, int srcIdx, final int srcEnd, byte[] dst, int dstIdx,
+         final int dstEnd, boolean learn)
+      {
+         final int dstEnd4 = dstEnd - 4;
+         int emitAnchor = srcIdx; // never less than initial srcIdx
+         int words = this.staticDictSize;
 
          while ((srcIdx < srcEnd) && (src[srcIdx] == ' '))
          {
@@ -640,7 +952,7 @@ public final class TextCodec implements ByteTransform
             emitAnchor++;
          }
 
-         int delimAnchor = isText(src[srcIdx]) ? srcIdx-1 : srcIdx; // previous delimiter
+         int delimAnchor = ((srcIdx < srcEnd) && isText(src[srcIdx])) ? srcIdx-1 : srcIdx; // previous delimiter
 
          while (srcIdx < srcEnd)
          {
@@ -698,7 +1010,7 @@ public final class TextCodec implements ByteTransform
                   {
                      // Word not found in the dictionary or hash collision.
                      // Replace entry if not in static dictionary
-                     if (((length > 3) || ((length == 3) && (words < THRESHOLD2))) && (e1 == null))
+                     if ((learn == true) && ((length > 3) || ((length == 3) && (words < THRESHOLD2))) && (e1 == null))
                      {
                         e = this.dictList[words];
 
@@ -732,19 +1044,13 @@ public final class TextCodec implements ByteTransform
                         final int dIdx = this.emitSymbols(src, emitAnchor, dst, dstIdx, delimAnchor+1, dstEnd);
 
                         if (dIdx < 0)
-                        {
-                           res = false;
-                           break;
-                        }
+                           return -1;
 
                         dstIdx = dIdx;
                      }
 
                      if (dstIdx >= dstEnd4)
-                     {
-                        res = false;
-                        break;
-                     }
+                        return -1;
 
                      dst[dstIdx++] = (e == e1) ? ESCAPE_TOKEN1 : ESCAPE_TOKEN2;
                      dstIdx = emitWordIndex(dst, dstIdx, e.data&MASK_LENGTH);
@@ -758,22 +1064,8 @@ public final class TextCodec implements ByteTransform
             srcIdx++;
          }
 
-         if (res == true)
-         {
-            // Emit last symbols
-            final int dIdx = this.emitSymbols(src, emitAnchor, dst, dstIdx, srcEnd, dstEnd);
-
-            if (dIdx < 0)
-               res = false;
-            else
-               dstIdx = dIdx;
-
-            res &= (srcIdx == srcEnd);
-         }
-
-         output.index = dstIdx;
-         input.index = srcIdx;
-         return res;
+         // Emit last symbols
+         return this.emitSymbols(src, emitAnchor, dst, dstIdx, srcEnd, dstEnd);
       }
 
 
@@ -793,6 +1085,47 @@ public final class TextCodec implements ByteTransform
          return true;
       }
 
+      @Override
+      public int firstWordIndex()
+      {
+         return this.staticDictSize;
+      }
+
+
+      @Override
+      public boolean addWord(byte[] buf, int pos, int length, int hash, int idx)
+      {
+         // Skip words colliding with existing entries (EG. static dictionary)
+         if (this.dictMap[hash&this.hashMask] != null)
+            return false;
+
+         if (this.setWord(buf, pos, length, idx) == false)
+            return false;
+
+         final DictEntry e = this.dictList[idx];
+         e.hash = hash;
+         this.dictMap[hash&this.hashMask] = e;
+         return true;
+      }
+
+
+      @Override
+      public boolean setWord(byte[] buf, int pos, int length, int idx)
+      {
+         while (idx >= this.dictSize)
+         {
+            if (this.expandDictionary() == false)
+               return false;
+         }
+
+         final DictEntry e = this.dictList[idx];
+         e.buf = buf;
+         e.pos = pos;
+         e.data = (length<<24) | idx;
+         return true;
+      }
+
+
 
       private int emitSymbols(byte[] src, final int srcIdx, byte[] dst, int dstIdx, final int srcEnd, final int dstEnd)
       {
@@ -867,13 +1200,39 @@ public final class TextCodec implements ByteTransform
 
          this.reset(output.length);
          final int srcEnd = input.index + count;
-         final int dstEnd = dst.length - 1;
+         final int mode = src[srcIdx++];
+         this.isCRLF = (mode & MASK_CRLF) != 0;
+
+         if ((mode & MASK_SEGMENTS) != 0)
+         {
+            // Decode segments concurrently against a block dictionary
+            dstIdx = inverseSegments(this, src, srcIdx, srcEnd, dst, dstIdx, this.jobs, this.pool);
+         }
+         else
+         {
+            dstIdx = this.decode(src, srcIdx, srcEnd, dst, dstIdx, dst.length-1, true);
+         }
+
+         if (dstIdx < 0)
+            return false;
+
+         output.index = dstIdx;
+         input.index = srcEnd;
+         return true;
+      }
 
-         int delimAnchor = isText(src[srcIdx]) ? srcIdx-1 : srcIdx; // previous delimiter
+
+      // Decode src[srcIdx..srcEnd[ and return the new destination index (or -1
+      // if the input is invalid). The dictionary is read only when learn is
+      // false, so that segments can be decoded concurrently.
+      @Override
+      public int decode(byte[] src, int srcIdx, final int srcEnd, byte[] dst, int dstIdx,
+         final int dstEnd, boolean learn)
+      {
+         int delimAnchor = srcIdx - 1; // previous delimiter (mode byte)
          int words = this.staticDictSize;
          boolean wordRun = false;
-         final boolean _isCRLF = (src[srcIdx++] & MASK_CRLF) != 0;
-         this.isCRLF = _isCRLF;
+         final boolean _isCRLF = this.isCRLF;
 
          while ((srcIdx < srcEnd) && (dstIdx < dstEnd))
          {
@@ -887,7 +1246,7 @@ public final class TextCodec implements ByteTransform
                continue;
             }
 
-            if ((srcIdx > delimAnchor+3) && isDelimiter(cur))
+            if ((learn == true) && (srcIdx > delimAnchor+3) && isDelimiter(cur))
             {
                final int length = srcIdx - delimAnchor - 1; // length > 2
 
@@ -1017,9 +1376,7 @@ public final class TextCodec implements ByteTransform
             }
          }
 
-         output.index = dstIdx;
-         input.index = srcIdx;
-         return srcIdx == srcEnd;
+         return (srcIdx == srcEnd) ? dstIdx : -1;
       }
 
 
@@ -1034,7 +1391,7 @@ public final class TextCodec implements ByteTransform
 
 
    // Encode word indexes using a mask (0x80)
-   static class TextCodec2 implements ByteTransform
+   static class TextCodec2 implements ByteTransform, SegmentCodec
    {
       private DictEntry[] dictMap;
       private DictEntry[] dictList;
@@ -1044,6 +1401,8 @@ public final class TextCodec implements ByteTransform
       private boolean isCRLF; // EOL = CR+LF ?
       private int dictSize;
       private Map<String, Object> ctx;
+      private final int jobs;
+      private final ExecutorService pool;
 
 
       public TextCodec2()
@@ -1054,6 +1413,8 @@ public final class TextCodec implements ByteTransform
          this.dictList = new DictEntry[0];
          this.hashMask = (1<<this.logHashSize) - 1;
          this.staticDictSize = STATIC_DICT_WORDS;
+         this.jobs = 1;
+         this.pool = null;
       }
 
 
@@ -1079,6 +1440,11 @@ public final class TextCodec implements ByteTransform
          this.hashMask = (1<<this.logHashSize) - 1;
          this.staticDictSize = STATIC_DICT_WORDS;
          this.ctx = ctx;
+
+         // Jobs available to process the segments of a block concurrently
+         final int tasks = (Integer) ctx.getOrDefault("jobs", 1);
+         this.pool = (ExecutorService) ctx.get("pool");
+         this.jobs = (this.pool == null) ? 1 : Math.max(tasks, 1);
       }
 
 
@@ -1176,14 +1542,43 @@ public final class TextCodec implements ByteTransform
 
          this.reset(count);
          final int dstEnd = output.index + this.getMaxEncodedLength(count);
-         final int dstEnd3 = dstEnd - 3;
-         int emitAnchor = input.index; // never less than input.index
-         int words = this.staticDictSize;
 
          // DOS encoded end of line (CR+LF) ?
          this.isCRLF = (mode & MASK_CRLF) != 0;
-         dst[dstIdx++] = (byte) mode;
-         boolean res = true;
+         final int nbSegments = getNbSegments(count);
+
+         if (nbSegments > 1)
+         {
+            // Encode segments against a block dictionary (concurrently if jobs allow)
+            dst[dstIdx++] = (byte) (mode|MASK_SEGMENTS);
+            dstIdx = forwardSegments(this, src, srcIdx, srcEnd, dst, dstIdx, dstEnd,
+               nbSegments, this.jobs, this.pool);
+         }
+         else
+         {
+            dst[dstIdx++] = (byte) mode;
+            dstIdx = this.encode(src, srcIdx, srcEnd, dst, dstIdx, dstEnd, true);
+         }
+
+         if (dstIdx < 0)
+            return false;
+
+         output.index = dstIdx;
+         input.index = srcEnd;
+         return true;
+      }
+
+
+      // Encode src[srcIdx..srcEnd[ and return the new destination index (or -1
+      // if the output is too small). The dictionary is read only when learn is
+      // false, so that segments can be encoded concurrently.
+      @Override
+      public int encode(byte[] src, int srcIdx, final int srcEnd, byte[] dst, int dstIdx,
+         final int dstEnd, boolean learn)
+      {
+         final int dstEnd3 = dstEnd - 3;
+         int emitAnchor = srcIdx; // never less than initial srcIdx
+         int words = this.staticDictSize;
 
          while ((srcIdx < srcEnd) && (src[srcIdx] == ' '))
          {
@@ -1192,7 +1587,7 @@ public final class TextCodec implements ByteTransform
             emitAnchor++;
          }
 
-         int delimAnchor = isText(src[srcIdx]) ? srcIdx-1 : srcIdx; // previous delimiter
+         int delimAnchor = ((srcIdx < srcEnd) && isText(src[srcIdx])) ? srcIdx-1 : srcIdx; // previous delimiter
 
          while (srcIdx < srcEnd)
          {
@@ -1250,7 +1645,7 @@ public final class TextCodec implements ByteTransform
                   {
                      // Word not found in the dictionary or hash collision.
                      // Replace entry if not in static dictionary
-                     if (((length > 3) || ((length == 3) && (words < THRESHOLD2))) && (e1 == null))
+                     if ((learn == true) && ((length > 3) || ((length == 3) && (words < THRESHOLD2))) && (e1 == null))
                      {
                         e = this.dictList[words];
 
@@ -1284,19 +1679,13 @@ public final class TextCodec implements ByteTransform
                         final int dIdx = this.emitSymbols(src, emitAnchor, dst, dstIdx, delimAnchor+1, dstEnd);
 
                         if (dIdx < 0)
-                        {
-                           res = false;
-                           break;
-                        }
+                           return -1;
 
                         dstIdx = dIdx;
                      }
 
                      if (dstIdx >= dstEnd3)
-                     {
-                        res = false;
-                        break;
-                     }
+                        return -1;
 
                      dstIdx = emitWordIndex(dst, dstIdx, e.data&MASK_LENGTH, ((e == e1) ? 0 : 32));
                      emitAnchor = delimAnchor + 1 + (e.data>>>24);
@@ -1310,20 +1699,7 @@ public final class TextCodec implements ByteTransform
          }
 
          // Emit last symbols
-         if (res == true)
-         {
-            final int dIdx = this.emitSymbols(src, emitAnchor, dst, dstIdx, srcEnd, dstEnd);
-
-            if (dIdx < 0)
-               res = false;
-            else
-               dstIdx = dIdx;
-         }
-
-         output.index = dstIdx;
-         input.index = srcIdx;
-         res &= (srcIdx == srcEnd);
-         return res;
+         return this.emitSymbols(src, emitAnchor, dst, dstIdx, srcEnd, dstEnd);
       }
 
 
@@ -1343,6 +1719,47 @@ public final class TextCodec implements ByteTransform
          return true;
       }
 
+      @Override
+      public int firstWordIndex()
+      {
+         return this.staticDictSize;
+      }
+
+
+      @Override
+      public boolean addWord(byte[] buf, int pos, int length, int hash, int idx)
+      {
+         // Skip words colliding with existing entries (EG. static dictionary)
+         if (this.dictMap[hash&this.hashMask] != null)
+            return false;
+
+         if (this.setWord(buf, pos, length, idx) == false)
+            return false;
+
+         final DictEntry e = this.dictList[idx];
+         e.hash = hash;
+         this.dictMap[hash&this.hashMask] = e;
+         return true;
+      }
+
+
+      @Override
+      public boolean setWord(byte[] buf, int pos, int length, int idx)
+      {
+         while (idx >= this.dictSize)
+         {
+            if (this.expandDictionary() == false)
+               return false;
+         }
+
+         final DictEntry e = this.dictList[idx];
+         e.buf = buf;
+         e.pos = pos;
+         e.data = (length<<24) | idx;
+         return true;
+      }
+
+
 
       private int emitSymbols(byte[] src, final int srcIdx, byte[] dst, int dstIdx, final int srcEnd, final int dstEnd)
       {
@@ -1460,12 +1877,39 @@ public final class TextCodec implements ByteTransform
 
          this.reset(output.length);
          final int srcEnd = input.index + count;
-         final int dstEnd = dst.length - 1;
-         int delimAnchor = isText(src[srcIdx]) ? srcIdx-1 : srcIdx; // previous delimiter
+         final int mode = src[srcIdx++];
+         this.isCRLF = (mode & MASK_CRLF) != 0;
+
+         if ((mode & MASK_SEGMENTS) != 0)
+         {
+            // Decode segments concurrently against a block dictionary
+            dstIdx = inverseSegments(this, src, srcIdx, srcEnd, dst, dstIdx, this.jobs, this.pool);
+         }
+         else
+         {
+            dstIdx = this.decode(src, srcIdx, srcEnd, dst, dstIdx, dst.length-1, true);
+         }
+
+         if (dstIdx < 0)
+            return false;
+
+         output.index = dstIdx;
+         input.index = srcEnd;
+         return true;
+      }
+
+
+      // Decode src[srcIdx..srcEnd[ and return the new destination index (or -1
+      // if the input is invalid). The dictionary is read only when learn is
+      // false, so that segments can be decoded concurrently.
+      @Override
+      public int decode(byte[] src, int srcIdx, final int srcEnd, byte[] dst, int dstIdx,
+         final int dstEnd, boolean learn)
+      {
+         int delimAnchor = srcIdx - 1; // previous delimiter (mode byte)
          int words = this.staticDictSize;
          boolean wordRun = false;
-         final boolean _isCRLF = (src[srcIdx++] & MASK_CRLF) != 0;
-         this.isCRLF = _isCRLF;
+         final boolean _isCRLF = this.isCRLF;
 
          while ((srcIdx < srcEnd) && (dstIdx < dstEnd))
          {
@@ -1479,7 +1923,7 @@ public final class TextCodec implements ByteTransform
                continue;
             }
 
-            if ((srcIdx > delimAnchor+3) && isDelimiter(cur))
+            if ((learn == true) && (srcIdx > delimAnchor+3) && isDelimiter(cur))
             {
                final int length = srcIdx - delimAnchor - 1; // length > 2
 
@@ -1608,9 +2052,7 @@ public final class TextCodec implements ByteTransform
             }
          }
 
-         output.index = dstIdx;
-         input.index = srcIdx;
-         return srcIdx == srcEnd;
+         return (srcIdx == srcEnd) ? dstIdx : -1;
       }
 
 
@@ -1624,6 +2066,177 @@ public final class TextCodec implements ByteTransform
    }
 
 
+   // Text codec able to process the segments of a block concurrently
+   // against a fixed block dictionary
+   interface SegmentCodec
+   {
+      // Index of the first block dictionary word
+      public int firstWordIndex();
+
+      // Max size of an encoded segment
+      public int getMaxEncodedLength(int srcLength);
+
+      // Encoder: add a word to the dictionary, return false if not added
+      public boolean addWord(byte[] buf, int pos, int length, int hash, int idx);
+
+      // Decoder: set the word at the provided index of the dictionary
+      public boolean setWord(byte[] buf, int pos, int length, int idx);
+
+      // Return the new destination index or -1 on failure
+      public int encode(byte[] src, int srcIdx, int srcEnd, byte[] dst, int dstIdx,
+         int dstEnd, boolean learn);
+
+      // Return the new destination index or -1 on failure
+      public int decode(byte[] src, int srcIdx, int srcEnd, byte[] dst, int dstIdx,
+         int dstEnd, boolean learn);
+   }
+
+
+   // Count the words of a segment: hash, first position, length and frequency
+   // in an open addressing table
+   static class WordCounter implements Callable<Integer>
+   {
+      private final byte[] buf;
+      private final int start;
+      private final int end;
+      private final int mask;
+      final int[] hashes;
+      final int[] positions;
+      final int[] counts; // 0 means empty slot
+      final byte[] lengths;
+      int size;
+
+
+      WordCounter(byte[] buf, int start, int end, int logSize)
+      {
+         this.buf = buf;
+         this.start = start;
+         this.end = end;
+         this.mask = (1<<logSize) - 1;
+         this.hashes = new int[1<<logSize];
+         this.positions = new int[1<<logSize];
+         this.counts = new int[1<<logSize];
+         this.lengths = new byte[1<<logSize];
+      }
+
+
+      private void add(int hash, int pos, int length, int count)
+      {
+         int slot = hash & this.mask;
+
+         while (this.counts[slot] != 0)
+         {
+            if ((this.hashes[slot] == hash) && (this.lengths[slot] == length))
+            {
+               this.counts[slot] += count;
+               return;
+            }
+
+            slot = (slot+1) & this.mask;
+         }
+
+         // Keep the table at most 3/4 full, ignore new words beyond
+         if (this.size >= ((this.mask+1)>>2)*3)
+            return;
+
+         this.hashes[slot] = hash;
+         this.positions[slot] = pos;
+         this.lengths[slot] = (byte) length;
+         this.counts[slot] = count;
+         this.size++;
+      }
+
+
+      void mergeInto(WordCounter wc)
+      {
+         for (int i=0; i<this.counts.length; i++)
+         {
+            if (this.counts[i] != 0)
+               wc.add(this.hashes[i], this.positions[i], this.lengths[i], this.counts[i]);
+         }
+      }
+
+
+      @Override
+      public Integer call() throws Exception
+      {
+         final byte[] src = this.buf;
+         int i = this.start;
+
+         while (i < this.end)
+         {
+            if (isText(src[i]) == false)
+            {
+               i++;
+               continue;
+            }
+
+            // Same hash as the encoder for words followed by a delimiter
+            final int anchor = i;
+            int h = HASH1;
+
+            while ((i < this.end) && (isText(src[i]) == true))
+            {
+               h = h*HASH1 ^ src[i]*HASH2;
+               i++;
+            }
+
+            final int length = i - anchor;
+
+            if ((length >= MIN_BLOCK_WORD_LENGTH) && (length <= MAX_WORD_LENGTH) &&
+               (i < this.end) && (isDelimiter(src[i]) == true))
+               this.add(h, anchor, length, 1);
+         }
+
+         return this.size;
+      }
+   }
+
+
+   // Encode or decode one segment against the block dictionary
+   static class SegmentTask implements Callable<Integer>
+   {
+      private final SegmentCodec codec;
+      private final byte[] input;
+      private final int srcIdx;
+      private final int srcEnd;
+      final byte[] output;
+      private final int dstIdx;
+      private final int dstEnd;
+      private final boolean forward;
+      int result;
+
+
+      SegmentTask(SegmentCodec codec, byte[] input, int srcIdx, int srcEnd,
+         byte[] output, int dstIdx, int dstEnd, boolean forward)
+      {
+         this.codec = codec;
+         this.input = input;
+         this.srcIdx = srcIdx;
+         this.srcEnd = srcEnd;
+         this.output = output;
+         this.dstIdx = dstIdx;
+         this.dstEnd = dstEnd;
+         this.forward = forward;
+         this.result = -1;
+      }
+
+
+      @Override
+      public Integer call() throws Exception
+      {
+         if (this.forward == true)
+            this.result = this.codec.encode(this.input, this.srcIdx, this.srcEnd,
+               this.output, this.dstIdx, this.dstEnd, false);
+         else
+            this.result = this.codec.decode(this.input, this.srcIdx, this.srcEnd,
+               this.output, this.dstIdx, this.dstEnd, false);
+
+         return this.result;
+      }
+   }
+
+
    public static class DictEntry
    {
       int hash; // full word hash
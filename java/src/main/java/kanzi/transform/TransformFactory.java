@@ -17,6 +17,7 @@ package kanzi.transform;
 
 import java.util.Map;
 import kanzi.ByteTransform;
+import kanzi.Global;
 
 
 public class TransformFactory
@@ -157,10 +158,17 @@ public class TransformFactory
       ByteTransform[] transforms = new ByteTransform[nbtr];
       nbtr = 0;
 
+      // Only the last transform can record the histograms of its output
+      // (the input of the entropy coder)
+      final Object histograms = ctx.remove("histograms");
+
       for (int i=0; i<transforms.length; i++)
       {
          final int t = (int) ((functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK);
 
+         if ((histograms != null) && (nbtr == transforms.length-1))
+            ctx.put("histograms", histograms);
+
          if ((t != NONE_TYPE) || (i == 0))
             transforms[nbtr++] = newFunctionToken(ctx, t);
       }
@@ -242,6 +250,97 @@ public class TransformFactory
    }
 
 
+   // Return the type of the last transform applied to a block (skip flag not
+   // set) or NONE_TYPE if all the transforms have been skipped
+   public int getLastApplied(long functionType, byte skipFlags)
+   {
+      int res = NONE_TYPE;
+      int n = 0;
+
+      for (int i=0; i<8; i++)
+      {
+         final int t = (int) ((functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK);
+
+         // Same rule as in newFunction
+         if ((t == NONE_TYPE) && (i != 0))
+            continue;
+
+         if ((skipFlags & (1<<(7-n))) == 0)
+            res = t;
+
+         n++;
+      }
+
+      return res;
+   }
+
+
+   // Return the type of data of a block deduced from the transforms applied
+   // (skip flag not set): the EXE, FSD and TEXT transforms only apply to
+   // executable code, multimedia data and text respectively. A skipped TEXT
+   // transform means that the block is not text. The decoder gets the same
+   // result from the skip flags, so the type is not stored in the bitstream.
+   public Global.DataType getDataType(long functionType, byte skipFlags)
+   {
+      Global.DataType res = Global.DataType.UNDEFINED;
+      int n = 0;
+
+      for (int i=0; i<8; i++)
+      {
+         final int t = (int) ((functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK);
+
+         // Same rule as in newFunction
+         if ((t == NONE_TYPE) && (i != 0))
+            continue;
+
+         final boolean applied = (skipFlags & (1<<(7-n))) == 0;
+         n++;
+
+         if (t == X86_TYPE)
+         {
+            if (applied == true)
+               return Global.DataType.X86;
+         }
+         else if (t == FSD_TYPE)
+         {
+            if (applied == true)
+               return Global.DataType.MULTIMEDIA;
+         }
+         else if (t == DICT_TYPE)
+         {
+            if (res == Global.DataType.UNDEFINED)
+               res = (applied == true) ? Global.DataType.TEXT : Global.DataType.BIN;
+         }
+      }
+
+      return res;
+   }
+
+
+   // Return the number of transforms applied to a block (skip flag not set)
+   public int getNbApplied(long functionType, byte skipFlags)
+   {
+      int res = 0;
+      int n = 0;
+
+      for (int i=0; i<8; i++)
+      {
+         final int t = (int) ((functionType >>> (MAX_SHIFT-ONE_SHIFT*i)) & MASK);
+
+         // Same rule as in newFunction
+         if ((t == NONE_TYPE) && (i != 0))
+            continue;
+
+         if ((skipFlags & (1<<(7-n))) == 0)
+            res++;
+
+         n++;
+      }
+
+      return res;
+   }
+
+
    public String getName(long functionType)
    {
       StringBuilder sb = new StringBuilder();
@@ -18,6 +18,7 @@ package kanzi.transform;
 import java.util.Map;
 import kanzi.ByteTransform;
 import kanzi.Global;
+import kanzi.Histograms;
 import kanzi.SliceByteArray;
 
 // Zero Run Length Encoding is a simple encoding algorithm by Wheeler
@@ -28,19 +29,28 @@ import kanzi.SliceByteArray;
 
 public final class ZRLT implements ByteTransform
 {
+   private final Histograms histograms; // output histograms (optional)
+
+
    public ZRLT()
    {
+      this.histograms = null;
    }
 
 
+   // If present in the context, the histograms of the output are recorded
    public ZRLT(Map<String, Object> ctx)
    {
+      this.histograms = (Histograms) ctx.get("histograms");
    }
 
 
    @Override
    public boolean forward(SliceByteArray input, SliceByteArray output)
    {
+      if (this.histograms != null)
+         this.histograms.reset();
+
       if (input.length == 0)
          return true;
 
@@ -52,6 +62,9 @@ public final class ZRLT implements ByteTransform
       if (output.length - output.index < getMaxEncodedLength(count))
          return false;
 
+      if (this.histograms != null)
+         return this.forward(input, output, this.histograms);
+
       final byte[] src = input.array;
       final byte[] dst = output.array;
       int srcIdx = input.index;
@@ -121,6 +134,119 @@ public final class ZRLT implements ByteTransform
    }
 
 
+   // Same as forward but record the histograms of the output, slot by slot,
+   // while it is written.
+   private boolean forward(SliceByteArray input, SliceByteArray output, Histograms histos)
+   {
+      final int count = input.length;
+      final byte[] src = input.array;
+      final byte[] dst = output.array;
+      int srcIdx = input.index;
+      int dstIdx = output.index;
+      final int srcEnd = srcIdx + count;
+      final int dstEnd = output.length;
+      int runLength = 0;
+      int[] h = histos.nextSlot();
+      int slotEnd = output.index + Histograms.SLOT_SIZE;
+
+      if (dstIdx < dstEnd)
+      {
+         while (srcIdx < srcEnd)
+         {
+            if (dstIdx >= slotEnd)
+            {
+               // The last run may overlap the end of the slot: move the extra
+               // bytes to the next slot
+               final int[] h2 = histos.nextSlot();
+
+               for (int i=slotEnd; i<dstIdx; i++)
+               {
+                  h[dst[i]&0xFF]--;
+                  h2[dst[i]&0xFF]++;
+               }
+
+               h = h2;
+               slotEnd += Histograms.SLOT_SIZE;
+            }
+
+            if (src[srcIdx] == 0)
+            {
+               runLength = 1;
+
+               while ((srcIdx+runLength < srcEnd) && (src[srcIdx+runLength] == src[srcIdx]))
+                  runLength++;
+
+               srcIdx += runLength;
+
+               // Encode length
+               runLength++;
+               int log2 = (runLength<=256) ? Global.LOG2[runLength-1] : 31-Integer.numberOfLeadingZeros(runLength);
+
+               if (dstIdx >= dstEnd-log2)
+                  break;
+
+               // Write every bit as a byte except the most significant one
+               while (log2 > 0)
+               {
+                  log2--;
+                  final int bit = (runLength >> log2) & 1;
+                  dst[dstIdx++] = (byte) bit;
+                  h[bit]++;
+               }
+
+               runLength = 0;
+               continue;
+            }
+
+            final int val = src[srcIdx] & 0xFF;
+
+            if (val >= 0xFE)
+            {
+               if (dstIdx >= dstEnd - 1)
+                  break;
+
+               dst[dstIdx] = (byte) 0xFF;
+               dst[dstIdx+1] = (byte) (val-0xFE);
+               h[0xFF]++;
+               h[val-0xFE]++;
+               dstIdx += 2;
+            }
+            else
+            {
+               if (dstIdx >= dstEnd)
+                  break;
+
+               dst[dstIdx] = (byte) (val+1);
+               h[val+1]++;
+               dstIdx++;
+            }
+
+            srcIdx++;
+         }
+      }
+
+      if (dstIdx > slotEnd)
+      {
+         final int[] h2 = histos.nextSlot();
+
+         for (int i=slotEnd; i<dstIdx; i++)
+         {
+            h[dst[i]&0xFF]--;
+            h2[dst[i]&0xFF]++;
+         }
+      }
+
+      final boolean res = (srcIdx == srcEnd) && (runLength == 0);
+
+      if (res == true)
+         histos.setLength(dstIdx-output.index);
+
+      input.index = srcIdx;
+      output.index = dstIdx;
+      return res;
+   }
+
+
    @Override
    public boolean inverse(SliceByteArray input, SliceByteArray output)
    {
@@ -0,0 +1,93 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.transform;
+
+import kanzi.IntTransform;
+import kanzi.SliceIntArray;
+
+
+// ZigZag coding maps signed ints to unsigned ints so that values of small
+// magnitude (positive or negative) get small codes: 0,-1,1,-2,2 => 0,1,2,3,4.
+// Typically applied after a delta transform.
+public class ZigZagCodec implements IntTransform
+{
+   public ZigZagCodec()
+   {
+   }
+
+
+   @Override
+   public boolean forward(SliceIntArray input, SliceIntArray output)
+   {
+      if (input.length == 0)
+         return true;
+
+      final int count = input.length;
+
+      if (output.length - output.index < count)
+         return false;
+
+      final int[] src = input.array;
+      final int[] dst = output.array;
+      final int srcIdx = input.index;
+      final int dstIdx = output.index;
+
+      for (int i=0; i<count; i++)
+      {
+         final int val = src[srcIdx+i];
+         dst[dstIdx+i] = (val<<1) ^ (val>>31);
+      }
+
+      input.index += count;
+      output.index += count;
+      return true;
+   }
+
+
+   @Override
+   public boolean inverse(SliceIntArray input, SliceIntArray output)
+   {
+      if (input.length == 0)
+         return true;
+
+      final int count = input.length;
+
+      if (output.length - output.index < count)
+         return false;
+
+      final int[] src = input.array;
+      final int[] dst = output.array;
+      final int srcIdx = input.index;
+      final int dstIdx = output.index;
+
+      for (int i=0; i<count; i++)
+      {
+         final int val = src[srcIdx+i];
+         dst[dstIdx+i] = (val>>>1) ^ -(val&1);
+      }
+
+      input.index += count;
+      output.index += count;
+      return true;
+   }
+
+
+   @Override
+   public int getMaxEncodedLength(int srcLength)
+   {
+      return srcLength;
+   }
+}
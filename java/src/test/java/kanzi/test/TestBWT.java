@@ -92,6 +92,14 @@ public class TestBWT
          {
             buf1 = "SIX.MIXED.PIXIES.SIFT.SIXTY.PIXIE.DUST.BOXES".getBytes();
          }
+         else if (ii == 4)
+         {
+            // Long runs and periodic sections (many Lyndon factors)
+            buf1 = new byte[4096];
+
+            for (int i=0; i<buf1.length; i++)
+               buf1[i] = (byte) (((i % 1000) < 500) ? 'a' : 65 + (i % 3));
+         }
          else if (ii < iters)
          {
             buf1 = new byte[128];
@@ -0,0 +1,167 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.nio.channels.FileChannel;
+import java.nio.file.Files;
+import java.nio.file.StandardOpenOption;
+import java.util.Map;
+import java.util.Random;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import kanzi.io.Checkpoint;
+import kanzi.io.CompressedOutputStream;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestCheckpoint
+{
+   public static void main(String[] args) throws Exception
+   {
+      TestCheckpoint test = new TestCheckpoint();
+      test.testResume();
+      test.testOptionsMismatch();
+   }
+
+
+   @Test
+   public void testResume() throws Exception
+   {
+      // Interrupt a job after a few checkpoints, resume it and compare the
+      // output with the one of an uninterrupted job
+      System.out.println("\n\nTestResume");
+      final byte[] input = TestCompressedStream.generate(new Random(12345), (1<<20) + 333);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+      File output = File.createTempFile("kanzi", ".knz");
+      final String cpName = Checkpoint.getFileName(output.getPath());
+
+      try
+      {
+         for (int jobs : new int[] { 1, 4 })
+         {
+            for (boolean chunkTable : new boolean[] { false, true })
+            {
+               byte[] expected = TestCompressedStream.compress(input,
+                  newContext(input.length, jobs, pool, chunkTable, null, false));
+
+               // First run, stopped without closing the compressed stream
+               Checkpoint cp = new Checkpoint(cpName, 0);
+
+               try (FileOutputStream fos = new FileOutputStream(output))
+               {
+                  cp.setOutput(fos.getChannel());
+                  CompressedOutputStream cos = new CompressedOutputStream(fos,
+                     newContext(input.length, jobs, pool, chunkTable, cp, false));
+                  cos.write(input, 0, 5*input.length/8);
+               }
+
+               // Second run, from the saved checkpoint
+               Checkpoint cp2 = Checkpoint.load(cpName, 0);
+               Assert.assertNotNull(cp2);
+               Assert.assertTrue(cp2.getInputOffset() > 0);
+               Assert.assertTrue(cp2.getInputOffset() <= 5*input.length/8);
+               Assert.assertTrue(cp2.matches(input.length, 32768, "TEXT+LZX", "HUFFMAN",
+                  true, false, chunkTable));
+               System.out.println("Jobs "+jobs+", chunk table "+chunkTable+": resume from block "+
+                  (cp2.getBlockId()+1)+" (input offset "+cp2.getInputOffset()+", output offset "+
+                  cp2.getOutputOffset()+")");
+
+               try (FileChannel fc = FileChannel.open(output.toPath(), StandardOpenOption.WRITE))
+               {
+                  fc.truncate(cp2.getOutputOffset());
+               }
+
+               try (FileOutputStream fos = new FileOutputStream(output, true))
+               {
+                  cp2.setOutput(fos.getChannel());
+                  CompressedOutputStream cos = new CompressedOutputStream(fos,
+                     newContext(input.length, jobs, pool, chunkTable, cp2, true));
+                  final int offset = (int) cp2.getInputOffset();
+                  cos.write(input, offset, input.length-offset);
+                  cos.close();
+               }
+
+               byte[] resumed = Files.readAllBytes(output.toPath());
+               Assert.assertArrayEquals(expected, resumed);
+               Assert.assertArrayEquals(input, TestCompressedStream.decompress(resumed, jobs, pool));
+               new File(cpName).delete();
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+         output.delete();
+         new File(cpName).delete();
+      }
+   }
+
+
+   @Test
+   public void testOptionsMismatch() throws Exception
+   {
+      // Every option changing the bitstream must be recorded in the checkpoint
+      System.out.println("\n\nTestOptionsMismatch");
+      File tmp = File.createTempFile("kanzi", ".ckpt");
+
+      try
+      {
+         Checkpoint cp = new Checkpoint(tmp.getPath(), 0);
+         cp.setParameters(100000, 65536, "TEXT+LZX", "HUFFMAN", true, true, true, 2);
+         cp.update(65536, 1, 12345, 0x5, 3);
+         cp.save();
+
+         Checkpoint cp2 = Checkpoint.load(tmp.getPath(), 0);
+         Assert.assertEquals(2, cp2.getFormatVersion());
+         Assert.assertEquals(65536, cp2.getInputOffset());
+         Assert.assertEquals(12345, cp2.getOutputOffset());
+         Assert.assertEquals(0x5, cp2.getPendingBits());
+         Assert.assertEquals(3, cp2.getPendingCount());
+         Assert.assertTrue(cp2.matches(100000, 65536, "TEXT+LZX", "HUFFMAN", true, true, true));
+         Assert.assertFalse(cp2.matches(100001, 65536, "TEXT+LZX", "HUFFMAN", true, true, true));
+         Assert.assertFalse(cp2.matches(100000, 32768, "TEXT+LZX", "HUFFMAN", true, true, true));
+         Assert.assertFalse(cp2.matches(100000, 65536, "LZX", "HUFFMAN", true, true, true));
+         Assert.assertFalse(cp2.matches(100000, 65536, "TEXT+LZX", "ANS0", true, true, true));
+         Assert.assertFalse(cp2.matches(100000, 65536, "TEXT+LZX", "HUFFMAN", false, true, true));
+         Assert.assertFalse(cp2.matches(100000, 65536, "TEXT+LZX", "HUFFMAN", true, false, true));
+         Assert.assertFalse(cp2.matches(100000, 65536, "TEXT+LZX", "HUFFMAN", true, true, false));
+      }
+      finally
+      {
+         tmp.delete();
+      }
+   }
+
+
+   private static Map<String, Object> newContext(long fileSize, int jobs, ExecutorService pool,
+      boolean chunkTable, Checkpoint cp, boolean resume)
+   {
+      Map<String, Object> ctx = TestCompressedStream.newContext("TEXT+LZX", "HUFFMAN", 32768, jobs, pool);
+      ctx.put("fileSize", fileSize);
+      ctx.put("chunkTable", chunkTable);
+
+      if (cp != null)
+      {
+         ctx.put("checkpoint", cp);
+         ctx.put("resume", resume);
+      }
+
+      return ctx;
+   }
+}
@@ -0,0 +1,289 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.nio.file.Files;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.Map;
+import java.util.Random;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import kanzi.bitstream.DefaultInputBitStream;
+import kanzi.io.BlockCache;
+import kanzi.io.CompressedFileReader;
+import kanzi.io.CompressedOutputStream;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestCompressedFileReader
+{
+   private static final int BLOCK_SIZE = 65536;
+
+
+   public static void main(String[] args) throws Exception
+   {
+      TestCompressedFileReader test = new TestCompressedFileReader();
+      test.testRandomReads();
+      test.testConcurrentReads();
+      test.testSubmittedBlocks();
+   }
+
+
+   @Test
+   public void testRandomReads() throws Exception
+   {
+      // Reads at random positions must return the bytes of a sequential decode.
+      // Fixed block sizes (number of blocks in the header) and variable block
+      // sizes (blocks split on content), with a cache smaller than the data.
+      System.out.println("\n\nTestRandomReads");
+      final byte[] input = generateMixed(new Random(12345), (1<<20) + 777);
+      ExecutorService pool = Executors.newFixedThreadPool(2);
+
+      try
+      {
+         for (boolean split : new boolean[] { false, true })
+         {
+            Map<String, Object> ctx = TestCompressedStream.newContext("TEXT+LZX", "HUFFMAN", BLOCK_SIZE, 1, null);
+
+            if (split == true)
+               ctx.put("splitBlocks", true);
+            else
+               ctx.put("fileSize", (long) input.length);
+
+            File file = writeCompressed(input, ctx);
+            final byte[] expected = TestCompressedStream.decompress(Files.readAllBytes(file.toPath()), 1, null);
+            Assert.assertArrayEquals(input, expected);
+            BlockCache cache = new BlockCache(4*BLOCK_SIZE);
+
+            try (CompressedFileReader reader = new CompressedFileReader(file.getPath(), cache, pool))
+            {
+               System.out.println((split ? "Split blocks: " : "Fixed blocks: ")+reader.getNbBlocks()+" blocks");
+
+               if (split == false)
+                  Assert.assertEquals((input.length+BLOCK_SIZE-1)/BLOCK_SIZE, reader.getNbBlocks());
+
+               Random rnd = new Random(6789);
+               byte[] buf = new byte[3*BLOCK_SIZE];
+
+               for (int i=0; i<200; i++)
+               {
+                  final long pos = (i%10 == 0) ? input.length-1-rnd.nextInt(1000) : rnd.nextInt(input.length);
+                  final int len = 1 + rnd.nextInt((i%3 == 0) ? buf.length : 1000);
+                  final int off = rnd.nextInt(16);
+                  final int r = reader.read(pos, buf, off, Math.min(len, buf.length-off));
+                  final int n = (int) Math.min(Math.min(len, buf.length-off), input.length-pos);
+                  Assert.assertEquals(n, r);
+                  Assert.assertArrayEquals(Arrays.copyOfRange(expected, (int) pos, (int) pos+n),
+                     Arrays.copyOfRange(buf, off, off+n));
+                  Assert.assertTrue(cache.size() <= cache.capacity());
+               }
+
+               // Sequential reads (with prefetching) over the whole data
+               byte[] output = new byte[input.length];
+               int read = 0;
+
+               while (read < output.length)
+               {
+                  final int r = reader.read(read, output, read, Math.min(10000, output.length-read));
+                  Assert.assertTrue(r > 0);
+                  read += r;
+               }
+
+               Assert.assertArrayEquals(expected, output);
+               Assert.assertEquals(-1, reader.read(input.length, buf, 0, 10));
+               Assert.assertEquals(-1, reader.read(input.length+12345, buf, 0, 10));
+               Assert.assertEquals(0, reader.read(0, buf, 0, 0));
+            }
+            finally
+            {
+               file.delete();
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testConcurrentReads() throws Exception
+   {
+      // Several readers of the same file share the cache
+      System.out.println("\n\nTestConcurrentReads");
+      final byte[] input = generateMixed(new Random(12345), (1<<20) + 777);
+      Map<String, Object> ctx = TestCompressedStream.newContext("LZ", "ANS0", BLOCK_SIZE, 1, null);
+      ctx.put("fileSize", (long) input.length);
+      final File file = writeCompressed(input, ctx);
+      final BlockCache cache = new BlockCache(BlockCache.DEFAULT_CAPACITY);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         List<Future<Boolean>> results = new ArrayList<>();
+
+         for (int t=0; t<4; t++)
+         {
+            final long seed = 1000 + t;
+
+            results.add(pool.submit(new Callable<Boolean>()
+            {
+               @Override
+               public Boolean call() throws Exception
+               {
+                  Random rnd = new Random(seed);
+                  byte[] buf = new byte[100000];
+
+                  try (CompressedFileReader reader = new CompressedFileReader(file.getPath(), cache, null))
+                  {
+                     for (int i=0; i<100; i++)
+                     {
+                        final int pos = rnd.nextInt(input.length);
+                        final int len = 1 + rnd.nextInt(buf.length);
+                        final int r = reader.read(pos, buf, 0, len);
+                        final int n = Math.min(len, input.length-pos);
+
+                        if ((r != n) || (Arrays.equals(Arrays.copyOfRange(input, pos, pos+n),
+                           Arrays.copyOf(buf, n)) == false))
+                           return false;
+                     }
+                  }
+
+                  return true;
+               }
+            }));
+         }
+
+         for (Future<Boolean> res : results)
+            Assert.assertTrue(res.get());
+
+         // Each block was decoded at most once per concurrent reader
+         final int nbBlocks = (input.length+BLOCK_SIZE-1) / BLOCK_SIZE;
+         System.out.println("Cache hits: "+cache.hits()+", misses: "+cache.misses());
+         Assert.assertTrue(cache.misses() <= 4*nbBlocks);
+         Assert.assertTrue(cache.size() <= (long) nbBlocks*BLOCK_SIZE);
+      }
+      finally
+      {
+         pool.shutdown();
+         file.delete();
+      }
+   }
+
+
+   @Test
+   public void testSubmittedBlocks() throws Exception
+   {
+      // Submitted blocks have any size up to the block size: the header has
+      // no number of blocks even if the file size is known
+      System.out.println("\n\nTestSubmittedBlocks");
+      final byte[] input = generateMixed(new Random(12345), (1<<20) + 777);
+      ExecutorService pool = Executors.newFixedThreadPool(2);
+      File file = File.createTempFile("kanzi", ".knz");
+
+      try
+      {
+         Map<String, Object> ctx = TestCompressedStream.newContext("LZX", "HUFFMAN", BLOCK_SIZE, 2, pool);
+         ctx.put("fileSize", (long) input.length);
+         ByteArrayOutputStream baos = new ByteArrayOutputStream();
+         CompressedOutputStream cos = new CompressedOutputStream(baos, ctx);
+         Random rnd = new Random(6789);
+         List<Future<Integer>> results = new ArrayList<>();
+
+         for (int off=0; off<input.length; )
+         {
+            final int len = Math.min(1+rnd.nextInt(BLOCK_SIZE), input.length-off);
+            results.add(cos.submitBlock(cos.newTicket(), input, off, len));
+            off += len;
+         }
+
+         for (Future<Integer> res : results)
+            Assert.assertTrue(res.get() > 0);
+
+         cos.close();
+         Files.write(file.toPath(), baos.toByteArray());
+
+         // Type (32 bits), version, checksum, entropy, transform and block size
+         // (86 bits) then number of blocks (6 bits)
+         DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(baos.toByteArray()), 1024);
+         ibs.readBits(32);
+         ibs.readBits(86);
+         Assert.assertEquals(0, ibs.readBits(6));
+         BlockCache cache = new BlockCache(4*BLOCK_SIZE);
+
+         try (CompressedFileReader reader = new CompressedFileReader(file.getPath(), cache, null))
+         {
+            System.out.println(results.size()+" submitted blocks, "+reader.getNbBlocks()+" blocks");
+            Assert.assertEquals(results.size(), reader.getNbBlocks());
+            byte[] buf = new byte[3*BLOCK_SIZE];
+
+            for (int i=0; i<100; i++)
+            {
+               final int pos = rnd.nextInt(input.length);
+               final int len = 1 + rnd.nextInt(buf.length);
+               final int r = reader.read(pos, buf, 0, len);
+               final int n = Math.min(len, input.length-pos);
+               Assert.assertEquals(n, r);
+               Assert.assertArrayEquals(Arrays.copyOfRange(input, pos, pos+n), Arrays.copyOf(buf, n));
+            }
+
+            // The blocks of the file are released with the reader key
+            Assert.assertTrue(cache.size() > 0);
+            cache.invalidate(reader.getFileKey());
+            Assert.assertEquals(0, cache.size());
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+         file.delete();
+      }
+   }
+
+
+   private static File writeCompressed(byte[] input, Map<String, Object> ctx) throws Exception
+   {
+      File file = File.createTempFile("kanzi", ".knz");
+      Files.write(file.toPath(), TestCompressedStream.compress(input, ctx));
+      return file;
+   }
+
+
+   // Text and binary regions (so that split blocks have different sizes)
+   private static byte[] generateMixed(Random rnd, int length)
+   {
+      final byte[] data = TestCompressedStream.generate(rnd, length);
+
+      for (int n=rnd.nextInt(100000); n<length; n+=100000+rnd.nextInt(200000))
+      {
+         final int len = Math.min(20000+rnd.nextInt(40000), length-n);
+
+         for (int i=0; i<len; i++)
+            data[n+i] = (byte) rnd.nextInt(256);
+      }
+
+      return data;
+   }
+}
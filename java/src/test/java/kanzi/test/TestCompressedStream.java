@@ -0,0 +1,742 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.Random;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.TimeoutException;
+import kanzi.EntropyEncoder;
+import kanzi.Error;
+import kanzi.Global;
+import kanzi.EntropyDecoder;
+import kanzi.SliceByteArray;
+import kanzi.bitstream.DefaultInputBitStream;
+import kanzi.bitstream.DefaultOutputBitStream;
+import kanzi.entropy.ChunkedEntropyEncoder;
+import kanzi.entropy.EntropyCodecFactory;
+import kanzi.io.CompressedInputStream;
+import kanzi.io.CompressedOutputStream;
+import kanzi.transform.Sequence;
+import kanzi.transform.TransformFactory;
+import kanzi.util.hash.XXHash32;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestCompressedStream
+{
+   private static final int BITSTREAM_TYPE = 0x4B414E5A; // "KANZ"
+
+
+   public static void main(String[] args) throws Exception
+   {
+      TestCompressedStream test = new TestCompressedStream();
+      test.testSubmitBlocks();
+      test.testDuplicateTicket();
+      test.testSubmitError();
+      test.testLZLevels();
+      test.testROLZLazyMatch();
+      test.testVersion1Stream();
+      test.testVersion1TPAQ();
+      test.testStreaming();
+      test.testChunkTable();
+      test.testStaged();
+   }
+
+
+   @Test
+   public void testSubmitBlocks() throws Exception
+   {
+      // Blocks submitted out of order by several producers are emitted in ticket order
+      System.out.println("\n\nTestSubmitBlocks");
+      final int blockSize = 65536;
+      final byte[] input = generate(new Random(12345), 40*blockSize + 1000);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+      ExecutorService producers = Executors.newFixedThreadPool(3);
+
+      try
+      {
+         ByteArrayOutputStream baos = new ByteArrayOutputStream();
+         final CompressedOutputStream cos = new CompressedOutputStream(baos,
+            newContext("LZ", "HUFFMAN", blockSize, 4, pool));
+         final List<Integer> tickets = new ArrayList<>();
+
+         for (int i=0; i<input.length; i+=blockSize)
+            tickets.add(cos.newTicket());
+
+         Collections.shuffle(tickets, new Random(6789));
+         List<Future<Future<Integer>>> results = new ArrayList<>();
+
+         for (final int ticket : tickets)
+         {
+            results.add(producers.submit(new Callable<Future<Integer>>()
+            {
+               @Override
+               public Future<Integer> call() throws Exception
+               {
+                  final int off = (ticket-1) * blockSize;
+                  return cos.submitBlock(ticket, input, off, Math.min(blockSize, input.length-off));
+               }
+            }));
+         }
+
+         for (Future<Future<Integer>> res : results)
+            Assert.assertTrue(res.get().get() > 0);
+
+         cos.close();
+         System.out.println(input.length+" => "+baos.size()+" bytes");
+         Assert.assertArrayEquals(input, decompress(baos.toByteArray(), 4, pool));
+      }
+      finally
+      {
+         producers.shutdown();
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testDuplicateTicket() throws Exception
+   {
+      System.out.println("\n\nTestDuplicateTicket");
+      final byte[] input = generate(new Random(12345), 3*4096);
+      ExecutorService pool = Executors.newFixedThreadPool(2);
+
+      try
+      {
+         ByteArrayOutputStream baos = new ByteArrayOutputStream();
+         CompressedOutputStream cos = new CompressedOutputStream(baos,
+            newContext("LZ", "HUFFMAN", 4096, 2, pool));
+         final int ticket1 = cos.newTicket();
+         final int ticket2 = cos.newTicket();
+         cos.submitBlock(ticket2, input, 4096, 4096);
+
+         try
+         {
+            cos.submitBlock(ticket2, input, 8192, 4096);
+            Assert.fail("A reused ticket must be rejected");
+         }
+         catch (IllegalArgumentException e)
+         {
+            System.out.println("Expected: "+e.getMessage());
+         }
+
+         cos.submitBlock(ticket1, input, 0, 4096);
+         cos.close();
+         Assert.assertArrayEquals(Arrays.copyOf(input, 8192), decompress(baos.toByteArray(), 2, pool));
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testSubmitError() throws Exception
+   {
+      // A write failure in a submitted block is reported by its future and by close
+      System.out.println("\n\nTestSubmitError");
+      final int blockSize = 262144;
+      final byte[] input = new byte[8*blockSize];
+      new Random(12345).nextBytes(input);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         OutputStream failing = new OutputStream()
+         {
+            @Override
+            public void write(int b) throws IOException
+            {
+               throw new IOException("Disk full");
+            }
+         };
+
+         CompressedOutputStream cos = new CompressedOutputStream(failing,
+            newContext("NONE", "NONE", blockSize, 4, pool));
+         List<Future<Integer>> results = new ArrayList<>();
+         final int nbBlocks = input.length / blockSize;
+
+         for (int i=0; i<nbBlocks; i++)
+            cos.newTicket();
+
+         for (int i=nbBlocks; i>0; i--)
+            results.add(cos.submitBlock(i, input, (i-1)*blockSize, blockSize));
+
+         int failed = 0;
+
+         for (Future<Integer> res : results)
+         {
+            try
+            {
+               res.get();
+            }
+            catch (ExecutionException e)
+            {
+               failed++;
+            }
+         }
+
+         Assert.assertTrue("The encoding failure was not reported", failed > 0);
+
+         try
+         {
+            cos.close();
+            Assert.fail("Closing the stream must report the encoding failure");
+         }
+         catch (IOException e)
+         {
+            System.out.println("Expected: "+e.getMessage());
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testLZLevels() throws Exception
+   {
+      // Levels 1 and 2: LZ blocks coded by literal, token and match sections
+      System.out.println("\n\nTestLZLevels");
+      final String[][] configs = {
+         { "TEXT+LZ", "HUFFMAN" }, { "TEXT+FSD+LZX", "HUFFMAN" },
+         { "LZ", "ANS0" }, { "LZX", "ANS1" }
+      };
+      final byte[] input = generate(new Random(12345), (3<<20) + 777);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         for (String[] config : configs)
+         {
+            for (int blockSize : new int[] { 4096, 1<<20 })
+            {
+               for (int jobs : new int[] { 1, 4 })
+               {
+                  byte[] output = compress(input, newContext(config[0], config[1], blockSize, jobs, pool));
+                  System.out.println(config[0]+"&"+config[1]+", block size "+blockSize+", jobs "+jobs+
+                     ": "+input.length+" => "+output.length+" bytes");
+                  Assert.assertArrayEquals(input, decompress(output, jobs, pool));
+               }
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testROLZLazyMatch() throws Exception
+   {
+      // Blocks encoded with lazy match evaluation, decoded by a regular stream
+      System.out.println("\n\nTestROLZLazyMatch");
+      final byte[] input = generate(new Random(12345), (3<<20) + 777);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         for (String transform : new String[] { "ROLZ", "ROLZX", "TEXT+ROLZ" })
+         {
+            for (int jobs : new int[] { 1, 4 })
+            {
+               Map<String, Object> ctx = newContext(transform, "NONE", 1<<20, jobs, pool);
+               ctx.put("lazyMatch", true);
+               byte[] output = compress(input, ctx);
+               System.out.println(transform+", jobs "+jobs+": "+input.length+" => "+output.length+" bytes");
+               Assert.assertArrayEquals(input, decompress(output, jobs, pool));
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testVersion1Stream() throws Exception
+   {
+      // Streams written before version 2 have no LZ section sizes
+      System.out.println("\n\nTestVersion1Stream");
+      final String[][] configs = {
+         { "TEXT+LZ", "HUFFMAN" }, { "TEXT+FSD+LZX", "HUFFMAN" },
+         { "LZ", "ANS0" }, { "LZP", "HUFFMAN" }
+      };
+      final byte[] input = generate(new Random(12345), (1<<20) + 777);
+
+      for (String[] config : configs)
+      {
+         for (int blockSize : new int[] { 4096, 65536 })
+         {
+            byte[] output = compressV1(input, config[0], config[1], blockSize);
+            System.out.println(config[0]+"&"+config[1]+", block size "+blockSize+": "+
+               input.length+" => "+output.length+" bytes");
+            Assert.assertArrayEquals(input, decompress(output, 1, null));
+         }
+      }
+   }
+
+
+   @Test
+   public void testVersion1TPAQ() throws Exception
+   {
+      // Version 1 blocks were entropy coded without a type of data: TPAQ
+      // must select its contexts adaptively (as for an undefined type) even
+      // if the transforms imply a type of data
+      System.out.println("\n\nTestVersion1TPAQ");
+      final String[][] configs = {
+         { "TEXT", "TPAQ" }, { "TEXT", "TPAQX" }, { "X86", "TPAQ" }, { "FSD", "TPAQX" }
+      };
+      final byte[] input = generate(new Random(12345), (1<<18) + 777);
+
+      for (String[] config : configs)
+      {
+         byte[] output = compressV1(input, config[0], config[1], 65536);
+         System.out.println(config[0]+"&"+config[1]+": "+input.length+" => "+output.length+" bytes");
+         Assert.assertArrayEquals(input, decompress(output, 1, null));
+      }
+   }
+
+
+   @Test
+   public void testStreaming() throws Exception
+   {
+      // Streaming mode: the bytes of LZ blocks are returned while decoding and
+      // the checksum is verified at the end of each block
+      System.out.println("\n\nTestStreaming");
+      final String[][] configs = {
+         { "LZX", "NONE" }, { "LZX", "HUFFMAN" }, { "ROLZ", "NONE" }, { "ROLZX", "NONE" },
+         { "TEXT+LZX", "HUFFMAN" }
+      };
+      final byte[] input = generate(new Random(12345), (1<<20) + 777);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         for (String[] config : configs)
+         {
+            Map<String, Object> ctx = newContext(config[0], config[1], 65536, 1, pool);
+            byte[] output = compress(input, ctx);
+            Map<String, Object> ctx2 = newContext("NONE", "NONE", 1024, 2, pool);
+            ctx2.put("streaming", true);
+            System.out.println(config[0]+"&"+config[1]+": "+input.length+" => "+output.length+" bytes");
+            Assert.assertArrayEquals(input, readSmallChunks(output, ctx2, new Random(6789)));
+
+            // Corrupt the checksum of the first block: the block is decoded
+            // but the checksum error must be reported
+            final long pos = findBits(output, new XXHash32(BITSTREAM_TYPE).hash(input, 0, 65536), 32, 128, 512);
+            Assert.assertTrue(pos >= 0);
+            byte[] corrupted = output.clone();
+            corrupted[(int) ((pos+5)>>3)] ^= (byte) (0x80 >> ((pos+5)&7));
+
+            try
+            {
+               readSmallChunks(corrupted, ctx2, new Random(6789));
+               Assert.fail("The corrupted block was not detected");
+            }
+            catch (kanzi.io.IOException e)
+            {
+               System.out.println("Expected: "+e.getMessage());
+               Assert.assertEquals(Error.ERR_CRC_CHECK, e.getErrorCode());
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testChunkTable() throws Exception
+   {
+      // Blocks of several chunks preceded by the table of chunk sizes
+      System.out.println("\n\nTestChunkTable");
+      final String[] codecs = { "HUFFMAN", "ANS0", "ANS1", "RANGE", "FPAQ" };
+      final int chunkSize = ChunkedEntropyEncoder.CHUNK_SIZE;
+      final byte[] input = generate(new Random(12345), (3<<20) + 777);
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         // Entropy codecs, around the chunk boundaries
+         for (String codec : codecs)
+         {
+            final int entropyType = EntropyCodecFactory.getType(codec);
+
+            for (int count : new int[] { chunkSize-1, chunkSize, chunkSize+1, 3*chunkSize+777 })
+            {
+               for (int jobs : new int[] { 1, 4 })
+               {
+                  Map<String, Object> ctx = newContext("NONE", codec, 4*chunkSize, jobs, pool);
+                  ctx.put("chunkTable", true);
+                  ByteArrayOutputStream baos = new ByteArrayOutputStream();
+                  DefaultOutputBitStream obs = new DefaultOutputBitStream(baos, 16384);
+                  EntropyEncoder ee = new EntropyCodecFactory().newEncoder(obs, ctx, entropyType);
+                  Assert.assertEquals(count, ee.encode(input, 0, count));
+                  ee.dispose();
+                  obs.close();
+                  final byte[] encoded = baos.toByteArray();
+                  final int nbChunks = (count+chunkSize-1) / chunkSize;
+
+                  if ((nbChunks > 1) && (ChunkedEntropyEncoder.isSupported(entropyType) == true))
+                  {
+                     // The table of chunk sizes covers the whole block
+                     DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(encoded), 16384);
+                     long total = 32L*nbChunks;
+
+                     for (int i=0; i<nbChunks; i++)
+                        total += 8*ibs.readBits(32);
+
+                     ibs.close();
+                     Assert.assertEquals(total, 8L*encoded.length);
+                  }
+
+                  byte[] output = new byte[count];
+                  DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(encoded), 16384);
+                  EntropyDecoder ed = new EntropyCodecFactory().newDecoder(ibs, ctx, entropyType);
+                  Assert.assertEquals(count, ed.decode(output, 0, count));
+                  ed.dispose();
+                  ibs.close();
+                  Assert.assertArrayEquals(Arrays.copyOf(input, count), output);
+               }
+            }
+         }
+
+         // Compressed streams, with blocks of several chunks
+         for (String codec : codecs)
+         {
+            for (String transform : new String[] { "NONE", "TEXT+LZX" })
+            {
+               for (int jobs : new int[] { 1, 4 })
+               {
+                  Map<String, Object> ctx = newContext(transform, codec, 1<<20, jobs, pool);
+                  ctx.put("chunkTable", true);
+                  byte[] output = compress(input, ctx);
+                  System.out.println(transform+"&"+codec+", jobs "+jobs+": "+input.length+" => "+output.length+" bytes");
+                  Assert.assertArrayEquals(input, decompress(output, jobs, pool));
+               }
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testStaged() throws Exception
+   {
+      // Staged execution: the entropy stages of a batch run with the transforms
+      // of the next batch. Both submit nested tasks to the pool (text segments,
+      // chunks). A file size hint of 2 blocks gives 2-block batches with 4 jobs.
+      System.out.println("\n\nTestStaged");
+      final int blockSize = 2<<20;
+      final byte[] input = generate(new Random(12345), 8*blockSize + 777);
+      final long[] sizeHints = { 2L*blockSize, 0, input.length };
+      final ExecutorService pool = Executors.newFixedThreadPool(4);
+      ExecutorService caller = Executors.newSingleThreadExecutor();
+
+      try
+      {
+         for (final String transform : new String[] { "TEXT+LZX", "TEXT+LZ" })
+         {
+            for (final long sizeHint : sizeHints)
+            {
+               final Map<String, Object> ctx = newContext(transform, "HUFFMAN", blockSize, 4, pool);
+               ctx.put("staged", true);
+               ctx.put("chunkTable", true);
+               ctx.put("fileSize", sizeHint);
+               Future<byte[]> res = caller.submit(new Callable<byte[]>()
+               {
+                  @Override
+                  public byte[] call() throws Exception
+                  {
+                     return compress(input, ctx);
+                  }
+               });
+               byte[] output;
+
+               try
+               {
+                  output = res.get(5, TimeUnit.MINUTES);
+               }
+               catch (TimeoutException e)
+               {
+                  Assert.fail("Staged compression did not complete (deadlock)");
+                  return;
+               }
+
+               System.out.println(transform+"&HUFFMAN, size hint "+sizeHint+": "+input.length+
+                  " => "+output.length+" bytes");
+               Assert.assertArrayEquals(input, decompress(output, 4, pool));
+            }
+         }
+      }
+      finally
+      {
+         caller.shutdownNow();
+         pool.shutdownNow();
+      }
+   }
+
+
+   // Decompress with reads of random sizes
+   private static byte[] readSmallChunks(byte[] data, Map<String, Object> ctx, Random rnd)
+      throws IOException
+   {
+      CompressedInputStream cis = new CompressedInputStream(new ByteArrayInputStream(data), ctx);
+      ByteArrayOutputStream baos = new ByteArrayOutputStream();
+      byte[] buf = new byte[8192];
+
+      try
+      {
+         while (true)
+         {
+            final int r = cis.read(buf, 0, 1+rnd.nextInt(buf.length));
+
+            if (r <= 0)
+               break;
+
+            baos.write(buf, 0, r);
+         }
+      }
+      finally
+      {
+         cis.close();
+      }
+
+      return baos.toByteArray();
+   }
+
+
+   // Return the first bit position in [start, end) of the provided value
+   // (written with 'count' bits, most significant bit first) or -1
+   private static long findBits(byte[] data, long value, int count, long start, long end)
+   {
+      final long mask = (1L<<count) - 1;
+      value &= mask;
+
+      for (long pos=start; (pos<end) && (pos+count<=8L*data.length); pos++)
+      {
+         long v = 0;
+
+         for (int i=0; i<count; i++)
+            v = (v<<1) | ((data[(int) ((pos+i)>>3)] >> (7-((pos+i)&7))) & 1);
+
+         if (v == value)
+            return pos;
+      }
+
+      return -1;
+   }
+
+
+   // Write a stream with the layout of version 1: header, then for each block
+   // the mode, the size after transform, the checksum and the entropy coded
+   // data (one section). The LZP table has 2^16 entries.
+   static byte[] compressV1(byte[] input, String transformName, String codecName, int blockSize)
+      throws IOException
+   {
+      ByteArrayOutputStream baos = new ByteArrayOutputStream();
+      DefaultOutputBitStream obs = new DefaultOutputBitStream(baos, 65536);
+      final long transformType = new TransformFactory().getType(transformName);
+      final int entropyType = EntropyCodecFactory.getType(codecName);
+      XXHash32 hasher = new XXHash32(BITSTREAM_TYPE);
+      obs.writeBits(BITSTREAM_TYPE, 32);
+      obs.writeBits(1, 4); // version
+      obs.writeBits(1, 1); // checksum
+      obs.writeBits(entropyType, 5);
+      obs.writeBits(transformType, 48);
+      obs.writeBits(blockSize>>>4, 28);
+      obs.writeBits(0, 6); // number of blocks unknown
+      obs.writeBits(0, 4); // reserved
+
+      for (int n=0; n<input.length; n+=blockSize)
+      {
+         final int length = Math.min(blockSize, input.length-n);
+         Map<String, Object> ctx = new HashMap<>();
+         ctx.put("bsVersion", 1);
+         ctx.put("transform", transformName);
+         ctx.put("codec", codecName);
+         ctx.put("blockSize", blockSize);
+         ctx.put("jobs", 1);
+         ctx.put("size", length);
+         Sequence transform = new TransformFactory().newFunction(ctx, transformType);
+         SliceByteArray src = new SliceByteArray(input, length, n);
+         SliceByteArray buf = new SliceByteArray(new byte[transform.getMaxEncodedLength(length)], 0);
+         transform.forward(src, buf);
+         final int postLength = buf.index;
+         final int dataSize = (postLength < 256) ? 1 : (Global.log2(postLength)>>3) + 1;
+         ctx.put("size", postLength);
+         ByteArrayOutputStream block = new ByteArrayOutputStream();
+         DefaultOutputBitStream os = new DefaultOutputBitStream(block, 16384);
+         os.writeBits((((dataSize-1) & 0x03) << 5) | ((transform.getSkipFlags() & 0xFF) >>> 4), 8);
+         os.writeBits(postLength, 8*dataSize);
+         os.writeBits(hasher.hash(input, n, length), 32);
+         EntropyEncoder ee = new EntropyCodecFactory().newEncoder(os, ctx, entropyType);
+         ee.encode(buf.array, 0, postLength);
+         ee.dispose();
+         os.close();
+         final long written = os.written();
+         final int lw = (written < 8) ? 3 : Global.log2((int) (written >> 3)) + 4;
+         obs.writeBits(lw-3, 5);
+         obs.writeBits(written, lw);
+         obs.writeBits(block.toByteArray(), 0, (int) written);
+      }
+
+      // End of stream marker
+      obs.writeBits(0, 5);
+      obs.writeBits(0, 3);
+      obs.close();
+      return baos.toByteArray();
+   }
+
+
+   static Map<String, Object> newContext(String transform, String codec, int blockSize,
+      int jobs, ExecutorService pool)
+   {
+      Map<String, Object> ctx = new HashMap<>();
+      ctx.put("transform", transform);
+      ctx.put("codec", codec);
+      ctx.put("blockSize", blockSize);
+      ctx.put("jobs", jobs);
+      ctx.put("checksum", true);
+
+      if (pool != null)
+         ctx.put("pool", pool);
+
+      return ctx;
+   }
+
+
+   static byte[] compress(byte[] input, Map<String, Object> ctx) throws IOException
+   {
+      ByteArrayOutputStream baos = new ByteArrayOutputStream();
+      CompressedOutputStream cos = new CompressedOutputStream(baos, ctx);
+      cos.write(input, 0, input.length);
+      cos.close();
+      return baos.toByteArray();
+   }
+
+
+   static byte[] decompress(byte[] data, int jobs, ExecutorService pool) throws IOException
+   {
+      return decompress(data, newContext("NONE", "NONE", 1024, jobs, pool));
+   }
+
+
+   static byte[] decompress(byte[] data, Map<String, Object> ctx) throws IOException
+   {
+      CompressedInputStream cis = new CompressedInputStream(new ByteArrayInputStream(data), ctx);
+      ByteArrayOutputStream baos = new ByteArrayOutputStream();
+      byte[] buf = new byte[65536];
+
+      try
+      {
+         while (true)
+         {
+            final int r = cis.read(buf, 0, buf.length);
+
+            if (r <= 0)
+               break;
+
+            baos.write(buf, 0, r);
+         }
+      }
+      finally
+      {
+         cis.close();
+      }
+
+      return baos.toByteArray();
+   }
+
+
+   // Text like data with repeats, runs and random regions
+   static byte[] generate(Random rnd, int length)
+   {
+      final String[] words = { "the", "quick", "brown", "fox", "jumps", "over", "lazy",
+         "dog", "kanzi", "block", "stream", "entropy", "\n", ", " };
+      final byte[] data = new byte[length];
+      int n = 0;
+
+      while (n < length)
+      {
+         final int kind = rnd.nextInt(16);
+
+         if (kind < 10)
+         {
+            final byte[] w = (words[rnd.nextInt(words.length)] + " ").getBytes();
+            final int len = Math.min(w.length, length-n);
+            System.arraycopy(w, 0, data, n, len);
+            n += len;
+         }
+         else if ((kind < 13) && (n > 1024))
+         {
+            // Repeat older data
+            final int dist = 1 + rnd.nextInt(Math.min(n, 65536));
+            final int len = Math.min(4 + rnd.nextInt(60), length-n);
+
+            for (int i=0; i<len; i++, n++)
+               data[n] = data[n-dist];
+         }
+         else if (kind < 15)
+         {
+            final int len = Math.min(rnd.nextInt(32), length-n);
+            final byte val = (byte) rnd.nextInt(256);
+
+            for (int i=0; i<len; i++)
+               data[n++] = val;
+         }
+         else
+         {
+            final int len = Math.min(rnd.nextInt(64), length-n);
+
+            for (int i=0; i<len; i++)
+               data[n++] = (byte) rnd.nextInt(256);
+         }
+      }
+
+      return data;
+   }
+}
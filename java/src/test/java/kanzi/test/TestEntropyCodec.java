@@ -20,9 +20,12 @@ import kanzi.entropy.BinaryEntropyDecoder;
 import kanzi.entropy.BinaryEntropyEncoder;
 import java.io.ByteArrayInputStream;
 import java.io.ByteArrayOutputStream;
+import java.util.HashMap;
+import java.util.Map;
 import java.util.Random;
 import kanzi.EntropyDecoder;
 import kanzi.EntropyEncoder;
+import kanzi.Global;
 import kanzi.InputBitStream;
 import kanzi.OutputBitStream;
 import kanzi.bitstream.DebugOutputBitStream;
@@ -31,6 +34,7 @@ import kanzi.bitstream.DefaultOutputBitStream;
 import kanzi.entropy.ANSRangeDecoder;
 import kanzi.entropy.ANSRangeEncoder;
 import kanzi.entropy.CMPredictor;
+import kanzi.entropy.CMXPredictor;
 import kanzi.entropy.ExpGolombDecoder;
 import kanzi.entropy.ExpGolombEncoder;
 import kanzi.entropy.HuffmanDecoder;
@@ -101,6 +105,12 @@ public class TestEntropyCodec
                 System.exit(1);
 
               testSpeed("CM", 100);
+              System.out.println("\n\nTest CMX Codec");
+
+              if (testCorrectness("CMX") == false)
+                System.exit(1);
+
+              testSpeed("CMX", 100);
               System.out.println("\n\nTestTPAQCodec");
 
               if (testCorrectness("TPAQ") == false)
@@ -150,6 +160,9 @@ public class TestEntropyCodec
       System.out.println("\n\nTest CM Codec");
       Assert.assertTrue(testCorrectness("CM"));
       //testSpeed("CM");
+      System.out.println("\n\nTest CMX Codec");
+      Assert.assertTrue(testCorrectness("CMX"));
+      //testSpeed("CMX");
       System.out.println("\n\nTest TPAQ Codec");
       Assert.assertTrue(testCorrectness("TPAQ"));
       //testSpeed("TPAQ");
@@ -162,6 +175,160 @@ public class TestEntropyCodec
    }
 
 
+   @Test
+   public void testHuffmanLongCodes()
+   {
+      // Fibonacci frequencies give the deepest Huffman trees: with n symbols
+      // per chunk, the longest codes have n-1 bits before length limiting.
+      System.out.println("\n\nTest Huffman Long Codes");
+
+      // 19 symbols: 18 bit codes, limited by the encoder
+      byte[] input = generateFibonacci(new Random(12345), 19, 6);
+      int chunkSize = input.length / 6;
+
+      for (int maxSymbolSize : new int[] { 8, 12, 14 })
+      {
+         System.out.println("Max code length "+maxSymbolSize);
+         Assert.assertArrayEquals(input, roundTripHuffman(input, chunkSize, maxSymbolSize));
+      }
+
+      // 15 symbols: 14 bit codes, not limited with a max of 14 bits. Previous
+      // versions (max of 14 bits, no limiting below) wrote the same stream.
+      // Codes over 12 bits are decoded with the 14 bit table.
+      input = generateFibonacci(new Random(6789), 15, 20);
+      chunkSize = input.length / 20;
+      System.out.println("Codes of 13-14 bits");
+      Assert.assertArrayEquals(input, roundTripHuffman(input, chunkSize, 14));
+   }
+
+
+   @Test
+   public void testTPAQBlockTypes()
+   {
+      // The contexts of TPAQ depend on the type of data of the block (ctx
+      // 'blockType'). The decoder gets the same type.
+      System.out.println("\n\nTest TPAQ Block Types");
+      final byte[] input = TestCompressedStream.generate(new Random(12345), 100000);
+
+      for (String codec : new String[] { "TPAQ", "TPAQX" })
+      {
+         byte[] undefined = null;
+
+         for (Global.DataType dt : Global.DataType.values())
+         {
+            Map<String, Object> ctx = newTPAQContext(codec, input.length);
+            ctx.put("blockType", dt);
+            byte[] encoded = encodeTPAQ(input, ctx);
+            System.out.println(codec+", "+dt+": "+input.length+" => "+encoded.length);
+            Assert.assertArrayEquals(input, decodeTPAQ(encoded, input.length, ctx));
+
+            if (dt == Global.DataType.UNDEFINED)
+               undefined = encoded;
+         }
+
+         // No type of data (EG. version 1 blocks): adaptive contexts, as for
+         // an undefined type
+         byte[] encoded = encodeTPAQ(input, newTPAQContext(codec, input.length));
+         Assert.assertArrayEquals(undefined, encoded);
+      }
+   }
+
+
+   private static Map<String, Object> newTPAQContext(String codec, int size)
+   {
+      Map<String, Object> ctx = new HashMap<>();
+      ctx.put("codec", codec);
+      ctx.put("blockSize", size);
+      ctx.put("size", size);
+      return ctx;
+   }
+
+
+   private static byte[] encodeTPAQ(byte[] input, Map<String, Object> ctx)
+   {
+      ByteArrayOutputStream os = new ByteArrayOutputStream(input.length);
+      OutputBitStream obs = new DefaultOutputBitStream(os, 16384);
+      EntropyEncoder ec = new BinaryEntropyEncoder(obs, new TPAQPredictor(ctx));
+      Assert.assertEquals(input.length, ec.encode(input, 0, input.length));
+      ec.dispose();
+      obs.close();
+      return os.toByteArray();
+   }
+
+
+   private static byte[] decodeTPAQ(byte[] data, int length, Map<String, Object> ctx)
+   {
+      InputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(data), 16384);
+      EntropyDecoder ed = new BinaryEntropyDecoder(ibs, new TPAQPredictor(ctx));
+      byte[] output = new byte[length];
+      Assert.assertEquals(length, ed.decode(output, 0, output.length));
+      ed.dispose();
+      ibs.close();
+      return output;
+   }
+
+
+   // Chunks where the i-th symbol appears fib(i+1) times (shuffled)
+   private static byte[] generateFibonacci(Random rnd, int nbSymbols, int nbChunks)
+   {
+      final int[] freqs = new int[nbSymbols];
+      int chunkSize = 0;
+
+      for (int i=0, a=1, b=1; i<nbSymbols; i++)
+      {
+         freqs[i] = a;
+         chunkSize += a;
+         final int t = a + b;
+         a = b;
+         b = t;
+      }
+
+      final byte[] data = new byte[nbChunks*chunkSize];
+
+      for (int c=0; c<nbChunks; c++)
+      {
+         final int start = c * chunkSize;
+         int n = start;
+
+         for (int i=0; i<nbSymbols; i++)
+         {
+            for (int j=0; j<freqs[i]; j++)
+               data[n++] = (byte) (32+3*i);
+         }
+
+         for (int i=chunkSize-1; i>0; i--)
+         {
+            final int j = rnd.nextInt(i+1);
+            final byte t = data[start+i];
+            data[start+i] = data[start+j];
+            data[start+j] = t;
+         }
+      }
+
+      return data;
+   }
+
+
+   private static byte[] roundTripHuffman(byte[] input, int chunkSize, int maxSymbolSize)
+   {
+      ByteArrayOutputStream os = new ByteArrayOutputStream(input.length);
+      OutputBitStream obs = new DefaultOutputBitStream(os, 16384);
+      EntropyEncoder ec = new HuffmanEncoder(obs, chunkSize, maxSymbolSize);
+      Assert.assertEquals(input.length, ec.encode(input, 0, input.length));
+      ec.dispose();
+      obs.close();
+      byte[] buf = os.toByteArray();
+      System.out.println("Encoded: "+input.length+" => "+buf.length);
+      InputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(buf), 16384);
+      EntropyDecoder ed = new HuffmanDecoder(ibs, chunkSize);
+      byte[] output = new byte[input.length];
+      Assert.assertEquals(input.length, ed.decode(output, 0, output.length));
+      ed.dispose();
+      ibs.close();
+      return output;
+   }
+
+
    private static Predictor getPredictor(String type)
    {
       if (type.equals("TPAQ"))
@@ -170,6 +337,9 @@ public class TestEntropyCodec
       if (type.equals("CM"))
          return new CMPredictor();
 
+      if (type.equals("CMX"))
+         return new CMXPredictor(null);
+
       return null;
    }
 
@@ -179,6 +349,7 @@ public class TestEntropyCodec
       switch(name)
       {
          case "CM":
+         case "CMX":
          case "TPAQ":
             return new BinaryEntropyEncoder(obs, getPredictor(name));
 
@@ -215,6 +386,7 @@ public class TestEntropyCodec
       switch(name)
       {
          case "CM":
+         case "CMX":
          case "TPAQ":
             Predictor pred = getPredictor(name);
 
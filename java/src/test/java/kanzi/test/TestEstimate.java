@@ -0,0 +1,132 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.nio.ByteBuffer;
+import java.util.Arrays;
+import java.util.Random;
+import kanzi.app.Kanzi;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestEstimate
+{
+   public static void main(String[] args)
+   {
+      TestEstimate test = new TestEstimate();
+      test.testRandomVersusText();
+      test.testBufferPosition();
+      test.testSmallInputs();
+   }
+
+
+   @Test
+   public void testRandomVersusText()
+   {
+      System.out.println("\n\nTestRandomVersusText");
+      final byte[] random = new byte[1<<20];
+      new Random(12345).nextBytes(random);
+      final byte[] text = generateText(new Random(12345), 1<<20);
+
+      for (int level=1; level<=9; level++)
+      {
+         Kanzi.Estimate e1 = Kanzi.estimate(random, level);
+         Kanzi.Estimate e2 = Kanzi.estimate(text, level);
+         System.out.println("Level "+level+": random ("+e1+"), text ("+e2+")");
+         Assert.assertFalse(e1.isCompressible());
+         Assert.assertFalse(e1.text);
+         Assert.assertTrue(e2.isCompressible());
+         Assert.assertTrue(e2.text);
+         Assert.assertTrue(e2.ratio < e1.ratio);
+      }
+   }
+
+
+   @Test
+   public void testBufferPosition()
+   {
+      // Only the remaining bytes are estimated and the position is not modified
+      System.out.println("\n\nTestBufferPosition");
+      final int start = 32768;
+      final byte[] data = new byte[start+(256<<10)];
+      new Random(12345).nextBytes(data);
+      final byte[] text = generateText(new Random(6789), data.length-start);
+      System.arraycopy(text, 0, data, start, text.length);
+      final Kanzi.Estimate ref = Kanzi.estimate(text, 2);
+
+      ByteBuffer heap = ByteBuffer.wrap(data);
+      heap.position(start);
+      ByteBuffer direct = ByteBuffer.allocateDirect(data.length);
+      direct.put(data);
+      direct.position(start);
+
+      for (ByteBuffer bb : new ByteBuffer[] { heap, direct })
+      {
+         Kanzi.Estimate e = Kanzi.estimate(bb, 2);
+         System.out.println((bb.isDirect() ? "Direct" : "Heap")+" buffer: "+e);
+         Assert.assertEquals(start, bb.position());
+         Assert.assertEquals(data.length, bb.limit());
+         Assert.assertEquals(ref.ratio, e.ratio, 0.0);
+         Assert.assertEquals(ref.text, e.text);
+      }
+
+      // The limit bounds the estimated bytes
+      heap.limit(start+100000);
+      Kanzi.Estimate e = Kanzi.estimate(heap, 2);
+      Kanzi.Estimate e2 = Kanzi.estimate(Arrays.copyOfRange(data, start, start+100000), 2);
+      Assert.assertEquals(start, heap.position());
+      Assert.assertEquals(start+100000, heap.limit());
+      Assert.assertEquals(e2.ratio, e.ratio, 0.0);
+   }
+
+
+   @Test
+   public void testSmallInputs()
+   {
+      System.out.println("\n\nTestSmallInputs");
+      final byte[] text = generateText(new Random(12345), 65536);
+      Assert.assertEquals(1.0, Kanzi.estimate(text, 0).ratio, 0.0);
+      Assert.assertEquals(1.0, Kanzi.estimate(Arrays.copyOf(text, 32), 9).ratio, 0.0);
+      Assert.assertEquals(1.0, Kanzi.estimate(new byte[0], 1).ratio, 0.0);
+
+      try
+      {
+         Kanzi.estimate(text, 10);
+         Assert.fail("Invalid level accepted");
+      }
+      catch (IllegalArgumentException e)
+      {
+         System.out.println("Expected: "+e.getMessage());
+      }
+   }
+
+
+   private static byte[] generateText(Random rnd, int length)
+   {
+      final String[] words = { "the", "quick", "brown", "fox", "jumps", "over", "lazy",
+         "dog", "and", "compression", "of", "text", "is", "a", "simple", "matter" };
+      StringBuilder sb = new StringBuilder(length+16);
+
+      while (sb.length() < length)
+      {
+         sb.append(words[rnd.nextInt(words.length)]);
+         sb.append((rnd.nextInt(12) == 0) ? ".\n" : " ");
+      }
+
+      return Arrays.copyOf(sb.toString().getBytes(), length);
+   }
+}
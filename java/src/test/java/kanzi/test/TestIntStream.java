@@ -0,0 +1,141 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.Random;
+import kanzi.io.CompressedIntInputStream;
+import kanzi.io.CompressedIntOutputStream;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestIntStream
+{
+   public static void main(String[] args)
+   {
+      if (testCorrectness() == false)
+         System.exit(1);
+   }
+
+
+   @Test
+   public void testIntStream()
+   {
+      Assert.assertTrue(testCorrectness());
+   }
+
+
+   public static boolean testCorrectness()
+   {
+      String[] transforms = new String[] { "NONE", "DELTA", "DELTA+ZIGZAG", "FOR", "DELTA+FOR+ZIGZAG" };
+      Random rnd = new Random(12345);
+
+      for (int ii=0; ii<6; ii++)
+      {
+         final int size = (ii == 0) ? 0 : 1000 + rnd.nextInt(100000);
+         int[] values = new int[size];
+
+         for (int i=0; i<size; i++)
+         {
+            switch (ii)
+            {
+               case 1: // posting list
+                  values[i] = (i == 0) ? 0 : values[i-1] + rnd.nextInt(20);
+                  break;
+
+               case 2: // noisy time series
+                  values[i] = 100000 + (int) (1000 * Math.sin(i/100.0)) + rnd.nextInt(16) - 8;
+                  break;
+
+               case 3: // skewed values with outliers
+                  values[i] = ((i & 255) == 0) ? rnd.nextInt() : rnd.nextInt(4);
+                  break;
+
+               case 4: // constant
+                  values[i] = -7;
+                  break;
+
+               default: // random
+                  values[i] = rnd.nextInt();
+            }
+         }
+
+         for (String transform : transforms)
+         {
+            System.out.println("Test "+ii+", transform "+transform+", size "+size);
+
+            try
+            {
+               Map<String, Object> ctx = new HashMap<>();
+               ctx.put("transform", transform);
+               ctx.put("blockSize", 4096);
+               ByteArrayOutputStream baos = new ByteArrayOutputStream();
+               CompressedIntOutputStream cos = new CompressedIntOutputStream(baos, ctx);
+               cos.write(values, 0, size/2);
+
+               for (int i=size/2; i<size; i++)
+                  cos.write(values[i]);
+
+               cos.close();
+               System.out.println(4L*size + " => " + baos.size() + " bytes");
+               CompressedIntInputStream cis = new CompressedIntInputStream(
+                  new ByteArrayInputStream(baos.toByteArray()), new HashMap<>());
+               int[] res = new int[size+100];
+               int n = 0;
+
+               while (true)
+               {
+                  final int r = cis.read(res, n, Math.min(1000, res.length-n));
+
+                  if (r < 0)
+                     break;
+
+                  n += r;
+               }
+
+               cis.close();
+
+               if (n != size)
+               {
+                  System.out.println("Failure: decoded "+n+" ints instead of "+size);
+                  return false;
+               }
+
+               for (int i=0; i<size; i++)
+               {
+                  if (res[i] != values[i])
+                  {
+                     System.out.println("Failure at index "+i+": "+res[i]+" != "+values[i]);
+                     return false;
+                  }
+               }
+            }
+            catch (IOException e)
+            {
+               System.out.println("Exception: "+e.getMessage());
+               return false;
+            }
+         }
+      }
+
+      return true;
+   }
+}
@@ -0,0 +1,214 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.File;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.attribute.FileTime;
+import java.util.Arrays;
+import java.util.Random;
+import kanzi.app.Manifest;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestManifest
+{
+   public static void main(String[] args) throws Exception
+   {
+      TestManifest test = new TestManifest();
+      test.testUnchangedFiles();
+      test.testHasher();
+      test.testOptions();
+   }
+
+
+   @Test
+   public void testUnchangedFiles() throws Exception
+   {
+      // Unchanged and touched files are skipped, changed files are not
+      System.out.println("\n\nTestUnchangedFiles");
+      final String options = Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true,
+         false, false, false, false);
+      Path dir = Files.createTempDirectory("kanzi");
+      final String mfName = dir.resolve(Manifest.FILE_NAME).toString();
+      final String[] names = { "same", "touched", "changed", "resized", "nooutput", "removed" };
+      final Random rnd = new Random(12345);
+
+      try
+      {
+         Manifest manifest = Manifest.load(mfName, options);
+
+         for (String name : names)
+         {
+            final byte[] data = new byte[100000+rnd.nextInt(1000)];
+            rnd.nextBytes(data);
+            final Path input = createFile(dir.resolve(name), data, 1600000000000L);
+            createFile(dir.resolve(name+".knz"), Arrays.copyOf(data, 1000), 1600000000000L);
+            Assert.assertFalse(manifest.isUnchanged(input.toString(), input+".knz"));
+            manifest.update(input.toString(), data.length, 1600000000000L, 1000);
+            Assert.assertTrue(manifest.contains(input.toString()));
+         }
+
+         manifest.save();
+
+         // Next run
+         final Path touched = dir.resolve("touched");
+         Files.setLastModifiedTime(touched, FileTime.fromMillis(1700000000000L));
+         final Path changed = dir.resolve("changed");
+         final byte[] data = Files.readAllBytes(changed);
+         data[data.length/2] ^= 1;
+         createFile(changed, data, 1700000000000L);
+         createFile(dir.resolve("resized"), Arrays.copyOf(data, data.length+1), 1600000000000L);
+         Files.delete(dir.resolve("nooutput.knz"));
+         manifest = Manifest.load(mfName, options);
+         manifest.retain(Arrays.asList(new String[] { dir.resolve("same").toString(),
+            touched.toString(), changed.toString(), dir.resolve("resized").toString(),
+            dir.resolve("nooutput").toString() }));
+         Assert.assertFalse(manifest.contains(dir.resolve("removed").toString()));
+
+         for (String name : names)
+         {
+            final String inputName = dir.resolve(name).toString();
+
+            if (name.equals("removed") == false)
+               Assert.assertTrue(manifest.contains(inputName));
+
+            final boolean expected = name.equals("same") || name.equals("touched");
+            Assert.assertEquals(name, expected, manifest.isUnchanged(inputName, inputName+".knz"));
+         }
+
+         Assert.assertEquals(2, manifest.getNbUnchanged());
+
+         // The new time of the touched file is recorded
+         manifest.save();
+         manifest = Manifest.load(mfName, options);
+         Assert.assertTrue(manifest.isUnchanged(touched.toString(), touched+".knz"));
+
+         // A file modified during its compression is not recorded
+         final Path same = dir.resolve("same");
+         manifest.update(same.toString(), Files.size(same), 1500000000000L, 1000);
+         Assert.assertFalse(manifest.contains(same.toString()));
+      }
+      finally
+      {
+         for (File f : dir.toFile().listFiles())
+            f.delete();
+
+         dir.toFile().delete();
+      }
+   }
+
+
+   @Test
+   public void testHasher() throws Exception
+   {
+      // The hash computed while compressing (pieces of any size) must be the
+      // one of the file content: a touched file is found unchanged
+      System.out.println("\n\nTestHasher");
+      final String options = Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true,
+         false, false, false, false);
+      Path dir = Files.createTempDirectory("kanzi");
+      final String mfName = dir.resolve(Manifest.FILE_NAME).toString();
+      final Random rnd = new Random(12345);
+
+      try
+      {
+         Manifest manifest = Manifest.load(mfName, options);
+
+         for (int size : new int[] { 0, 1000, 1<<20, (5<<19) + 777 })
+         {
+            final byte[] data = new byte[size];
+            rnd.nextBytes(data);
+            final Path input = createFile(dir.resolve("file"+size), data, 1600000000000L);
+            createFile(dir.resolve("file"+size+".knz"), new byte[100], 1600000000000L);
+            Manifest.Hasher hasher = new Manifest.Hasher();
+
+            for (int off=0; off<size; )
+            {
+               final int len = Math.min(1+rnd.nextInt(300000), size-off);
+               hasher.update(data, off, len);
+               off += len;
+            }
+
+            manifest.update(input.toString(), size, 1600000000000L, 100, hasher.getValue());
+            Files.setLastModifiedTime(input, FileTime.fromMillis(1700000000000L));
+            Assert.assertTrue(manifest.isUnchanged(input.toString(), input+".knz"));
+         }
+      }
+      finally
+      {
+         for (File f : dir.toFile().listFiles())
+            f.delete();
+
+         dir.toFile().delete();
+      }
+   }
+
+
+   @Test
+   public void testOptions() throws Exception
+   {
+      // A manifest created with other compression options is dropped
+      System.out.println("\n\nTestOptions");
+      final String options = Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true,
+         false, false, false, false);
+      final String[] others = {
+         Manifest.getOptions("TEXT+LZ", "HUFFMAN", 65536, true, false, false, false, false),
+         Manifest.getOptions("TEXT+LZX", "ANS0", 65536, true, false, false, false, false),
+         Manifest.getOptions("TEXT+LZX", "HUFFMAN", 131072, true, false, false, false, false),
+         Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, false, false, false, false, false),
+         Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true, true, false, false, false),
+         Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true, false, true, false, false),
+         Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true, false, false, true, false),
+         Manifest.getOptions("TEXT+LZX", "HUFFMAN", 65536, true, false, false, false, true)
+      };
+      Path dir = Files.createTempDirectory("kanzi");
+      final String mfName = dir.resolve(Manifest.FILE_NAME).toString();
+
+      try
+      {
+         final Path input = createFile(dir.resolve("file"), new byte[1000], 1600000000000L);
+         createFile(dir.resolve("file.knz"), new byte[100], 1600000000000L);
+         Manifest manifest = Manifest.load(mfName, options);
+         manifest.update(input.toString(), 1000, 1600000000000L, 100);
+         manifest.save();
+         Assert.assertTrue(Manifest.load(mfName, options).isUnchanged(input.toString(), input+".knz"));
+
+         for (String other : others)
+         {
+            Assert.assertNotEquals(options, other);
+            Assert.assertFalse(Manifest.load(mfName, other).contains(input.toString()));
+         }
+      }
+      finally
+      {
+         for (File f : dir.toFile().listFiles())
+            f.delete();
+
+         dir.toFile().delete();
+      }
+   }
+
+
+   private static Path createFile(Path path, byte[] data, long time) throws Exception
+   {
+      Files.write(path, data);
+      Files.setLastModifiedTime(path, FileTime.fromMillis(time));
+      return path;
+   }
+}
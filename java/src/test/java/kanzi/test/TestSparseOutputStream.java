@@ -0,0 +1,159 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.nio.file.Files;
+import java.util.Random;
+import kanzi.io.SparseOutputStream;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+public class TestSparseOutputStream
+{
+   public static void main(String[] args) throws Exception
+   {
+      TestSparseOutputStream test = new TestSparseOutputStream();
+      test.testZeroPages();
+   }
+
+
+   @Test
+   public void testZeroPages() throws Exception
+   {
+      // Leading, middle and trailing zero pages, zero runs not aligned on
+      // pages and a partial last page. The file must have the size and the
+      // content of the data whatever the sizes of the writes.
+      System.out.println("\n\nTestZeroPages");
+      File file = File.createTempFile("kanzi", ".sparse");
+
+      try
+      {
+         for (int pageSize : new int[] { 512, SparseOutputStream.DEFAULT_PAGE_SIZE })
+         {
+            // { leading zero pages, middle zero pages, trailing zero pages, bytes of the last partial page }
+            final int[][] layouts = {
+               { 3, 5, 4, 100 }, { 3, 5, 4, 0 }, { 0, 2, 0, 1 }, { 2, 0, 0, 0 }, { 0, 0, 3, 0 }
+            };
+
+            for (int[] layout : layouts)
+            {
+               for (boolean zeroTail : new boolean[] { false, true })
+               {
+                  if ((zeroTail == true) && (layout[3] == 0))
+                     continue;
+
+                  final byte[] data = generate(new Random(12345), pageSize, layout, zeroTail);
+                  final long skipped = (long) countZeroPages(data, pageSize) * pageSize;
+
+                  for (int mode=0; mode<3; mode++)
+                  {
+                     SparseOutputStream os = new SparseOutputStream(new FileOutputStream(file), pageSize);
+                     write(os, data, mode, new Random(6789));
+                     os.close();
+                     System.out.println("Page size "+pageSize+", layout "+layout[0]+"/"+layout[1]+"/"+
+                        layout[2]+"/"+layout[3]+(zeroTail ? " (zero tail)" : "")+", mode "+mode+
+                        ": "+data.length+" bytes, "+os.getSkipped()+" skipped");
+                     Assert.assertEquals(data.length, file.length());
+                     Assert.assertArrayEquals(data, Files.readAllBytes(file.toPath()));
+                     Assert.assertEquals(skipped, os.getSkipped());
+                  }
+               }
+            }
+         }
+      }
+      finally
+      {
+         file.delete();
+      }
+   }
+
+
+   // Write with one call, calls of random sizes or one byte at a time
+   private static void write(SparseOutputStream os, byte[] data, int mode, Random rnd) throws Exception
+   {
+      if (mode == 0)
+      {
+         os.write(data, 0, data.length);
+         return;
+      }
+
+      if (mode == 2)
+      {
+         for (byte b : data)
+            os.write(b & 0xFF);
+
+         return;
+      }
+
+      for (int n=0; n<data.length; )
+      {
+         final int len = Math.min(1+rnd.nextInt(3000), data.length-n);
+         os.write(data, n, len);
+         n += len;
+      }
+   }
+
+
+   // Data pages between the zero pages, some starting or ending with zeros
+   private static byte[] generate(Random rnd, int pageSize, int[] layout, boolean zeroTail)
+   {
+      final int dataPages = 2;
+      final int nbPages = layout[0] + dataPages + layout[1] + dataPages + layout[2];
+      final byte[] data = new byte[nbPages*pageSize + layout[3]];
+      int n = layout[0] * pageSize;
+
+      for (int i=0; i<2; i++)
+      {
+         for (int j=0; j<dataPages*pageSize; j++)
+            data[n+j] = (byte) rnd.nextInt(256);
+
+         // Zeros around a page boundary: not a whole zero page
+         for (int j=pageSize/2; j<pageSize+pageSize/2; j++)
+            data[n+j] = 0;
+
+         n += (dataPages+layout[1]) * pageSize;
+      }
+
+      if (zeroTail == false)
+      {
+         for (int j=nbPages*pageSize; j<data.length; j++)
+            data[j] = (byte) (1+rnd.nextInt(255));
+      }
+
+      return data;
+   }
+
+
+   private static int countZeroPages(byte[] data, int pageSize)
+   {
+      int res = 0;
+
+      for (int i=0; i+pageSize<=data.length; i+=pageSize)
+      {
+         boolean zero = true;
+
+         for (int j=i; j<i+pageSize; j++)
+            zero &= (data[j] == 0);
+
+         res += (zero == true) ? 1 : 0;
+      }
+
+      return res;
+   }
+}
@@ -19,7 +19,11 @@ import java.util.Arrays;
 import java.util.HashMap;
 import java.util.Map;
 import java.util.Random;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
 import kanzi.ByteTransform;
+import kanzi.Global;
+import kanzi.Histograms;
 import kanzi.SliceByteArray;
 import kanzi.transform.FSDCodec;
 import kanzi.transform.LZCodec;
@@ -27,6 +31,7 @@ import kanzi.transform.RLT;
 import kanzi.transform.ROLZCodec;
 import kanzi.transform.SBRT;
 import kanzi.transform.SRT;
+import kanzi.transform.TextCodec;
 import kanzi.transform.TransformFactory;
 import kanzi.transform.ZRLT;
 import org.junit.Assert;
@@ -170,6 +175,401 @@ public class TestTransforms
    }
 
 
+   @Test
+   public void testTextSegments()
+   {
+      // Big text block encoded by segments with a block dictionary
+      final String[] words = { "the", "quick", "brown", "Fox", "jumps", "over", "lazy",
+         "dogs", "compression", "dictionary", "segment", "parallel", "Block", "a" };
+
+      // With end of lines, then a single line (segments cut after a delimiter)
+      final String[][] delimSets = {
+         { " ", " ", " ", ", ", ".\n", "\r\n", " (", ") " },
+         { " ", " ", " ", ", ", ". ", " (", ") " }
+      };
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         for (int test=0; test<4; test++)
+         {
+            final String[] delims = delimSets[test>>1];
+            final int type = (test&1) + 1;
+            Random rnd = new Random(12345);
+            StringBuilder sb = new StringBuilder(4<<20);
+
+            while (sb.length() < (4<<20))
+               sb.append(words[rnd.nextInt(words.length)]).append(delims[rnd.nextInt(delims.length)]);
+
+            final byte[] input = sb.toString().getBytes();
+            System.out.println("\n\nTestTextSegments (TextCodec"+type+", "+((test<2) ? "lines" : "no EOL")+")");
+            Map<String, Object> ctx = new HashMap<>();
+            ctx.put("blockSize", input.length);
+            ctx.put("textcodec", type);
+            ctx.put("jobs", 4);
+            ctx.put("pool", pool);
+            ByteTransform f = new TextCodec(ctx);
+            byte[] output = new byte[f.getMaxEncodedLength(input.length)];
+            byte[] reverse = new byte[input.length];
+            SliceByteArray sa1 = new SliceByteArray(input, 0);
+            SliceByteArray sa2 = new SliceByteArray(output, 0);
+            SliceByteArray sa3 = new SliceByteArray(reverse, 0);
+            Assert.assertTrue(f.forward(sa1, sa2));
+            Assert.assertTrue("Block not segmented", (output[0] & 0x20) != 0);
+            System.out.println("Encoded: "+input.length+" => "+sa2.index);
+
+            // Same output with a single job
+            Map<String, Object> ctx1 = new HashMap<>(ctx);
+            ctx1.put("jobs", 1);
+            ctx1.remove("pool");
+            byte[] output1 = new byte[output.length];
+            SliceByteArray sa4 = new SliceByteArray(output1, 0);
+            sa1.index = 0;
+            Assert.assertTrue(new TextCodec(ctx1).forward(sa1, sa4));
+            Assert.assertEquals(sa2.index, sa4.index);
+            Assert.assertArrayEquals(Arrays.copyOf(output, sa2.index), Arrays.copyOf(output1, sa4.index));
+            sa2.length = sa2.index;
+            sa2.index = 0;
+            f = new TextCodec(ctx);
+            Assert.assertTrue(f.inverse(sa2, sa3));
+            Assert.assertEquals(input.length, sa3.index);
+            Assert.assertArrayEquals(input, reverse);
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testLZPBlocks()
+   {
+      // The LZP table size follows the block size of the stream. The codecs
+      // are reused across blocks, as in a stream.
+      final int[] blockSizes = { 1024, 4096, 16384, 65536, 1<<20 };
+      final byte[] data = generateRepeats(new Random(12345), 3<<20);
+
+      for (int bsVersion=1; bsVersion<=2; bsVersion++)
+      {
+         for (int blockSize : blockSizes)
+         {
+            System.out.println("\n\nTestLZPBlocks (version "+bsVersion+", block size "+blockSize+")");
+            Map<String, Object> ctx = new HashMap<>();
+            ctx.put("lz", TransformFactory.LZP_TYPE);
+            ctx.put("blockSize", blockSize);
+            ctx.put("bsVersion", bsVersion);
+            ByteTransform encoder = new LZCodec(ctx);
+            ByteTransform decoder = new LZCodec(ctx);
+            final int nbBlocks = Math.min(data.length/blockSize, 8);
+
+            for (int i=0; i<nbBlocks; i++)
+            {
+               final byte[] input = Arrays.copyOfRange(data, i*blockSize, (i+1)*blockSize);
+               byte[] output = new byte[encoder.getMaxEncodedLength(blockSize)];
+               byte[] reverse = new byte[blockSize];
+               SliceByteArray sa1 = new SliceByteArray(input, 0);
+               SliceByteArray sa2 = new SliceByteArray(output, 0);
+               SliceByteArray sa3 = new SliceByteArray(reverse, 0);
+               Assert.assertTrue(encoder.forward(sa1, sa2));
+
+               if (bsVersion == 1)
+               {
+                  // Same output as a new codec with the biggest table
+                  Map<String, Object> ctx2 = new HashMap<>();
+                  ctx2.put("lz", TransformFactory.LZP_TYPE);
+                  byte[] output2 = new byte[output.length];
+                  SliceByteArray sa4 = new SliceByteArray(output2, 0);
+                  sa1.index = 0;
+                  Assert.assertTrue(new LZCodec(ctx2).forward(sa1, sa4));
+                  Assert.assertEquals(sa2.index, sa4.index);
+                  Assert.assertArrayEquals(Arrays.copyOf(output, sa2.index), Arrays.copyOf(output2, sa4.index));
+               }
+
+               sa2.length = sa2.index;
+               sa2.index = 0;
+               Assert.assertTrue(decoder.inverse(sa2, sa3));
+               Assert.assertEquals(blockSize, sa3.index);
+               Assert.assertArrayEquals(input, reverse);
+            }
+         }
+      }
+   }
+
+
+   @Test
+   public void testLZXSegments()
+   {
+      // Big blocks encoded as concurrent segments. Matches cross the segment
+      // boundaries (window references) and chain through copied bytes.
+      final int[] sizes = { 12<<20, (17<<20) + 5 };
+      final int[] jobs = { 4, 8 };
+      ExecutorService pool = Executors.newFixedThreadPool(4);
+
+      try
+      {
+         for (int t=0; t<sizes.length; t++)
+         {
+            final byte[] input = generateMatches(new Random(12345+t), sizes[t]);
+
+            for (short lzType : new short[] { TransformFactory.LZ_TYPE, TransformFactory.LZX_TYPE })
+            {
+               System.out.println("\n\nTestLZXSegments ("+((lzType == TransformFactory.LZ_TYPE) ? "LZ" : "LZX")+
+                  ", size "+input.length+", jobs "+jobs[t]+")");
+               Map<String, Object> ctx = new HashMap<>();
+               ctx.put("lz", lzType);
+               ctx.put("blockSize", input.length);
+               ctx.put("jobs", jobs[t]);
+               ctx.put("pool", pool);
+               ByteTransform f = new LZCodec(ctx);
+               byte[] output = new byte[f.getMaxEncodedLength(input.length)];
+               byte[] reverse = new byte[input.length];
+               SliceByteArray sa1 = new SliceByteArray(input, 0);
+               SliceByteArray sa2 = new SliceByteArray(output, 0);
+               SliceByteArray sa3 = new SliceByteArray(reverse, 0);
+               Assert.assertTrue(f.forward(sa1, sa2));
+               Assert.assertTrue("Block not segmented", (output[8] & 0x80) != 0);
+               System.out.println("Encoded: "+input.length+" => "+sa2.index);
+
+               // The segmentation depends on the block length only
+               Map<String, Object> ctx1 = new HashMap<>(ctx);
+               ctx1.put("jobs", 1);
+               ctx1.remove("pool");
+               byte[] output1 = new byte[output.length];
+               SliceByteArray sa4 = new SliceByteArray(output1, 0);
+               sa1.index = 0;
+               Assert.assertTrue(new LZCodec(ctx1).forward(sa1, sa4));
+               Assert.assertEquals(sa2.index, sa4.index);
+               Assert.assertArrayEquals(output, output1);
+
+               sa2.length = sa2.index;
+               sa2.index = 0;
+               f = new LZCodec(ctx);
+               Assert.assertTrue(f.inverse(sa2, sa3));
+               Assert.assertEquals(input.length, sa3.index);
+               Assert.assertArrayEquals(input, reverse);
+
+               // Corrupt the first token of the first segment: its literals
+               // run past the end of the segment. The block must be rejected.
+               final int nbSegments = (output[0] & 0xFF) | ((output[1] & 0xFF) << 8);
+               final int segSize = (output[4] & 0xFF) | ((output[5] & 0xFF) << 8) |
+                  ((output[6] & 0xFF) << 16) | ((output[7] & 0xFF) << 24);
+               final int seg = 9 + 4*nbSegments;
+               final int tkIdx = seg + ((output[seg] & 0xFF) | ((output[seg+1] & 0xFF) << 8) |
+                  ((output[seg+2] & 0xFF) << 16) | ((output[seg+3] & 0xFF) << 24));
+               final int litLen = segSize + 1 - 7 - 255;
+               output[tkIdx] = (byte) 0xE0;
+               output[seg+9] = (byte) 255;
+               output[seg+10] = (byte) (litLen >> 16);
+               output[seg+11] = (byte) (litLen >> 8);
+               output[seg+12] = (byte) litLen;
+               sa2.index = 0;
+               sa3.index = 0;
+               Assert.assertFalse(new LZCodec(ctx).inverse(sa2, sa3));
+            }
+         }
+      }
+      finally
+      {
+         pool.shutdown();
+      }
+   }
+
+
+   @Test
+   public void testROLZLazyMatch()
+   {
+      // Lazy match evaluation only changes the encoder: the blocks are
+      // decoded by a codec created without the option.
+      final byte[][] inputs = {
+         generateMatches(new Random(12345), (1<<20) + 777),
+         generateRepeats(new Random(6789), 300000),
+         new byte[] { 1, 2, 3, 1, 2, 3, 4, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 6 }
+      };
+
+      for (String name : new String[] { "ROLZ", "ROLZX" })
+      {
+         System.out.println("
+
+TestROLZLazyMatch ("+name+")");
+
+         for (byte[] input : inputs)
+         {
+            Map<String, Object> ctx = new HashMap<>();
+            ctx.put("transform", name);
+            ctx.put("lazyMatch", true);
+            ByteTransform f = new ROLZCodec(ctx);
+            byte[] output = new byte[f.getMaxEncodedLength(input.length)];
+            byte[] reverse = new byte[input.length];
+            SliceByteArray sa1 = new SliceByteArray(input, 0);
+            SliceByteArray sa2 = new SliceByteArray(output, 0);
+            SliceByteArray sa3 = new SliceByteArray(reverse, 0);
+
+            // Small blocks may be rejected by the codec
+            if (f.forward(sa1, sa2) == false)
+               continue;
+
+            System.out.println("Encoded: "+input.length+" => "+sa2.index);
+            sa2.length = sa2.index;
+            sa2.index = 0;
+            ctx.put("lazyMatch", false);
+            f = new ROLZCodec(ctx);
+            Assert.assertTrue(f.inverse(sa2, sa3));
+            Assert.assertEquals(input.length, sa3.index);
+            Assert.assertArrayEquals(input, reverse);
+         }
+      }
+   }
+
+
+   @Test
+   public void testZRLTHistograms()
+   {
+      // The histograms recorded by ZRLT must match the ones of its output,
+      // slot by slot. The transform is reused across blocks, as in a stream.
+      System.out.println("\n\nTestZRLTHistograms");
+      final int slotSize = Histograms.SLOT_SIZE;
+      final int[] lengths = { 1, 100, slotSize-1, slotSize, slotSize+1, 5*slotSize+123, 40*slotSize };
+      final byte[] data = generateZeroRuns(new Random(12345), 40*slotSize);
+      Histograms histograms = new Histograms();
+      Map<String, Object> ctx = new HashMap<>();
+      ctx.put("histograms", histograms);
+      ByteTransform zrlt = new ZRLT(ctx);
+      final int[] freqs1 = new int[257];
+      final int[] freqs2 = new int[257];
+
+      for (int length : lengths)
+      {
+         for (int dstStart : new int[] { 0, 7 })
+         {
+            final byte[] input = Arrays.copyOf(data, length);
+            byte[] output = new byte[dstStart+zrlt.getMaxEncodedLength(length)];
+            SliceByteArray sa1 = new SliceByteArray(input, 0);
+            SliceByteArray sa2 = new SliceByteArray(output, dstStart);
+            Assert.assertTrue(zrlt.forward(sa1, sa2));
+            final int dstLength = sa2.index - dstStart;
+            System.out.println(length+" => "+dstLength+" bytes ("+((dstLength+slotSize-1)/slotSize)+" slots)");
+
+            for (int start=0; start<dstLength; start+=slotSize)
+            {
+               final int end = Math.min(start+slotSize, dstLength);
+               Assert.assertTrue(histograms.getHistogram(start, end, freqs1, true));
+               Global.computeHistogramOrder0(output, dstStart+start, dstStart+end, freqs2, true);
+               Assert.assertArrayEquals(freqs2, freqs1);
+            }
+
+            // Whole output and invalid ranges
+            Assert.assertTrue(histograms.getHistogram(0, dstLength, freqs1, false));
+            Global.computeHistogramOrder0(output, dstStart, dstStart+dstLength, freqs2, false);
+            Assert.assertArrayEquals(Arrays.copyOf(freqs2, 256), Arrays.copyOf(freqs1, 256));
+            Assert.assertFalse(histograms.getHistogram(0, dstLength+1, freqs1, false));
+
+            if (dstLength > slotSize)
+            {
+               Assert.assertFalse(histograms.getHistogram(1, dstLength, freqs1, false));
+               Assert.assertFalse(histograms.getHistogram(0, slotSize-1, freqs1, false));
+            }
+
+            // Round trip
+            byte[] reverse = new byte[length];
+            sa2.length = dstLength;
+            sa2.index = dstStart;
+            SliceByteArray sa3 = new SliceByteArray(reverse, 0);
+            Assert.assertTrue(new ZRLT().inverse(sa2, sa3));
+            Assert.assertArrayEquals(input, reverse);
+         }
+      }
+
+      // Output too small: the histograms of the previous block are dropped
+      SliceByteArray sa1 = new SliceByteArray(Arrays.copyOf(data, 3*slotSize), 0);
+      SliceByteArray sa2 = new SliceByteArray(new byte[slotSize], 0);
+      Assert.assertFalse(zrlt.forward(sa1, sa2));
+      Assert.assertFalse(histograms.getHistogram(0, 1, freqs1, false));
+   }
+
+
+   // Zero runs of all lengths (some spanning several slots) between small
+   // values, as in the output of BWT+MTF
+   private static byte[] generateZeroRuns(Random rnd, int length)
+   {
+      final byte[] data = new byte[length];
+      int n = 0;
+
+      while (n < length)
+      {
+         final int kind = rnd.nextInt(16);
+
+         if (kind < 8)
+         {
+            final int len = (kind == 0) ? rnd.nextInt(3*Histograms.SLOT_SIZE) : rnd.nextInt(64);
+            n += Math.min(len, length-n);
+         }
+         else
+         {
+            final int len = Math.min(1 + rnd.nextInt(16), length-n);
+
+            for (int i=0; i<len; i++)
+               data[n++] = (byte) ((kind == 15) ? 254 + rnd.nextInt(2) : 1 + rnd.nextInt(20));
+         }
+      }
+
+      return data;
+   }
+
+
+   // Literals and matches at short and long distances
+   private static byte[] generateMatches(Random rnd, int length)
+   {
+      final byte[] data = new byte[length];
+      int n = 0;
+
+      while (n < length)
+      {
+         final int kind = rnd.nextInt(8);
+
+         if ((kind < 3) || (n < 65536))
+         {
+            final int len = Math.min(1 + rnd.nextInt(16), length-n);
+
+            for (int i=0; i<len; i++)
+               data[n++] = (byte) (32 + rnd.nextInt(64));
+         }
+         else
+         {
+            // Mostly short distances, some up to 1 MB
+            final int maxDist = (kind == 7) ? Math.min(n, 1<<20) : Math.min(n, 65536);
+            final int dist = 1 + rnd.nextInt(maxDist);
+            final int len = Math.min(5 + rnd.nextInt(200), length-n);
+
+            for (int i=0; i<len; i++, n++)
+               data[n] = data[n-dist];
+         }
+      }
+
+      return data;
+   }
+
+
+   // Paragraphs repeated with a few changes (long matches for LZP)
+   private static byte[] generateRepeats(Random rnd, int length)
+   {
+      final byte[] data = new byte[length];
+      final byte[] paragraph = new byte[300];
+
+      for (int i=0; i<paragraph.length; i++)
+         paragraph[i] = (byte) (32 + rnd.nextInt(95));
+
+      for (int n=0; n<length; n+=paragraph.length)
+      {
+         paragraph[rnd.nextInt(paragraph.length)] = (byte) (32 + rnd.nextInt(95));
+         System.arraycopy(paragraph, 0, data, n, Math.min(paragraph.length, length-n));
+      }
+
+      return data;
+   }
+
+
    private static ByteTransform getTransform(String name)
    {
       switch(name)
@@ -0,0 +1,431 @@
+/*
+Copyright 2011-2021 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+package kanzi.test;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.Random;
+import kanzi.EntropyDecoder;
+import kanzi.EntropyEncoder;
+import kanzi.SliceByteArray;
+import kanzi.bitstream.DefaultInputBitStream;
+import kanzi.bitstream.DefaultOutputBitStream;
+import kanzi.entropy.EntropyCodecFactory;
+import kanzi.transform.Sequence;
+import kanzi.transform.TransformFactory;
+import org.junit.Assert;
+import org.junit.Test;
+
+
+// Throughput of the transforms and entropy codecs on adversarial inputs
+// (inputs that defeat the heuristics: huge runs, periodic data, long
+// repeated words, near random data) next to typical data. The worst case
+// throughput of each transform/codec must stay above a fraction of its
+// throughput on typical data. The ratios do not depend on the speed of the
+// machine but need a quiet machine and a warm JIT: the thresholds are checked
+// by main() only. The unit test checks the round trips.
+public class TestWorstCase
+{
+   private static final String[] TRANSFORMS =
+   {
+      "BWT", "BWTS", "LZ", "LZX", "ROLZ", "ROLZX", "TEXT", "RLT", "ZRLT", "SRT"
+   };
+
+   private static final String[] CODECS =
+   {
+      "HUFFMAN", "ANS0", "RANGE", "FPAQ", "CM"
+   };
+
+   private static final String[] FAMILIES =
+   {
+      "TYPICAL", "RUNS", "PERIODIC", "LONG_PERIOD", "LONG_WORDS", "NEAR_RANDOM", "RANDOM"
+   };
+
+   // Minimum ratio (worst case throughput / typical throughput)
+   private static final Map<String, Double> THRESHOLDS = new HashMap<>();
+
+   static
+   {
+      THRESHOLDS.put("BWT", 0.2);
+      THRESHOLDS.put("BWTS", 0.2);
+      THRESHOLDS.put("LZ", 0.1);
+      THRESHOLDS.put("LZX", 0.1);
+      THRESHOLDS.put("ROLZ", 0.1);
+      THRESHOLDS.put("ROLZX", 0.05);
+      THRESHOLDS.put("TEXT", 0.1);
+      THRESHOLDS.put("RLT", 0.2);
+      THRESHOLDS.put("ZRLT", 0.2);
+      THRESHOLDS.put("SRT", 0.2);
+      THRESHOLDS.put("HUFFMAN", 0.3);
+      THRESHOLDS.put("ANS0", 0.3);
+      THRESHOLDS.put("RANGE", 0.3);
+      THRESHOLDS.put("FPAQ", 0.3);
+      THRESHOLDS.put("CM", 0.3);
+   }
+
+
+   public static void main(String[] args)
+   {
+      String type = "ALL";
+      int size = 8*1024*1024;
+      int iter = 3;
+
+      for (String arg : args)
+      {
+         arg = arg.toUpperCase();
+
+         if (arg.startsWith("-TYPE="))
+            type = arg.substring(6);
+         else if (arg.startsWith("-SIZE="))
+            size = Integer.parseInt(arg.substring(6));
+         else if (arg.startsWith("-ITER="))
+            iter = Integer.parseInt(arg.substring(6));
+      }
+
+      String[] names = (type.equals("ALL")) ? concat(TRANSFORMS, CODECS) : new String[] { type };
+      boolean res = true;
+
+      for (String name : names)
+         res &= testWorstCase(name, size, iter);
+
+      if (res == false)
+         System.exit(1);
+   }
+
+
+   @Test
+   public void testWorstCase()
+   {
+      // Round trips only (timings on a shared machine are not reliable)
+      for (String name : concat(TRANSFORMS, CODECS))
+      {
+         final boolean isCodec = Arrays.asList(CODECS).contains(name);
+
+         for (String family : FAMILIES)
+         {
+            byte[] input = generate(family, 256*1024, 12345);
+            long[] d = (isCodec == true) ? runCodec(name, input) : runTransform(name, input);
+            Assert.assertNotNull(name+" ("+family+")", d);
+         }
+      }
+   }
+
+
+   // Return false if the round trip fails or if the worst throughput is
+   // below the threshold
+   public static boolean testWorstCase(String name, int size, int iter)
+   {
+      System.out.println("\n\nWorst case test for " + name + " (" + size + " bytes)");
+      final boolean isCodec = Arrays.asList(CODECS).contains(name);
+      final double threshold = THRESHOLDS.getOrDefault(name, 0.1);
+      double typical = 0;
+      double worst = Double.MAX_VALUE;
+      String worstFamily = null;
+
+      // Warm up the JIT before the first (typical) measure
+      final byte[] warmup = generate("TYPICAL", size, 6789);
+
+      for (int ii=0; ii<iter; ii++)
+      {
+         if (((isCodec == true) ? runCodec(name, warmup) : runTransform(name, warmup)) == null)
+            return false;
+      }
+
+      for (String family : FAMILIES)
+      {
+         byte[] input = generate(family, size, 12345);
+         long[] delta = new long[] { Long.MAX_VALUE, Long.MAX_VALUE };
+
+         // Keep the best time of each pass (less noise)
+         for (int ii=0; ii<iter; ii++)
+         {
+            long[] d = (isCodec == true) ? runCodec(name, input) : runTransform(name, input);
+
+            if (d == null)
+               return false;
+
+            delta[0] = Math.min(delta[0], d[0]);
+            delta[1] = Math.min(delta[1], d[1]);
+         }
+
+         final double enc = throughput(size, delta[0]);
+         final double dec = throughput(size, delta[1]);
+         final double all = throughput(size, delta[0]+delta[1]);
+         System.out.println(String.format("%-12s encoding: %9.2f MB/s   decoding: %9.2f MB/s", family, enc, dec));
+
+         if (family.equals("TYPICAL"))
+         {
+            typical = all;
+         }
+         else if (all < worst)
+         {
+            worst = all;
+            worstFamily = family;
+         }
+      }
+
+      final double ratio = worst / typical;
+      System.out.println(String.format("Worst case: %s (%.2f of typical, threshold %.2f)", worstFamily, ratio, threshold));
+
+      if (ratio < threshold)
+      {
+         System.out.println("Worst case throughput below threshold");
+         return false;
+      }
+
+      return true;
+   }
+
+
+   private static double throughput(int size, long nanos)
+   {
+      return (nanos <= 0) ? Double.MAX_VALUE : (double) size * 1000.0 / (double) nanos * 1000000.0 / (1024*1024);
+   }
+
+
+   // Return the encoding and decoding times or null if the round trip fails
+   private static long[] runTransform(String name, byte[] input)
+   {
+      TransformFactory tf = new TransformFactory();
+      final long type = tf.getType(name);
+      Map<String, Object> ctx = new HashMap<>();
+      ctx.put("blockSize", input.length);
+      ctx.put("transform", name);
+      ctx.put("jobs", 1);
+      ctx.put("size", input.length);
+      Sequence f = tf.newFunction(ctx, type);
+      SliceByteArray sa1 = new SliceByteArray(input, 0);
+      SliceByteArray sa2 = new SliceByteArray(new byte[f.getMaxEncodedLength(input.length)], 0);
+      SliceByteArray sa3 = new SliceByteArray(new byte[input.length], 0);
+      long before = System.nanoTime();
+
+      // A transform may skip the data (returns false): the original data is copied
+      f.forward(sa1, sa2);
+      long after = System.nanoTime();
+      final long delta1 = after - before;
+      final byte skipFlags = f.getSkipFlags();
+      sa2.length = sa2.index;
+      sa2.index = 0;
+      ctx.put("size", sa2.length);
+      f = tf.newFunction(ctx, type);
+      f.setSkipFlags(skipFlags);
+      before = System.nanoTime();
+
+      if (f.inverse(sa2, sa3) == false)
+      {
+         System.out.println("Decoding error");
+         return null;
+      }
+
+      after = System.nanoTime();
+
+      if ((sa3.index != input.length) || (Arrays.equals(input, sa3.array) == false))
+      {
+         System.out.println("Round trip failure");
+         return null;
+      }
+
+      return new long[] { delta1, after - before };
+   }
+
+
+   // Return the encoding and decoding times or null if the round trip fails
+   private static long[] runCodec(String name, byte[] input)
+   {
+      EntropyCodecFactory ef = new EntropyCodecFactory();
+      final int type = EntropyCodecFactory.getType(name);
+      Map<String, Object> ctx = new HashMap<>();
+      ctx.put("blockSize", input.length);
+      ctx.put("size", input.length);
+      ByteArrayOutputStream os = new ByteArrayOutputStream(input.length);
+      DefaultOutputBitStream obs = new DefaultOutputBitStream(os, 65536);
+      EntropyEncoder ee = ef.newEncoder(obs, ctx, type);
+      long before = System.nanoTime();
+
+      if (ee.encode(input, 0, input.length) < 0)
+      {
+         System.out.println("Encoding error");
+         return null;
+      }
+
+      ee.dispose();
+      long after = System.nanoTime();
+      final long delta1 = after - before;
+      obs.close();
+      byte[] output = new byte[input.length];
+      DefaultInputBitStream ibs = new DefaultInputBitStream(new ByteArrayInputStream(os.toByteArray()), 65536);
+      EntropyDecoder ed = ef.newDecoder(ibs, ctx, type);
+      before = System.nanoTime();
+
+      if (ed.decode(output, 0, output.length) < 0)
+      {
+         System.out.println("Decoding error");
+         return null;
+      }
+
+      ed.dispose();
+      after = System.nanoTime();
+      ibs.close();
+
+      if (Arrays.equals(input, output) == false)
+      {
+         System.out.println("Round trip failure");
+         return null;
+      }
+
+      return new long[] { delta1, after - before };
+   }
+
+
+   // Generate an input of the given family
+   public static byte[] generate(String family, int size, long seed)
+   {
+      Random rnd = new Random(seed);
+      byte[] buf = new byte[size];
+
+      switch (family)
+      {
+         case "TYPICAL":
+         {
+            // Text like: words of a small vocabulary with a skewed distribution
+            byte[][] words = newWords(rnd, 4096, 2, 10);
+
+            for (int i=0; i<size; )
+            {
+               final int r = rnd.nextInt(words.length);
+               final byte[] w = words[(r*r) / words.length];
+               i = append(buf, i, w);
+
+               if (i < size)
+                  buf[i++] = (byte) ((rnd.nextInt(16) == 0) ? '\n' : ' ');
+            }
+
+            break;
+         }
+
+         case "RUNS":
+            // Huge runs (worst case of suffix sorting and run detection)
+            for (int i=0; i<size; )
+            {
+               final int len = Math.min(size-i, (size>>2) + rnd.nextInt(size>>2));
+               Arrays.fill(buf, i, i+len, (byte) rnd.nextInt(4));
+               i += len;
+            }
+
+            break;
+
+         case "PERIODIC":
+         {
+            // Short period: every position matches the same few candidates
+            final byte[] pattern = { 'a', 'b', 'c', 'a', 'b', 'd', 'a', 'b', 'c', 'a', 'b', 'e' };
+
+            for (int i=0; i<size; i++)
+               buf[i] = pattern[i%pattern.length];
+
+            break;
+         }
+
+         case "LONG_PERIOD":
+         {
+            // Random period longer than the match search windows
+            byte[] pattern = new byte[4093];
+            rnd.nextBytes(pattern);
+
+            for (int i=0; i<size; i++)
+               buf[i] = pattern[i%pattern.length];
+
+            break;
+         }
+
+         case "LONG_WORDS":
+         {
+            // Long repeated words: stress the text dictionary
+            byte[][] words = newWords(rnd, 30000, 24, 64);
+
+            for (int i=0; i<size; )
+            {
+               i = append(buf, i, words[rnd.nextInt(words.length)]);
+
+               if (i < size)
+                  buf[i++] = ' ';
+            }
+
+            break;
+         }
+
+         case "NEAR_RANDOM":
+            // Random data with frequent short repeats (match probes that fail)
+            rnd.nextBytes(buf);
+
+            for (int i=8; i<size-3; i+=3+rnd.nextInt(8))
+            {
+               final int dist = 1 + rnd.nextInt(8);
+               buf[i] = buf[i-dist];
+               buf[i+1] = buf[i+1-dist];
+               buf[i+2] = buf[i+2-dist];
+            }
+
+            break;
+
+         case "RANDOM":
+            rnd.nextBytes(buf);
+            break;
+
+         default:
+            throw new IllegalArgumentException("Unknown input family: "+family);
+      }
+
+      return buf;
+   }
+
+
+   private static byte[][] newWords(Random rnd, int count, int minLen, int maxLen)
+   {
+      byte[][] words = new byte[count][];
+
+      for (int i=0; i<count; i++)
+      {
+         words[i] = new byte[minLen+rnd.nextInt(maxLen-minLen+1)];
+
+         for (int j=0; j<words[i].length; j++)
+            words[i][j] = (byte) ('a' + rnd.nextInt(26));
+
+         if ((i & 7) == 0)
+            words[i][0] -= 32; // capitalized
+      }
+
+      return words;
+   }
+
+
+   private static int append(byte[] buf, int idx, byte[] word)
+   {
+      final int n = Math.min(word.length, buf.length-idx);
+      System.arraycopy(word, 0, buf, idx, n);
+      return idx + n;
+   }
+
+
+   private static String[] concat(String[] a, String[] b)
+   {
+      String[] res = Arrays.copyOf(a, a.length+b.length);
+      System.arraycopy(b, 0, res, a.length, b.length);
+      return res;
+   }
+}